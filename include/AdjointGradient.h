@@ -0,0 +1,75 @@
+#ifndef AdjointGradient_H
+#define AdjointGradient_H
+#include "QuantumCircuit.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief coefficient times a tensor product of Pauli operators, where
+ * paulis[k] ('I', 'X', 'Y' or 'Z') acts on qubit k. Qubits past the end of
+ * paulis get 'I', so {0.5, "IZ"} is 0.5 Z on qubit 1.
+ *
+ */
+struct PauliTerm
+{
+    double coefficient=1;
+    std::string paulis;
+};
+
+// Hermitian observable as a sum of Pauli terms.
+typedef std::vector<PauliTerm> Hamiltonian;
+
+/**
+ * @brief Result of adjoint_gradient(). Every PhaseGate added to the circuit,
+ * on its own or inside a ControlledGate, is a parameter; subcircuits and
+ * QFTs are applied whole and have none. parameters[i] is the gate and
+ * gradients[i] is dE/dphase for it, in the order the gates are applied.
+ * Gates that share an angle each get their own entry, so add them up for the
+ * shared parameter.
+ */
+struct GradientResult
+{
+    double expectation=0;
+    std::vector<double> gradients;
+    std::vector<const PhaseGate*> parameters;
+};
+
+/**
+ * @brief <psi|H|psi> for a normalised state.
+ *
+ * @param state
+ * @param hamiltonian
+ * @return double
+ */
+double expectation_value(const StateVector& state, const Hamiltonian& hamiltonian);
+
+/**
+ * @brief Sets result to H|state>, one pass over the state per term.
+ *
+ * @param state
+ * @param hamiltonian
+ * @param result
+ */
+void apply_hamiltonian(const StateVector& state, const Hamiltonian& hamiltonian,
+    StateVector& result);
+
+/**
+ * @brief Computes E=<psi|H|psi> for the final state of the circuit and its
+ * derivative with respect to every PhaseGate angle by adjoint
+ * differentiation: one forward pass builds |psi>, then |psi> and H|psi> are
+ * walked back through the inverse of each gate in turn. At every phase gate,
+ * dE/dphase=-2 Im(<lambda|P|psi>) with P the projector onto the target (and
+ * control) qubits being 1. That is one forward and one backward pass however
+ * many parameters there are, against 2 simulations per parameter for finite
+ * differences, and only two state vectors are ever held.
+ *
+ * @param circuit
+ * @param hamiltonian
+ * @return GradientResult
+ */
+GradientResult adjoint_gradient(const QuantumCircuit& circuit, const Hamiltonian& hamiltonian);
+
+// Prints "E = ..." followed by one "P(...) on qubit q: dE = ..." line per parameter.
+std::ostream& operator<<(std::ostream& os, const GradientResult& result);
+#endif
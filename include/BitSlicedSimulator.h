@@ -0,0 +1,56 @@
+#ifndef BitSlicedSimulator_H
+#define BitSlicedSimulator_H
+#include "Operation.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief A permutation gate lowered to bit operations. flip inverts target
+ * when every control is 1, swap exchanges target and other under the
+ * controls, and table looks up the image of the target bits in mapping.
+ */
+struct BitSlicedInstruction
+{
+    enum class Kind { flip, swap, table };
+    Kind kind=Kind::table;
+    size_t target=0;
+    size_t other=0;
+    std::vector<size_t> controls;
+    std::vector<size_t> targets;
+    std::vector<size_t> mapping;
+};
+
+/**
+ * @brief Classical simulator for circuits whose gates only permute basis
+ * states (X, CNOT, swap, Toffoli, full adders, ... up to phases, which cannot
+ * change which basis state comes out). Inputs are bit-sliced: qubit q of 64,
+ * 256 or 512 consecutive inputs is held in one block of 64 bit words, so each
+ * gate costs a few word operations for the whole block. Blocks are processed
+ * on all threads.
+ */
+class BitSlicedSimulator
+{
+private:
+    size_t num_qubits;
+    size_t lanes;
+    std::vector<BitSlicedInstruction> instructions;
+
+public:
+    // Constructors and destructors
+    BitSlicedSimulator(const std::vector<Operation>& operations,
+        size_t num_qubits, size_t lanes=256);
+    ~BitSlicedSimulator() {}
+
+    // Accessors
+    size_t get_num_qubits() const;
+    size_t get_lanes() const;
+    const std::vector<BitSlicedInstruction>& get_instructions() const;
+    size_t evaluate(size_t input) const;
+    void evaluate(size_t first_input, size_t count, size_t* outputs) const;
+    std::vector<size_t> get_truth_table() const;
+
+    // Static functions
+    static bool is_permutation(const Operation& operation);
+    static bool is_permutation(const std::vector<Operation>& operations);
+};
+#endif
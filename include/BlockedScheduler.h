@@ -0,0 +1,119 @@
+#ifndef BlockedScheduler_H
+#define BlockedScheduler_H
+#include "StateVector.h"
+#include <complex>
+#include <ostream>
+#include <vector>
+
+/**
+ * @brief Number of low-order qubits per tile used by BlockedScheduler, so a
+ * tile holds 2^tile_qubits amplitudes. Defaults to the largest tile that
+ * fills at most half of the L2 cache, or QC_TILE_QUBITS if set. Registers no
+ * larger than one tile are run gate by gate.
+ *
+ */
+size_t get_tile_qubits();
+void set_tile_qubits(size_t tile_qubits);
+
+/**
+ * @brief Counts of the passes a BlockedScheduler makes over the state. Each
+ * pass reads and writes every amplitude once, where applying the operations
+ * one at a time would make one pass per operation.
+ *
+ */
+struct ScheduleStats
+{
+    size_t operations=0;
+    size_t tile_qubits=0;
+    size_t tiled_passes=0;    // Groups of operations applied tile by tile.
+    size_t tiled_operations=0;
+    size_t reorder_passes=0;  // Swaps of high qubits with low ones.
+    size_t direct_passes=0;   // Operations too wide for a tile.
+};
+
+/**
+ * @brief Cache blocked execution of an operation list on a state vector. The
+ * 2^n amplitudes are cut into contiguous tiles of 2^b, one per value of the
+ * n-b high-order bits. Consecutive operations whose targets all lie on the b
+ * low-order (physical) qubits are grouped, and a group is applied tile by
+ * tile, so each tile stays in cache while all of the group's gates run on it
+ * and the state is streamed from memory once per group rather than once per
+ * gate. Controls on high qubits are constant within a tile, so tiles whose
+ * control bits are 0 skip the gate. When a gate targets a high qubit, one
+ * reordering pass swaps every high qubit needed by the longest run of
+ * upcoming gates that fits in a tile with the low qubits whose next use is
+ * furthest away, and the logical to physical qubit map is updated instead of
+ * moving them back; the identity order is restored at the end. Swaps
+ * between two low qubits are ordinary gates in the current group. The
+ * schedule keeps pointers to the operations' matrices, so it must not
+ * outlive the circuit they came from.
+ */
+class BlockedScheduler
+{
+private:
+    struct TiledOperation
+    {
+        Operation operation; // Physical targets and low controls only.
+        size_t high_control_mask=0; // Tile index bits that must be 1.
+    };
+
+    enum class PassType
+    {
+        tiled,
+        reorder,
+        direct
+    };
+
+    struct Pass
+    {
+        PassType type=PassType::tiled;
+        std::vector<TiledOperation> group;
+        Operation operation;
+        std::vector<size_t> low_positions;  // Bits swapped by a reordering,
+        std::vector<size_t> high_positions; // pairwise.
+    };
+
+    size_t num_qubits;
+    size_t tile_qubits;
+    std::vector<size_t> physical_of; // Physical bit holding each logical qubit.
+    std::vector<size_t> logical_of;
+    std::vector<Pass> passes;
+    std::vector<TiledOperation> open_group; // Not yet closed by a full pass.
+    ScheduleStats stats;
+
+    void flush_group();
+    void swap_low(size_t position_1, size_t position_2);
+    void reorder(const std::vector<size_t>& low_positions, const std::vector<size_t>& high_positions);
+    void make_low(const std::vector<Operation>& operations, size_t index);
+    void schedule(const std::vector<Operation>& operations, size_t index);
+    void restore_order();
+    void apply_tiled(std::complex<double>* amplitudes, const Pass& pass) const;
+    void apply_reorder(std::complex<double>* amplitudes, const Pass& pass) const;
+
+public:
+    // Constructors and destructors
+    BlockedScheduler(const std::vector<Operation>& operations, size_t num_qubits,
+        size_t tile_qubits=::get_tile_qubits());
+    ~BlockedScheduler() {}
+
+    // Accessors
+    size_t get_num_qubits() const;
+    size_t get_tile_qubits() const;
+    ScheduleStats get_stats() const;
+
+    // Mutators
+    void apply(StateVector& state) const;
+    void apply(std::complex<double>* amplitudes) const;
+};
+
+/**
+ * @brief Applies operations in order to state, through a BlockedScheduler
+ * when the state is larger than one tile and gate by gate otherwise.
+ *
+ * @param state
+ * @param operations
+ */
+void apply_operations(StateVector& state, const std::vector<Operation>& operations);
+
+std::ostream& operator<<(std::ostream& os, const ScheduleStats& stats);
+#endif
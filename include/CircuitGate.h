@@ -0,0 +1,39 @@
+#ifndef CircuitGate_H
+#define CircuitGate_H
+#include "QuantumCircuit.h"
+#include <string>
+#include <memory>
+#include <mutex>
+
+/**
+ * @brief A multi gate built from a circuit. Keeps the circuit it was made from
+ * so that backends which cannot use a dense matrix (eg: the stabilizer
+ * tableau) can inline the gates it is made of instead. The dense matrix is
+ * only compiled the first time it is needed, and comes from the GateCache so
+ * that gates made from the same circuit share one matrix.
+ *
+ */
+class CircuitGate : public MultiGate
+{
+private:
+    std::shared_ptr<const QuantumCircuit> circuit;
+    mutable std::string cache_key;
+    mutable std::once_flag compile_flag;
+    mutable std::shared_ptr<const Matrix> compiled_matrix;
+    const Matrix& get_compiled_matrix() const;
+
+public:
+    // Constructors and destructors
+    CircuitGate(const QuantumCircuit& circuit, size_t qubit_index,
+        std::string symbol);
+    CircuitGate(std::shared_ptr<const QuantumCircuit> circuit,
+        size_t qubit_index, std::string symbol, std::string cache_key);
+    ~CircuitGate() {}
+
+    // Accessors
+    const QuantumCircuit& get_circuit() const;
+    const Matrix& get_matrix() const;
+    void append_operations(std::vector<Operation>& operations,
+        size_t qubit_offset, bool decompose_subcircuits) const;
+};
+#endif
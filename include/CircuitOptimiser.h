@@ -0,0 +1,34 @@
+#ifndef CircuitOptimiser_H
+#define CircuitOptimiser_H
+#include "QuantumCircuit.h"
+
+/**
+ * @brief Summary of what optimise_circuit() removed.
+ *
+ */
+struct OptimisationReport
+{
+    size_t gates_before=0;
+    size_t gates_after=0;
+    size_t steps_before=0;
+    size_t steps_after=0;
+    size_t cancelled_pairs=0;
+    size_t passes=0;
+};
+
+/**
+ * @brief Peephole optimisation of a circuit in place. Removes pairs of gates
+ * that are inverses of each other (H.H, X.X, T.T*, repeated CNOTs, qft and
+ * inverse_qft, ...) when everything between them on their registers commutes
+ * with them: gates on other registers, or diagonal gates such as Z, S, T,
+ * phases and controlled phases when both gates are diagonal. Repeats until no
+ * more pairs cancel, then deletes the steps left empty.
+ *
+ * @param circuit
+ * @return OptimisationReport
+ */
+OptimisationReport optimise_circuit(QuantumCircuit& circuit);
+
+// Prints the report as "gates: 40 -> 12 (-70%), steps: ..."
+std::ostream& operator<<(std::ostream& os, const OptimisationReport& report);
+#endif
@@ -0,0 +1,245 @@
+#ifndef DecisionDiagram_H
+#define DecisionDiagram_H
+#include "Operation.h"
+#include "StateVector.h"
+#include <array>
+#include <complex>
+#include <deque>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class QuantumCircuit;
+
+/**
+ * @brief A hash-consed edge weight. Values within DecisionDiagramPackage::
+ * tolerance of each other share one DDWeight, so edges (and the nodes built
+ * from them) compare by pointer.
+ *
+ */
+struct DDWeight
+{
+    std::complex<double> value;
+    size_t ref_count=0;
+};
+
+struct DDNode;
+
+struct DDEdge
+{
+    DDNode* node=nullptr;
+    DDWeight* weight=nullptr;
+
+    bool operator==(const DDEdge& other) const { return node==other.node&&weight==other.weight; }
+    bool operator!=(const DDEdge& other) const { return !(*this==other); }
+};
+
+/**
+ * @brief Node of a quantum multiple-valued decision diagram on the qubit
+ * given by level; the terminal has level -1. Vector nodes use children 0 and
+ * 1 (qubit is 0 or 1), matrix nodes all four (2*row bit+column bit). Every
+ * level is present on every path, and the largest child weight is 1.
+ *
+ */
+struct DDNode
+{
+    std::array<DDEdge, 4> children;
+    int level=-1;
+    bool matrix=false;
+    size_t ref_count=0;
+};
+
+/**
+ * @brief Counters reported by DecisionDiagramPackage::get_stats().
+ *
+ */
+struct DecisionDiagramStats
+{
+    size_t live_nodes=0;
+    size_t peak_nodes=0;
+    size_t live_weights=0;
+    size_t compute_lookups=0;
+    size_t compute_hits=0;
+    size_t garbage_collections=0;
+};
+
+/**
+ * @brief Unique table, complex table and compute tables shared by every
+ * decision diagram, so equal sub-diagrams of different states are the same
+ * node. Nodes and weights are reference counted from the roots held by
+ * DecisionDiagramState and DecisionDiagramUnitary; garbage_collect() frees
+ * the ones no root reaches once more than the collection threshold are alive,
+ * and clears the (lossy, direct-mapped) compute tables. Not thread safe.
+ */
+class DecisionDiagramPackage
+{
+private:
+    struct NodeHash
+    {
+        size_t operator()(const DDNode* node) const;
+    };
+    struct NodeEqual
+    {
+        bool operator()(const DDNode* a, const DDNode* b) const;
+    };
+    // Edge whose weight has not been through the complex table yet, so
+    // intermediate sums and products do not fill it with values that are
+    // never stored in a node.
+    struct RawEdge
+    {
+        DDNode* node=nullptr;
+        std::complex<double> weight;
+    };
+    struct AddEntry
+    {
+        DDNode* a=nullptr;
+        DDNode* b=nullptr;
+        DDWeight* ratio=nullptr;
+        RawEdge result;
+    };
+    struct MultiplyEntry
+    {
+        DDNode* a=nullptr;
+        DDNode* b=nullptr;
+        RawEdge result;
+    };
+    struct InnerProductEntry
+    {
+        DDNode* a=nullptr;
+        DDNode* b=nullptr;
+        std::complex<double> result;
+    };
+
+    DDNode terminal;
+    DDWeight zero_weight;
+    DDWeight one_weight;
+    std::deque<DDNode> node_storage;
+    std::vector<DDNode*> free_nodes;
+    std::unordered_set<DDNode*, NodeHash, NodeEqual> unique_table;
+    std::deque<DDWeight> weight_storage;
+    std::vector<DDWeight*> free_weights;
+    std::unordered_map<unsigned long long, std::vector<DDWeight*>> weight_table;
+    std::vector<AddEntry> add_table;
+    std::vector<MultiplyEntry> multiply_table;
+    std::vector<InnerProductEntry> inner_product_table;
+    DecisionDiagramStats stats;
+    size_t collection_threshold;
+
+    DecisionDiagramPackage();
+    DDEdge to_edge(const RawEdge& edge);
+    RawEdge normalise(int level, bool matrix, const std::array<RawEdge, 4>& children);
+    RawEdge add_raw(RawEdge a, RawEdge b);
+    RawEdge multiply_raw(const DDEdge& a, const DDEdge& b);
+    RawEdge multiply_nodes(DDNode* a, DDNode* b);
+    std::complex<double> inner_product_nodes(DDNode* a, DDNode* b);
+    void clear_compute_tables();
+
+public:
+    // Weights closer than this are merged.
+    static const double tolerance;
+
+    ~DecisionDiagramPackage() {}
+    DecisionDiagramPackage(const DecisionDiagramPackage&)=delete;
+    DecisionDiagramPackage& operator=(const DecisionDiagramPackage&)=delete;
+
+    static DecisionDiagramPackage& instance();
+
+    // Accessors
+    DecisionDiagramStats get_stats() const;
+    size_t get_memory_bytes() const;
+    DDEdge get_zero_edge();
+    DDEdge get_one_edge();
+    std::complex<double> get_entry(const DDEdge& edge, size_t row, size_t col) const;
+    size_t count_nodes(const DDEdge& edge) const;
+
+    // Construction and arithmetic
+    DDWeight* lookup_weight(const std::complex<double>& value);
+    DDEdge make_node(int level, bool matrix, const std::array<DDEdge, 4>& children);
+    DDEdge make_basis_state(size_t num_qubits, size_t index);
+    DDEdge make_identity(size_t num_qubits);
+    DDEdge make_gate(size_t num_qubits, const Operation& operation);
+    DDEdge make_phase_oracle(size_t num_qubits, const Operation& operation);
+    DDEdge add(const DDEdge& a, const DDEdge& b);
+    DDEdge multiply(const DDEdge& a, const DDEdge& b);
+    std::complex<double> inner_product(const DDEdge& a, const DDEdge& b);
+
+    // Mutators
+    void inc_ref(const DDEdge& edge);
+    void dec_ref(const DDEdge& edge);
+    void garbage_collect(bool force=false);
+};
+
+/**
+ * @brief State vector stored as a decision diagram, so states with repeated
+ * structure stay small: a GHZ state or a QFT of a basis state needs one or two
+ * nodes per qubit where the dense vector needs 2^n amplitudes. Gates are
+ * turned into matrix diagrams (QFTs through their decomposition) and
+ * multiplied in, so the cost follows the diagram size, not 2^n. Registers
+ * of up to 63 qubits are supported.
+ */
+class DecisionDiagramState
+{
+private:
+    size_t num_qubits;
+    DDEdge root;
+
+    void set_root(const DDEdge& edge);
+
+public:
+    // Constructors and destructors
+    DecisionDiagramState(size_t num_qubits);
+    DecisionDiagramState(const DecisionDiagramState& other);
+    DecisionDiagramState& operator=(const DecisionDiagramState& other);
+    ~DecisionDiagramState();
+
+    // Accessors
+    size_t get_num_qubits() const;
+    DDEdge get_root() const;
+    size_t get_node_count() const;
+    std::complex<double> get_amplitude(size_t index) const;
+    double get_probability(size_t index) const;
+    double get_qubit_probability(size_t qubit) const;
+    double get_fidelity(const DecisionDiagramState& other) const;
+    bool is_equivalent(const DecisionDiagramState& other, bool up_to_global_phase=true,
+        double tolerance=1e-9) const;
+    StateVector to_state_vector() const;
+
+    // Mutators
+    void set_basis_state(size_t index);
+    void apply_operation(const Operation& operation);
+    void apply_circuit(const QuantumCircuit& circuit);
+};
+
+/**
+ * @brief Unitary of a circuit as a matrix decision diagram, built by
+ * multiplying in one gate diagram at a time. Two circuits are equivalent when
+ * their diagrams are (checked through the Hilbert-Schmidt inner product, so
+ * weights that differ by rounding still match), without forming a 2^n x 2^n
+ * matrix.
+ */
+class DecisionDiagramUnitary
+{
+private:
+    size_t num_qubits;
+    DDEdge root;
+
+public:
+    // Constructors and destructors
+    DecisionDiagramUnitary(const QuantumCircuit& circuit);
+    DecisionDiagramUnitary(const DecisionDiagramUnitary& other);
+    DecisionDiagramUnitary& operator=(const DecisionDiagramUnitary& other);
+    ~DecisionDiagramUnitary();
+
+    // Accessors
+    size_t get_num_qubits() const;
+    DDEdge get_root() const;
+    size_t get_node_count() const;
+    std::complex<double> get_entry(size_t row, size_t col) const;
+    bool is_equivalent(const DecisionDiagramUnitary& other, bool up_to_global_phase=true,
+        double tolerance=1e-9) const;
+};
+
+// Non-member functions
+std::ostream& operator<<(std::ostream& os, const DecisionDiagramStats& stats);
+#endif
@@ -0,0 +1,55 @@
+#ifndef DensityMatrix_H
+#define DensityMatrix_H
+#include "NoiseChannel.h"
+#include "QuantumCircuit.h"
+#include <complex>
+#include <vector>
+
+/**
+ * @brief Mixed state of n qubits stored as the 2^n x 2^n matrix rho, with
+ * element (r, c) at index r+(c<<n). That is the amplitude layout of a 2n
+ * qubit state vector whose low n qubits index rows and high n qubits index
+ * columns, so U rho U^dagger is U applied to the row qubits followed by
+ * conj(U) applied to the column qubits, using the StateVector kernels, and no
+ * operator is ever expanded to the full register. A k qubit NoiseChannel is
+ * applied in a single pass as its 4^k x 4^k superoperator on the matching row
+ * and column qubits. Memory is 16*4^n bytes (1 GiB at 13 qubits).
+ * apply_circuit() composes single qubit gates and noise into one pending
+ * superoperator per qubit and only applies it when a wider operation touches
+ * that qubit.
+ */
+class DensityMatrix
+{
+private:
+    size_t num_qubits;
+    std::vector<std::complex<double>, PoolAllocator<std::complex<double>>> elements;
+
+    void apply_superoperator(const Matrix& superoperator,
+        const std::vector<size_t>& qubits);
+
+public:
+    // Constructors and destructors
+    DensityMatrix(size_t num_qubits);
+    DensityMatrix(const StateVector& state);
+    ~DensityMatrix() {}
+
+    // Accessors
+    size_t get_num_qubits() const;
+    size_t get_dimension() const;
+    std::complex<double> get_element(size_t row, size_t col) const;
+    const std::complex<double>* get_data() const;
+    double get_trace() const;
+    double get_purity() const;
+    double get_fidelity(const StateVector& state) const;
+    std::vector<double> get_probabilities() const;
+    Matrix to_matrix() const;
+
+    // Mutators
+    std::complex<double>* get_data();
+    void set_basis_state(size_t index);
+    void apply_operation(const Operation& operation);
+    void apply_channel(const NoiseChannel& channel, const std::vector<size_t>& qubits);
+    void apply_circuit(const QuantumCircuit& circuit,
+        const NoiseModel& noise=NoiseModel());
+};
+#endif
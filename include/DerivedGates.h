@@ -22,14 +22,18 @@ std::shared_ptr<SingleGate> adjoint(std::shared_ptr<SingleGate> gate);
 
 /**
  * @brief Creates a multi gate from a circuit. Assigns the matrix representation
- * of a given circuit to a new multi gate.
+ * of a given circuit to a new multi gate. The gate keeps its own copy of the
+ * circuit; pass a temporary (or std::move) to hand the circuit over instead.
  *
  * @param circuit
  * @param qubit_index
  * @param symbol
  * @return std::shared_ptr<MultiGate>
  */
-std::shared_ptr<MultiGate> gate_from_circuit(QuantumCircuit circuit,
+std::shared_ptr<MultiGate> gate_from_circuit(const QuantumCircuit& circuit,
+    size_t qubit_index,
+    std::string symbol);
+std::shared_ptr<MultiGate> gate_from_circuit(QuantumCircuit&& circuit,
     size_t qubit_index,
     std::string symbol);
 
@@ -67,4 +71,39 @@ std::shared_ptr<MultiGate> swap(size_t index_1, size_t index_2);
 std::shared_ptr<MultiGate> toffoli(size_t target_index, size_t control_1,
     size_t control_2);
 
+/**
+ * @brief Creates a quantum Fourier transform over size registers starting at
+ * first_index. Equivalent to the usual circuit of H gates, controlled phases
+ * and swaps, but simulated directly with an FFT.
+ *
+ * @param first_index
+ * @param size
+ * @return std::shared_ptr<MultiGate>
+ */
+std::shared_ptr<MultiGate> qft(size_t first_index, size_t size);
+
+/**
+ * @brief Creates the inverse of qft(first_index, size).
+ *
+ * @param first_index
+ * @param size
+ * @return std::shared_ptr<MultiGate>
+ */
+std::shared_ptr<MultiGate> inverse_qft(size_t first_index, size_t size);
+
+/**
+ * @brief Creates a phase oracle that negates the basis states for which
+ * predicate returns true, where bit r of its input is the value of
+ * qubits[r]. Replaces chains of toffoli() gates and ancillas with a single
+ * diagonal pass (see PhaseOracle.h).
+ *
+ * @param qubits
+ * @param predicate
+ * @return std::shared_ptr<MultiGate>
+ */
+std::shared_ptr<MultiGate> phase_oracle(const std::vector<size_t>& qubits,
+    const std::function<bool(size_t)>& predicate);
+std::shared_ptr<MultiGate> phase_oracle(const std::vector<size_t>& qubits,
+    const std::vector<bool>& truth_table);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,81 @@
+#ifndef DistributedStateVector_H
+#define DistributedStateVector_H
+#include "QuantumCircuit.h"
+#include <complex>
+#include <vector>
+
+struct DistributedControl;
+
+/**
+ * @brief Number of local processes QuantumCircuit::get_final_state_vector()
+ * splits large states across (a power of two, default 1 for a single
+ * process).
+ *
+ */
+size_t get_process_count();
+void set_process_count(size_t process_count);
+
+// True when a register of num_qubits is large enough to be worth splitting
+// across the configured processes (at least 4096 amplitudes per process).
+bool should_distribute(size_t num_qubits);
+
+/**
+ * @brief State vector split across 2^g worker processes on one host. The
+ * amplitudes live in one shared memory segment; rank r owns the 2^(n-g)
+ * amplitudes whose top g physical bits equal r and touches them first, so on
+ * a NUMA machine its pages land on the node it runs on. Gates run on the low
+ * (local) physical qubits of every rank in lockstep, driven by commands in a
+ * shared control block and a process-shared barrier. When a gate targets a
+ * global qubit, that qubit is exchanged with a local one: every rank swaps
+ * half of its slice with the partner rank differing in that global bit, and
+ * the logical to physical qubit map is updated instead of moving the data
+ * back. Controls on global qubits need no exchange, since ranks whose bit is
+ * 0 simply skip the gate. Phase oracles need no exchange either: the driver
+ * applies them to the whole segment through the qubit map. Workers are forked by the constructor, which should
+ * therefore be called outside any parallel_for(), and are shut down by the
+ * destructor, or by the constructor itself if it fails. A worker is killed
+ * if the process (on Linux, the thread) that forked it exits first. Where processes cannot be forked (anything but Linux) the
+ * ranks run one after another in the calling process, which gives the same
+ * state.
+ */
+class DistributedStateVector
+{
+private:
+    size_t num_qubits;
+    size_t num_processes;
+    size_t local_qubits;
+    std::vector<size_t> physical_of; // Physical bit holding each logical qubit.
+    std::vector<size_t> logical_of;
+    std::complex<double>* amplitudes=nullptr;
+    size_t amplitude_bytes=0;
+    DistributedControl* control=nullptr;
+    std::vector<int> workers; // Process ids of ranks 1 and up.
+    size_t exchange_count=0;
+
+    size_t to_physical(size_t logical_index) const;
+    void release();
+    void run_command();
+    void exchange(size_t local_position, size_t global_position);
+    bool make_local(const std::vector<size_t>& logical_targets);
+
+public:
+    // Constructors and destructors
+    DistributedStateVector(size_t num_qubits, size_t num_processes);
+    DistributedStateVector(const DistributedStateVector&)=delete;
+    DistributedStateVector& operator=(const DistributedStateVector&)=delete;
+    ~DistributedStateVector();
+
+    // Accessors
+    size_t get_num_qubits() const;
+    size_t get_num_processes() const;
+    size_t get_local_qubits() const;
+    size_t get_exchange_count() const;
+    std::complex<double> get_amplitude(size_t index) const;
+    StateVector to_state_vector() const;
+
+    // Mutators
+    void set_basis_state(size_t index);
+    void apply_operation(const Operation& operation);
+    void apply_circuit(const QuantumCircuit& circuit);
+};
+#endif
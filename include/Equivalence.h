@@ -0,0 +1,72 @@
+#ifndef Equivalence_H
+#define Equivalence_H
+#include "Operation.h"
+#include <complex>
+#include <iostream>
+#include <vector>
+
+/**
+ * @brief Settings for check_equivalence(). tolerance is the largest
+ * ||V|psi> - e^(i phi) U|psi>|| accepted for a state, where phi is fixed by
+ * the first state checked (or 0 when up_to_global_phase is false).
+ *
+ */
+struct EquivalenceOptions
+{
+    size_t random_states=4;
+    bool check_basis_states=false; // Also run every basis state (2^n runs).
+    bool up_to_global_phase=true;
+    double tolerance=1e-8;
+    double confidence=0.99;        // For EquivalenceReport::fidelity_bound.
+    unsigned seed=20240101;
+};
+
+/**
+ * @brief Result of check_equivalence(). Random states are Haar distributed,
+ * so when all of them pass, fidelity_bound is a lower bound, holding with
+ * probability confidence, on the average over all states of
+ * |<psi|U^dagger V|psi>|^2. It comes from Markov's inequality or, for
+ * larger registers where single states concentrate around the average, from
+ * Cantelli's inequality with the Poincare bound on the variance; every
+ * state checked tightens it. After all basis states pass it is (1-tolerance)^2
+ * regardless of confidence.
+ */
+struct EquivalenceReport
+{
+    static const size_t none=static_cast<size_t>(-1);
+
+    size_t random_states_checked=0;
+    size_t basis_states_checked=0;
+    bool equivalent=true;
+    double worst_fidelity=1;
+    double largest_distance=0;
+    std::complex<double> global_phase=1;  // e^(i phi)
+    size_t failed_random_state=none;
+    size_t failed_basis_state=none;       // Lowest failing input.
+    double confidence=0;
+    double fidelity_bound=0;
+
+    bool passed() const { return equivalent; }
+};
+
+/**
+ * @brief Checks whether two operation lists on num_qubits implement the same
+ * unitary by running both on random states, and on every basis state if
+ * asked, with the state vector kernels. Costs O(states * gates * 2^n) time
+ * and two state vectors per thread, rather than the O(8^n) time and O(4^n)
+ * memory of comparing get_matrix(). Stops at the first random state that
+ * differs; basis states are split across threads (see Parallel.h).
+ *
+ * @param first
+ * @param second
+ * @param num_qubits
+ * @param options
+ * @return EquivalenceReport
+ */
+EquivalenceReport check_equivalence(const std::vector<Operation>& first,
+    const std::vector<Operation>& second, size_t num_qubits,
+    const EquivalenceOptions& options=EquivalenceOptions());
+
+// Prints "equivalent on 4 random states (...)" or where they differed.
+std::ostream& operator<<(std::ostream& os, const EquivalenceReport& report);
+#endif
@@ -0,0 +1,64 @@
+#ifndef GateCache_H
+#define GateCache_H
+#include "QuantumCircuit.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief Process-wide cache of the circuits and compiled matrices behind
+ * subcircuit gates. Entries are keyed by content: factories such as toffoli()
+ * and swap() use their name, the qubit layout relative to their first
+ * register and their parameters (eg: "toffoli(t=2,c1=0,c2=1)"), and
+ * gate_from_circuit() uses a hash of the circuit's operations. Every gate with
+ * the same key shares one circuit and one matrix, which is compiled once.
+ * Compiled matrices can be saved to a file and loaded by later runs; files
+ * written by a build with different factories are ignored.
+ */
+class GateCache
+{
+private:
+    struct Entry
+    {
+        std::once_flag compile_flag;
+        std::shared_ptr<const Matrix> matrix;
+    };
+    mutable std::mutex cache_mutex;
+    std::unordered_map<std::string, std::shared_ptr<const QuantumCircuit>> circuits;
+    std::unordered_map<std::string, std::shared_ptr<Entry>> matrices;
+    std::string cache_file;
+    size_t hits=0;
+    size_t misses=0;
+    size_t loaded=0;
+
+    GateCache();
+
+public:
+    ~GateCache();
+    GateCache(const GateCache&)=delete;
+    GateCache& operator=(const GateCache&)=delete;
+
+    static GateCache& instance();
+
+    // Accessors
+    size_t get_hits() const;
+    size_t get_misses() const;
+    size_t get_loaded() const;
+    size_t get_size() const;
+
+    // Mutators
+    std::shared_ptr<const QuantumCircuit> get_circuit(const std::string& key,
+        const std::function<QuantumCircuit()>& build);
+    std::shared_ptr<const Matrix> get_matrix(const std::string& key,
+        const QuantumCircuit& circuit);
+    size_t load(const std::string& path);
+    void save(const std::string& path) const;
+    void set_cache_file(const std::string& path);
+    void clear();
+};
+
+// Content key of a circuit: register size and a hash of its operations.
+std::string get_circuit_key(const QuantumCircuit& circuit);
+#endif
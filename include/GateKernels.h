@@ -0,0 +1,106 @@
+#ifndef GateKernels_H
+#define GateKernels_H
+#include "Matrix.h"
+#include <array>
+#include <complex>
+#include <vector>
+
+/**
+ * @brief A gate matrix on K qubits with a size fixed at compile time, so the
+ * standard gates can be defined as constexpr constants rather than built on
+ * the heap at run time. Entries are row-major.
+ *
+ */
+template <size_t K>
+struct FixedGate
+{
+    static constexpr size_t dimension=size_t(1)<<K;
+    std::array<std::complex<double>, dimension*dimension> entries;
+
+    constexpr std::complex<double> operator()(size_t row, size_t col) const
+    {
+        return entries[row*dimension+col];
+    }
+
+    Matrix to_matrix() const
+    {
+        Matrix matrix(dimension, dimension);
+        for (size_t i=0; i<dimension; i++)
+        {
+            for (size_t j=0; j<dimension; j++)
+            {
+                matrix(i, j)=entries[i*dimension+j];
+            }
+        }
+        return matrix;
+    }
+};
+
+// 1/sqrt(2) as evaluated in double, which is what the gates have always
+// held (one ulp below the correctly rounded value).
+constexpr double inverse_sqrt_2=0.70710678118654746;
+
+constexpr FixedGate<1> identity_gate{ { 1.0, 0.0, 0.0, 1.0 } };
+constexpr FixedGate<1> hadamard_gate{ { inverse_sqrt_2, inverse_sqrt_2, inverse_sqrt_2, -inverse_sqrt_2 } };
+constexpr FixedGate<1> pauli_x_gate{ { 0.0, 1.0, 1.0, 0.0 } };
+constexpr FixedGate<1> pauli_y_gate{ { 0.0, std::complex<double>(0, -1), std::complex<double>(0, 1), 0.0 } };
+constexpr FixedGate<1> pauli_z_gate{ { 1.0, 0.0, 0.0, -1.0 } };
+constexpr FixedGate<1> s_gate{ { 1.0, 0.0, 0.0, std::complex<double>(0, 1) } };
+constexpr FixedGate<1> t_gate{ { 1.0, 0.0, 0.0, std::complex<double>(inverse_sqrt_2, inverse_sqrt_2) } };
+constexpr FixedGate<2> swap_gate{ {
+    1.0, 0.0, 0.0, 0.0,
+    0.0, 0.0, 1.0, 0.0,
+    0.0, 1.0, 0.0, 0.0,
+    0.0, 0.0, 0.0, 1.0 } };
+
+/**
+ * @brief Structure of a gate matrix that the specialised kernels exploit.
+ * Each class is a special case of the ones after it, and classify_gate()
+ * returns the first that applies. Entries within 1e-12 of 0 count as zero,
+ * so gates multiplied out from other gates are still recognised as sparse.
+ *
+ */
+enum class GateClass
+{
+    identity,    // Nothing to do.
+    phase,       // Diagonal with only the last entry different from 1 (Z, S, T, P, CZ).
+    diagonal,
+    permutation, // One entry of exactly 1 in every row and column (X, SWAP, CNOT, Toffoli).
+    monomial,    // One non-zero entry in every row and column (Y).
+    hadamard,    // Real [[a, a], [a, -a]] on one qubit.
+    general
+};
+
+const size_t gate_class_count=7;
+
+// Magnitude below which classify_gate() treats a real or imaginary part as 0.
+const double gate_zero_tolerance=1e-12;
+
+// Largest number of target qubits with specialised kernels.
+const size_t max_specialised_qubits=3;
+
+GateClass classify_gate(const Matrix& matrix);
+
+/**
+ * @brief Applies matrix to the targets with the kernel instantiated for its
+ * size and GateClass, picked from a dispatch table. Wider gates are only
+ * handled when they are monomial (eg: a swap of distant qubits); otherwise
+ * returns false without touching the amplitudes. Qubits are assumed to have
+ * been checked by the caller.
+ *
+ * @param amplitudes
+ * @param num_qubits
+ * @param targets
+ * @param matrix
+ */
+bool apply_specialised_matrix(std::complex<double>* amplitudes, size_t num_qubits,
+    const std::vector<size_t>& targets, const Matrix& matrix);
+
+/**
+ * @brief As apply_specialised_matrix() for a 2x2 matrix on target applied
+ * where all controls are 1.
+ *
+ */
+void apply_specialised_controlled(std::complex<double>* amplitudes, size_t num_qubits,
+    const std::vector<size_t>& controls, size_t target, const Matrix& matrix);
+#endif
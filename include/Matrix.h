@@ -1,12 +1,14 @@
 #ifndef Matrix_H
 #define Matrix_H
+#include "MemoryPool.h"
 #include <iostream>
 #include <vector>
 #include <complex>
 
 /**
- * @brief A class for representing a matrix of complex numbers.
- *
+ * @brief A class for representing a matrix of complex numbers. Entries are
+ * stored contiguously in row-major order and taken from the MemoryPool, so
+ * temporaries of the same shape reuse each other's storage.
  */
 class Matrix
 {
@@ -16,34 +18,39 @@ class Matrix
 private:
     size_t rows;
     size_t cols;
-    std::vector<std::vector<std::complex<double>>> data;
+    std::vector<std::complex<double>, PoolAllocator<std::complex<double>>> data;
 
 public:
     // Constructors and destructors
     Matrix();
     Matrix(size_t rows, size_t cols);
     Matrix(std::vector<std::vector<std::complex<double>>> data);
+    Matrix(const Matrix&);
+    Matrix(Matrix&&) noexcept;
     ~Matrix() {}
 
     // Accessors
     size_t get_rows() const { return rows; }
     size_t get_cols() const { return cols; }
     const std::complex<double> operator()(size_t, size_t) const;
+    const std::complex<double>* get_data() const { return data.data(); }
+    Matrix operator+(const Matrix&) const;
+    Matrix operator-(const Matrix&) const;
+    Matrix operator*(const Matrix&) const;
+    bool operator==(const Matrix&) const;
+    Matrix tensor_product(const Matrix&) const;
+    Matrix transpose() const;
+    Matrix conjugate() const;
+    Matrix adjoint() const;
 
     // Mutators
     Matrix& operator=(const Matrix&);
-    Matrix operator+(const Matrix&);
-    Matrix operator-(const Matrix&);
-    Matrix operator*(const Matrix&);
-    bool operator==(const Matrix);
+    Matrix& operator=(Matrix&&) noexcept;
     std::complex<double>& operator()(size_t, size_t);
-    Matrix tensor_product(const Matrix&);
-    Matrix transpose();
-    Matrix conjugate();
-    Matrix adjoint();
+    std::complex<double>* get_data() { return data.data(); }
 };
 
 // Non-member functions
 Matrix identity_matrix(size_t n);
-Matrix perform_tensor_product(const std::vector<Matrix> matrices);
+Matrix perform_tensor_product(const std::vector<Matrix>& matrices);
 #endif
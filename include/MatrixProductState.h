@@ -0,0 +1,61 @@
+#ifndef MatrixProductState_H
+#define MatrixProductState_H
+#include "QuantumCircuit.h"
+#include <complex>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Matrix product state simulator for circuits with little
+ * entanglement. Each qubit is a tensor A[left][physical][right] and the bond
+ * between neighbouring qubits is capped at max_bond_dimension, discarding the
+ * smallest singular values when a gate would grow it further. The discarded
+ * weight is accumulated so the cost of the cap can be checked. Gates on
+ * qubits that are not neighbours are routed with swap networks, so memory is
+ * O(n*chi^2) and the full state vector is never formed.
+ */
+class MatrixProductState
+{
+private:
+    size_t num_qubits;
+    size_t max_bond_dimension;
+    double truncation_threshold=1e-14;
+    std::vector<std::vector<std::complex<double>>> tensors;
+    std::vector<size_t> bond_dimensions; // bond k sits left of qubit k.
+    size_t orthogonality_center=0;
+    double truncation_error=0;
+    double max_truncation_error=0;
+    double fidelity_estimate=1;
+
+    void move_center_to(size_t qubit);
+    void apply_contiguous(size_t first_qubit, size_t gate_size,
+        const std::vector<std::complex<double>>& gate);
+    void apply_adjacent_swap(size_t qubit);
+    void apply_phase_oracle(const Operation& operation);
+
+public:
+    // Constructors and destructors
+    MatrixProductState(size_t num_qubits, size_t max_bond_dimension);
+    ~MatrixProductState() {}
+
+    // Accessors
+    size_t get_num_qubits() const;
+    size_t get_max_bond_dimension() const;
+    std::vector<size_t> get_bond_dimensions() const;
+    double get_truncation_error() const;
+    double get_max_truncation_error() const;
+    double get_fidelity_estimate() const;
+    double get_norm() const;
+    std::complex<double> get_amplitude(const std::vector<int>& basis_state) const;
+    std::vector<std::string> sample(size_t shots, std::mt19937_64& rng) const;
+
+    // Mutators
+    void set_truncation_threshold(double threshold);
+    void set_basis_state(const std::vector<int>& basis_state);
+    void apply_single(size_t qubit, const Matrix& gate);
+    void apply_two_qubit(size_t qubit_1, size_t qubit_2, const Matrix& gate);
+    void apply_operation(const Operation& operation);
+    void apply_circuit(const QuantumCircuit& circuit);
+};
+#endif
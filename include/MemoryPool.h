@@ -0,0 +1,106 @@
+#ifndef MemoryPool_H
+#define MemoryPool_H
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Counters reported by MemoryPool::get_stats(). Bytes are block sizes
+ * after rounding up to a power of two.
+ *
+ */
+struct MemoryPoolStats
+{
+    size_t allocations=0;     // Requests served by the pool.
+    size_t reuses=0;          // Requests served from a freed block.
+    size_t system_allocations=0;
+    size_t huge_page_blocks=0;
+    size_t bytes_in_use=0;
+    size_t bytes_cached=0;    // Freed blocks kept for reuse.
+    size_t high_water_in_use=0;
+    size_t high_water_reserved=0; // Peak of in use + cached.
+};
+
+/**
+ * @brief Pool for the large buffers behind matrices and state vectors. Freed
+ * blocks are kept in per-size free lists and handed back out to the next
+ * request of the same size, so a long circuit stops paying for page faults
+ * and for returning memory to the OS on every step. Requests below
+ * min_pooled_bytes go straight to operator new. Blocks of at least 2 MiB can
+ * be backed by huge pages (MAP_HUGETLB, or madvise(MADV_HUGEPAGE) when no
+ * huge pages are reserved). At most max_cached_bytes are kept in the free
+ * lists; anything beyond is returned to the OS. Blocks taken from the system
+ * are spread over NUMA nodes according to get_numa_placement() (Numa.h), and
+ * keep that placement while they are reused.
+ */
+class MemoryPool
+{
+private:
+    mutable std::mutex pool_mutex;
+    std::map<size_t, std::vector<void*>> free_blocks;
+    std::map<void*, bool> huge_page_backed; // Blocks that came from mmap.
+    MemoryPoolStats stats;
+    size_t max_cached_bytes=size_t(4)<<30;
+    bool use_huge_pages=false;
+
+    MemoryPool() {}
+    void* allocate_from_system(size_t block_size);
+    void release_to_system(void* block, size_t block_size);
+
+public:
+    static const size_t min_pooled_bytes=size_t(1)<<14;
+    static const size_t huge_page_bytes=size_t(1)<<21;
+
+    ~MemoryPool();
+    MemoryPool(const MemoryPool&)=delete;
+    MemoryPool& operator=(const MemoryPool&)=delete;
+
+    static MemoryPool& instance();
+
+    // Accessors
+    MemoryPoolStats get_stats() const;
+    bool get_huge_pages() const;
+
+    // Mutators
+    void* allocate(size_t bytes);
+    void deallocate(void* block, size_t bytes);
+    void set_huge_pages(bool enabled);
+    void set_max_cached_bytes(size_t bytes);
+    void trim();
+    void reset_high_water();
+};
+
+/**
+ * @brief Standard allocator that takes its memory from MemoryPool, for use as
+ * std::vector<T, PoolAllocator<T>>.
+ */
+template <typename T>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+
+    PoolAllocator() noexcept {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(MemoryPool::instance().allocate(n*sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        MemoryPool::instance().deallocate(p, n*sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>&) const noexcept { return false; }
+};
+
+// Prints the stats as "in use 256 MiB (peak 512 MiB), cached ..., reuses ...".
+std::ostream& operator<<(std::ostream& os, const MemoryPoolStats& stats);
+#endif
@@ -0,0 +1,66 @@
+#ifndef NoiseChannel_H
+#define NoiseChannel_H
+#include "Matrix.h"
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Completely positive trace preserving map on k qubits given by its
+ * Kraus operators K_i, rho -> sum_i K_i rho K_i^dagger. The operators are
+ * checked for completeness (sum_i K_i^dagger K_i = I) on construction. Row
+ * and column bit r of each 2^k x 2^k operator is the r-th qubit the channel
+ * is applied to, as for Operation::targets.
+ */
+class NoiseChannel
+{
+private:
+    size_t num_qubits;
+    std::string name;
+    std::vector<Matrix> kraus_operators;
+    Matrix superoperator;
+
+public:
+    // Constructors and destructors
+    NoiseChannel(std::vector<Matrix> kraus_operators, std::string name="kraus");
+    ~NoiseChannel() {}
+
+    // Accessors
+    size_t get_num_qubits() const;
+    const std::string& get_name() const;
+    const std::vector<Matrix>& get_kraus_operators() const;
+    const Matrix& get_superoperator() const;
+};
+
+// Standard channels. Probabilities must lie in [0, 1].
+NoiseChannel depolarizing(double probability, size_t num_qubits=1);
+NoiseChannel amplitude_damping(double gamma);
+NoiseChannel phase_damping(double lambda);
+NoiseChannel dephasing(double probability);
+NoiseChannel bit_flip(double probability);
+
+/**
+ * @brief Where noise is attached when a circuit runs on a DensityMatrix. Gate
+ * noise follows every operation whose component has the given symbol ("*"
+ * matches every gate). A single qubit channel is applied to each qubit the
+ * gate touches; a wider channel must match the gate's width and is applied to
+ * its targets then controls. Qubit noise is applied to its qubit at the end of
+ * every circuit step, whether or not a gate acted on it, to model idling.
+ */
+class NoiseModel
+{
+private:
+    std::map<std::string, std::vector<NoiseChannel>> gate_noise;
+    std::map<size_t, std::vector<NoiseChannel>> qubit_noise;
+
+public:
+    // Accessors
+    bool empty() const;
+    std::vector<const NoiseChannel*> get_gate_noise(const std::string& symbol) const;
+    const std::map<size_t, std::vector<NoiseChannel>>& get_qubit_noise() const;
+
+    // Mutators
+    void add_gate_noise(const std::string& symbol, NoiseChannel channel);
+    void add_qubit_noise(size_t qubit, NoiseChannel channel);
+};
+#endif
@@ -0,0 +1,79 @@
+#ifndef Numa_H
+#define Numa_H
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A NUMA node and the CPUs this process may run on there.
+ *
+ */
+struct NumaNode
+{
+    size_t id=0;
+    std::vector<size_t> cpus;
+};
+
+/**
+ * @brief How fresh pool blocks are spread over NUMA nodes.
+ * first_touch leaves it to the kernel, so a buffer zeroed by one thread lands
+ * on that thread's node. partition touches the block's pages with workers
+ * pinned node by node, in the same proportional chunks parallel_for() hands
+ * to pinned threads, so each pinned worker mostly streams memory on its own
+ * node. interleave spreads pages round robin over all nodes with mbind(),
+ * which suits access patterns with no locality at all.
+ */
+enum class NumaPlacement
+{
+    first_touch,
+    partition,
+    interleave
+};
+
+// Nodes from /sys/devices/system/node, or one node holding every allowed CPU.
+const std::vector<NumaNode>& get_numa_nodes();
+// Allowed CPUs ordered node by node; parallel_for() pins chunk c of C to
+// entry c*size/C when thread affinity is on.
+const std::vector<size_t>& get_worker_cpus();
+size_t get_node_of_cpu(size_t cpu);
+bool pin_current_thread(size_t cpu);
+
+/**
+ * @brief Placement policy, initially read from the QC_NUMA environment
+ * variable ("first_touch", "partition" or "interleave"). Choosing partition
+ * also turns on thread affinity (see Parallel.h).
+ *
+ */
+NumaPlacement get_numa_placement();
+void set_numa_placement(NumaPlacement placement);
+
+/**
+ * @brief Applies the placement policy to a block whose pages have not been
+ * touched yet. Called by MemoryPool for blocks it takes from the system.
+ *
+ * @param block
+ * @param bytes
+ */
+void place_pages(void* block, size_t bytes);
+
+/**
+ * @brief Bytes of the block resident on each node (index = node id), from a
+ * sample of at most max_samples pages. Pages not yet touched are not counted.
+ *
+ * @param block
+ * @param bytes
+ * @param max_samples
+ * @return std::vector<double>
+ */
+std::vector<double> get_page_placement(const void* block, size_t bytes,
+    size_t max_samples=4096);
+
+// Records a "placement" ProfileEvent with the bytes per node of the block.
+void record_placement(const std::string& name, const void* block, size_t bytes);
+
+#ifdef QC_ENABLE_PROFILING
+#define QC_PROFILE_PLACEMENT(name, block, bytes) record_placement(name, block, bytes)
+#else
+#define QC_PROFILE_PLACEMENT(name, block, bytes) ((void)0)
+#endif
+#endif
@@ -0,0 +1,43 @@
+#ifndef Operation_H
+#define Operation_H
+#include "Matrix.h"
+#include <cstdint>
+#include <vector>
+
+class QuantumComponent;
+
+/**
+ * @brief Kinds of Operation understood by the simulation backends.
+ *
+ */
+enum class OperationType
+{
+    matrix,     // Dense 2^k x 2^k matrix on the target qubits.
+    controlled, // 2x2 matrix on the single target, applied when all controls are 1.
+    qft,        // Quantum Fourier transform over contiguous targets (no matrix).
+    inverse_qft,
+    phase_oracle // Negates basis states whose target bits are marked (no matrix).
+};
+
+/**
+ * @brief A flattened description of what a component does to the register.
+ * Backends walk a list of these (see QuantumCircuit::get_operations()) rather
+ * than expanding every component to a full 2^n x 2^n matrix. Target qubits
+ * are listed lowest-order first, so bit r of the matrix's row/column index
+ * corresponds to targets[r]. For a phase oracle, bit x of marked is set when
+ * the local index x (bit r from targets[r]) is marked. The matrix, marked and
+ * component pointers are owned by the circuit the operation came from.
+ */
+struct Operation
+{
+    OperationType type=OperationType::matrix;
+    std::vector<size_t> targets;
+    std::vector<size_t> controls;
+    const Matrix* matrix=nullptr;
+    const std::vector<uint64_t>* marked=nullptr;
+    const QuantumComponent* component=nullptr;
+    size_t step_index=0;
+
+    bool is_marked(size_t local) const { return ((*marked)[local>>6]>>(local&63))&1; }
+};
+#endif
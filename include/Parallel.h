@@ -0,0 +1,38 @@
+#ifndef Parallel_H
+#define Parallel_H
+#include <cstddef>
+#include <functional>
+
+/**
+ * @brief Number of threads used by parallel_for(). Defaults to the hardware
+ * concurrency of the machine.
+ *
+ */
+size_t get_thread_count();
+void set_thread_count(size_t thread_count);
+
+/**
+ * @brief When on, parallel_for() pins the thread running chunk c of C to
+ * CPU c*P/C of the P allowed CPUs ordered node by node (see Numa.h), so the
+ * same share of every index range always runs on the same NUMA node. The
+ * calling thread's own affinity is restored after it runs chunk 0. Off by
+ * default.
+ */
+bool get_thread_affinity();
+void set_thread_affinity(bool enabled);
+
+/**
+ * @brief Splits [begin, end) into contiguous chunks of at least min_chunk
+ * indices and calls body(chunk_begin, chunk_end) for each chunk on a separate
+ * thread. Runs serially for small ranges, when only one thread is configured,
+ * or when called from inside another parallel_for(). Exceptions thrown by
+ * body are rethrown on the calling thread.
+ *
+ * @param begin
+ * @param end
+ * @param min_chunk
+ * @param body
+ */
+void parallel_for(size_t begin, size_t end, size_t min_chunk,
+    const std::function<void(size_t, size_t)>& body);
+#endif
@@ -0,0 +1,47 @@
+#ifndef PhaseOracle_H
+#define PhaseOracle_H
+#include "QuantumComponent.h"
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Flips the sign of every basis state whose bits on the selected
+ * qubits form a marked input, as the oracle of a Grover search does. Input
+ * bit r is qubit qubits[r], and the predicate (or truth table) is evaluated
+ * once for each of the 2^k inputs when the oracle is made. Simulated as one
+ * diagonal pass over the state that reads 64 marks at a time, with no
+ * ancillas and no dense matrix; that matrix, over every register from the
+ * lowest to the highest selected qubit, is only built when asked for.
+ */
+class PhaseOracle : public MultiGate
+{
+private:
+    std::vector<size_t> qubits;
+    std::vector<uint64_t> marked; // Bit x set when input x is marked.
+    size_t marked_count=0;
+    mutable std::once_flag matrix_flag;
+    mutable Matrix dense_matrix;
+    void set_qubits(const std::vector<size_t>& qubits_in);
+
+public:
+    // Inputs an oracle may take (its truth table has 2^max_inputs bits).
+    static const size_t max_inputs=32;
+
+    // Constructors and destructors
+    PhaseOracle(const std::vector<size_t>& qubits,
+        const std::function<bool(size_t)>& predicate);
+    PhaseOracle(const std::vector<size_t>& qubits,
+        const std::vector<bool>& truth_table);
+    ~PhaseOracle() {}
+
+    // Accessors
+    const std::vector<size_t>& get_qubits() const;
+    const std::vector<uint64_t>& get_marked() const;
+    size_t get_marked_count() const;
+    bool is_marked(size_t input) const;
+    const Matrix& get_matrix() const;
+    void append_operations(std::vector<Operation>& operations,
+        size_t qubit_offset, bool decompose_subcircuits) const;
+};
+#endif
@@ -0,0 +1,107 @@
+#ifndef Profiler_H
+#define Profiler_H
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A single timed region recorded by the profiler. Fields that do not
+ * apply to an event (eg: the step of a whole-circuit event) are set to
+ * ProfileEvent::none.
+ *
+ */
+struct ProfileEvent
+{
+    static const size_t none=static_cast<size_t>(-1);
+    std::string name;     // Gate symbol or name of the routine.
+    std::string category; // "component", "step", "circuit", ...
+    size_t step_index=none;
+    size_t qubit_index=none;
+    size_t rows=0;        // Dimensions of the matrix/state being produced.
+    size_t cols=0;
+    double flops=0;       // Estimated floating point operations.
+    double bytes=0;       // Estimated bytes read and written.
+    size_t allocations=0; // Buffers allocated while the event was open.
+    size_t allocated_bytes=0;
+    double start_us=0;    // Microseconds since the profiler was created.
+    double duration_us=0;
+    size_t thread_id=0;
+    std::vector<double> node_bytes; // Bytes per NUMA node, for "placement" events.
+};
+
+/**
+ * @brief Collects ProfileEvents from the simulator. Instrumentation points use
+ * the QC_PROFILE_* macros below, which are compiled out unless
+ * QC_ENABLE_PROFILING is defined, so a normal build pays nothing for them.
+ * Events can be exported as JSON, as Chrome trace-event format (load the
+ * file in chrome://tracing or https://ui.perfetto.dev) or as a per-gate
+ * summary sorted by total time.
+ */
+class Profiler
+{
+private:
+    mutable std::mutex mutex;
+    std::vector<ProfileEvent> events;
+    std::chrono::steady_clock::time_point epoch;
+
+    Profiler();
+
+public:
+    static Profiler& instance();
+    static bool is_enabled();
+
+    // Accessors
+    std::vector<ProfileEvent> get_events() const;
+    double get_time_us() const;
+    void write_json(std::ostream& os) const;
+    void write_chrome_trace(std::ostream& os) const;
+    void write_summary(std::ostream& os) const;
+
+    // Mutators
+    void record(ProfileEvent event);
+    void clear();
+
+    // Per-thread allocation counters, read by ProfileScope.
+    static void record_allocation(size_t bytes);
+    static size_t get_thread_allocations();
+    static size_t get_thread_allocated_bytes();
+    static size_t get_thread_id();
+};
+
+/**
+ * @brief Times the enclosing scope and records it as a ProfileEvent when it is
+ * destroyed. Allocations made by the current thread while the scope is open
+ * are attributed to the event.
+ *
+ */
+class ProfileScope
+{
+private:
+    ProfileEvent event;
+    size_t start_allocations;
+    size_t start_allocated_bytes;
+
+public:
+    ProfileScope(std::string name, std::string category, size_t step_index,
+        size_t qubit_index, size_t rows, size_t cols, double flops,
+        double bytes);
+    ~ProfileScope();
+    ProfileScope(const ProfileScope&)=delete;
+    ProfileScope& operator=(const ProfileScope&)=delete;
+};
+
+#define QC_PROFILE_CONCAT_INNER(a, b) a##b
+#define QC_PROFILE_CONCAT(a, b) QC_PROFILE_CONCAT_INNER(a, b)
+
+#ifdef QC_ENABLE_PROFILING
+#define QC_PROFILE_SCOPE(...) \
+    ProfileScope QC_PROFILE_CONCAT(qc_profile_scope_, __LINE__)(__VA_ARGS__)
+#define QC_PROFILE_ALLOCATION(bytes) Profiler::record_allocation(bytes)
+#else
+#define QC_PROFILE_SCOPE(...) ((void)0)
+#define QC_PROFILE_ALLOCATION(bytes) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef QFTGate_H
+#define QFTGate_H
+#include "QuantumCircuit.h"
+#include <memory>
+#include <mutex>
+
+/**
+ * @brief Quantum Fourier transform (or its inverse) over gate_size contiguous
+ * registers starting at qubit_index, with the first register as the most
+ * significant bit. Simulated with an in-place FFT in O(n*2^n); the dense
+ * matrix and the equivalent circuit of controlled phases and swaps are only
+ * built when something asks for them.
+ */
+class QFTGate : public MultiGate
+{
+private:
+    bool inverse;
+    mutable std::once_flag circuit_flag;
+    mutable std::shared_ptr<const QuantumCircuit> circuit;
+    mutable std::once_flag matrix_flag;
+    mutable Matrix dense_matrix;
+    const QuantumCircuit& get_circuit() const;
+
+public:
+    // Constructors and destructors
+    QFTGate(size_t qubit_index, size_t gate_size, bool inverse);
+    ~QFTGate() {}
+
+    // Accessors
+    bool is_inverse() const;
+    const Matrix& get_matrix() const;
+    void append_operations(std::vector<Operation>& operations,
+        size_t qubit_offset, bool decompose_subcircuits) const;
+};
+#endif
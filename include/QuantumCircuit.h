@@ -1,12 +1,22 @@
 #ifndef QuantumCircuit_H
 #define QuantumCircuit_H
+#include "Equivalence.h"
 #include "Matrix.h"
 #include "QuantumComponent.h"
+#include "ResourceEstimator.h"
+#include "StateOutput.h"
+#include "StateVector.h"
+#include "TruthTable.h"
 #include <iostream>
 #include <vector>
 #include <bitset>
 #include <memory>
 #include <iterator>
+#include <map>
+#include <unordered_set>
+
+class DecisionDiagramState;
+class SparseStateVector;
 
 /**
  * @brief QuantumCircuit class. Creates a circuit from individual
@@ -22,29 +32,69 @@ private:
     size_t register_size;
     size_t total_steps=-1;
     std::vector<int> input_register;
+    std::unordered_set<const QuantumComponent*> placed_gates;
 
 public:
     // Constructor and destructor
     QuantumCircuit(size_t register_size);
+    QuantumCircuit(const QuantumCircuit&)=default;
+    QuantumCircuit(QuantumCircuit&&)=default;
+    QuantumCircuit& operator=(const QuantumCircuit&)=default;
+    QuantumCircuit& operator=(QuantumCircuit&&)=default;
     ~QuantumCircuit();
 
     // Accessors
     Matrix get_initial_state() const;
     Matrix get_final_state() const;
     Matrix get_state_after_step(size_t step_index) const;
+    StateVector get_initial_state_vector() const;
+    StateVector get_final_state_vector() const;
+    SparseStateVector get_final_sparse_state() const;
+    DecisionDiagramState get_final_decision_diagram() const;
+    void apply_to_state(StateVector& state) const;
     size_t get_register_size() const;
     size_t get_total_steps() const;
+    size_t get_gate_count() const;
+    std::vector<int> get_input_register() const;
+    std::shared_ptr<QuantumComponent> get_component(size_t register_index,
+        size_t step_index) const;
     Matrix get_matrix_at_step(size_t step_index) const;
     Matrix get_matrix() const;
+    Matrix get_matrix_by_products() const;
     bool step_contains_multigate(size_t step_index) const;
     std::shared_ptr<QuantumComponent> get_multigate_at_step(size_t step_index)
         const;
     bool is_step_empty(size_t step_index) const;
     bool is_gate_in_circuit(std::shared_ptr<QuantumComponent>) const;
+    std::vector<Operation> get_operations(bool decompose_subcircuits) const;
+    void append_operations(std::vector<Operation>& operations,
+        size_t qubit_offset, bool decompose_subcircuits) const;
+    bool is_clifford() const;
+    ResourceEstimate estimate_resources(ExecutionMode mode,
+        size_t max_bond_dimension=64) const;
+    bool is_permutation() const;
+    std::vector<size_t> get_truth_table() const;
+    std::map<std::string, size_t> sample(size_t shots, unsigned seed) const;
+    std::vector<double> get_marginal_probabilities(
+        const std::vector<size_t>& qubits) const;
+    TruthTableReport verify_truth_table(
+        const std::function<size_t(size_t)>& expected_output,
+        size_t max_reported=16) const;
+    TruthTableReport verify_truth_table(
+        const std::vector<size_t>& expected_outputs,
+        size_t max_reported=16) const;
+    EquivalenceReport check_equivalence(const QuantumCircuit& other,
+        const EquivalenceOptions& options=EquivalenceOptions()) const;
 
     // Functions to draw output to console
     void draw_circuit() const;
     void draw_probability_distribution() const;
+    void write_final_state(std::ostream& os, const OutputOptions& options) const;
+    void write_probability_distribution(std::ostream& os,
+        const OutputOptions& options) const;
+    void draw_probability_distribution(const std::vector<size_t>& qubits) const;
+    void write_probability_distribution(std::ostream& os,
+        const std::vector<size_t>& qubits, const OutputOptions& options) const;
 
     // Mutators
     void set_input_register(std::vector<int> input_register);
@@ -52,10 +102,11 @@ public:
     void replace_component(std::shared_ptr<QuantumComponent> gate,
         size_t register_index,
         size_t step_index);
+    void remove_step(size_t step_index);
     void evolve();
     void evolve(size_t step_number);
     void ask_for_input();
-    void test_circuit();
+    void test_circuit() const;
 
 };
 
@@ -63,5 +114,5 @@ public:
 std::string get_binary_representation(int number, int register_size);
 Matrix calculate_matrix_for_register(std::vector<int> register_values);
 bool is_power_of_two(int number);
-void draw_state(Matrix state);
+void draw_state(const Matrix& state);
 #endif
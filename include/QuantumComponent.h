@@ -1,7 +1,9 @@
 #ifndef QuantumComponent_H
 #define QuantumComponent_H
 #include "Matrix.h"
+#include "Operation.h"
 #include <memory>
+#include <mutex>
 #include <complex>
 
 /**
@@ -25,7 +27,7 @@ public:
     // Accessors
     std::string get_symbol() const;
     size_t get_index() const;
-    virtual Matrix get_matrix() const=0;
+    virtual const Matrix& get_matrix() const=0;
     virtual Matrix get_matrix(size_t register_size) const=0;
     virtual std::string get_gate_type() const=0;
     virtual bool can_gate_fit(size_t register_size) const=0;
@@ -33,6 +35,8 @@ public:
         size_t register_index) const=0;
     virtual std::string get_line(std::string type) const;
     int get_line_length() const;
+    virtual void append_operations(std::vector<Operation>& operations,
+        size_t qubit_offset, bool decompose_subcircuits) const=0;
 };
 
 /**
@@ -49,12 +53,14 @@ public:
     virtual ~SingleGate() {}
 
     // Accessors
-    Matrix get_matrix() const;
+    const Matrix& get_matrix() const;
     Matrix get_matrix(size_t register_size) const;
     std::string get_gate_type() const;
     bool can_gate_fit(size_t register_size) const;
     virtual std::string get_terminal_output(size_t terminal_line,
         size_t register_index) const;
+    virtual void append_operations(std::vector<Operation>& operations,
+        size_t qubit_offset, bool decompose_subcircuits) const;
 };
 
 /**
@@ -75,12 +81,14 @@ public:
 
     // Accessors
     size_t get_gate_size() const;
-    Matrix get_matrix() const;
+    const Matrix& get_matrix() const;
     Matrix get_matrix(size_t register_size) const;
     std::string get_gate_type() const;
     bool can_gate_fit(size_t register_size) const;
     virtual std::string get_terminal_output(size_t terminal_line,
         size_t register_index) const;
+    virtual void append_operations(std::vector<Operation>& operations,
+        size_t qubit_offset, bool decompose_subcircuits) const;
 };
 
 /**
@@ -93,7 +101,11 @@ class ControlledGate : public MultiGate
 private:
     size_t control_index; // Register index that controls gate
     size_t target_index;  // Register index of the gate being controlled
-    Matrix get_controlled_matrix(Matrix gate_matrix) const;
+    Matrix target_matrix; // Matrix of the gate being controlled
+    std::shared_ptr<SingleGate> target_gate;
+    mutable std::once_flag controlled_flag;
+    mutable Matrix controlled_matrix; // Built the first time get_matrix() is called
+    Matrix get_controlled_matrix(const Matrix& gate_matrix) const;
     
 public:
     // Constructors and destructors
@@ -103,8 +115,14 @@ public:
 
     // Accessors
     size_t get_control_index() const;
+    size_t get_target_index() const;
+    const Matrix& get_matrix() const;
+    const Matrix& get_target_matrix() const;
+    std::shared_ptr<SingleGate> get_target_gate() const;
     std::string get_terminal_output(size_t terminal_line,
         size_t register_index) const;
+    void append_operations(std::vector<Operation>& operations,
+        size_t qubit_offset, bool decompose_subcircuits) const;
 };
 
 // Collection of single gates
@@ -168,9 +186,13 @@ public:
 
 class PhaseGate : public SingleGate
 {
+private:
+    double phase;
+
 public:
     PhaseGate();
     PhaseGate(size_t qubit_index, double phase);
     ~PhaseGate() {}
+    double get_phase() const;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,109 @@
+#ifndef ResourceEstimator_H
+#define ResourceEstimator_H
+#include "Operation.h"
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Ways of running a circuit that estimate_resources() can cost.
+ *
+ */
+enum class ExecutionMode
+{
+    state_vector,         // get_final_state_vector(), get_final_state(), sample().
+    unitary,              // get_matrix(): one state vector per column.
+    unitary_by_products,  // get_matrix_by_products(): dense 2^n x 2^n products.
+    stabilizer,           // Clifford circuits only.
+    matrix_product_state, // Bounded by the maximum bond dimension.
+    bit_sliced,           // get_truth_table(), permutation circuits only.
+    density_matrix        // DensityMatrix::apply_circuit(), excluding noise.
+};
+
+/**
+ * @brief What MemoryBudget::admit() does with a run that does not fit: throw,
+ * or let the caller switch to a cheaper backend when it has one (sample() on a
+ * non-Clifford circuit falls back to a matrix product state).
+ */
+enum class BudgetPolicy
+{
+    reject,
+    fallback
+};
+
+/**
+ * @brief Predicted cost of running a circuit in one ExecutionMode. Byte and
+ * flop counts are doubles because dense modes overflow size_t past 32 qubits.
+ * supported is false when the mode cannot run the circuit at all (a
+ * non-Clifford gate on the stabilizer backend, ...).
+ */
+struct ResourceEstimate
+{
+    ExecutionMode mode=ExecutionMode::state_vector;
+    size_t num_qubits=0;
+    size_t num_operations=0;
+    double peak_bytes=0;
+    double flops=0;
+    bool supported=true;
+};
+
+/**
+ * @brief Estimates peak memory and floating point work of running the
+ * operations in the given mode, without allocating anything. Peak memory
+ * covers the state (or tableau, tensors, truth table), per-thread scratch and
+ * the gate matrices the operations point to. For the stabilizer and bit sliced
+ * modes flops counts 64-bit word operations.
+ *
+ * @param operations Output of QuantumCircuit::get_operations().
+ * @param num_qubits
+ * @param num_steps Only used by unitary_by_products.
+ * @param mode
+ * @param max_bond_dimension Only used by matrix_product_state.
+ * @return ResourceEstimate
+ */
+ResourceEstimate estimate_resources(const std::vector<Operation>& operations,
+    size_t num_qubits, size_t num_steps, ExecutionMode mode,
+    size_t max_bond_dimension=64);
+
+/**
+ * @brief Process-wide memory limit checked before any dense simulation
+ * allocates. The limit defaults to the QC_MEMORY_BUDGET environment variable
+ * (bytes, or with a K, M, G or T suffix) and otherwise to the machine's
+ * physical memory, so a request that cannot fit is refused up front instead of
+ * getting the process OOM-killed halfway through.
+ */
+class MemoryBudget
+{
+private:
+    mutable std::mutex budget_mutex;
+    double limit_bytes;
+    BudgetPolicy policy=BudgetPolicy::reject;
+
+    MemoryBudget();
+
+public:
+    MemoryBudget(const MemoryBudget&)=delete;
+    MemoryBudget& operator=(const MemoryBudget&)=delete;
+
+    static MemoryBudget& instance();
+
+    // Accessors
+    double get_limit() const;
+    BudgetPolicy get_policy() const;
+    bool fits(const ResourceEstimate& estimate) const;
+    void admit(const ResourceEstimate& estimate, const std::string& caller) const;
+
+    // Mutators
+    void set_limit(double bytes);
+    void set_policy(BudgetPolicy policy);
+};
+
+// Parses "512M", "64G", "1.5T" or a plain byte count.
+double parse_byte_count(const std::string& text);
+std::string format_byte_count(double bytes);
+std::string to_string(ExecutionMode mode);
+
+// Prints "state_vector on 20 qubits, 35 operations: peak 16.0 MiB, 2.3e+09 flops".
+std::ostream& operator<<(std::ostream& os, const ResourceEstimate& estimate);
+#endif
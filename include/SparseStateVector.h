@@ -0,0 +1,105 @@
+#ifndef SparseStateVector_H
+#define SparseStateVector_H
+#include "Operation.h"
+#include "StateVector.h"
+#include <complex>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+class QuantumCircuit;
+
+/**
+ * @brief Open addressing hash map from basis index to amplitude, with linear
+ * probing over a power of two table kept at most half full. Indices are
+ * spread with Fibonacci hashing, since basis indices of arithmetic circuits
+ * differ in a few high bits. Entries are only removed by clear(); the
+ * sparse state builds a new map for every gate that moves amplitudes.
+ */
+class AmplitudeMap
+{
+private:
+    std::vector<size_t> keys;
+    std::vector<std::complex<double>> values;
+    size_t count=0;
+    size_t shift=60; // 64-log2(capacity)
+
+    size_t home_slot(size_t key) const { return (key*size_t(0x9E3779B97F4A7C15ull))>>shift; }
+    void grow();
+
+public:
+    static constexpr size_t empty_key=~size_t(0);
+
+    // Constructors and destructors
+    AmplitudeMap(size_t expected_size=8);
+    AmplitudeMap(const AmplitudeMap&)=default;
+    AmplitudeMap(AmplitudeMap&&)=default;
+    AmplitudeMap& operator=(const AmplitudeMap&)=default;
+    AmplitudeMap& operator=(AmplitudeMap&&)=default;
+    ~AmplitudeMap() {}
+
+    // Accessors
+    size_t size() const { return count; }
+    size_t get_capacity() const { return keys.size(); }
+    size_t get_key(size_t slot) const { return keys[slot]; }
+    const std::complex<double>& get_value(size_t slot) const { return values[slot]; }
+    const std::complex<double>* find(size_t key) const;
+
+    // Mutators
+    std::complex<double>& get_value(size_t slot) { return values[slot]; }
+    std::complex<double>& operator[](size_t key);
+    void reserve(size_t expected_size);
+    void clear();
+};
+
+/**
+ * @brief State vector that only stores the basis states with non-zero
+ * amplitude (the support), for circuits that stay in a small superposition
+ * such as arithmetic circuits and oracles. A gate on k qubits costs
+ * O(support * 2^k) instead of O(2^n), and diagonal and permutation gates
+ * (see classify_gate()) cost O(support), so registers of up to 63 qubits can
+ * be simulated as long as the support stays small. Amplitudes that cancel to
+ * below 1e-14 are dropped. When the support grows past 1/16 of 2^n and a
+ * dense state fits in the MemoryBudget, the amplitudes move to a StateVector;
+ * they move back once fewer than 1/64 of them are non-zero.
+ */
+class SparseStateVector
+{
+private:
+    size_t num_qubits;
+    AmplitudeMap amplitudes;
+    std::unique_ptr<StateVector> dense_state;
+    size_t operations_since_check=0;
+
+    void apply_sparse(const Operation& operation);
+    void apply_matrix_sparse(const std::vector<size_t>& targets, size_t control_mask,
+        const Matrix& matrix);
+    void update_representation();
+    void to_dense();
+    void to_sparse();
+
+public:
+    // Constructors and destructors
+    SparseStateVector(size_t num_qubits);
+    SparseStateVector(SparseStateVector&&)=default;
+    SparseStateVector& operator=(SparseStateVector&&)=default;
+    ~SparseStateVector() {}
+
+    // Accessors
+    size_t get_num_qubits() const;
+    bool is_dense() const;
+    size_t get_support_size() const;
+    std::complex<double> get_amplitude(size_t index) const;
+    std::vector<std::pair<size_t, std::complex<double>>> get_entries() const;
+    double get_norm() const;
+    std::vector<std::string> sample(size_t shots, std::mt19937_64& rng) const;
+    StateVector to_state_vector() const;
+
+    // Mutators
+    void set_basis_state(size_t index);
+    void apply_operation(const Operation& operation);
+    void apply_circuit(const QuantumCircuit& circuit);
+};
+#endif
@@ -0,0 +1,62 @@
+#ifndef StabilizerTableau_H
+#define StabilizerTableau_H
+#include "Operation.h"
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Aaronson-Gottesman stabilizer tableau for simulating Clifford
+ * circuits (H, S, S*, X, Y, Z, CNOT, CZ, CY and swap) in polynomial time.
+ * Rows 0..n-1 hold the destabilizers, rows n..2n-1 the stabilizers and row 2n
+ * is scratch space for deterministic measurements. Each row stores its X and Z
+ * bits packed into 64-bit words, so a gate costs O(n) and a measurement
+ * O(n^2/64) word operations.
+ */
+class StabilizerTableau
+{
+private:
+    size_t num_qubits;
+    size_t words; // 64-bit words per row for each of the X and Z halves.
+    std::vector<uint64_t> x_bits;
+    std::vector<uint64_t> z_bits;
+    std::vector<uint8_t> phases;
+
+    uint64_t* x_row(size_t row) { return &x_bits[row*words]; }
+    uint64_t* z_row(size_t row) { return &z_bits[row*words]; }
+    const uint64_t* x_row(size_t row) const { return &x_bits[row*words]; }
+    const uint64_t* z_row(size_t row) const { return &z_bits[row*words]; }
+    bool get_x(size_t row, size_t qubit) const;
+    bool get_z(size_t row, size_t qubit) const;
+    void row_sum(size_t target_row, size_t source_row);
+    void copy_row(size_t target_row, size_t source_row);
+    void clear_row(size_t row);
+
+public:
+    // Constructors and destructors
+    StabilizerTableau(size_t num_qubits);
+    ~StabilizerTableau() {}
+
+    // Accessors
+    size_t get_num_qubits() const;
+    std::vector<std::string> get_stabilizers() const;
+    std::vector<std::string> sample(size_t shots, std::mt19937_64& rng) const;
+    static bool is_clifford(const Operation& operation);
+
+    // Mutators
+    void apply_h(size_t qubit);
+    void apply_s(size_t qubit);
+    void apply_s_dagger(size_t qubit);
+    void apply_x(size_t qubit);
+    void apply_y(size_t qubit);
+    void apply_z(size_t qubit);
+    void apply_cnot(size_t control, size_t target);
+    void apply_cz(size_t control, size_t target);
+    void apply_cy(size_t control, size_t target);
+    void apply_swap(size_t qubit_1, size_t qubit_2);
+    void apply_operation(const Operation& operation);
+    int measure(size_t qubit, std::mt19937_64& rng);
+    std::string measure_all(std::mt19937_64& rng);
+};
+#endif
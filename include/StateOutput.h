@@ -0,0 +1,81 @@
+#ifndef StateOutput_H
+#define StateOutput_H
+#include "StateVector.h"
+#include <complex>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Formats understood by write_state() and write_probabilities().
+ *
+ */
+enum class OutputFormat
+{
+    text,       // Kets and a histogram bar per row, as draw_probability_distribution().
+    csv,        // Header line then one row per basis state.
+    json_lines, // One JSON object per basis state.
+    binary      // Raw little-endian float64 values, no header.
+};
+
+/**
+ * @brief Which rows to write and how. Rows with probability at or below
+ * threshold are skipped. When top_k is non zero only the top_k most likely
+ * rows are written, most likely first, found in one streaming pass that only
+ * keeps top_k rows per thread; otherwise rows are in basis order.
+ * In binary format the unfiltered output is just the 2^n values (probability,
+ * or real and imaginary parts), while filtered output prefixes each row with
+ * its basis index stored as a float64.
+ */
+struct OutputOptions
+{
+    OutputFormat format=OutputFormat::text;
+    size_t top_k=0;
+    double threshold=0;
+    size_t buffer_size=1<<16;
+};
+
+/**
+ * @brief Collects output in a large string and hands it to the stream in
+ * buffer_size blocks, so writing millions of rows costs a few stream calls
+ * rather than one (and a flush) per row.
+ */
+class OutputBuffer
+{
+private:
+    std::ostream& os;
+    std::string buffer;
+    size_t capacity;
+
+public:
+    // Constructors and destructors
+    OutputBuffer(std::ostream& os, size_t capacity=1<<16);
+    ~OutputBuffer();
+
+    // Mutators
+    void append(const char* data, size_t size);
+    void append(const std::string& text);
+    void append(char character, size_t count=1);
+    void append_number(double value, const char* format="%.17g");
+    void append_bits(size_t index, size_t num_bits);
+    void append_raw(double value);
+    void flush();
+};
+
+// Basis indices selected by options (threshold, then top_k) in output order.
+std::vector<size_t> select_basis_states(const std::complex<double>* amplitudes,
+    size_t num_qubits, const OutputOptions& options);
+
+// Write amplitudes (state) or |amplitude|^2 (probabilities) in the chosen format.
+void write_state(std::ostream& os, const std::complex<double>* amplitudes,
+    size_t num_qubits, const OutputOptions& options=OutputOptions());
+void write_state(std::ostream& os, const StateVector& state,
+    const OutputOptions& options=OutputOptions());
+void write_probabilities(std::ostream& os, const std::complex<double>* amplitudes,
+    size_t num_qubits, const OutputOptions& options=OutputOptions());
+void write_probabilities(std::ostream& os, const StateVector& state,
+    const OutputOptions& options=OutputOptions());
+// Same rows for a distribution of 2^k probabilities, eg: a marginal one.
+void write_probabilities(std::ostream& os, const std::vector<double>& probabilities,
+    const OutputOptions& options=OutputOptions());
+#endif
@@ -0,0 +1,67 @@
+#ifndef StateVector_H
+#define StateVector_H
+#include "Matrix.h"
+#include "Operation.h"
+#include <complex>
+#include <vector>
+
+/**
+ * @brief Dense state vector of 2^n amplitudes stored contiguously, with bit k
+ * of an amplitude's index holding the value of qubit k. Gates are applied in
+ * place with strided kernels, so applying a k qubit gate costs O(2^n * 2^k)
+ * rather than the O(8^n) of multiplying full circuit matrices. Large states
+ * are processed on all threads (see Parallel.h). Amplitudes come from the
+ * MemoryPool, so repeated states of the same size reuse one buffer.
+ */
+class StateVector
+{
+private:
+    size_t num_qubits;
+    std::vector<std::complex<double>, PoolAllocator<std::complex<double>>> amplitudes;
+
+public:
+    // Constructors and destructors
+    StateVector(size_t num_qubits);
+    StateVector(const Matrix& column);
+    ~StateVector() {}
+
+    // Accessors
+    size_t get_num_qubits() const;
+    size_t get_size() const;
+    std::complex<double> get_amplitude(size_t index) const;
+    const std::complex<double>* get_data() const;
+    std::vector<double> get_marginal_probabilities(const std::vector<size_t>& qubits) const;
+    Matrix to_matrix() const;
+
+    // Mutators
+    std::complex<double>* get_data();
+    void set_basis_state(size_t index);
+    void apply_operation(const Operation& operation);
+};
+
+// Kernels on raw amplitude buffers of 2^num_qubits entries. These are shared
+// by every backend that stores amplitudes contiguously.
+void apply_operation(std::complex<double>* amplitudes, size_t num_qubits,
+    const Operation& operation);
+void apply_matrix(std::complex<double>* amplitudes, size_t num_qubits,
+    const std::vector<size_t>& targets, const Matrix& matrix);
+void apply_controlled(std::complex<double>* amplitudes, size_t num_qubits,
+    const std::vector<size_t>& controls, size_t target, const Matrix& matrix);
+void apply_qft(std::complex<double>* amplitudes, size_t num_qubits,
+    size_t first_qubit, size_t size, bool inverse);
+void apply_phase_oracle(std::complex<double>* amplitudes, size_t num_qubits,
+    const std::vector<size_t>& targets, const std::vector<uint64_t>& marked);
+
+/**
+ * @brief Probability of every outcome of measuring only the given qubits,
+ * where bit r of the outcome is qubits[r]. Returns 2^k values for k qubits
+ * from a single pass over the 2^n amplitudes.
+ *
+ * @param amplitudes
+ * @param num_qubits
+ * @param qubits
+ * @return std::vector<double>
+ */
+std::vector<double> marginal_probabilities(const std::complex<double>* amplitudes,
+    size_t num_qubits, const std::vector<size_t>& qubits);
+#endif
@@ -0,0 +1,107 @@
+#ifndef TrajectorySimulator_H
+#define TrajectorySimulator_H
+#include "NoiseChannel.h"
+#include "QuantumCircuit.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+// Real valued function of a trajectory's final state, averaged over trajectories.
+typedef std::function<double(const StateVector&)> Observable;
+
+Observable z_expectation(size_t qubit);
+Observable basis_probability(size_t index);
+
+struct TrajectoryResult;
+
+/**
+ * @brief Settings for TrajectorySimulator::run(). Trajectories run in batches
+ * of batch_size spread across threads, and after each batch the run stops once
+ * at least min_trajectories have finished and every observable's standard
+ * error is at or below target_standard_error (0 runs all max_trajectories).
+ * Trajectory t always uses the random stream seeded by (seed, t), so results
+ * do not depend on the thread count. progress, when set, is called with the
+ * running result after every batch.
+ */
+struct TrajectoryOptions
+{
+    size_t max_trajectories=1000;
+    size_t min_trajectories=32;
+    size_t batch_size=64;
+    double target_standard_error=0;
+    size_t shots_per_trajectory=1;
+    uint64_t seed=1;
+    std::function<void(const TrajectoryResult&)> progress;
+};
+
+/**
+ * @brief Aggregated outcome of a run: measurement counts over all shots, and
+ * the mean and standard error of the mean of each observable.
+ */
+struct TrajectoryResult
+{
+    size_t trajectories=0;
+    bool converged=false;
+    std::map<std::string, size_t> counts;
+    std::vector<double> means;
+    std::vector<double> standard_errors;
+};
+
+/**
+ * @brief Monte-Carlo wave function simulator for noisy circuits. Each
+ * trajectory runs the circuit on a pure StateVector and, at every noise
+ * location of the NoiseModel (same placement as DensityMatrix::apply_circuit()),
+ * applies one Kraus operator K_i with probability ||K_i psi||^2 and
+ * renormalises. Averaged over trajectories this reproduces the density matrix
+ * while needing only 2^n amplitudes per thread. Channels whose Kraus operators
+ * are scaled unitaries (depolarizing, dephasing, bit flip) are sampled without
+ * touching the state.
+ */
+class TrajectorySimulator
+{
+private:
+    struct Branch
+    {
+        Matrix kraus;     // K_i, or U_i for a unitary mixture.
+        Matrix gram;      // K_i^dagger K_i, for state dependent branches.
+        double weight=0;  // Probability of U_i for a unitary mixture.
+        bool identity=false;
+    };
+    struct PreparedChannel
+    {
+        bool unitary_mixture=true;
+        std::vector<Branch> branches;
+    };
+    struct Instruction
+    {
+        const Operation* operation=nullptr; // Otherwise a noise location.
+        size_t channel=0;
+        std::vector<size_t> qubits;
+    };
+
+    QuantumCircuit circuit;
+    std::vector<Operation> operations;
+    std::vector<PreparedChannel> channels;
+    std::vector<Instruction> program;
+
+    size_t prepare_channel(const NoiseChannel& channel);
+    void run_trajectory(StateVector& state, std::mt19937_64& rng) const;
+
+public:
+    // Constructors and destructors
+    TrajectorySimulator(const QuantumCircuit& circuit, const NoiseModel& noise);
+    ~TrajectorySimulator() {}
+
+    // Accessors
+    size_t get_noise_locations() const;
+    StateVector run_single(uint64_t seed) const;
+    TrajectoryResult run(const TrajectoryOptions& options,
+        const std::vector<Observable>& observables={}) const;
+};
+
+// Prints the trajectory count and each observable as "mean +- error".
+std::ostream& operator<<(std::ostream& os, const TrajectoryResult& result);
+#endif
@@ -0,0 +1,58 @@
+#ifndef TruthTable_H
+#define TruthTable_H
+#include "Operation.h"
+#include <functional>
+#include <iostream>
+#include <vector>
+
+/**
+ * @brief One basis input whose output differed from the expected one.
+ * Inputs and outputs are basis indices with bit k holding qubit k. actual is
+ * the most likely output and expected_probability the probability of
+ * measuring the expected output.
+ */
+struct TruthTableMismatch
+{
+    size_t input;
+    size_t expected;
+    size_t actual;
+    double expected_probability;
+};
+
+/**
+ * @brief Result of QuantumCircuit::verify_truth_table(). mismatches holds the
+ * lowest max_reported failing inputs in order, mismatch_count all of them.
+ */
+struct TruthTableReport
+{
+    size_t inputs_checked=0;
+    size_t mismatch_count=0;
+    bool classical=false; // true when every gate mapped basis states to basis states.
+    std::vector<TruthTableMismatch> mismatches;
+
+    bool passed() const { return mismatch_count==0; }
+};
+
+/**
+ * @brief Runs every basis input in [first_input, end_input) through the
+ * operations and compares the output with expected_output(input). Inputs are
+ * split across threads (see Parallel.h), so expected_output must be safe to
+ * call concurrently. When every operation permutes basis states (X, CNOT,
+ * Toffoli, swap, phases, ...) the outputs come from the BitSlicedSimulator;
+ * otherwise a state vector is propagated per input.
+ *
+ * @param operations
+ * @param num_qubits
+ * @param expected_output
+ * @param first_input
+ * @param end_input
+ * @param max_reported
+ * @return TruthTableReport
+ */
+TruthTableReport verify_truth_table(const std::vector<Operation>& operations,
+    size_t num_qubits, const std::function<size_t(size_t)>& expected_output,
+    size_t first_input, size_t end_input, size_t max_reported=16);
+
+// Prints "passed 256/256 inputs" or the count and the reported mismatches.
+std::ostream& operator<<(std::ostream& os, const TruthTableReport& report);
+#endif
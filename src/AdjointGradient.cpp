@@ -0,0 +1,271 @@
+#include "AdjointGradient.h"
+#include "BlockedScheduler.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+
+typedef std::complex<double> complex;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    const size_t parallel_grain=1<<14;
+
+    bool odd_parity(size_t bits)
+    {
+        return std::bitset<64>(bits).count()&1;
+    }
+
+    /**
+     * @brief A Pauli string as bit masks: P|i>=phase*(-1)^|i & sign_mask|
+     * |i ^ flip_mask>, since X|b>=|1-b>, Z|b>=(-1)^b|b> and Y|b>=i(-1)^b|1-b>.
+     *
+     */
+    struct PauliMasks
+    {
+        size_t flip_mask=0;
+        size_t sign_mask=0;
+        complex phase=1;
+    };
+
+    PauliMasks masks_of(const PauliTerm& term, size_t num_qubits)
+    {
+        if (term.paulis.size()>num_qubits)
+        {
+            throw std::invalid_argument("Pauli term acts on more qubits than the state has");
+        }
+        PauliMasks masks;
+        for (size_t k=0; k<term.paulis.size(); k++)
+        {
+            const size_t bit=size_t(1)<<k;
+            switch (term.paulis[k])
+            {
+            case 'I':
+                break;
+            case 'X':
+                masks.flip_mask|=bit;
+                break;
+            case 'Y':
+                masks.flip_mask|=bit;
+                masks.sign_mask|=bit;
+                masks.phase*=complex(0, 1);
+                break;
+            case 'Z':
+                masks.sign_mask|=bit;
+                break;
+            default:
+                throw std::invalid_argument("Pauli terms may only contain I, X, Y and Z");
+            }
+        }
+        return masks;
+    }
+
+    // Sums body(begin, end) over chunks of [0, size) split across threads.
+    complex parallel_sum(size_t size, const std::function<complex(size_t, size_t)>& body)
+    {
+        complex total=0;
+        std::mutex total_mutex;
+        parallel_for(0, size, parallel_grain, [&](size_t begin, size_t end)
+            {
+                const complex partial=body(begin, end);
+                std::lock_guard<std::mutex> lock(total_mutex);
+                total+=partial;
+            });
+        return total;
+    }
+
+    // The PhaseGate whose angle an operation applies, or nullptr.
+    const PhaseGate* phase_parameter_of(const Operation& operation)
+    {
+        if (auto phase_gate=dynamic_cast<const PhaseGate*>(operation.component))
+        {
+            return phase_gate;
+        }
+        if (auto controlled_gate=dynamic_cast<const ControlledGate*>(operation.component))
+        {
+            return dynamic_cast<const PhaseGate*>(controlled_gate->get_target_gate().get());
+        }
+        return nullptr;
+    }
+
+    // Bits that must all be 1 for a phase operation to act.
+    size_t phase_mask_of(const Operation& operation)
+    {
+        size_t mask=size_t(1)<<operation.targets[0];
+        for (size_t control : operation.controls)
+        {
+            mask|=size_t(1)<<control;
+        }
+        return mask;
+    }
+
+    void apply_inverse(StateVector& state, const Operation& operation, const Matrix* inverse_matrix)
+    {
+        Operation inverse=operation;
+        inverse.matrix=inverse_matrix;
+        if (operation.type==OperationType::qft)
+        {
+            inverse.type=OperationType::inverse_qft;
+        }
+        else if (operation.type==OperationType::inverse_qft)
+        {
+            inverse.type=OperationType::qft;
+        }
+        state.apply_operation(inverse);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Non-member functions
+///////////////////////////////////////////////////////////////////////////////
+
+double expectation_value(const StateVector& state, const Hamiltonian& hamiltonian)
+{
+    const complex* amplitudes=state.get_data();
+    double expectation=0;
+    for (const PauliTerm& term : hamiltonian)
+    {
+        // <psi|P|psi>=sum over i of conj(psi[i^flip])*phase*sign(i)*psi[i].
+        const PauliMasks masks=masks_of(term, state.get_num_qubits());
+        const complex sum=parallel_sum(state.get_size(), [&](size_t begin, size_t end)
+            {
+                complex partial=0;
+                for (size_t i=begin; i<end; i++)
+                {
+                    const complex product=std::conj(amplitudes[i^masks.flip_mask])*amplitudes[i];
+                    partial+=odd_parity(i&masks.sign_mask) ? -product : product;
+                }
+                return partial;
+            });
+        expectation+=term.coefficient*(masks.phase*sum).real();
+    }
+    return expectation;
+}
+
+void apply_hamiltonian(const StateVector& state, const Hamiltonian& hamiltonian, StateVector& result)
+{
+    if (result.get_num_qubits()!=state.get_num_qubits())
+    {
+        throw std::invalid_argument("State sizes do not match for apply_hamiltonian()");
+    }
+    const complex* amplitudes=state.get_data();
+    complex* output=result.get_data();
+    parallel_for(0, result.get_size(), parallel_grain, [output](size_t begin, size_t end)
+        {
+            std::fill(output+begin, output+end, complex(0.0));
+        });
+    for (const PauliTerm& term : hamiltonian)
+    {
+        const PauliMasks masks=masks_of(term, state.get_num_qubits());
+        const complex factor=term.coefficient*masks.phase;
+        // i -> i^flip is a bijection, so threads never write the same output.
+        parallel_for(0, state.get_size(), parallel_grain, [&](size_t begin, size_t end)
+            {
+                for (size_t i=begin; i<end; i++)
+                {
+                    const complex value=factor*amplitudes[i];
+                    output[i^masks.flip_mask]+=odd_parity(i&masks.sign_mask) ? -value : value;
+                }
+            });
+    }
+}
+
+GradientResult adjoint_gradient(const QuantumCircuit& circuit, const Hamiltonian& hamiltonian)
+{
+    const size_t num_qubits=circuit.get_register_size();
+    ResourceEstimate estimate=circuit.estimate_resources(ExecutionMode::state_vector);
+    estimate.peak_bytes*=2;
+    MemoryBudget::instance().admit(estimate, "adjoint_gradient()");
+
+    const std::vector<Operation> operations=circuit.get_operations(false);
+    std::vector<const PhaseGate*> parameter_of(operations.size(), nullptr);
+    size_t parameter_count=0;
+    size_t first_parameter=operations.size();
+    for (size_t k=0; k<operations.size(); k++)
+    {
+        parameter_of[k]=phase_parameter_of(operations[k]);
+        if (parameter_of[k])
+        {
+            parameter_count++;
+            first_parameter=std::min(first_parameter, k);
+        }
+    }
+
+    StateVector psi=circuit.get_initial_state_vector();
+    apply_operations(psi, operations);
+    StateVector lambda(num_qubits);
+    apply_hamiltonian(psi, hamiltonian, lambda);
+
+    GradientResult result;
+    result.expectation=parallel_sum(psi.get_size(), [&](size_t begin, size_t end)
+        {
+            complex partial=0;
+            for (size_t i=begin; i<end; i++)
+            {
+                partial+=std::conj(psi.get_data()[i])*lambda.get_data()[i];
+            }
+            return partial;
+        }).real();
+    result.gradients.resize(parameter_count);
+    result.parameters.resize(parameter_count);
+
+    // Backward pass: before undoing gate k, psi=U_k...U_1|0> and
+    // lambda=U_{k+1}^dagger...U_L^dagger H|psi_final>. Nothing before the
+    // first parameter needs undoing.
+    size_t parameter=parameter_count;
+    for (size_t k=operations.size(); k-->first_parameter;)
+    {
+        const Operation& operation=operations[k];
+        if (parameter_of[k])
+        {
+            // dU/dphase=i P U, so dE/dphase=2 Re(<lambda|i P|psi>).
+            const size_t mask=phase_mask_of(operation);
+            const complex overlap=parallel_sum(psi.get_size(), [&](size_t begin, size_t end)
+                {
+                    complex partial=0;
+                    for (size_t i=begin; i<end; i++)
+                    {
+                        if ((i&mask)==mask)
+                        {
+                            partial+=std::conj(lambda.get_data()[i])*psi.get_data()[i];
+                        }
+                    }
+                    return partial;
+                });
+            parameter--;
+            result.gradients[parameter]=-2*overlap.imag();
+            result.parameters[parameter]=parameter_of[k];
+            if (k==first_parameter)
+            {
+                break;
+            }
+        }
+        // Inverse gates come from the operation's own matrix, as adjoint()
+        // in DerivedGates.cpp does for single gates.
+        const Matrix inverse_matrix=operation.matrix ? operation.matrix->adjoint() : Matrix();
+        const Matrix* inverse=operation.matrix ? &inverse_matrix : nullptr;
+        apply_inverse(psi, operation, inverse);
+        apply_inverse(lambda, operation, inverse);
+    }
+    return result;
+}
+
+std::ostream& operator<<(std::ostream& os, const GradientResult& result)
+{
+    os<<"E = "<<result.expectation<<std::endl;
+    for (size_t i=0; i<result.parameters.size(); i++)
+    {
+        os<<result.parameters[i]->get_symbol()<<" on qubit "<<result.parameters[i]->get_index()
+            <<": dE = "<<result.gradients[i]<<std::endl;
+    }
+    return os;
+}
@@ -0,0 +1,433 @@
+#include "BitSlicedSimulator.h"
+#include "Parallel.h"
+#include <stdexcept>
+#include <string>
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    const double tolerance=1e-9;
+    // Blocks per thread before it is worth starting another one.
+    const size_t block_grain=16;
+
+    typedef BitSlicedInstruction::Kind Kind;
+
+    // Image of each value of the target bits, or false if a column of the
+    // matrix does not have exactly one non-zero entry.
+    bool build_mapping(const Matrix& matrix, std::vector<size_t>& mapping)
+    {
+        mapping.assign(matrix.get_cols(), 0);
+        for (size_t column=0; column<matrix.get_cols(); column++)
+        {
+            size_t nonzero=0;
+            for (size_t row=0; row<matrix.get_rows(); row++)
+            {
+                if (std::abs(matrix(row, column))>tolerance)
+                {
+                    mapping[column]=row;
+                    nonzero++;
+                }
+            }
+            if (nonzero!=1)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Recognises mappings that flip local bit t when the local bits in
+    // control_mask are all 1 (X, CNOT and Toffoli compiled into a multigate).
+    bool find_flip(const std::vector<size_t>& mapping, size_t& t, size_t& control_mask)
+    {
+        size_t k=0;
+        while ((size_t(1)<<k)<mapping.size())
+        {
+            k++;
+        }
+        for (t=0; t<k; t++)
+        {
+            size_t bit=size_t(1)<<t;
+            size_t common=(mapping.size()-1)&~bit;
+            bool any=false, valid=true;
+            for (size_t v=0; v<mapping.size()&&valid; v++)
+            {
+                size_t difference=mapping[v]^v;
+                valid=difference==0||difference==bit;
+                if (difference==bit)
+                {
+                    common&=v;
+                    any=true;
+                }
+            }
+            if (!valid||!any)
+            {
+                continue;
+            }
+            control_mask=common&~bit;
+            for (size_t v=0; v<mapping.size()&&valid; v++)
+            {
+                valid=((mapping[v]^v)==bit)==((v&control_mask)==control_mask);
+            }
+            if (valid)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Recognises mappings that exchange two local bits (swap()).
+    bool find_swap(const std::vector<size_t>& mapping, size_t k, size_t& a, size_t& b)
+    {
+        for (a=0; a<k; a++)
+        {
+            for (b=a+1; b<k; b++)
+            {
+                bool valid=true;
+                for (size_t v=0; v<mapping.size()&&valid; v++)
+                {
+                    size_t bit_a=(v>>a)&1, bit_b=(v>>b)&1;
+                    size_t swapped=(v&~((size_t(1)<<a)|(size_t(1)<<b)))|(bit_a<<b)|(bit_b<<a);
+                    valid=mapping[v]==swapped;
+                }
+                if (valid)
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Returns false for gates that leave every basis state in place (Z, S, T,
+    // controlled phases), which need no instruction.
+    bool lower(const Operation& operation, BitSlicedInstruction& instruction)
+    {
+        if (operation.type==OperationType::phase_oracle)
+        {
+            return false;
+        }
+        std::vector<size_t> mapping;
+        build_mapping(*operation.matrix, mapping);
+        bool identity=true;
+        for (size_t v=0; v<mapping.size(); v++)
+        {
+            identity=identity&&mapping[v]==v;
+        }
+        if (identity)
+        {
+            return false;
+        }
+        const std::vector<size_t>& targets=operation.targets;
+        instruction.controls=operation.controls;
+        size_t t, control_mask, a, b;
+        if (find_flip(mapping, t, control_mask))
+        {
+            instruction.kind=Kind::flip;
+            instruction.target=targets[t];
+            for (size_t r=0; r<targets.size(); r++)
+            {
+                if ((control_mask>>r)&1)
+                {
+                    instruction.controls.push_back(targets[r]);
+                }
+            }
+        }
+        else if (find_swap(mapping, targets.size(), a, b))
+        {
+            instruction.kind=Kind::swap;
+            instruction.target=targets[a];
+            instruction.other=targets[b];
+        }
+        else
+        {
+            instruction.kind=Kind::table;
+            instruction.targets=targets;
+            instruction.mapping=mapping;
+        }
+        return true;
+    }
+
+    template <size_t Words>
+    struct Block
+    {
+        uint64_t w[Words];
+    };
+
+    // In-place transpose of a 64x64 bit matrix held as 64 words (Hacker's
+    // Delight 7-3). Turns 64 qubit slices into 64 output indices.
+    void transpose_64(uint64_t* a)
+    {
+        uint64_t m=0x00000000FFFFFFFFull;
+        for (size_t j=32; j!=0; j>>=1, m^=m<<j)
+        {
+            for (size_t k=0; k<64; k=(k+j+1)&~j)
+            {
+                uint64_t t=(a[k]^(a[k+j]>>j))&m;
+                a[k]^=t;
+                a[k+j]^=t<<j;
+            }
+        }
+    }
+
+    template <size_t Words>
+    void run_instruction(const BitSlicedInstruction& instruction, Block<Words>* slices)
+    {
+        Block<Words> mask;
+        for (size_t w=0; w<Words; w++)
+        {
+            mask.w[w]=~uint64_t(0);
+        }
+        for (size_t control : instruction.controls)
+        {
+            for (size_t w=0; w<Words; w++)
+            {
+                mask.w[w]&=slices[control].w[w];
+            }
+        }
+        switch (instruction.kind)
+        {
+        case Kind::flip:
+        {
+            Block<Words>& target=slices[instruction.target];
+            for (size_t w=0; w<Words; w++)
+            {
+                target.w[w]^=mask.w[w];
+            }
+            break;
+        }
+        case Kind::swap:
+        {
+            Block<Words>& a=slices[instruction.target];
+            Block<Words>& b=slices[instruction.other];
+            for (size_t w=0; w<Words; w++)
+            {
+                uint64_t difference=(a.w[w]^b.w[w])&mask.w[w];
+                a.w[w]^=difference;
+                b.w[w]^=difference;
+            }
+            break;
+        }
+        case Kind::table:
+        {
+            // Sum of minterms: output bit r is the OR of the minterms of the
+            // input values whose image has bit r set.
+            const std::vector<size_t>& targets=instruction.targets;
+            std::vector<Block<Words>> outputs(targets.size());
+            for (Block<Words>& output : outputs)
+            {
+                for (size_t w=0; w<Words; w++)
+                {
+                    output.w[w]=0;
+                }
+            }
+            for (size_t v=0; v<instruction.mapping.size(); v++)
+            {
+                Block<Words> minterm=mask;
+                for (size_t r=0; r<targets.size(); r++)
+                {
+                    uint64_t flip=((v>>r)&1) ? 0 : ~uint64_t(0);
+                    for (size_t w=0; w<Words; w++)
+                    {
+                        minterm.w[w]&=slices[targets[r]].w[w]^flip;
+                    }
+                }
+                for (size_t r=0; r<targets.size(); r++)
+                {
+                    if ((instruction.mapping[v]>>r)&1)
+                    {
+                        for (size_t w=0; w<Words; w++)
+                        {
+                            outputs[r].w[w]|=minterm.w[w];
+                        }
+                    }
+                }
+            }
+            for (size_t r=0; r<targets.size(); r++)
+            {
+                Block<Words>& target=slices[targets[r]];
+                for (size_t w=0; w<Words; w++)
+                {
+                    target.w[w]=(target.w[w]&~mask.w[w])|outputs[r].w[w];
+                }
+            }
+            break;
+        }
+        }
+    }
+
+    template <size_t Words>
+    void run_blocks(const std::vector<BitSlicedInstruction>& instructions, size_t num_qubits,
+        size_t first_input, size_t count, size_t* outputs)
+    {
+        const size_t lanes=64*Words;
+        std::vector<Block<Words>> slices(num_qubits);
+        uint64_t transposed[64];
+        for (size_t block_start=0; block_start<count; block_start+=lanes)
+        {
+            // Load: word w of qubit q holds bit q of inputs base..base+63.
+            for (size_t w=0; w<Words; w++)
+            {
+                size_t base=first_input+block_start+64*w;
+                for (size_t i=0; i<64; i++)
+                {
+                    transposed[i]=base+i;
+                }
+                transpose_64(transposed);
+                for (size_t q=0; q<num_qubits; q++)
+                {
+                    slices[q].w[w]=transposed[63-q];
+                }
+            }
+            for (const BitSlicedInstruction& instruction : instructions)
+            {
+                run_instruction<Words>(instruction, slices.data());
+            }
+            // Store: transpose the slices back into one index per input.
+            for (size_t w=0; w<Words; w++)
+            {
+                for (size_t i=0; i<64; i++)
+                {
+                    transposed[i]=0;
+                }
+                for (size_t q=0; q<num_qubits; q++)
+                {
+                    transposed[63-q]=slices[q].w[w];
+                }
+                transpose_64(transposed);
+                size_t offset=block_start+64*w;
+                for (size_t i=0; i<64&&offset+i<count; i++)
+                {
+                    outputs[offset+i]=transposed[i];
+                }
+            }
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BitSlicedSimulator
+///////////////////////////////////////////////////////////////////////////////
+
+BitSlicedSimulator::BitSlicedSimulator(const std::vector<Operation>& operations,
+    size_t num_qubits_in, size_t lanes_in)
+    : num_qubits{ num_qubits_in }, lanes{ lanes_in }
+{
+    if (lanes!=64&&lanes!=256&&lanes!=512)
+    {
+        throw std::invalid_argument("Bit-sliced simulator supports 64, 256 or 512 lanes, not "+std::to_string(lanes));
+    }
+    if (num_qubits>63)
+    {
+        throw std::invalid_argument("Bit-sliced simulator supports at most 63 qubits");
+    }
+    for (const Operation& operation : operations)
+    {
+        if (!is_permutation(operation))
+        {
+            throw std::invalid_argument("Operation does not permute basis states, so it cannot be bit-sliced");
+        }
+        BitSlicedInstruction instruction;
+        if (lower(operation, instruction))
+        {
+            instructions.push_back(std::move(instruction));
+        }
+    }
+}
+
+// Accessors
+///////////////////////////////////////////////////////////////////////////////
+
+size_t BitSlicedSimulator::get_num_qubits() const
+{
+    return num_qubits;
+}
+
+size_t BitSlicedSimulator::get_lanes() const
+{
+    return lanes;
+}
+
+const std::vector<BitSlicedInstruction>& BitSlicedSimulator::get_instructions() const
+{
+    return instructions;
+}
+
+size_t BitSlicedSimulator::evaluate(size_t input) const
+{
+    size_t output;
+    evaluate(input, 1, &output);
+    return output;
+}
+
+void BitSlicedSimulator::evaluate(size_t first_input, size_t count, size_t* outputs) const
+{
+    if (count==0)
+    {
+        return;
+    }
+    if (first_input+count>(size_t(1)<<num_qubits))
+    {
+        throw std::out_of_range("Input range is outside the "+std::to_string(num_qubits)+" qubit basis");
+    }
+    size_t blocks=(count+lanes-1)/lanes;
+    parallel_for(0, blocks, block_grain, [&](size_t begin, size_t end)
+    {
+        size_t start=begin*lanes;
+        size_t length=std::min(count, end*lanes)-start;
+        switch (lanes)
+        {
+        case 64:
+            run_blocks<1>(instructions, num_qubits, first_input+start, length, outputs+start);
+            break;
+        case 256:
+            run_blocks<4>(instructions, num_qubits, first_input+start, length, outputs+start);
+            break;
+        default:
+            run_blocks<8>(instructions, num_qubits, first_input+start, length, outputs+start);
+            break;
+        }
+    });
+}
+
+std::vector<size_t> BitSlicedSimulator::get_truth_table() const
+{
+    std::vector<size_t> outputs(size_t(1)<<num_qubits);
+    evaluate(0, outputs.size(), outputs.data());
+    return outputs;
+}
+
+// Static functions
+///////////////////////////////////////////////////////////////////////////////
+
+bool BitSlicedSimulator::is_permutation(const Operation& operation)
+{
+    if (operation.type==OperationType::phase_oracle)
+    {
+        return true;
+    }
+    if (operation.type!=OperationType::matrix&&operation.type!=OperationType::controlled)
+    {
+        return false;
+    }
+    std::vector<size_t> mapping;
+    return build_mapping(*operation.matrix, mapping);
+}
+
+bool BitSlicedSimulator::is_permutation(const std::vector<Operation>& operations)
+{
+    for (const Operation& operation : operations)
+    {
+        if (!is_permutation(operation))
+        {
+            return false;
+        }
+    }
+    return true;
+}
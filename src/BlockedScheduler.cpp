@@ -0,0 +1,533 @@
+#include "BlockedScheduler.h"
+#include "GateKernels.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include "QuantumComponent.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+typedef std::complex<double> complex;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    std::atomic<size_t> configured_tile_qubits{ 0 };
+    std::once_flag tile_flag;
+
+    // Amplitudes per thread for the reordering pass.
+    const size_t parallel_grain=1<<14;
+
+    // Operations looked ahead when choosing which low qubits to give up.
+    const size_t victim_lookahead=256;
+
+    const size_t min_tile_qubits=4;
+    const size_t max_tile_qubits=24;
+
+    size_t read_tile_setting()
+    {
+        const char* setting=std::getenv("QC_TILE_QUBITS");
+        if (setting!=nullptr)
+        {
+            size_t tile_qubits=std::strtoul(setting, nullptr, 10);
+            if (tile_qubits>0)
+            {
+                return tile_qubits;
+            }
+        }
+        // Half of L2 leaves room for the kernels' other data and for the
+        // hardware prefetcher running ahead into the next tile.
+        long l2_bytes=-1;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+        l2_bytes=sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+        if (l2_bytes<=0)
+        {
+            l2_bytes=256*1024;
+        }
+        size_t tile_qubits=0;
+        while ((sizeof(complex)<<(tile_qubits+1))<=size_t(l2_bytes)/2)
+        {
+            tile_qubits++;
+        }
+        return std::min(std::max(tile_qubits, min_tile_qubits), max_tile_qubits);
+    }
+
+    size_t insert_zero_bits(size_t index, const std::vector<size_t>& sorted_positions)
+    {
+        for (size_t position : sorted_positions)
+        {
+            size_t low=index&((size_t(1)<<position)-1);
+            index=((index>>position)<<(position+1))|low;
+        }
+        return index;
+    }
+
+    const Matrix& swap_matrix()
+    {
+        static const Matrix matrix=swap_gate.to_matrix();
+        return matrix;
+    }
+
+    bool is_qft(const Operation& operation)
+    {
+        return operation.type==OperationType::qft||operation.type==OperationType::inverse_qft;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Non-member functions
+///////////////////////////////////////////////////////////////////////////////
+
+size_t get_tile_qubits()
+{
+    std::call_once(tile_flag, []()
+        {
+            size_t expected=0;
+            configured_tile_qubits.compare_exchange_strong(expected, read_tile_setting());
+        });
+    return configured_tile_qubits.load();
+}
+
+void set_tile_qubits(size_t tile_qubits)
+{
+    if (tile_qubits==0)
+    {
+        throw std::invalid_argument("Tiles need at least one qubit");
+    }
+    std::call_once(tile_flag, []() {});
+    configured_tile_qubits=tile_qubits;
+}
+
+void apply_operations(StateVector& state, const std::vector<Operation>& operations)
+{
+    if (state.get_num_qubits()<=get_tile_qubits())
+    {
+        for (const Operation& operation : operations)
+        {
+            state.apply_operation(operation);
+        }
+        return;
+    }
+    BlockedScheduler(operations, state.get_num_qubits()).apply(state);
+}
+
+std::ostream& operator<<(std::ostream& os, const ScheduleStats& stats)
+{
+    size_t passes=stats.tiled_passes+stats.reorder_passes+stats.direct_passes;
+    os<<stats.operations<<" operations in "<<passes<<" passes over the state ("
+        <<stats.tiled_passes<<" tiled of 2^"<<stats.tile_qubits<<" amplitudes holding "
+        <<stats.tiled_operations<<" operations, "<<stats.reorder_passes<<" reorderings, "
+        <<stats.direct_passes<<" direct)";
+    return os;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BlockedScheduler
+///////////////////////////////////////////////////////////////////////////////
+
+BlockedScheduler::BlockedScheduler(const std::vector<Operation>& operations, size_t n, size_t tile_qubits_in)
+    : num_qubits{ n }, tile_qubits{ std::min(tile_qubits_in, n) }
+{
+    if (tile_qubits_in==0)
+    {
+        throw std::invalid_argument("Tiles need at least one qubit");
+    }
+    for (size_t i=0; i<num_qubits; i++)
+    {
+        physical_of.push_back(i);
+        logical_of.push_back(i);
+    }
+    stats.operations=operations.size();
+    stats.tile_qubits=tile_qubits;
+    for (size_t i=0; i<operations.size(); i++)
+    {
+        for (size_t qubit : operations[i].targets)
+        {
+            if (qubit>=num_qubits)
+            {
+                throw std::out_of_range("Qubit "+std::to_string(qubit)+" out of range for BlockedScheduler of "+std::to_string(num_qubits)+" qubits");
+            }
+        }
+        for (size_t qubit : operations[i].controls)
+        {
+            if (qubit>=num_qubits)
+            {
+                throw std::out_of_range("Qubit "+std::to_string(qubit)+" out of range for BlockedScheduler of "+std::to_string(num_qubits)+" qubits");
+            }
+        }
+        schedule(operations, i);
+    }
+    restore_order();
+    flush_group();
+}
+
+void BlockedScheduler::flush_group()
+{
+    if (open_group.empty())
+    {
+        return;
+    }
+    Pass pass;
+    pass.type=PassType::tiled;
+    pass.group.swap(open_group);
+    passes.push_back(std::move(pass));
+    stats.tiled_passes++;
+}
+
+void BlockedScheduler::swap_low(size_t position_1, size_t position_2)
+{
+    TiledOperation swap;
+    swap.operation.targets={ std::min(position_1, position_2), std::max(position_1, position_2) };
+    swap.operation.matrix=&swap_matrix();
+    open_group.push_back(swap);
+    size_t logical_1=logical_of[position_1];
+    size_t logical_2=logical_of[position_2];
+    std::swap(logical_of[position_1], logical_of[position_2]);
+    physical_of[logical_1]=position_2;
+    physical_of[logical_2]=position_1;
+}
+
+void BlockedScheduler::reorder(const std::vector<size_t>& low_positions, const std::vector<size_t>& high_positions)
+{
+    // The pairs move data between tiles, so the open group has to be
+    // finished on the old order first.
+    flush_group();
+    Pass pass;
+    pass.type=PassType::reorder;
+    pass.low_positions=low_positions;
+    pass.high_positions=high_positions;
+    passes.push_back(std::move(pass));
+    stats.reorder_passes++;
+    for (size_t i=0; i<low_positions.size(); i++)
+    {
+        size_t logical_low=logical_of[low_positions[i]];
+        size_t logical_high=logical_of[high_positions[i]];
+        std::swap(logical_of[low_positions[i]], logical_of[high_positions[i]]);
+        physical_of[logical_low]=high_positions[i];
+        physical_of[logical_high]=low_positions[i];
+    }
+}
+
+void BlockedScheduler::make_low(const std::vector<Operation>& operations, size_t index)
+{
+    // Grow a window of upcoming operations while their targets fit in a
+    // tile, then bring all of its high targets down in one pass.
+    bool all_low=true;
+    for (size_t target : operations[index].targets)
+    {
+        all_low=all_low&&physical_of[target]<tile_qubits;
+    }
+    if (all_low)
+    {
+        return;
+    }
+    std::vector<bool> in_window(num_qubits, false);
+    size_t window_qubits=0;
+    size_t end=index;
+    for (; end<operations.size(); end++)
+    {
+        size_t added=0;
+        for (size_t target : operations[end].targets)
+        {
+            added+=in_window[target] ? 0 : 1;
+        }
+        if (window_qubits+added>tile_qubits)
+        {
+            break;
+        }
+        for (size_t target : operations[end].targets)
+        {
+            window_qubits+=in_window[target] ? 0 : 1;
+            in_window[target]=true;
+        }
+    }
+    std::vector<size_t> needed;
+    for (size_t qubit=0; qubit<num_qubits; qubit++)
+    {
+        if (in_window[qubit]&&physical_of[qubit]>=tile_qubits)
+        {
+            needed.push_back(qubit);
+        }
+    }
+    // Victims are the low qubits outside the window targeted again
+    // furthest in the future (or never within the lookahead).
+    std::vector<size_t> next_use(num_qubits, victim_lookahead+1);
+    size_t lookahead_end=std::min(operations.size(), end+victim_lookahead);
+    for (size_t j=lookahead_end; j-->end;)
+    {
+        for (size_t target : operations[j].targets)
+        {
+            next_use[target]=j-end;
+        }
+    }
+    // Ties go to the highest bits, which keeps the runs that the
+    // reordering pass moves long.
+    std::vector<size_t> victims;
+    for (size_t position=tile_qubits; position-->0;)
+    {
+        if (!in_window[logical_of[position]])
+        {
+            victims.push_back(position);
+        }
+    }
+    std::stable_sort(victims.begin(), victims.end(), [&](size_t a, size_t b)
+        {
+            return next_use[logical_of[a]]>next_use[logical_of[b]];
+        });
+    std::vector<size_t> low_positions, high_positions;
+    for (size_t i=0; i<needed.size(); i++)
+    {
+        low_positions.push_back(victims[i]);
+        high_positions.push_back(physical_of[needed[i]]);
+    }
+    reorder(low_positions, high_positions);
+}
+
+void BlockedScheduler::schedule(const std::vector<Operation>& operations, size_t index)
+{
+    const Operation& operation=operations[index];
+    const size_t width=operation.targets.size();
+    if (width>tile_qubits||operation.type==OperationType::phase_oracle)
+    {
+        // Too wide for a tile (or a phase oracle, which is diagonal and reads
+        // its targets from any bit positions): run it on the whole state. The
+        // QFT kernel needs the range on consecutive bits, which the identity
+        // order has.
+        if (is_qft(operation))
+        {
+            restore_order();
+        }
+        flush_group();
+        Pass pass;
+        pass.type=PassType::direct;
+        pass.operation=operation;
+        for (size_t& target : pass.operation.targets)
+        {
+            target=physical_of[target];
+        }
+        for (size_t& control : pass.operation.controls)
+        {
+            control=physical_of[control];
+        }
+        passes.push_back(std::move(pass));
+        stats.direct_passes++;
+        return;
+    }
+    make_low(operations, index);
+    if (is_qft(operation))
+    {
+        // Place target i on bit first+i, keeping the range where it is when
+        // it fits there.
+        size_t first=physical_of[operation.targets[0]];
+        if (first+width>tile_qubits)
+        {
+            first=tile_qubits-width;
+        }
+        for (size_t i=0; i<width; i++)
+        {
+            if (physical_of[operation.targets[i]]!=first+i)
+            {
+                swap_low(first+i, physical_of[operation.targets[i]]);
+            }
+        }
+    }
+    TiledOperation tiled;
+    tiled.operation=operation;
+    tiled.operation.controls.clear();
+    for (size_t& target : tiled.operation.targets)
+    {
+        target=physical_of[target];
+    }
+    for (size_t control : operation.controls)
+    {
+        size_t position=physical_of[control];
+        if (position<tile_qubits)
+        {
+            tiled.operation.controls.push_back(position);
+        }
+        else
+        {
+            tiled.high_control_mask|=size_t(1)<<(position-tile_qubits);
+        }
+    }
+    open_group.push_back(tiled);
+    stats.tiled_operations++;
+}
+
+void BlockedScheduler::restore_order()
+{
+    // Every pass puts at least one high qubit back without disturbing
+    // those already in place; the low qubits are then sorted by swaps
+    // inside the last group.
+    while (true)
+    {
+        std::vector<bool> used(num_qubits, false);
+        std::vector<size_t> low_positions, high_positions;
+        for (size_t position=tile_qubits; position<num_qubits; position++)
+        {
+            size_t source=physical_of[position];
+            if (logical_of[position]!=position&&!used[position]&&!used[source])
+            {
+                used[position]=used[source]=true;
+                low_positions.push_back(std::min(position, source));
+                high_positions.push_back(std::max(position, source));
+            }
+        }
+        if (low_positions.empty())
+        {
+            break;
+        }
+        reorder(low_positions, high_positions);
+    }
+    for (size_t position=0; position<tile_qubits; position++)
+    {
+        if (logical_of[position]!=position)
+        {
+            swap_low(position, physical_of[position]);
+        }
+    }
+}
+
+void BlockedScheduler::apply_tiled(std::complex<double>* amplitudes, const Pass& pass) const
+{
+    const size_t tiles=size_t(1)<<(num_qubits-tile_qubits);
+    auto run_tiles=[&](size_t begin, size_t end)
+    {
+        for (size_t tile=begin; tile<end; tile++)
+        {
+            complex* data=amplitudes+(tile<<tile_qubits);
+            for (const TiledOperation& tiled : pass.group)
+            {
+                if ((tile&tiled.high_control_mask)==tiled.high_control_mask)
+                {
+                    ::apply_operation(data, tile_qubits, tiled.operation);
+                }
+            }
+        }
+    };
+    if (tiles>=get_thread_count())
+    {
+        parallel_for(0, tiles, 1, run_tiles);
+    }
+    else
+    {
+        // Too few tiles to go round, so the kernels split each tile instead.
+        run_tiles(0, tiles);
+    }
+}
+
+void BlockedScheduler::apply_reorder(std::complex<double>* amplitudes, const Pass& pass) const
+{
+    // With the k pairs of bits split into a low value v and a high value w,
+    // the pass exchanges (v, w) with (w, v): a transpose of 2^k x 2^k runs
+    // for every value of the remaining bits. Runs are contiguous below the
+    // lowest bit involved.
+    const size_t pairs=pass.low_positions.size();
+    std::vector<size_t> sorted(pass.low_positions);
+    sorted.insert(sorted.end(), pass.high_positions.begin(), pass.high_positions.end());
+    std::sort(sorted.begin(), sorted.end());
+    const size_t run=size_t(1)<<sorted[0];
+    const size_t values=size_t(1)<<pairs;
+    std::vector<size_t> low_spread(values, 0), high_spread(values, 0);
+    for (size_t value=0; value<values; value++)
+    {
+        for (size_t i=0; i<pairs; i++)
+        {
+            if ((value>>i)&1)
+            {
+                low_spread[value]|=size_t(1)<<pass.low_positions[i];
+                high_spread[value]|=size_t(1)<<pass.high_positions[i];
+            }
+        }
+    }
+    const size_t outer=(size_t(1)<<num_qubits)>>(2*pairs+sorted[0]);
+    parallel_for(0, outer, std::max<size_t>(1, parallel_grain>>(2*pairs+sorted[0])), [&](size_t begin, size_t end)
+        {
+            for (size_t index=begin; index<end; index++)
+            {
+                size_t base=insert_zero_bits(index<<sorted[0], sorted);
+                for (size_t v=0; v<values; v++)
+                {
+                    for (size_t w=v+1; w<values; w++)
+                    {
+                        complex* a=amplitudes+(base|low_spread[v]|high_spread[w]);
+                        complex* b=amplitudes+(base|low_spread[w]|high_spread[v]);
+                        std::swap_ranges(a, a+run, b);
+                    }
+                }
+            }
+        });
+}
+
+// Accessors
+///////////////////////////////////////////////////////////////////////////////
+
+size_t BlockedScheduler::get_num_qubits() const
+{
+    return num_qubits;
+}
+
+size_t BlockedScheduler::get_tile_qubits() const
+{
+    return tile_qubits;
+}
+
+ScheduleStats BlockedScheduler::get_stats() const
+{
+    return stats;
+}
+
+// Mutators
+///////////////////////////////////////////////////////////////////////////////
+
+void BlockedScheduler::apply(StateVector& state) const
+{
+    if (state.get_num_qubits()!=num_qubits)
+    {
+        throw std::invalid_argument("State size does not match BlockedScheduler's register size!");
+    }
+    apply(state.get_data());
+}
+
+void BlockedScheduler::apply(std::complex<double>* amplitudes) const
+{
+    for (const Pass& pass : passes)
+    {
+        switch (pass.type)
+        {
+        case PassType::tiled:
+        {
+            QC_PROFILE_SCOPE("tile group", "scheduler", ProfileEvent::none, ProfileEvent::none,
+                size_t(1)<<num_qubits, 1, 0.0, double(sizeof(complex)<<(num_qubits+1)));
+            apply_tiled(amplitudes, pass);
+            break;
+        }
+        case PassType::reorder:
+        {
+            QC_PROFILE_SCOPE("reorder", "scheduler", ProfileEvent::none, pass.high_positions[0],
+                size_t(1)<<num_qubits, 1, 0.0, double(sizeof(complex)<<(num_qubits+1)));
+            apply_reorder(amplitudes, pass);
+            break;
+        }
+        case PassType::direct:
+        {
+            QC_PROFILE_SCOPE(pass.operation.component!=nullptr ? pass.operation.component->get_symbol() : "operation",
+                "scheduler", pass.operation.step_index, pass.operation.targets[0],
+                size_t(1)<<num_qubits, 1, 0.0, double(sizeof(complex)<<(num_qubits+1)));
+            ::apply_operation(amplitudes, num_qubits, pass.operation);
+            break;
+        }
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#include "CircuitGate.h"
+#include "GateCache.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CircuitGate
+///////////////////////////////////////////////////////////////////////////////
+
+CircuitGate::CircuitGate(const QuantumCircuit& circuit_in, size_t n, std::string symbol_in)
+{
+    qubit_index=n;
+    symbol=symbol_in;
+    gate_size=circuit_in.get_register_size();
+    matrix=Matrix();
+    circuit=std::make_shared<const QuantumCircuit>(circuit_in);
+}
+
+CircuitGate::CircuitGate(std::shared_ptr<const QuantumCircuit> circuit_in, size_t n, std::string symbol_in, std::string cache_key_in)
+    : circuit{ circuit_in }, cache_key{ cache_key_in }
+{
+    qubit_index=n;
+    symbol=symbol_in;
+    gate_size=circuit->get_register_size();
+    matrix=Matrix();
+}
+
+const Matrix& CircuitGate::get_compiled_matrix() const
+{
+    // Gates without a factory key are addressed by the content of their
+    // circuit, which is only hashed when the matrix is first needed.
+    std::call_once(compile_flag, [this]()
+        {
+            if (cache_key.empty())
+            {
+                cache_key=get_circuit_key(*circuit);
+            }
+            compiled_matrix=GateCache::instance().get_matrix(cache_key, *circuit);
+        });
+    return *compiled_matrix;
+}
+
+const QuantumCircuit& CircuitGate::get_circuit() const
+{
+    return *circuit;
+}
+
+const Matrix& CircuitGate::get_matrix() const
+{
+    return get_compiled_matrix();
+}
+
+void CircuitGate::append_operations(std::vector<Operation>& operations, size_t qubit_offset, bool decompose_subcircuits) const
+{
+    if (!decompose_subcircuits)
+    {
+        Operation operation;
+        operation.type=OperationType::matrix;
+        for (size_t i=0; i<gate_size; i++)
+        {
+            operation.targets.push_back(get_index()+qubit_offset+i);
+        }
+        operation.matrix=&get_compiled_matrix();
+        operation.component=this;
+        operations.push_back(operation);
+        return;
+    }
+    circuit->append_operations(operations, get_index()+qubit_offset, true);
+}
@@ -0,0 +1,268 @@
+#include "CircuitOptimiser.h"
+#include "PhaseOracle.h"
+#include "QFTGate.h"
+#include <algorithm>
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // Dense matrices are only compared for gates up to this many registers.
+    const size_t max_compared_gate_size=4;
+    const double tolerance=1e-10;
+
+    struct GateEntry
+    {
+        std::shared_ptr<QuantumComponent> gate;
+        size_t register_index;
+        size_t step_index;
+        std::vector<size_t> qubits;
+        bool diagonal;
+        bool removed;
+    };
+
+    bool is_diagonal_matrix(const Matrix& m)
+    {
+        for (size_t i=0; i<m.get_rows(); i++)
+        {
+            for (size_t j=0; j<m.get_cols(); j++)
+            {
+                if (i!=j&&std::abs(m(i, j))>tolerance)
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool is_identity_product(const Matrix& second, const Matrix& first)
+    {
+        Matrix product=second*first;
+        for (size_t i=0; i<product.get_rows(); i++)
+        {
+            for (size_t j=0; j<product.get_cols(); j++)
+            {
+                if (std::abs(product(i, j)-(i==j ? 1.0 : 0.0))>tolerance)
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    GateEntry make_entry(const std::shared_ptr<QuantumComponent>& gate, size_t register_index, size_t step_index)
+    {
+        GateEntry entry{ gate, register_index, step_index, {}, false, false };
+        if (auto controlled=std::dynamic_pointer_cast<ControlledGate>(gate))
+        {
+            entry.qubits={ controlled->get_control_index(), controlled->get_target_index() };
+            entry.diagonal=is_diagonal_matrix(controlled->get_target_matrix());
+        }
+        else if (auto oracle=std::dynamic_pointer_cast<PhaseOracle>(gate))
+        {
+            // Registers between the selected qubits are left alone.
+            entry.qubits=oracle->get_qubits();
+            entry.diagonal=true;
+        }
+        else if (gate->get_gate_type()=="MultiGate")
+        {
+            auto multi=std::dynamic_pointer_cast<MultiGate>(gate);
+            for (size_t i=0; i<multi->get_gate_size(); i++)
+            {
+                entry.qubits.push_back(gate->get_index()+i);
+            }
+            entry.diagonal=!std::dynamic_pointer_cast<QFTGate>(gate)&&
+                multi->get_gate_size()<=max_compared_gate_size&&is_diagonal_matrix(gate->get_matrix());
+        }
+        else
+        {
+            entry.qubits={ gate->get_index() };
+            entry.diagonal=is_diagonal_matrix(gate->get_matrix());
+        }
+        std::sort(entry.qubits.begin(), entry.qubits.end());
+        return entry;
+    }
+
+    bool are_inverses(const GateEntry& first, const GateEntry& second)
+    {
+        if (first.qubits!=second.qubits)
+        {
+            return false;
+        }
+        auto controlled_1=std::dynamic_pointer_cast<ControlledGate>(first.gate);
+        auto controlled_2=std::dynamic_pointer_cast<ControlledGate>(second.gate);
+        if (controlled_1||controlled_2)
+        {
+            return controlled_1&&controlled_2&&
+                controlled_1->get_control_index()==controlled_2->get_control_index()&&
+                is_identity_product(controlled_2->get_target_matrix(), controlled_1->get_target_matrix());
+        }
+        auto qft_1=std::dynamic_pointer_cast<QFTGate>(first.gate);
+        auto qft_2=std::dynamic_pointer_cast<QFTGate>(second.gate);
+        if (qft_1||qft_2)
+        {
+            return qft_1&&qft_2&&qft_1->is_inverse()!=qft_2->is_inverse();
+        }
+        auto oracle_1=std::dynamic_pointer_cast<PhaseOracle>(first.gate);
+        auto oracle_2=std::dynamic_pointer_cast<PhaseOracle>(second.gate);
+        if (oracle_1||oracle_2)
+        {
+            // Every phase oracle is its own inverse.
+            return oracle_1&&oracle_2&&oracle_1->get_qubits()==oracle_2->get_qubits()&&
+                oracle_1->get_marked()==oracle_2->get_marked();
+        }
+        if (first.gate->get_gate_type()!=second.gate->get_gate_type()||first.qubits.size()>max_compared_gate_size)
+        {
+            return false;
+        }
+        return is_identity_product(second.gate->get_matrix(), first.gate->get_matrix());
+    }
+
+    bool commute(const GateEntry& a, const GateEntry& b)
+    {
+        if (a.diagonal&&b.diagonal)
+        {
+            return true;
+        }
+        for (size_t q : a.qubits)
+        {
+            if (std::binary_search(b.qubits.begin(), b.qubits.end(), q))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t run_pass(QuantumCircuit& circuit)
+    {
+        // Gate entries in circuit order, plus for every register the
+        // positions of the entries that touch it.
+        std::vector<GateEntry> entries;
+        size_t register_size=circuit.get_register_size();
+        for (size_t step=0; step<circuit.get_total_steps()+1; step++)
+        {
+            for (size_t i=0; i<register_size; i++)
+            {
+                std::shared_ptr<QuantumComponent> gate=circuit.get_component(i, step);
+                if (gate->get_symbol()!="I")
+                {
+                    entries.push_back(make_entry(gate, i, step));
+                }
+            }
+        }
+        std::vector<std::vector<size_t>> by_register(register_size);
+        std::vector<std::vector<size_t>> position_in_register(entries.size());
+        for (size_t e=0; e<entries.size(); e++)
+        {
+            for (size_t q : entries[e].qubits)
+            {
+                position_in_register[e].push_back(by_register[q].size());
+                by_register[q].push_back(e);
+            }
+        }
+        size_t cancelled=0;
+        for (size_t a=0; a<entries.size(); a++)
+        {
+            if (entries[a].removed)
+            {
+                continue;
+            }
+            // Walk forward along the first register of the gate. Every gate met
+            // there must either cancel it or commute with it.
+            const std::vector<size_t>& lane=by_register[entries[a].qubits[0]];
+            for (size_t k=position_in_register[a][0]+1; k<lane.size(); k++)
+            {
+                size_t c=lane[k];
+                if (entries[c].removed)
+                {
+                    continue;
+                }
+                if (are_inverses(entries[a], entries[c]))
+                {
+                    // The other registers must also be clear between a and c.
+                    bool clear=true;
+                    for (size_t r=1; r<entries[a].qubits.size()&&clear; r++)
+                    {
+                        const std::vector<size_t>& other=by_register[entries[a].qubits[r]];
+                        for (size_t m=position_in_register[a][r]+1; m<other.size()&&other[m]!=c; m++)
+                        {
+                            if (!entries[other[m]].removed&&!commute(entries[a], entries[other[m]]))
+                            {
+                                clear=false;
+                                break;
+                            }
+                        }
+                    }
+                    if (clear)
+                    {
+                        entries[a].removed=true;
+                        entries[c].removed=true;
+                        cancelled++;
+                        break;
+                    }
+                }
+                if (!commute(entries[a], entries[c]))
+                {
+                    break;
+                }
+            }
+        }
+        for (const GateEntry& entry : entries)
+        {
+            if (entry.removed)
+            {
+                circuit.replace_component(std::make_shared<IGate>(entry.register_index),
+                    entry.register_index, entry.step_index);
+            }
+        }
+        return cancelled;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Non-member functions
+///////////////////////////////////////////////////////////////////////////////
+
+OptimisationReport optimise_circuit(QuantumCircuit& circuit)
+{
+    OptimisationReport report;
+    report.gates_before=circuit.get_gate_count();
+    report.steps_before=circuit.get_total_steps()+1;
+    while (true)
+    {
+        size_t cancelled=run_pass(circuit);
+        report.passes++;
+        report.cancelled_pairs+=cancelled;
+        if (cancelled==0)
+        {
+            break;
+        }
+    }
+    for (size_t step=circuit.get_total_steps()+1; step-->0;)
+    {
+        if (step<=circuit.get_total_steps()&&circuit.is_step_empty(step)&&circuit.get_total_steps()>0)
+        {
+            circuit.remove_step(step);
+        }
+    }
+    report.gates_after=circuit.get_gate_count();
+    report.steps_after=circuit.get_total_steps()+1;
+    return report;
+}
+
+std::ostream& operator<<(std::ostream& os, const OptimisationReport& report)
+{
+    double reduction=report.gates_before==0 ? 0 :
+        100.0*(double(report.gates_before)-double(report.gates_after))/double(report.gates_before);
+    os<<"gates: "<<report.gates_before<<" -> "<<report.gates_after
+        <<" (-"<<reduction<<"%), steps: "<<report.steps_before<<" -> "<<report.steps_after
+        <<", cancelled pairs: "<<report.cancelled_pairs<<", passes: "<<report.passes;
+    return os;
+}
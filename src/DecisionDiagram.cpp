@@ -0,0 +1,1022 @@
+#include "DecisionDiagram.h"
+#include "Profiler.h"
+#include "QuantumCircuit.h"
+#include "ResourceEstimator.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+
+typedef std::complex<double> complex;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // Slots in each direct-mapped compute table.
+    const size_t compute_table_size=size_t(1)<<16;
+
+    // Live nodes before the first garbage collection.
+    const size_t initial_collection_threshold=size_t(1)<<16;
+
+    // Basis indices are size_t, as in SparseStateVector.
+    const size_t max_diagram_qubits=63;
+
+    inline size_t hash_pointers(const void* a, const void* b, const void* c=nullptr, const void* d=nullptr)
+    {
+        size_t hash=reinterpret_cast<size_t>(a)*0x9E3779B97F4A7C15ull;
+        hash^=(reinterpret_cast<size_t>(b)+0x632BE59BD9B4E019ull+(hash<<6)+(hash>>2));
+        hash^=(reinterpret_cast<size_t>(c)+0x8CB92BA72F3D8DD7ull+(hash<<6)+(hash>>2));
+        hash^=(reinterpret_cast<size_t>(d)+0x9E3779B97F4A7C15ull+(hash<<6)+(hash>>2));
+        return hash^(hash>>29);
+    }
+
+    // Complex table cells are weight_grid wide, so a value has to be
+    // compared with a neighbouring cell only when it is within tolerance of
+    // that side.
+    const double weight_grid=4*DecisionDiagramPackage::tolerance;
+
+    inline double grid_position(double value)
+    {
+        return std::max(-1e18, std::min(1e18, value/weight_grid));
+    }
+
+    inline bool is_negligible(const complex& value)
+    {
+        return std::abs(value.real())<=DecisionDiagramPackage::tolerance&&std::abs(value.imag())<=DecisionDiagramPackage::tolerance;
+    }
+
+
+    inline unsigned long long weight_key(long long re, long long im)
+    {
+        return static_cast<unsigned long long>(re)*0x9E3779B97F4A7C15ull^static_cast<unsigned long long>(im);
+    }
+
+    void fill_amplitudes(const DDEdge& edge, complex weight, size_t offset, complex* data)
+    {
+        weight*=edge.weight->value;
+        if (weight==0.0)
+        {
+            return;
+        }
+        if (edge.node->level<0)
+        {
+            data[offset]=weight;
+            return;
+        }
+        const size_t stride=size_t(1)<<edge.node->level;
+        fill_amplitudes(edge.node->children[0], weight, offset, data);
+        fill_amplitudes(edge.node->children[1], weight, offset+stride, data);
+    }
+
+    void check_budget(size_t num_qubits)
+    {
+        double bytes=DecisionDiagramPackage::instance().get_memory_bytes();
+        if (bytes>MemoryBudget::instance().get_limit())
+        {
+            throw std::length_error("Decision diagram on "+std::to_string(num_qubits)+" qubits needs "+
+                format_byte_count(bytes)+", over the memory budget of "+
+                format_byte_count(MemoryBudget::instance().get_limit()));
+        }
+    }
+
+    void check_qubits(const Operation& operation, size_t num_qubits)
+    {
+        for (size_t qubit : operation.targets)
+        {
+            if (qubit>=num_qubits)
+            {
+                throw std::out_of_range("Qubit "+std::to_string(qubit)+" out of range for decision diagram of "+std::to_string(num_qubits)+" qubits");
+            }
+        }
+        for (size_t qubit : operation.controls)
+        {
+            if (qubit>=num_qubits)
+            {
+                throw std::out_of_range("Qubit "+std::to_string(qubit)+" out of range for decision diagram of "+std::to_string(num_qubits)+" qubits");
+            }
+        }
+    }
+
+    bool overlaps_match(complex overlap, double norm_a, double norm_b, bool up_to_global_phase, double tolerance)
+    {
+        double scale=std::sqrt(norm_a*norm_b);
+        if (std::abs(norm_a-norm_b)>tolerance*std::max(norm_a, norm_b))
+        {
+            return false;
+        }
+        if (up_to_global_phase)
+        {
+            return std::abs(overlap)>=scale*(1-tolerance);
+        }
+        return std::abs(overlap-scale)<=scale*tolerance;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// DecisionDiagramPackage
+///////////////////////////////////////////////////////////////////////////////
+
+const double DecisionDiagramPackage::tolerance=1e-13;
+
+DecisionDiagramPackage::DecisionDiagramPackage() :
+    add_table(compute_table_size), multiply_table(compute_table_size),
+    inner_product_table(compute_table_size), collection_threshold{ initial_collection_threshold }
+{
+    zero_weight.value=0;
+    one_weight.value=1;
+}
+
+DecisionDiagramPackage& DecisionDiagramPackage::instance()
+{
+    static DecisionDiagramPackage package;
+    return package;
+}
+
+size_t DecisionDiagramPackage::NodeHash::operator()(const DDNode* node) const
+{
+    size_t hash=hash_pointers(node->children[0].node, node->children[0].weight,
+        node->children[1].node, node->children[1].weight);
+    if (node->matrix)
+    {
+        hash^=hash_pointers(node->children[2].node, node->children[2].weight,
+            node->children[3].node, node->children[3].weight)*31;
+    }
+    return hash^size_t(node->level);
+}
+
+bool DecisionDiagramPackage::NodeEqual::operator()(const DDNode* a, const DDNode* b) const
+{
+    return a->level==b->level&&a->matrix==b->matrix&&a->children==b->children;
+}
+
+DDEdge DecisionDiagramPackage::to_edge(const RawEdge& edge)
+{
+    DDWeight* weight=lookup_weight(edge.weight);
+    return weight==&zero_weight ? get_zero_edge() : DDEdge{ edge.node, weight };
+}
+
+DecisionDiagramPackage::RawEdge DecisionDiagramPackage::normalise(int level, bool matrix, const std::array<RawEdge, 4>& children)
+{
+    // Divide through by the largest child weight (the first, among equals)
+    // so that equal sub-diagrams normalise to the same node.
+    const size_t count=matrix ? 4 : 2;
+    double largest=0;
+    for (size_t i=0; i<count; i++)
+    {
+        if (!is_negligible(children[i].weight))
+        {
+            largest=std::max(largest, std::norm(children[i].weight));
+        }
+    }
+    if (largest==0)
+    {
+        return RawEdge{ &terminal, 0.0 };
+    }
+    size_t pivot=0;
+    while (is_negligible(children[pivot].weight)||std::norm(children[pivot].weight)<largest*(1-1e-10))
+    {
+        pivot++;
+    }
+    const complex divisor=children[pivot].weight;
+    DDNode* node;
+    if (!free_nodes.empty())
+    {
+        node=free_nodes.back();
+        free_nodes.pop_back();
+    }
+    else
+    {
+        node_storage.emplace_back();
+        node=&node_storage.back();
+    }
+    node->level=level;
+    node->matrix=matrix;
+    node->ref_count=0;
+    for (size_t i=0; i<4; i++)
+    {
+        if (i>=count)
+        {
+            node->children[i]=get_zero_edge();
+        }
+        else if (i==pivot)
+        {
+            node->children[i]=DDEdge{ children[i].node, &one_weight };
+        }
+        else
+        {
+            node->children[i]=to_edge(RawEdge{ children[i].node, children[i].weight/divisor });
+        }
+    }
+    auto inserted=unique_table.insert(node);
+    if (!inserted.second)
+    {
+        free_nodes.push_back(node);
+        node=*inserted.first;
+    }
+    else
+    {
+        stats.peak_nodes=std::max(stats.peak_nodes, unique_table.size());
+    }
+    return RawEdge{ node, divisor };
+}
+
+DecisionDiagramPackage::RawEdge DecisionDiagramPackage::add_raw(RawEdge a, RawEdge b)
+{
+    if (is_negligible(a.weight))
+    {
+        return b;
+    }
+    if (is_negligible(b.weight))
+    {
+        return a;
+    }
+    if (a.node==b.node)
+    {
+        return RawEdge{ a.node, a.weight+b.weight };
+    }
+    if (a.node>b.node)
+    {
+        std::swap(a, b);
+    }
+    // a+b=a.weight*(a.node+ratio*b.node): caching on the canonical ratio
+    // lets sums that only differ by a common factor (the children of a
+    // product state, say) share one entry.
+    DDWeight* ratio=lookup_weight(b.weight/a.weight);
+    if (ratio==&zero_weight)
+    {
+        return a;
+    }
+    AddEntry& entry=add_table[hash_pointers(a.node, b.node, ratio)&(compute_table_size-1)];
+    stats.compute_lookups++;
+    if (entry.a==a.node&&entry.b==b.node&&entry.ratio==ratio)
+    {
+        stats.compute_hits++;
+        return RawEdge{ entry.result.node, entry.result.weight*a.weight };
+    }
+    std::array<RawEdge, 4> children;
+    for (size_t i=0; i<(a.node->matrix ? 4 : 2); i++)
+    {
+        const DDEdge& child_a=a.node->children[i];
+        const DDEdge& child_b=b.node->children[i];
+        children[i]=add_raw(RawEdge{ child_a.node, child_a.weight->value },
+            RawEdge{ child_b.node, child_b.weight->value*ratio->value });
+    }
+    RawEdge result=normalise(a.node->level, a.node->matrix, children);
+    entry.a=a.node;
+    entry.b=b.node;
+    entry.ratio=ratio;
+    entry.result=result;
+    return RawEdge{ result.node, result.weight*a.weight };
+}
+
+DecisionDiagramPackage::RawEdge DecisionDiagramPackage::multiply_raw(const DDEdge& a, const DDEdge& b)
+{
+    if (a.weight==&zero_weight||b.weight==&zero_weight)
+    {
+        return RawEdge{ &terminal, 0.0 };
+    }
+    const complex factor=a.weight->value*b.weight->value;
+    if (a.node->level<0)
+    {
+        return RawEdge{ &terminal, factor };
+    }
+    RawEdge product=multiply_nodes(a.node, b.node);
+    product.weight*=factor;
+    return product;
+}
+
+DecisionDiagramPackage::RawEdge DecisionDiagramPackage::multiply_nodes(DDNode* a, DDNode* b)
+{
+    // Product of the two nodes with unit weights, so one cached result serves
+    // every pair of incoming weights.
+    MultiplyEntry& entry=multiply_table[hash_pointers(a, b)&(compute_table_size-1)];
+    stats.compute_lookups++;
+    if (entry.a==a&&entry.b==b)
+    {
+        stats.compute_hits++;
+        return entry.result;
+    }
+    std::array<RawEdge, 4> children;
+    if (b->matrix)
+    {
+        for (size_t row=0; row<2; row++)
+        {
+            for (size_t col=0; col<2; col++)
+            {
+                children[row*2+col]=add_raw(multiply_raw(a->children[row*2], b->children[col]),
+                    multiply_raw(a->children[row*2+1], b->children[2+col]));
+            }
+        }
+    }
+    else
+    {
+        for (size_t row=0; row<2; row++)
+        {
+            children[row]=add_raw(multiply_raw(a->children[row*2], b->children[0]),
+                multiply_raw(a->children[row*2+1], b->children[1]));
+        }
+    }
+    RawEdge result=normalise(a->level, b->matrix, children);
+    entry.a=a;
+    entry.b=b;
+    entry.result=result;
+    return result;
+}
+
+complex DecisionDiagramPackage::inner_product_nodes(DDNode* a, DDNode* b)
+{
+    if (a->level<0)
+    {
+        return 1;
+    }
+    InnerProductEntry& entry=inner_product_table[hash_pointers(a, b)&(compute_table_size-1)];
+    stats.compute_lookups++;
+    if (entry.a==a&&entry.b==b)
+    {
+        stats.compute_hits++;
+        return entry.result;
+    }
+    complex result=0;
+    for (size_t i=0; i<(a->matrix ? 4 : 2); i++)
+    {
+        result+=inner_product(a->children[i], b->children[i]);
+    }
+    InnerProductEntry& slot=inner_product_table[hash_pointers(a, b)&(compute_table_size-1)];
+    slot.a=a;
+    slot.b=b;
+    slot.result=result;
+    return result;
+}
+
+void DecisionDiagramPackage::clear_compute_tables()
+{
+    std::fill(add_table.begin(), add_table.end(), AddEntry());
+    std::fill(multiply_table.begin(), multiply_table.end(), MultiplyEntry());
+    std::fill(inner_product_table.begin(), inner_product_table.end(), InnerProductEntry());
+}
+
+// Accessors
+///////////////////////////////////////////////////////////////////////////////
+
+DecisionDiagramStats DecisionDiagramPackage::get_stats() const
+{
+    DecisionDiagramStats current=stats;
+    current.live_nodes=unique_table.size();
+    current.live_weights=weight_storage.size()-free_weights.size();
+    return current;
+}
+
+size_t DecisionDiagramPackage::get_memory_bytes() const
+{
+    // Storage is only ever grown, so this is the high water mark of the
+    // node and weight pools plus the fixed compute tables.
+    return node_storage.size()*(sizeof(DDNode)+2*sizeof(DDNode*))
+        +weight_storage.size()*(sizeof(DDWeight)+2*sizeof(DDWeight*))
+        +compute_table_size*(sizeof(AddEntry)+sizeof(MultiplyEntry)+sizeof(InnerProductEntry));
+}
+
+DDEdge DecisionDiagramPackage::get_zero_edge()
+{
+    return DDEdge{ &terminal, &zero_weight };
+}
+
+DDEdge DecisionDiagramPackage::get_one_edge()
+{
+    return DDEdge{ &terminal, &one_weight };
+}
+
+complex DecisionDiagramPackage::get_entry(const DDEdge& edge, size_t row, size_t col) const
+{
+    complex value=edge.weight->value;
+    const DDNode* node=edge.node;
+    while (node->level>=0&&value!=0.0)
+    {
+        const size_t level=node->level;
+        size_t child=(row>>level)&1;
+        if (node->matrix)
+        {
+            child=child*2+((col>>level)&1);
+        }
+        value*=node->children[child].weight->value;
+        node=node->children[child].node;
+    }
+    return value;
+}
+
+size_t DecisionDiagramPackage::count_nodes(const DDEdge& edge) const
+{
+    std::unordered_set<const DDNode*> visited;
+    std::vector<const DDNode*> pending{ edge.node };
+    while (!pending.empty())
+    {
+        const DDNode* node=pending.back();
+        pending.pop_back();
+        if (node->level<0||!visited.insert(node).second)
+        {
+            continue;
+        }
+        for (const DDEdge& child : node->children)
+        {
+            pending.push_back(child.node);
+        }
+    }
+    return visited.size();
+}
+
+// Construction and arithmetic
+///////////////////////////////////////////////////////////////////////////////
+
+DDWeight* DecisionDiagramPackage::lookup_weight(const complex& value)
+{
+    if (is_negligible(value))
+    {
+        return &zero_weight;
+    }
+    if (is_negligible(value-1.0))
+    {
+        return &one_weight;
+    }
+    const double re=grid_position(value.real());
+    const double im=grid_position(value.imag());
+    const long long cell_re=static_cast<long long>(std::floor(re));
+    const long long cell_im=static_cast<long long>(std::floor(im));
+    const double margin=tolerance/weight_grid;
+    const long long first_re=re-cell_re<margin ? cell_re-1 : cell_re;
+    const long long last_re=re-cell_re>1-margin ? cell_re+1 : cell_re;
+    const long long first_im=im-cell_im<margin ? cell_im-1 : cell_im;
+    const long long last_im=im-cell_im>1-margin ? cell_im+1 : cell_im;
+    for (long long r=first_re; r<=last_re; r++)
+    {
+        for (long long i=first_im; i<=last_im; i++)
+        {
+            auto bucket=weight_table.find(weight_key(r, i));
+            if (bucket==weight_table.end())
+            {
+                continue;
+            }
+            for (DDWeight* weight : bucket->second)
+            {
+                if (is_negligible(weight->value-value))
+                {
+                    return weight;
+                }
+            }
+        }
+    }
+    DDWeight* weight;
+    if (!free_weights.empty())
+    {
+        weight=free_weights.back();
+        free_weights.pop_back();
+    }
+    else
+    {
+        weight_storage.emplace_back();
+        weight=&weight_storage.back();
+    }
+    weight->value=value;
+    weight->ref_count=0;
+    weight_table[weight_key(cell_re, cell_im)].push_back(weight);
+    return weight;
+}
+
+DDEdge DecisionDiagramPackage::make_node(int level, bool matrix, const std::array<DDEdge, 4>& children)
+{
+    std::array<RawEdge, 4> raw;
+    for (size_t i=0; i<4; i++)
+    {
+        raw[i]=RawEdge{ children[i].node, children[i].weight->value };
+    }
+    return to_edge(normalise(level, matrix, raw));
+}
+
+DDEdge DecisionDiagramPackage::make_basis_state(size_t num_qubits, size_t index)
+{
+    DDEdge edge=get_one_edge();
+    for (size_t level=0; level<num_qubits; level++)
+    {
+        if ((index>>level)&1)
+        {
+            edge=make_node(level, false, { get_zero_edge(), edge, get_zero_edge(), get_zero_edge() });
+        }
+        else
+        {
+            edge=make_node(level, false, { edge, get_zero_edge(), get_zero_edge(), get_zero_edge() });
+        }
+    }
+    return edge;
+}
+
+DDEdge DecisionDiagramPackage::make_identity(size_t num_qubits)
+{
+    DDEdge edge=get_one_edge();
+    for (size_t level=0; level<num_qubits; level++)
+    {
+        edge=make_node(level, true, { edge, get_zero_edge(), get_zero_edge(), edge });
+    }
+    return edge;
+}
+
+DDEdge DecisionDiagramPackage::make_gate(size_t num_qubits, const Operation& operation)
+{
+    if (operation.type==OperationType::phase_oracle)
+    {
+        return make_phase_oracle(num_qubits, operation);
+    }
+    if (operation.type!=OperationType::matrix&&operation.type!=OperationType::controlled)
+    {
+        throw std::invalid_argument("Only matrix, controlled and phase oracle operations can be made into a gate decision diagram");
+    }
+    const size_t k=operation.targets.size();
+    const Matrix& matrix=*operation.matrix;
+    if (matrix.get_rows()!=(size_t(1)<<k)||matrix.get_cols()!=(size_t(1)<<k))
+    {
+        throw std::invalid_argument("Matrix size does not match number of targets for decision diagram gate");
+    }
+    std::vector<int> target_bit(num_qubits, -1);
+    std::vector<bool> is_control(num_qubits, false);
+    for (size_t r=0; r<k; r++)
+    {
+        target_bit[operation.targets[r]]=r;
+    }
+    for (size_t control : operation.controls)
+    {
+        is_control[control]=true;
+    }
+    // Walk down from the top qubit choosing the row and column bit of each
+    // target. Below a control that is 0 the gate is the identity, which only
+    // depends on whether the target bits chosen so far agree.
+    std::unordered_map<size_t, DDEdge> built;
+    std::function<DDEdge(int, size_t, size_t, bool)> build=[&](int level, size_t row, size_t col, bool active) -> DDEdge
+    {
+        if (!active)
+        {
+            if (row!=col)
+            {
+                return get_zero_edge();
+            }
+            row=col=0;
+        }
+        if (level<0)
+        {
+            return DDEdge{ &terminal, lookup_weight(active ? matrix(row, col) : complex(1)) };
+        }
+        const size_t key=((((size_t(level)<<1)|active)<<k|row)<<k)|col;
+        auto found=built.find(key);
+        if (found!=built.end())
+        {
+            return found->second;
+        }
+        std::array<DDEdge, 4> children{ get_zero_edge(), get_zero_edge(), get_zero_edge(), get_zero_edge() };
+        if (target_bit[level]>=0)
+        {
+            const size_t r=target_bit[level];
+            for (size_t row_bit=0; row_bit<2; row_bit++)
+            {
+                for (size_t col_bit=0; col_bit<2; col_bit++)
+                {
+                    children[row_bit*2+col_bit]=build(level-1, row|row_bit<<r, col|col_bit<<r, active);
+                }
+            }
+        }
+        else if (is_control[level])
+        {
+            children[0]=build(level-1, row, col, false);
+            children[3]=build(level-1, row, col, active);
+        }
+        else
+        {
+            children[0]=children[3]=build(level-1, row, col, active);
+        }
+        DDEdge edge=make_node(level, true, children);
+        built[key]=edge;
+        return edge;
+    };
+    return build(int(num_qubits)-1, 0, 0, true);
+}
+
+DDEdge DecisionDiagramPackage::make_phase_oracle(size_t num_qubits, const Operation& operation)
+{
+    // Diagonal, so each level only chooses the bit of a target; below the
+    // lowest target every path ends in +1 or -1. Sub-diagrams are shared by
+    // the input bits chosen so far, which is as small as the truth table
+    // allows.
+    const size_t k=operation.targets.size();
+    std::vector<int> target_bit(num_qubits, -1);
+    for (size_t r=0; r<k; r++)
+    {
+        target_bit[operation.targets[r]]=r;
+    }
+    std::unordered_map<size_t, DDEdge> built;
+    std::function<DDEdge(int, size_t)> build=[&](int level, size_t input) -> DDEdge
+    {
+        if (level<0)
+        {
+            return DDEdge{ &terminal, lookup_weight(operation.is_marked(input) ? -1.0 : 1.0) };
+        }
+        const size_t key=(size_t(level)<<k)|input;
+        auto found=built.find(key);
+        if (found!=built.end())
+        {
+            return found->second;
+        }
+        std::array<DDEdge, 4> children{ get_zero_edge(), get_zero_edge(), get_zero_edge(), get_zero_edge() };
+        if (target_bit[level]>=0)
+        {
+            children[0]=build(level-1, input);
+            children[3]=build(level-1, input|size_t(1)<<target_bit[level]);
+        }
+        else
+        {
+            children[0]=children[3]=build(level-1, input);
+        }
+        DDEdge edge=make_node(level, true, children);
+        built[key]=edge;
+        return edge;
+    };
+    return build(int(num_qubits)-1, 0);
+}
+
+DDEdge DecisionDiagramPackage::add(const DDEdge& a, const DDEdge& b)
+{
+    return to_edge(add_raw(RawEdge{ a.node, a.weight->value }, RawEdge{ b.node, b.weight->value }));
+}
+
+DDEdge DecisionDiagramPackage::multiply(const DDEdge& a, const DDEdge& b)
+{
+    return to_edge(multiply_raw(a, b));
+}
+
+complex DecisionDiagramPackage::inner_product(const DDEdge& a, const DDEdge& b)
+{
+    // Sum of conj(a)*b over every entry.
+    if (a.weight==&zero_weight||b.weight==&zero_weight)
+    {
+        return 0;
+    }
+    return std::conj(a.weight->value)*b.weight->value*inner_product_nodes(a.node, b.node);
+}
+
+// Mutators
+///////////////////////////////////////////////////////////////////////////////
+
+void DecisionDiagramPackage::inc_ref(const DDEdge& edge)
+{
+    if (edge.weight!=&zero_weight&&edge.weight!=&one_weight)
+    {
+        edge.weight->ref_count++;
+    }
+    if (edge.node->level>=0&&edge.node->ref_count++==0)
+    {
+        for (const DDEdge& child : edge.node->children)
+        {
+            inc_ref(child);
+        }
+    }
+}
+
+void DecisionDiagramPackage::dec_ref(const DDEdge& edge)
+{
+    if (edge.weight!=&zero_weight&&edge.weight!=&one_weight)
+    {
+        edge.weight->ref_count--;
+    }
+    if (edge.node->level>=0&&--edge.node->ref_count==0)
+    {
+        for (const DDEdge& child : edge.node->children)
+        {
+            dec_ref(child);
+        }
+    }
+}
+
+void DecisionDiagramPackage::garbage_collect(bool force)
+{
+    const size_t live_weights=weight_storage.size()-free_weights.size();
+    if (!force&&unique_table.size()<collection_threshold&&live_weights<collection_threshold)
+    {
+        return;
+    }
+    for (auto it=unique_table.begin(); it!=unique_table.end();)
+    {
+        if ((*it)->ref_count==0)
+        {
+            free_nodes.push_back(*it);
+            it=unique_table.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    for (auto bucket=weight_table.begin(); bucket!=weight_table.end();)
+    {
+        std::vector<DDWeight*>& weights=bucket->second;
+        for (DDWeight* weight : weights)
+        {
+            if (weight->ref_count==0)
+            {
+                free_weights.push_back(weight);
+            }
+        }
+        weights.erase(std::remove_if(weights.begin(), weights.end(),
+            [](const DDWeight* weight) { return weight->ref_count==0; }), weights.end());
+        bucket=weights.empty() ? weight_table.erase(bucket) : std::next(bucket);
+    }
+    clear_compute_tables();
+    stats.garbage_collections++;
+    // Collect less often while most of the diagram stays alive.
+    if (std::max(unique_table.size(), weight_storage.size()-free_weights.size())>collection_threshold/2)
+    {
+        collection_threshold*=2;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// DecisionDiagramState
+///////////////////////////////////////////////////////////////////////////////
+
+DecisionDiagramState::DecisionDiagramState(size_t n) : num_qubits{ n }
+{
+    if (num_qubits==0||num_qubits>max_diagram_qubits)
+    {
+        throw std::out_of_range("DecisionDiagramState needs between 1 and "+std::to_string(max_diagram_qubits)+" qubits");
+    }
+    root=DecisionDiagramPackage::instance().get_zero_edge();
+    set_basis_state(0);
+}
+
+DecisionDiagramState::DecisionDiagramState(const DecisionDiagramState& other) :
+    num_qubits{ other.num_qubits }, root{ other.root }
+{
+    DecisionDiagramPackage::instance().inc_ref(root);
+}
+
+DecisionDiagramState& DecisionDiagramState::operator=(const DecisionDiagramState& other)
+{
+    num_qubits=other.num_qubits;
+    set_root(other.root);
+    return *this;
+}
+
+DecisionDiagramState::~DecisionDiagramState()
+{
+    DecisionDiagramPackage::instance().dec_ref(root);
+}
+
+void DecisionDiagramState::set_root(const DDEdge& edge)
+{
+    DecisionDiagramPackage& package=DecisionDiagramPackage::instance();
+    package.inc_ref(edge);
+    package.dec_ref(root);
+    root=edge;
+}
+
+// Accessors
+///////////////////////////////////////////////////////////////////////////////
+
+size_t DecisionDiagramState::get_num_qubits() const
+{
+    return num_qubits;
+}
+
+DDEdge DecisionDiagramState::get_root() const
+{
+    return root;
+}
+
+size_t DecisionDiagramState::get_node_count() const
+{
+    return DecisionDiagramPackage::instance().count_nodes(root);
+}
+
+std::complex<double> DecisionDiagramState::get_amplitude(size_t index) const
+{
+    if (index>=(size_t(1)<<num_qubits))
+    {
+        throw std::out_of_range("Amplitude index out of range for DecisionDiagramState");
+    }
+    return DecisionDiagramPackage::instance().get_entry(root, index, 0);
+}
+
+double DecisionDiagramState::get_probability(size_t index) const
+{
+    return std::norm(get_amplitude(index));
+}
+
+double DecisionDiagramState::get_qubit_probability(size_t qubit) const
+{
+    // <psi|P1|psi> with P1 the projector onto qubit=1.
+    if (qubit>=num_qubits)
+    {
+        throw std::out_of_range("Qubit out of range for DecisionDiagramState");
+    }
+    Matrix projector(2, 2);
+    projector(1, 1)=1;
+    Operation operation;
+    operation.targets={ qubit };
+    operation.matrix=&projector;
+    DecisionDiagramPackage& package=DecisionDiagramPackage::instance();
+    DDEdge projected=package.multiply(package.make_gate(num_qubits, operation), root);
+    return package.inner_product(root, projected).real();
+}
+
+double DecisionDiagramState::get_fidelity(const DecisionDiagramState& other) const
+{
+    if (other.num_qubits!=num_qubits)
+    {
+        throw std::invalid_argument("Decision diagram states have different numbers of qubits");
+    }
+    return std::norm(DecisionDiagramPackage::instance().inner_product(root, other.root));
+}
+
+bool DecisionDiagramState::is_equivalent(const DecisionDiagramState& other, bool up_to_global_phase, double tolerance) const
+{
+    if (other.num_qubits!=num_qubits)
+    {
+        return false;
+    }
+    if (root==other.root||(up_to_global_phase&&root.node==other.root.node
+        &&std::abs(std::abs(root.weight->value)-std::abs(other.root.weight->value))<=tolerance))
+    {
+        return true;
+    }
+    DecisionDiagramPackage& package=DecisionDiagramPackage::instance();
+    return overlaps_match(package.inner_product(root, other.root), package.inner_product(root, root).real(),
+        package.inner_product(other.root, other.root).real(), up_to_global_phase, tolerance);
+}
+
+StateVector DecisionDiagramState::to_state_vector() const
+{
+    double bytes=std::pow(2.0, double(num_qubits))*sizeof(complex);
+    if (num_qubits>40||bytes>MemoryBudget::instance().get_limit())
+    {
+        throw std::length_error("Dense state of "+std::to_string(num_qubits)+" qubits does not fit in the memory budget");
+    }
+    StateVector state(num_qubits);
+    state.set_basis_state(0);
+    state.get_data()[0]=0;
+    fill_amplitudes(root, 1.0, 0, state.get_data());
+    return state;
+}
+
+// Mutators
+///////////////////////////////////////////////////////////////////////////////
+
+void DecisionDiagramState::set_basis_state(size_t index)
+{
+    if (index>=(size_t(1)<<num_qubits))
+    {
+        throw std::out_of_range("Basis state index out of range for DecisionDiagramState");
+    }
+    set_root(DecisionDiagramPackage::instance().make_basis_state(num_qubits, index));
+}
+
+void DecisionDiagramState::apply_operation(const Operation& operation)
+{
+    check_qubits(operation, num_qubits);
+    if (operation.type==OperationType::qft||operation.type==OperationType::inverse_qft)
+    {
+        // The QFT's own circuit of H and controlled phases; its diagram stays
+        // small where the dense FFT would not.
+        if (operation.component==nullptr)
+        {
+            throw std::invalid_argument("DecisionDiagramState cannot apply a QFT without its component");
+        }
+        std::vector<Operation> parts;
+        operation.component->append_operations(parts, operation.targets[0]-operation.component->get_index(), true);
+        for (const Operation& part : parts)
+        {
+            apply_operation(part);
+        }
+        return;
+    }
+    DecisionDiagramPackage& package=DecisionDiagramPackage::instance();
+    QC_PROFILE_SCOPE(operation.component!=nullptr ? operation.component->get_symbol() : "operation",
+        "decision diagram", operation.step_index, operation.targets[0], package.count_nodes(root), 1, 0.0, 0.0);
+    set_root(package.multiply(package.make_gate(num_qubits, operation), root));
+    package.garbage_collect();
+    check_budget(num_qubits);
+}
+
+void DecisionDiagramState::apply_circuit(const QuantumCircuit& circuit)
+{
+    if (circuit.get_register_size()!=num_qubits)
+    {
+        throw std::invalid_argument("Circuit size does not match DecisionDiagramState's number of qubits!");
+    }
+    for (const Operation& operation : circuit.get_operations(true))
+    {
+        apply_operation(operation);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// DecisionDiagramUnitary
+///////////////////////////////////////////////////////////////////////////////
+
+DecisionDiagramUnitary::DecisionDiagramUnitary(const QuantumCircuit& circuit) : num_qubits{ circuit.get_register_size() }
+{
+    if (num_qubits==0||num_qubits>max_diagram_qubits)
+    {
+        throw std::out_of_range("DecisionDiagramUnitary needs between 1 and "+std::to_string(max_diagram_qubits)+" qubits");
+    }
+    DecisionDiagramPackage& package=DecisionDiagramPackage::instance();
+    root=package.make_identity(num_qubits);
+    package.inc_ref(root);
+    for (const Operation& operation : circuit.get_operations(true))
+    {
+        check_qubits(operation, num_qubits);
+        DDEdge product=package.multiply(package.make_gate(num_qubits, operation), root);
+        package.inc_ref(product);
+        package.dec_ref(root);
+        root=product;
+        package.garbage_collect();
+        check_budget(num_qubits);
+    }
+}
+
+DecisionDiagramUnitary::DecisionDiagramUnitary(const DecisionDiagramUnitary& other) :
+    num_qubits{ other.num_qubits }, root{ other.root }
+{
+    DecisionDiagramPackage::instance().inc_ref(root);
+}
+
+DecisionDiagramUnitary& DecisionDiagramUnitary::operator=(const DecisionDiagramUnitary& other)
+{
+    DecisionDiagramPackage& package=DecisionDiagramPackage::instance();
+    package.inc_ref(other.root);
+    package.dec_ref(root);
+    num_qubits=other.num_qubits;
+    root=other.root;
+    return *this;
+}
+
+DecisionDiagramUnitary::~DecisionDiagramUnitary()
+{
+    DecisionDiagramPackage::instance().dec_ref(root);
+}
+
+// Accessors
+///////////////////////////////////////////////////////////////////////////////
+
+size_t DecisionDiagramUnitary::get_num_qubits() const
+{
+    return num_qubits;
+}
+
+DDEdge DecisionDiagramUnitary::get_root() const
+{
+    return root;
+}
+
+size_t DecisionDiagramUnitary::get_node_count() const
+{
+    return DecisionDiagramPackage::instance().count_nodes(root);
+}
+
+std::complex<double> DecisionDiagramUnitary::get_entry(size_t row, size_t col) const
+{
+    if (row>=(size_t(1)<<num_qubits)||col>=(size_t(1)<<num_qubits))
+    {
+        throw std::out_of_range("Entry out of range for DecisionDiagramUnitary");
+    }
+    return DecisionDiagramPackage::instance().get_entry(root, row, col);
+}
+
+bool DecisionDiagramUnitary::is_equivalent(const DecisionDiagramUnitary& other, bool up_to_global_phase, double tolerance) const
+{
+    if (other.num_qubits!=num_qubits)
+    {
+        return false;
+    }
+    if (root==other.root||(up_to_global_phase&&root.node==other.root.node
+        &&std::abs(std::abs(root.weight->value)-std::abs(other.root.weight->value))<=tolerance))
+    {
+        return true;
+    }
+    // Tr(U^dagger V) reaches 2^n exactly when V=U.
+    DecisionDiagramPackage& package=DecisionDiagramPackage::instance();
+    return overlaps_match(package.inner_product(root, other.root), package.inner_product(root, root).real(),
+        package.inner_product(other.root, other.root).real(), up_to_global_phase, tolerance);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Non-member functions
+///////////////////////////////////////////////////////////////////////////////
+
+std::ostream& operator<<(std::ostream& os, const DecisionDiagramStats& stats)
+{
+    os<<stats.live_nodes<<" live nodes (peak "<<stats.peak_nodes<<"), "<<stats.live_weights
+        <<" weights, "<<stats.compute_hits<<"/"<<stats.compute_lookups<<" compute table hits, "
+        <<stats.garbage_collections<<" garbage collections";
+    return os;
+}
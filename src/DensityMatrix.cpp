@@ -0,0 +1,368 @@
+#include "DensityMatrix.h"
+#include "Numa.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <stdexcept>
+
+typedef std::complex<double> complex;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    std::vector<size_t> shifted(const std::vector<size_t>& qubits, size_t offset)
+    {
+        std::vector<size_t> result;
+        result.reserve(qubits.size());
+        for (size_t qubit : qubits)
+        {
+            result.push_back(qubit+offset);
+        }
+        return result;
+    }
+
+    Matrix unitary_superoperator(const Matrix& unitary)
+    {
+        // rho -> U rho U^dagger as a 4x4 map on the (row, column) bit pair.
+        Matrix superoperator(4, 4);
+        for (size_t c=0; c<2; c++)
+        {
+            for (size_t c_in=0; c_in<2; c_in++)
+            {
+                for (size_t r=0; r<2; r++)
+                {
+                    for (size_t r_in=0; r_in<2; r_in++)
+                    {
+                        superoperator(r+2*c, r_in+2*c_in)=unitary(r, r_in)*std::conj(unitary(c, c_in));
+                    }
+                }
+            }
+        }
+        return superoperator;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// DensityMatrix
+///////////////////////////////////////////////////////////////////////////////
+
+DensityMatrix::DensityMatrix(size_t n) : num_qubits{ n }
+{
+    if (2*num_qubits>=8*sizeof(size_t)-1)
+    {
+        throw std::invalid_argument("Too many qubits for a density matrix");
+    }
+    QC_PROFILE_ALLOCATION((size_t(1)<<(2*num_qubits))*sizeof(complex));
+    elements.assign(size_t(1)<<(2*num_qubits), 0.0);
+    elements[0]=1;
+    QC_PROFILE_PLACEMENT("density matrix", elements.data(), elements.size()*sizeof(complex));
+}
+
+DensityMatrix::DensityMatrix(const StateVector& state) : DensityMatrix(state.get_num_qubits())
+{
+    // rho=|psi><psi|.
+    const size_t dimension=get_dimension();
+    const complex* amplitudes=state.get_data();
+    for (size_t c=0; c<dimension; c++)
+    {
+        complex column=std::conj(amplitudes[c]);
+        for (size_t r=0; r<dimension; r++)
+        {
+            elements[r+(c<<num_qubits)]=amplitudes[r]*column;
+        }
+    }
+}
+
+// Accessors
+///////////////////////////////////////////////////////////////////////////////
+
+size_t DensityMatrix::get_num_qubits() const
+{
+    return num_qubits;
+}
+
+size_t DensityMatrix::get_dimension() const
+{
+    return size_t(1)<<num_qubits;
+}
+
+std::complex<double> DensityMatrix::get_element(size_t row, size_t col) const
+{
+    if (row>=get_dimension()||col>=get_dimension())
+    {
+        throw std::out_of_range("Index ("+std::to_string(row)+","+std::to_string(col)+") out of bounds for density matrix");
+    }
+    return elements[row+(col<<num_qubits)];
+}
+
+const std::complex<double>* DensityMatrix::get_data() const
+{
+    return elements.data();
+}
+
+double DensityMatrix::get_trace() const
+{
+    double trace=0;
+    for (size_t i=0; i<get_dimension(); i++)
+    {
+        trace+=elements[i+(i<<num_qubits)].real();
+    }
+    return trace;
+}
+
+double DensityMatrix::get_purity() const
+{
+    // Tr(rho^2)=sum |rho_rc|^2 since rho is Hermitian.
+    double purity=0;
+    for (const complex& element : elements)
+    {
+        purity+=std::norm(element);
+    }
+    return purity;
+}
+
+double DensityMatrix::get_fidelity(const StateVector& state) const
+{
+    // <psi|rho|psi> for a pure reference state.
+    if (state.get_num_qubits()!=num_qubits)
+    {
+        throw std::invalid_argument("State size does not match density matrix in get_fidelity()");
+    }
+    const size_t dimension=get_dimension();
+    const complex* amplitudes=state.get_data();
+    complex fidelity=0;
+    for (size_t c=0; c<dimension; c++)
+    {
+        complex row_sum=0;
+        for (size_t r=0; r<dimension; r++)
+        {
+            row_sum+=std::conj(amplitudes[r])*elements[r+(c<<num_qubits)];
+        }
+        fidelity+=row_sum*amplitudes[c];
+    }
+    return fidelity.real();
+}
+
+std::vector<double> DensityMatrix::get_probabilities() const
+{
+    std::vector<double> probabilities(get_dimension());
+    for (size_t i=0; i<probabilities.size(); i++)
+    {
+        probabilities[i]=elements[i+(i<<num_qubits)].real();
+    }
+    return probabilities;
+}
+
+Matrix DensityMatrix::to_matrix() const
+{
+    const size_t dimension=get_dimension();
+    Matrix result(dimension, dimension);
+    for (size_t r=0; r<dimension; r++)
+    {
+        for (size_t c=0; c<dimension; c++)
+        {
+            result(r, c)=elements[r+(c<<num_qubits)];
+        }
+    }
+    return result;
+}
+
+// Mutators
+///////////////////////////////////////////////////////////////////////////////
+
+std::complex<double>* DensityMatrix::get_data()
+{
+    return elements.data();
+}
+
+void DensityMatrix::set_basis_state(size_t index)
+{
+    if (index>=get_dimension())
+    {
+        throw std::out_of_range("Basis state "+std::to_string(index)+" out of range for density matrix");
+    }
+    std::fill(elements.begin(), elements.end(), complex(0.0));
+    elements[index+(index<<num_qubits)]=1;
+}
+
+void DensityMatrix::apply_operation(const Operation& operation)
+{
+    // U on the row qubits, then conj(U) on the column qubits. The conjugate
+    // of the (symmetric) QFT matrix is the inverse QFT.
+    QC_PROFILE_SCOPE(operation.component!=nullptr ? operation.component->get_symbol() : "operation",
+        "density_matrix", operation.step_index, operation.targets.empty() ? ProfileEvent::none : operation.targets[0],
+        elements.size(), 1,
+        16.0*elements.size()*(operation.type==OperationType::matrix ? (size_t(1)<<operation.targets.size()) : 2),
+        4.0*elements.size()*sizeof(complex));
+    const size_t total_qubits=2*num_qubits;
+    ::apply_operation(elements.data(), total_qubits, operation);
+    Operation column_operation=operation;
+    column_operation.targets=shifted(operation.targets, num_qubits);
+    column_operation.controls=shifted(operation.controls, num_qubits);
+    Matrix conjugated;
+    switch (operation.type)
+    {
+    case OperationType::matrix:
+    case OperationType::controlled:
+        conjugated=operation.matrix->conjugate();
+        column_operation.matrix=&conjugated;
+        break;
+    case OperationType::qft:
+        column_operation.type=OperationType::inverse_qft;
+        break;
+    case OperationType::inverse_qft:
+        column_operation.type=OperationType::qft;
+        break;
+    case OperationType::phase_oracle:
+        // Real diagonal, so it is its own conjugate.
+        break;
+    }
+    ::apply_operation(elements.data(), total_qubits, column_operation);
+}
+
+void DensityMatrix::apply_channel(const NoiseChannel& channel, const std::vector<size_t>& qubits)
+{
+    if (qubits.size()!=channel.get_num_qubits())
+    {
+        throw std::invalid_argument("Channel "+channel.get_name()+" acts on "+std::to_string(channel.get_num_qubits())
+            +" qubits but was given "+std::to_string(qubits.size()));
+    }
+    QC_PROFILE_SCOPE(channel.get_name(), "noise", ProfileEvent::none, qubits.empty() ? ProfileEvent::none : qubits[0],
+        elements.size(), 1, 8.0*elements.size()*(size_t(1)<<(2*qubits.size())),
+        2.0*elements.size()*sizeof(complex));
+    apply_superoperator(channel.get_superoperator(), qubits);
+}
+
+void DensityMatrix::apply_superoperator(const Matrix& superoperator, const std::vector<size_t>& qubits)
+{
+    std::vector<size_t> targets=qubits;
+    for (size_t qubit : qubits)
+    {
+        targets.push_back(qubit+num_qubits);
+    }
+    ::apply_matrix(elements.data(), 2*num_qubits, targets, superoperator);
+}
+
+void DensityMatrix::apply_circuit(const QuantumCircuit& circuit, const NoiseModel& noise)
+{
+    // Starts from the circuit's input register. Gate noise follows each
+    // operation and qubit noise closes every step, including empty ones.
+    if (circuit.get_register_size()!=num_qubits)
+    {
+        throw std::invalid_argument("Circuit size does not match DensityMatrix::apply_circuit()");
+    }
+    for (const auto& entry : noise.get_qubit_noise())
+    {
+        if (entry.first>=num_qubits)
+        {
+            throw std::out_of_range("Noise attached to qubit "+std::to_string(entry.first)+" outside the register");
+        }
+    }
+    // Single qubit work (gates, their noise and idle noise) is composed into
+    // a pending 4x4 superoperator per qubit. Superoperators on different
+    // qubits commute, so a qubit's pending map only has to be applied when a
+    // wider operation touches it, which saves most passes over rho.
+    std::vector<Matrix> idle_noise(num_qubits);
+    for (const auto& entry : noise.get_qubit_noise())
+    {
+        Matrix combined=identity_matrix(4);
+        for (const NoiseChannel& channel : entry.second)
+        {
+            combined=channel.get_superoperator()*combined;
+        }
+        idle_noise[entry.first]=std::move(combined);
+    }
+    std::vector<Matrix> pending(num_qubits);
+    auto queue=[&](size_t qubit, const Matrix& superoperator)
+    {
+        pending[qubit]=pending[qubit].get_rows()==0 ? superoperator : superoperator*pending[qubit];
+    };
+    auto flush=[&](size_t qubit)
+    {
+        if (pending[qubit].get_rows()!=0)
+        {
+            QC_PROFILE_SCOPE("fused single qubit", "noise", ProfileEvent::none, qubit,
+                elements.size(), 1, 32.0*elements.size(), 2.0*elements.size()*sizeof(complex));
+            apply_superoperator(pending[qubit], { qubit });
+            pending[qubit]=Matrix();
+        }
+    };
+    auto end_step=[&]()
+    {
+        for (size_t qubit=0; qubit<num_qubits; qubit++)
+        {
+            if (idle_noise[qubit].get_rows()!=0)
+            {
+                queue(qubit, idle_noise[qubit]);
+            }
+        }
+    };
+    const std::vector<Operation> operations=circuit.get_operations(false);
+    const size_t num_steps=circuit.get_total_steps()+1;
+    MemoryBudget::instance().admit(::estimate_resources(operations, num_qubits, num_steps,
+        ExecutionMode::density_matrix), "DensityMatrix::apply_circuit()");
+    size_t index=0;
+    std::vector<int> input_register=circuit.get_input_register();
+    for (size_t i=0; i<num_qubits; i++)
+    {
+        if (input_register[i]==1)
+        {
+            index|=size_t(1)<<i;
+        }
+    }
+    set_basis_state(index);
+    size_t step=0;
+    for (const Operation& operation : operations)
+    {
+        for (; step<operation.step_index; step++)
+        {
+            end_step();
+        }
+        std::vector<size_t> qubits=operation.targets;
+        qubits.insert(qubits.end(), operation.controls.begin(), operation.controls.end());
+        if (operation.type==OperationType::matrix&&qubits.size()==1)
+        {
+            queue(qubits[0], unitary_superoperator(*operation.matrix));
+        }
+        else
+        {
+            for (size_t qubit : qubits)
+            {
+                flush(qubit);
+            }
+            apply_operation(operation);
+        }
+        if (operation.component==nullptr)
+        {
+            continue;
+        }
+        for (const NoiseChannel* channel : noise.get_gate_noise(operation.component->get_symbol()))
+        {
+            if (channel->get_num_qubits()==1)
+            {
+                for (size_t qubit : qubits)
+                {
+                    queue(qubit, channel->get_superoperator());
+                }
+                continue;
+            }
+            for (size_t qubit : qubits)
+            {
+                flush(qubit);
+            }
+            apply_channel(*channel, qubits);
+        }
+    }
+    for (; step<num_steps; step++)
+    {
+        end_step();
+    }
+    for (size_t qubit=0; qubit<num_qubits; qubit++)
+    {
+        flush(qubit);
+    }
+}
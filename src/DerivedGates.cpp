@@ -1,4 +1,8 @@
 #include "DerivedGates.h"
+#include "CircuitGate.h"
+#include "GateCache.h"
+#include "PhaseOracle.h"
+#include "QFTGate.h"
 
 
 std::shared_ptr<SingleGate> h(size_t n)
@@ -41,10 +45,16 @@ std::shared_ptr<MultiGate> controlled(std::shared_ptr<SingleGate> gate, size_t n
     return std::make_shared<ControlledGate>(gate, n);
 }
 
-std::shared_ptr<MultiGate> gate_from_circuit(QuantumCircuit qc, size_t n, std::string symbol)
+std::shared_ptr<MultiGate> gate_from_circuit(const QuantumCircuit& qc, size_t n, std::string symbol)
 {
-    std::shared_ptr<MultiGate> gate=std::make_shared<MultiGate>(
-        n, symbol, qc.get_matrix(), qc.get_register_size());
+    std::shared_ptr<MultiGate> gate=std::make_shared<CircuitGate>(qc, n, std::move(symbol));
+    return gate;
+}
+
+std::shared_ptr<MultiGate> gate_from_circuit(QuantumCircuit&& qc, size_t n, std::string symbol)
+{
+    std::shared_ptr<MultiGate> gate=std::make_shared<CircuitGate>(
+        std::make_shared<const QuantumCircuit>(std::move(qc)), n, std::move(symbol), "");
     return gate;
 }
 
@@ -53,13 +63,18 @@ std::shared_ptr<MultiGate> swap(size_t index_1, size_t index_2)
     size_t first_index=std::min(index_1, index_2);
     size_t last_index=std::max(index_1, index_2);
     size_t gate_size=last_index-first_index+1;
-    QuantumCircuit swap_circuit(gate_size);
-    swap_circuit.add_component(controlled(x(0), gate_size-1));
-    swap_circuit.add_component(controlled(x(gate_size-1), 0));
-    swap_circuit.add_component(controlled(x(0), gate_size-1));
-    std::shared_ptr<MultiGate> gate=gate_from_circuit(swap_circuit, first_index,
-        std::to_string(first_index)+" <-> "+std::to_string(last_index));
-    return gate;
+    // Every swap over the same distance shares one circuit and matrix.
+    std::string key="swap("+std::to_string(gate_size)+")";
+    auto swap_circuit=GateCache::instance().get_circuit(key, [gate_size]()
+        {
+            QuantumCircuit qc(gate_size);
+            qc.add_component(controlled(x(0), gate_size-1));
+            qc.add_component(controlled(x(gate_size-1), 0));
+            qc.add_component(controlled(x(0), gate_size-1));
+            return qc;
+        });
+    return std::make_shared<CircuitGate>(swap_circuit, first_index,
+        std::to_string(first_index)+" <-> "+std::to_string(last_index), key);
 }
 
 std::shared_ptr<SingleGate> adjoint(std::shared_ptr<SingleGate> gate)
@@ -75,30 +90,54 @@ std::shared_ptr<MultiGate> toffoli(size_t target, size_t control_1, size_t contr
 {
     int first_qubit=std::min(std::min(control_1, control_2), target);
     int last_qubit=std::max(std::max(control_1, control_2), target);
-    QuantumCircuit qc(last_qubit-first_qubit+1);
     int r_t=target-first_qubit;
     int r_c1=control_1-first_qubit;
     int r_c2=control_2-first_qubit;
-    qc.add_component(h(r_t));
-    qc.add_component(controlled(x(r_t), r_c2));
-    qc.add_component(adjoint(t(r_t)));
-    qc.add_component(controlled(x(r_t), r_c1));
-    qc.add_component(t(r_t));
-    qc.add_component(controlled(x(r_t), r_c2));
-    qc.add_component(adjoint(t(r_t)));
-    qc.add_component(controlled(x(r_t), r_c1));
-    qc.add_component(t(r_c2));
-    qc.add_component(t(r_t));
-    qc.add_component(h(r_t));
-    qc.add_component(controlled(x(r_c2), r_c1));
-    qc.add_component(t(r_c1));
-    qc.add_component(adjoint(t(r_c2)));
-    qc.add_component(controlled(x(r_c2), r_c1));
+    // Toffolis with the same relative layout share one circuit and matrix.
+    std::string key="toffoli(t="+std::to_string(r_t)+",c1="+std::to_string(r_c1)+
+        ",c2="+std::to_string(r_c2)+")";
+    auto circuit=GateCache::instance().get_circuit(key, [=]()
+        {
+            QuantumCircuit qc(last_qubit-first_qubit+1);
+            qc.add_component(h(r_t));
+            qc.add_component(controlled(x(r_t), r_c2));
+            qc.add_component(adjoint(t(r_t)));
+            qc.add_component(controlled(x(r_t), r_c1));
+            qc.add_component(t(r_t));
+            qc.add_component(controlled(x(r_t), r_c2));
+            qc.add_component(adjoint(t(r_t)));
+            qc.add_component(controlled(x(r_t), r_c1));
+            qc.add_component(t(r_c2));
+            qc.add_component(t(r_t));
+            qc.add_component(h(r_t));
+            qc.add_component(controlled(x(r_c2), r_c1));
+            qc.add_component(t(r_c1));
+            qc.add_component(adjoint(t(r_c2)));
+            qc.add_component(controlled(x(r_c2), r_c1));
+            return qc;
+        });
     std::string gate_symbol="q"+std::to_string(control_1)+
         "q"+std::to_string(control_2)+"(+)q"+
         std::to_string(target);
-    std::shared_ptr<MultiGate> gate=gate_from_circuit(qc,
-        first_qubit,
-        gate_symbol);
-    return gate;
-}
\ No newline at end of file
+    return std::make_shared<CircuitGate>(circuit, first_qubit, gate_symbol, key);
+}
+
+std::shared_ptr<MultiGate> qft(size_t first_index, size_t size)
+{
+    return std::make_shared<QFTGate>(first_index, size, false);
+}
+
+std::shared_ptr<MultiGate> inverse_qft(size_t first_index, size_t size)
+{
+    return std::make_shared<QFTGate>(first_index, size, true);
+}
+
+std::shared_ptr<MultiGate> phase_oracle(const std::vector<size_t>& qubits, const std::function<bool(size_t)>& predicate)
+{
+    return std::make_shared<PhaseOracle>(qubits, predicate);
+}
+
+std::shared_ptr<MultiGate> phase_oracle(const std::vector<size_t>& qubits, const std::vector<bool>& truth_table)
+{
+    return std::make_shared<PhaseOracle>(qubits, truth_table);
+}
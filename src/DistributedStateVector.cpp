@@ -0,0 +1,616 @@
+#include "DistributedStateVector.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#ifdef __linux__
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+typedef std::complex<double> complex;
+
+namespace
+{
+    const size_t max_matrix_qubits=6;
+    const size_t max_listed_qubits=64;
+}
+
+enum class DistributedCommand
+{
+    none,
+    set_basis_state,
+    matrix,
+    controlled,
+    qft,
+    exchange,
+    shutdown
+};
+
+/**
+ * @brief Command block shared by all ranks. The driver fills it in, then all
+ * ranks meet at the barrier, execute it on their slice and meet again. Qubit
+ * positions are physical. Without worker processes the driver executes it on
+ * every slice in turn.
+ */
+struct DistributedControl
+{
+#ifdef __linux__
+    pthread_barrier_t barrier;
+#endif
+    DistributedCommand command;
+    size_t num_targets;
+    size_t targets[max_listed_qubits];
+    size_t num_controls;
+    size_t controls[max_listed_qubits];
+    size_t basis_index;
+    size_t local_position;
+    size_t global_position;
+    bool inverse;
+    int error;
+    char message[256];
+    complex matrix[(size_t(1)<<max_matrix_qubits)*(size_t(1)<<max_matrix_qubits)];
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    std::atomic<size_t> configured_processes{ 1 };
+
+    // Local qubits below which get_final_state_vector() stays in one process.
+    const size_t min_distributed_local_qubits=12;
+
+    size_t log2_exact(size_t value)
+    {
+        size_t bits=0;
+        while ((size_t(1)<<bits)<value)
+        {
+            bits++;
+        }
+        return bits;
+    }
+
+    void execute(DistributedControl* control, complex* amplitudes, size_t rank, size_t local_qubits)
+    {
+        const size_t local_size=size_t(1)<<local_qubits;
+        complex* local=amplitudes+rank*local_size;
+        std::vector<size_t> targets(control->targets, control->targets+control->num_targets);
+        switch (control->command)
+        {
+        case DistributedCommand::set_basis_state:
+            std::fill(local, local+local_size, complex(0.0));
+            if ((control->basis_index>>local_qubits)==rank)
+            {
+                local[control->basis_index&(local_size-1)]=1;
+            }
+            break;
+        case DistributedCommand::matrix:
+        {
+            const size_t dimension=size_t(1)<<targets.size();
+            Matrix matrix(dimension, dimension);
+            for (size_t i=0; i<dimension; i++)
+            {
+                for (size_t j=0; j<dimension; j++)
+                {
+                    matrix(i, j)=control->matrix[i*dimension+j];
+                }
+            }
+            apply_matrix(local, local_qubits, targets, matrix);
+            break;
+        }
+        case DistributedCommand::controlled:
+        {
+            std::vector<size_t> local_controls;
+            for (size_t i=0; i<control->num_controls; i++)
+            {
+                size_t position=control->controls[i];
+                if (position<local_qubits)
+                {
+                    local_controls.push_back(position);
+                }
+                else if (((rank>>(position-local_qubits))&1)==0)
+                {
+                    return; // A global control is 0 on this whole slice.
+                }
+            }
+            Matrix matrix(2, 2);
+            for (size_t i=0; i<4; i++)
+            {
+                matrix(i/2, i%2)=control->matrix[i];
+            }
+            apply_controlled(local, local_qubits, local_controls, targets[0], matrix);
+            break;
+        }
+        case DistributedCommand::qft:
+            apply_qft(local, local_qubits, targets[0], targets.size(), control->inverse);
+            break;
+        case DistributedCommand::exchange:
+        {
+            // Swap amplitudes with (local bit, global bit)=(1, 0) and (0, 1).
+            // The lower rank of each pair does the first half of the pairs
+            // and the upper rank the second.
+            const size_t bit=control->global_position-local_qubits;
+            const size_t position=control->local_position;
+            const size_t lower=rank&~(size_t(1)<<bit);
+            const size_t upper=lower|(size_t(1)<<bit);
+            complex* lower_slice=amplitudes+lower*local_size;
+            complex* upper_slice=amplitudes+upper*local_size;
+            const size_t pairs=local_size/2;
+            const size_t begin=rank==lower ? 0 : pairs/2;
+            const size_t end=rank==lower ? pairs/2 : pairs;
+            const size_t mask=(size_t(1)<<position)-1;
+            parallel_for(begin, end, 1<<14, [&](size_t chunk_begin, size_t chunk_end)
+            {
+                for (size_t j=chunk_begin; j<chunk_end; j++)
+                {
+                    size_t i0=((j>>position)<<(position+1))|(j&mask);
+                    std::swap(lower_slice[i0|(size_t(1)<<position)], upper_slice[i0]);
+                }
+            });
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    void execute_safely(DistributedControl* control, complex* amplitudes, size_t rank, size_t local_qubits)
+    {
+        try
+        {
+            execute(control, amplitudes, rank, local_qubits);
+        }
+        catch (std::exception& e)
+        {
+            int expected=0;
+            if (__atomic_compare_exchange_n(&control->error, &expected, 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            {
+                std::string message="rank "+std::to_string(rank)+": "+e.what();
+                std::strncpy(control->message, message.c_str(), sizeof(control->message)-1);
+            }
+        }
+        catch (...)
+        {
+            // Anything escaping here would leave the other ranks at the
+            // barrier.
+            int expected=0;
+            if (__atomic_compare_exchange_n(&control->error, &expected, 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            {
+                std::strncpy(control->message, "unknown exception", sizeof(control->message)-1);
+            }
+        }
+    }
+
+#ifdef __linux__
+    [[noreturn]] void worker_loop(DistributedControl* control, complex* amplitudes, size_t rank, size_t local_qubits)
+    {
+        for (;;)
+        {
+            pthread_barrier_wait(&control->barrier);
+            if (control->command==DistributedCommand::shutdown)
+            {
+                _exit(0);
+            }
+            execute_safely(control, amplitudes, rank, local_qubits);
+            pthread_barrier_wait(&control->barrier);
+        }
+    }
+#endif
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Process count
+///////////////////////////////////////////////////////////////////////////////
+
+size_t get_process_count()
+{
+    return configured_processes;
+}
+
+void set_process_count(size_t process_count)
+{
+    if (process_count==0||(process_count&(process_count-1))!=0)
+    {
+        throw std::invalid_argument("Process count must be a power of two");
+    }
+    configured_processes=process_count;
+}
+
+bool should_distribute(size_t num_qubits)
+{
+    size_t processes=get_process_count();
+    return processes>1&&num_qubits>=log2_exact(processes)+min_distributed_local_qubits;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// DistributedStateVector
+///////////////////////////////////////////////////////////////////////////////
+
+DistributedStateVector::DistributedStateVector(size_t n, size_t processes)
+    : num_qubits{ n }, num_processes{ processes }
+{
+    if (num_processes==0||(num_processes&(num_processes-1))!=0)
+    {
+        throw std::invalid_argument("Process count must be a power of two");
+    }
+    size_t global_qubits=log2_exact(num_processes);
+    if (global_qubits>=num_qubits)
+    {
+        throw std::invalid_argument("Each process needs at least one local qubit");
+    }
+    local_qubits=num_qubits-global_qubits;
+    MemoryBudget::instance().admit(::estimate_resources({}, num_qubits, 0, ExecutionMode::state_vector),
+        "DistributedStateVector");
+    for (size_t i=0; i<num_qubits; i++)
+    {
+        physical_of.push_back(i);
+        logical_of.push_back(i);
+    }
+
+    amplitude_bytes=(size_t(1)<<num_qubits)*sizeof(complex);
+#ifdef __linux__
+    void* shared_amplitudes=mmap(nullptr, amplitude_bytes, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    void* shared_control=mmap(nullptr, sizeof(DistributedControl), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (shared_amplitudes==MAP_FAILED||shared_control==MAP_FAILED)
+    {
+        if (shared_amplitudes!=MAP_FAILED)
+        {
+            munmap(shared_amplitudes, amplitude_bytes);
+        }
+        if (shared_control!=MAP_FAILED)
+        {
+            munmap(shared_control, sizeof(DistributedControl));
+        }
+        throw std::runtime_error("Could not map shared memory for DistributedStateVector");
+    }
+    QC_PROFILE_ALLOCATION(amplitude_bytes);
+    amplitudes=static_cast<complex*>(shared_amplitudes);
+    control=static_cast<DistributedControl*>(shared_control);
+    pthread_barrierattr_t attributes;
+    pthread_barrierattr_init(&attributes);
+    pthread_barrierattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_barrier_init(&control->barrier, &attributes, unsigned(num_processes));
+    pthread_barrierattr_destroy(&attributes);
+
+    // Every rank gets an equal share of the configured threads.
+    const size_t threads_per_rank=std::max<size_t>(1, get_thread_count()/num_processes);
+    const pid_t driver=getpid();
+    for (size_t rank=1; rank<num_processes; rank++)
+    {
+        pid_t pid=fork();
+        if (pid==0)
+        {
+            // Die with the driver rather than wait at the barrier forever.
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            if (getppid()!=driver)
+            {
+                _exit(1);
+            }
+            set_thread_count(threads_per_rank);
+            worker_loop(control, amplitudes, rank, local_qubits);
+        }
+        if (pid<0)
+        {
+            release();
+            throw std::runtime_error("Could not start worker process for DistributedStateVector");
+        }
+        workers.push_back(pid);
+    }
+#else
+    // No fork() here, so the driver runs every rank's share itself.
+    amplitudes=static_cast<complex*>(::operator new(amplitude_bytes));
+    QC_PROFILE_ALLOCATION(amplitude_bytes);
+    control=new DistributedControl();
+#endif
+    try
+    {
+        set_basis_state(0);
+    }
+    catch (...)
+    {
+        // The destructor does not run for a failed constructor.
+        release();
+        throw;
+    }
+}
+
+DistributedStateVector::~DistributedStateVector()
+{
+    release();
+}
+
+void DistributedStateVector::release()
+{
+    // Stops the workers and frees the shared memory. When some ranks were
+    // never started the barrier cannot complete, so the ones that were are
+    // killed instead of sent the shutdown command.
+#ifdef __linux__
+    if (workers.size()+1==num_processes)
+    {
+        control->command=DistributedCommand::shutdown;
+        pthread_barrier_wait(&control->barrier);
+    }
+    else
+    {
+        for (int worker : workers)
+        {
+            kill(worker, SIGKILL);
+        }
+    }
+    for (int worker : workers)
+    {
+        waitpid(worker, nullptr, 0);
+    }
+    workers.clear();
+    pthread_barrier_destroy(&control->barrier);
+    munmap(amplitudes, amplitude_bytes);
+    munmap(control, sizeof(DistributedControl));
+#else
+    ::operator delete(amplitudes);
+    delete control;
+#endif
+}
+
+size_t DistributedStateVector::to_physical(size_t logical_index) const
+{
+    size_t physical_index=0;
+    for (size_t q=0; q<num_qubits; q++)
+    {
+        physical_index|=((logical_index>>q)&1)<<physical_of[q];
+    }
+    return physical_index;
+}
+
+void DistributedStateVector::run_command()
+{
+    // The driver is rank 0.
+    control->error=0;
+#ifdef __linux__
+    pthread_barrier_wait(&control->barrier);
+    execute_safely(control, amplitudes, 0, local_qubits);
+    pthread_barrier_wait(&control->barrier);
+#else
+    // Ranks touch disjoint amplitudes (the two ranks of an exchange swap
+    // different halves of their pairs), so running them in turn is the same.
+    for (size_t rank=0; rank<num_processes; rank++)
+    {
+        execute_safely(control, amplitudes, rank, local_qubits);
+    }
+#endif
+    control->command=DistributedCommand::none;
+    if (control->error!=0)
+    {
+        throw std::runtime_error(std::string("DistributedStateVector worker failed: ")+control->message);
+    }
+}
+
+void DistributedStateVector::exchange(size_t local_position, size_t global_position)
+{
+    QC_PROFILE_SCOPE("exchange", "distributed", ProfileEvent::none, global_position,
+        size_t(1)<<num_qubits, 1, 0.0, double(amplitude_bytes));
+    control->command=DistributedCommand::exchange;
+    control->local_position=local_position;
+    control->global_position=global_position;
+    run_command();
+    size_t logical_local=logical_of[local_position];
+    size_t logical_global=logical_of[global_position];
+    std::swap(logical_of[local_position], logical_of[global_position]);
+    physical_of[logical_local]=global_position;
+    physical_of[logical_global]=local_position;
+    exchange_count++;
+}
+
+bool DistributedStateVector::make_local(const std::vector<size_t>& logical_targets)
+{
+    // Swaps every global target with the highest local qubit that is not
+    // itself a target. Returns false if there are not enough local qubits.
+    if (logical_targets.size()>local_qubits)
+    {
+        return false;
+    }
+    std::vector<bool> busy(local_qubits, false);
+    for (size_t target : logical_targets)
+    {
+        if (physical_of[target]<local_qubits)
+        {
+            busy[physical_of[target]]=true;
+        }
+    }
+    for (size_t target : logical_targets)
+    {
+        if (physical_of[target]<local_qubits)
+        {
+            continue;
+        }
+        size_t victim=local_qubits;
+        while (busy[--victim]) {}
+        exchange(victim, physical_of[target]);
+        busy[victim]=true;
+    }
+    return true;
+}
+
+// Accessors
+///////////////////////////////////////////////////////////////////////////////
+
+size_t DistributedStateVector::get_num_qubits() const
+{
+    return num_qubits;
+}
+
+size_t DistributedStateVector::get_num_processes() const
+{
+    return num_processes;
+}
+
+size_t DistributedStateVector::get_local_qubits() const
+{
+    return local_qubits;
+}
+
+size_t DistributedStateVector::get_exchange_count() const
+{
+    return exchange_count;
+}
+
+std::complex<double> DistributedStateVector::get_amplitude(size_t index) const
+{
+    if (index>=(size_t(1)<<num_qubits))
+    {
+        throw std::out_of_range("Amplitude index out of range for DistributedStateVector");
+    }
+    return amplitudes[to_physical(index)];
+}
+
+StateVector DistributedStateVector::to_state_vector() const
+{
+    // Gathers into logical order in the driver process.
+    StateVector state(num_qubits);
+    complex* data=state.get_data();
+    for (size_t i=0; i<state.get_size(); i++)
+    {
+        data[i]=amplitudes[to_physical(i)];
+    }
+    return state;
+}
+
+// Mutators
+///////////////////////////////////////////////////////////////////////////////
+
+void DistributedStateVector::set_basis_state(size_t index)
+{
+    if (index>=(size_t(1)<<num_qubits))
+    {
+        throw std::out_of_range("Basis state "+std::to_string(index)+" out of range for DistributedStateVector");
+    }
+    control->command=DistributedCommand::set_basis_state;
+    control->basis_index=to_physical(index);
+    run_command();
+}
+
+void DistributedStateVector::apply_operation(const Operation& operation)
+{
+    if (operation.targets.size()>max_listed_qubits||operation.controls.size()>max_listed_qubits)
+    {
+        throw std::invalid_argument("Too many qubits in operation for DistributedStateVector");
+    }
+    bool runnable=false;
+    switch (operation.type)
+    {
+    case OperationType::matrix:
+        runnable=operation.targets.size()<=max_matrix_qubits&&make_local(operation.targets);
+        break;
+    case OperationType::controlled:
+        runnable=make_local(operation.targets);
+        break;
+    case OperationType::qft:
+    case OperationType::inverse_qft:
+        // The kernel needs the range on consecutive local bits.
+        runnable=make_local(operation.targets);
+        for (size_t i=1; runnable&&i<operation.targets.size(); i++)
+        {
+            runnable=physical_of[operation.targets[i]]==physical_of[operation.targets[0]]+i;
+        }
+        break;
+    case OperationType::phase_oracle:
+    {
+        // The workers only receive a fixed size command, not a truth table,
+        // but a diagonal needs no locality: the driver sweeps the whole
+        // shared segment, reading its targets through the qubit map.
+        QC_PROFILE_SCOPE(operation.component!=nullptr ? operation.component->get_symbol() : "operation",
+            "distributed", operation.step_index, physical_of[operation.targets[0]],
+            size_t(1)<<num_qubits, 1, 0.0, 2.0*amplitude_bytes);
+        std::vector<size_t> physical_targets;
+        for (size_t target : operation.targets)
+        {
+            physical_targets.push_back(physical_of[target]);
+        }
+        apply_phase_oracle(amplitudes, num_qubits, physical_targets, *operation.marked);
+        return;
+    }
+    }
+    if (!runnable)
+    {
+        // Too wide for the local qubits: run the component's own gates.
+        std::vector<Operation> parts;
+        if (operation.component!=nullptr)
+        {
+            size_t offset=operation.targets[0]-operation.component->get_index();
+            operation.component->append_operations(parts, offset, true);
+        }
+        if (parts.size()<=1)
+        {
+            throw std::invalid_argument("Operation is too wide for the local qubits of DistributedStateVector");
+        }
+        for (const Operation& part : parts)
+        {
+            apply_operation(part);
+        }
+        return;
+    }
+    QC_PROFILE_SCOPE(operation.component!=nullptr ? operation.component->get_symbol() : "operation",
+        "distributed", operation.step_index, physical_of[operation.targets[0]],
+        size_t(1)<<num_qubits, 1, 0.0, 2.0*amplitude_bytes);
+    control->num_targets=operation.targets.size();
+    for (size_t i=0; i<operation.targets.size(); i++)
+    {
+        control->targets[i]=physical_of[operation.targets[i]];
+    }
+    control->num_controls=operation.controls.size();
+    for (size_t i=0; i<operation.controls.size(); i++)
+    {
+        control->controls[i]=physical_of[operation.controls[i]];
+    }
+    if (operation.type==OperationType::qft||operation.type==OperationType::inverse_qft)
+    {
+        control->command=DistributedCommand::qft;
+        control->inverse=operation.type==OperationType::inverse_qft;
+    }
+    else
+    {
+        control->command=operation.type==OperationType::matrix ? DistributedCommand::matrix : DistributedCommand::controlled;
+        const Matrix& matrix=*operation.matrix;
+        for (size_t i=0; i<matrix.get_rows(); i++)
+        {
+            for (size_t j=0; j<matrix.get_cols(); j++)
+            {
+                control->matrix[i*matrix.get_cols()+j]=matrix(i, j);
+            }
+        }
+    }
+    run_command();
+}
+
+void DistributedStateVector::apply_circuit(const QuantumCircuit& circuit)
+{
+    if (circuit.get_register_size()!=num_qubits)
+    {
+        throw std::invalid_argument("Circuit size does not match DistributedStateVector::apply_circuit()");
+    }
+    size_t index=0;
+    std::vector<int> input_register=circuit.get_input_register();
+    for (size_t i=0; i<num_qubits; i++)
+    {
+        if (input_register[i]==1)
+        {
+            index|=size_t(1)<<i;
+        }
+    }
+    set_basis_state(index);
+    for (const Operation& operation : circuit.get_operations(false))
+    {
+        apply_operation(operation);
+    }
+}
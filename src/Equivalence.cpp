@@ -0,0 +1,221 @@
+#include "Equivalence.h"
+#include "BlockedScheduler.h"
+#include "Parallel.h"
+#include "StateVector.h"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+
+typedef std::complex<double> complex;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // Inputs per thread before it is worth starting another one.
+    const size_t input_grain=64;
+
+    // <a|b> for normalised a and b.
+    complex overlap_of(const StateVector& a, const StateVector& b)
+    {
+        complex overlap=0;
+        for (size_t i=0; i<a.get_size(); i++)
+        {
+            overlap+=std::conj(a.get_data()[i])*b.get_data()[i];
+        }
+        return overlap;
+    }
+
+    // ||b-phase*a||, summed directly: 2-2Re(conj(phase)<a|b>) cancels to
+    // around 1e-16, which would hide distances below 1e-8.
+    double distance_of(const StateVector& a, const StateVector& b, const complex& phase)
+    {
+        double distance=0;
+        for (size_t i=0; i<a.get_size(); i++)
+        {
+            distance+=std::norm(b.get_data()[i]-phase*a.get_data()[i]);
+        }
+        return std::sqrt(distance);
+    }
+
+    complex phase_of(const complex& overlap)
+    {
+        double magnitude=std::abs(overlap);
+        return magnitude>0 ? overlap/magnitude : complex(1);
+    }
+
+    void fill_haar_random(StateVector& state, std::mt19937_64& rng)
+    {
+        // Independent complex Gaussians, normalised, are Haar distributed.
+        std::normal_distribution<double> gaussian(0, 1);
+        double norm=0;
+        complex* amplitudes=state.get_data();
+        for (size_t i=0; i<state.get_size(); i++)
+        {
+            amplitudes[i]=complex(gaussian(rng), gaussian(rng));
+            norm+=std::norm(amplitudes[i]);
+        }
+        const double scale=1/std::sqrt(norm);
+        for (size_t i=0; i<state.get_size(); i++)
+        {
+            amplitudes[i]*=scale;
+        }
+    }
+
+    double fidelity_bound(size_t passes, size_t num_qubits, double tolerance, double confidence)
+    {
+        // Every state passed with fidelity at least threshold. If the average
+        // fidelity F were lower, one state would pass with probability at
+        // most F/threshold (Markov) or var/(var+(threshold-F)^2) (Cantelli),
+        // with var<=16/(2^(n+1)-1) since |<psi|W|psi>|^2 is 4-Lipschitz on
+        // the sphere. Solve (pass probability)^passes=1-confidence for F.
+        if (passes==0)
+        {
+            return 0;
+        }
+        const double threshold=std::pow(std::max(0.0, 1-tolerance*tolerance/2), 2);
+        const double per_state=std::pow(1-confidence, 1.0/passes);
+        const double markov=threshold*per_state;
+        const double variance=16/(std::pow(2.0, double(num_qubits)+1)-1);
+        const double cantelli=threshold-std::sqrt(variance*(1/per_state-1));
+        return std::min(1.0, std::max(0.0, std::max(markov, cantelli)));
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Non-member functions
+///////////////////////////////////////////////////////////////////////////////
+
+EquivalenceReport check_equivalence(const std::vector<Operation>& first,
+    const std::vector<Operation>& second, size_t num_qubits, const EquivalenceOptions& options)
+{
+    if (options.confidence<0||options.confidence>=1)
+    {
+        throw std::invalid_argument("Equivalence confidence must be in [0, 1)");
+    }
+    if (options.random_states==0&&!options.check_basis_states)
+    {
+        throw std::invalid_argument("Equivalence check needs random states or basis states to run");
+    }
+    EquivalenceReport report;
+    report.confidence=options.confidence;
+    bool phase_fixed=!options.up_to_global_phase;
+    // Fixes the global phase on the first state, then checks ||b-phase*a||
+    // against the tolerance. The phase is always fixed before threads start.
+    std::mutex report_mutex;
+    auto record=[&](const StateVector& state_a, const StateVector& state_b, bool basis_state)
+    {
+        const complex overlap=overlap_of(state_a, state_b);
+        if (!phase_fixed)
+        {
+            report.global_phase=phase_of(overlap);
+            phase_fixed=true;
+        }
+        const double distance=distance_of(state_a, state_b, report.global_phase);
+        std::lock_guard<std::mutex> lock(report_mutex);
+        report.basis_states_checked+=basis_state;
+        report.worst_fidelity=std::min(report.worst_fidelity, std::norm(overlap));
+        report.largest_distance=std::max(report.largest_distance, distance);
+        if (distance>options.tolerance)
+        {
+            report.equivalent=false;
+        }
+        return distance<=options.tolerance;
+    };
+    StateVector a(num_qubits), b(num_qubits);
+    std::mt19937_64 rng(options.seed);
+    for (size_t s=0; s<options.random_states; s++)
+    {
+        fill_haar_random(a, rng);
+        std::copy(a.get_data(), a.get_data()+a.get_size(), b.get_data());
+        apply_operations(a, first);
+        apply_operations(b, second);
+        report.random_states_checked++;
+        if (!record(a, b, false))
+        {
+            report.failed_random_state=s;
+            return report;
+        }
+    }
+    if (options.check_basis_states)
+    {
+        // Basis state 0 runs first on its own when it has to fix the phase
+        // the threads compare against.
+        const size_t first_parallel=phase_fixed ? 0 : 1;
+        auto run_basis_state=[&](size_t input, StateVector& column_a, StateVector& column_b)
+        {
+            column_a.set_basis_state(input);
+            column_b.set_basis_state(input);
+            for (const Operation& operation : first)
+            {
+                column_a.apply_operation(operation);
+            }
+            for (const Operation& operation : second)
+            {
+                column_b.apply_operation(operation);
+            }
+        };
+        if (first_parallel==1)
+        {
+            run_basis_state(0, a, b);
+            if (!record(a, b, true))
+            {
+                report.failed_basis_state=0;
+            }
+        }
+        parallel_for(first_parallel, size_t(1)<<num_qubits, input_grain, [&](size_t begin, size_t end)
+        {
+            StateVector column_a(num_qubits), column_b(num_qubits);
+            for (size_t input=begin; input<end; input++)
+            {
+                run_basis_state(input, column_a, column_b);
+                if (!record(column_a, column_b, true))
+                {
+                    std::lock_guard<std::mutex> lock(report_mutex);
+                    report.failed_basis_state=std::min(report.failed_basis_state, input);
+                }
+            }
+        });
+        if (report.equivalent)
+        {
+            report.fidelity_bound=std::pow(std::max(0.0, 1-options.tolerance), 2);
+            return report;
+        }
+    }
+    if (report.equivalent)
+    {
+        report.fidelity_bound=fidelity_bound(report.random_states_checked, num_qubits,
+            options.tolerance, options.confidence);
+    }
+    return report;
+}
+
+std::ostream& operator<<(std::ostream& os, const EquivalenceReport& report)
+{
+    if (!report.passed())
+    {
+        os<<"not equivalent: ";
+        if (report.failed_random_state!=EquivalenceReport::none)
+        {
+            os<<"random state "<<report.failed_random_state;
+        }
+        else
+        {
+            os<<"basis state "<<report.failed_basis_state;
+        }
+        return os<<" differs by "<<report.largest_distance<<" (fidelity "<<report.worst_fidelity<<")";
+    }
+    os<<"equivalent on "<<report.random_states_checked<<" random states";
+    if (report.basis_states_checked>0)
+    {
+        os<<" and "<<report.basis_states_checked<<" basis states";
+    }
+    return os<<" (worst fidelity "<<report.worst_fidelity<<", phase "<<report.global_phase
+        <<", average fidelity >= "<<report.fidelity_bound<<" with "<<100*report.confidence<<"% confidence)";
+}
@@ -0,0 +1,330 @@
+#include "GateCache.h"
+#include "MemoryPool.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    const char file_magic[8]={ 'Q', 'C', 'G', 'C', 'A', 'C', 'H', '2' };
+    const size_t family_magic_size=7; // "QCGCACH" of every layout.
+
+    // Written after the magic. Bump it whenever a factory's circuit or the
+    // way its key is built changes, so caches from older builds are dropped
+    // instead of handing back stale matrices.
+    const uint64_t decomposition_version=1;
+
+    // 64 bit FNV-1a, run twice with different offsets for a 128 bit key.
+    struct ContentHash
+    {
+        uint64_t a=0xcbf29ce484222325ull;
+        uint64_t b=0x84222325cbf29ce4ull;
+
+        void add(const void* data, size_t size)
+        {
+            const unsigned char* bytes=static_cast<const unsigned char*>(data);
+            for (size_t i=0; i<size; i++)
+            {
+                a=(a^bytes[i])*0x100000001b3ull;
+                b=(b^bytes[i])*0x100000001b3ull;
+                b^=b>>29;
+            }
+        }
+
+        void add(size_t value)
+        {
+            uint64_t word=value;
+            add(&word, sizeof(word));
+        }
+    };
+
+    void write_size(std::ostream& os, uint64_t value)
+    {
+        os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    uint64_t read_size(std::istream& is)
+    {
+        uint64_t value=0;
+        is.read(reinterpret_cast<char*>(&value), sizeof(value));
+        return value;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GateCache
+///////////////////////////////////////////////////////////////////////////////
+
+GateCache::GateCache()
+{
+    // The destructor saves at exit from matrices whose buffers the pool owns,
+    // so the pool is constructed first and destroyed after the cache.
+    MemoryPool::instance();
+}
+
+GateCache::~GateCache()
+{
+    if (!cache_file.empty())
+    {
+        try
+        {
+            save(cache_file);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr<<"Could not write gate cache: "<<e.what()<<std::endl;
+        }
+    }
+}
+
+GateCache& GateCache::instance()
+{
+    static GateCache cache;
+    return cache;
+}
+
+// Accessors
+///////////////////////////////////////////////////////////////////////////////
+
+size_t GateCache::get_hits() const
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return hits;
+}
+
+size_t GateCache::get_misses() const
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return misses;
+}
+
+size_t GateCache::get_loaded() const
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return loaded;
+}
+
+size_t GateCache::get_size() const
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return matrices.size();
+}
+
+// Mutators
+///////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const QuantumCircuit> GateCache::get_circuit(const std::string& key,
+    const std::function<QuantumCircuit()>& build)
+{
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto found=circuits.find(key);
+        if (found!=circuits.end())
+        {
+            return found->second;
+        }
+    }
+    // Built without the lock, since factories may ask the cache for the
+    // gates they are made of.
+    auto circuit=std::make_shared<const QuantumCircuit>(build());
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return circuits.emplace(key, circuit).first->second;
+}
+
+std::shared_ptr<const Matrix> GateCache::get_matrix(const std::string& key,
+    const QuantumCircuit& circuit)
+{
+    std::shared_ptr<Entry> entry;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        std::shared_ptr<Entry>& slot=matrices[key];
+        if (!slot)
+        {
+            slot=std::make_shared<Entry>();
+        }
+        entry=slot;
+    }
+    bool compiled=false;
+    std::call_once(entry->compile_flag, [&]()
+        {
+            if (!entry->matrix)
+            {
+                entry->matrix=std::make_shared<const Matrix>(circuit.get_matrix());
+                compiled=true;
+            }
+        });
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    compiled ? misses++ : hits++;
+    return entry->matrix;
+}
+
+size_t GateCache::load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return 0;
+    }
+    char magic[sizeof(file_magic)];
+    file.read(magic, sizeof(magic));
+    if (!file||std::memcmp(magic, file_magic, family_magic_size)!=0)
+    {
+        throw std::invalid_argument("File "+path+" is not a gate cache");
+    }
+    if (std::memcmp(magic, file_magic, sizeof(magic))!=0||read_size(file)!=decomposition_version)
+    {
+        return 0; // Written by another build; it is replaced on the next save.
+    }
+    size_t count=read_size(file);
+    size_t added=0;
+    for (size_t e=0; e<count; e++)
+    {
+        std::string key(read_size(file), '\0');
+        file.read(&key[0], key.size());
+        size_t rows=read_size(file);
+        size_t cols=read_size(file);
+        if (!file||rows*cols>(size_t(1)<<30))
+        {
+            throw std::invalid_argument("Gate cache "+path+" is truncated or corrupt");
+        }
+        std::vector<std::complex<double>> values(rows*cols);
+        file.read(reinterpret_cast<char*>(values.data()), values.size()*sizeof(std::complex<double>));
+        if (!file)
+        {
+            throw std::invalid_argument("Gate cache "+path+" is truncated or corrupt");
+        }
+        auto matrix=std::make_shared<Matrix>(rows, cols);
+        for (size_t i=0; i<rows; i++)
+        {
+            for (size_t j=0; j<cols; j++)
+            {
+                (*matrix)(i, j)=values[i*cols+j];
+            }
+        }
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        std::shared_ptr<Entry>& slot=matrices[key];
+        if (!slot)
+        {
+            slot=std::make_shared<Entry>();
+            slot->matrix=matrix;
+            added++;
+        }
+    }
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    loaded+=added;
+    return added;
+}
+
+void GateCache::save(const std::string& path) const
+{
+    // Snapshot the compiled entries, then write without holding the lock.
+    std::vector<std::pair<std::string, std::shared_ptr<const Matrix>>> compiled;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        for (const auto& entry : matrices)
+        {
+            if (entry.second->matrix)
+            {
+                compiled.emplace_back(entry.first, entry.second->matrix);
+            }
+        }
+    }
+    std::ofstream file(path, std::ios::binary|std::ios::trunc);
+    if (!file)
+    {
+        throw std::invalid_argument("Could not open "+path+" for writing");
+    }
+    file.write(file_magic, sizeof(file_magic));
+    write_size(file, decomposition_version);
+    write_size(file, compiled.size());
+    for (const auto& entry : compiled)
+    {
+        const Matrix& matrix=*entry.second;
+        write_size(file, entry.first.size());
+        file.write(entry.first.data(), entry.first.size());
+        write_size(file, matrix.get_rows());
+        write_size(file, matrix.get_cols());
+        std::vector<std::complex<double>> values;
+        values.reserve(matrix.get_rows()*matrix.get_cols());
+        for (size_t i=0; i<matrix.get_rows(); i++)
+        {
+            for (size_t j=0; j<matrix.get_cols(); j++)
+            {
+                values.push_back(matrix(i, j));
+            }
+        }
+        file.write(reinterpret_cast<const char*>(values.data()), values.size()*sizeof(std::complex<double>));
+    }
+}
+
+void GateCache::set_cache_file(const std::string& path)
+{
+    // Loads what earlier runs compiled; everything compiled by the end of
+    // this run is written back when the process exits.
+    load(path);
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache_file=path;
+}
+
+void GateCache::clear()
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    circuits.clear();
+    matrices.clear();
+    hits=0;
+    misses=0;
+    loaded=0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Non-member functions
+///////////////////////////////////////////////////////////////////////////////
+
+std::string get_circuit_key(const QuantumCircuit& circuit)
+{
+    // Subcircuits are decomposed so that hashing never compiles anything.
+    ContentHash hash;
+    for (const Operation& operation : circuit.get_operations(true))
+    {
+        hash.add(size_t(operation.type));
+        hash.add(operation.targets.size());
+        for (size_t target : operation.targets)
+        {
+            hash.add(target);
+        }
+        hash.add(operation.controls.size());
+        for (size_t control : operation.controls)
+        {
+            hash.add(control);
+        }
+        if (operation.matrix)
+        {
+            for (size_t i=0; i<operation.matrix->get_rows(); i++)
+            {
+                for (size_t j=0; j<operation.matrix->get_cols(); j++)
+                {
+                    std::complex<double> value=(*operation.matrix)(i, j);
+                    hash.add(&value, sizeof(value));
+                }
+            }
+        }
+        if (operation.marked)
+        {
+            hash.add(operation.marked->data(), operation.marked->size()*sizeof(uint64_t));
+        }
+    }
+    std::ostringstream key;
+    key<<"circuit("<<circuit.get_register_size()<<","<<std::hex<<std::setfill('0')
+        <<std::setw(16)<<hash.a<<std::setw(16)<<hash.b<<")";
+    return key.str();
+}
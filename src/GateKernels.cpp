@@ -0,0 +1,386 @@
+#include "GateKernels.h"
+#include "Parallel.h"
+#include <algorithm>
+
+typedef std::complex<double> complex;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // Amplitudes handled per thread before it is worth starting another one.
+    const size_t parallel_grain=1<<14;
+
+    // Gate matrices built as products of other gates (eg: toffoli()) carry
+    // rounding noise in their zero entries, which is dropped. Non-zero
+    // entries are kept as they are, so such a gate runs as a monomial rather
+    // than a permutation and its result does not change.
+    inline bool is_zero(const complex& value)
+    {
+        return std::abs(value.real())<=gate_zero_tolerance&&std::abs(value.imag())<=gate_zero_tolerance;
+    }
+
+    inline complex mul(const complex& a, const complex& b)
+    {
+        return complex(a.real()*b.real()-a.imag()*b.imag(), a.real()*b.imag()+a.imag()*b.real());
+    }
+
+    /**
+     * @brief Everything a K qubit kernel needs, in fixed-size arrays so the
+     * loops over them unroll.
+     */
+    template <size_t K>
+    struct GateData
+    {
+        static constexpr size_t dimension=size_t(1)<<K;
+        complex entries[dimension*dimension];
+        complex factors[dimension]; // The non-zero entry of each row (monomial gates).
+        size_t sources[dimension];  // Its column.
+        size_t offsets[dimension];  // Index bits of each local basis state.
+        size_t sorted[K];           // Target positions, ascending.
+        double hadamard_factor;
+    };
+
+    template <size_t K>
+    GateData<K> prepare(const std::vector<size_t>& targets, const Matrix& matrix)
+    {
+        constexpr size_t dimension=GateData<K>::dimension;
+        GateData<K> gate{};
+        for (size_t r=0; r<K; r++)
+        {
+            gate.sorted[r]=targets[r];
+        }
+        std::sort(gate.sorted, gate.sorted+K);
+        for (size_t local=0; local<dimension; local++)
+        {
+            for (size_t r=0; r<K; r++)
+            {
+                if ((local>>r)&1)
+                {
+                    gate.offsets[local]|=size_t(1)<<targets[r];
+                }
+            }
+        }
+        for (size_t i=0; i<dimension; i++)
+        {
+            for (size_t j=0; j<dimension; j++)
+            {
+                gate.entries[i*dimension+j]=matrix(i, j);
+                if (!is_zero(matrix(i, j)))
+                {
+                    gate.factors[i]=matrix(i, j);
+                    gate.sources[i]=j;
+                }
+            }
+        }
+        gate.hadamard_factor=matrix(0, 0).real();
+        return gate;
+    }
+
+    size_t insert_zero_bits(size_t index, const size_t* sorted_positions, size_t count)
+    {
+        for (size_t r=0; r<count; r++)
+        {
+            size_t position=sorted_positions[r];
+            index=((index>>position)<<(position+1))|(index&((size_t(1)<<position)-1));
+        }
+        return index;
+    }
+
+    // Same with a count known at compile time, so the loop unrolls.
+    template <size_t P>
+    inline size_t insert_zero_bits(size_t index, const size_t* sorted_positions)
+    {
+        for (size_t r=0; r<P; r++)
+        {
+            size_t position=sorted_positions[r];
+            index=((index>>position)<<(position+1))|(index&((size_t(1)<<position)-1));
+        }
+        return index;
+    }
+
+    /**
+     * @brief Applies the gate to the 2^K amplitudes at a+offsets[i]. Only the
+     * work the gate's class needs is done: phase gates touch one amplitude,
+     * permutations only move data and the Hadamard uses a real factor.
+     */
+    template <size_t K, GateClass C>
+    inline void apply_group(complex* a, const GateData<K>& gate)
+    {
+        constexpr size_t dimension=GateData<K>::dimension;
+        if constexpr (C==GateClass::phase)
+        {
+            complex& last=a[gate.offsets[dimension-1]];
+            last=mul(gate.factors[dimension-1], last);
+        }
+        else if constexpr (C==GateClass::diagonal)
+        {
+            for (size_t i=0; i<dimension; i++)
+            {
+                a[gate.offsets[i]]=mul(gate.factors[i], a[gate.offsets[i]]);
+            }
+        }
+        else if constexpr (C==GateClass::permutation||C==GateClass::monomial)
+        {
+            complex in[dimension];
+            for (size_t j=0; j<dimension; j++)
+            {
+                in[j]=a[gate.offsets[j]];
+            }
+            for (size_t i=0; i<dimension; i++)
+            {
+                if constexpr (C==GateClass::permutation)
+                {
+                    a[gate.offsets[i]]=in[gate.sources[i]];
+                }
+                else
+                {
+                    a[gate.offsets[i]]=mul(gate.factors[i], in[gate.sources[i]]);
+                }
+            }
+        }
+        else if constexpr (C==GateClass::hadamard)
+        {
+            complex x=a[0], y=a[gate.offsets[1]];
+            a[0]=(x+y)*gate.hadamard_factor;
+            a[gate.offsets[1]]=(x-y)*gate.hadamard_factor;
+        }
+        else
+        {
+            complex in[dimension];
+            for (size_t j=0; j<dimension; j++)
+            {
+                in[j]=a[gate.offsets[j]];
+            }
+            for (size_t i=0; i<dimension; i++)
+            {
+                const complex* row=&gate.entries[i*dimension];
+                complex sum=mul(row[0], in[0]);
+                for (size_t j=1; j<dimension; j++)
+                {
+                    sum+=mul(row[j], in[j]);
+                }
+                a[gate.offsets[i]]=sum;
+            }
+        }
+    }
+
+    // Monomial gates on more than max_specialised_qubits: out[i]=f[i]*in[s[i]]
+    // with the size only known at run time, instead of a dense product.
+    void run_wide_monomial(complex* amplitudes, size_t num_qubits, const std::vector<size_t>& targets, const Matrix& matrix, bool unit_factors)
+    {
+        const size_t k=targets.size();
+        const size_t dimension=size_t(1)<<k;
+        std::vector<size_t> sorted(targets);
+        std::sort(sorted.begin(), sorted.end());
+        std::vector<size_t> offsets(dimension, 0), sources(dimension, 0);
+        std::vector<complex> factors(dimension);
+        for (size_t local=0; local<dimension; local++)
+        {
+            for (size_t r=0; r<k; r++)
+            {
+                if ((local>>r)&1)
+                {
+                    offsets[local]|=size_t(1)<<targets[r];
+                }
+            }
+            for (size_t j=0; j<dimension; j++)
+            {
+                if (!is_zero(matrix(local, j)))
+                {
+                    sources[local]=j;
+                    factors[local]=matrix(local, j);
+                }
+            }
+        }
+        parallel_for(0, (size_t(1)<<num_qubits)>>k, std::max<size_t>(1, parallel_grain>>k), [&](size_t begin, size_t end)
+            {
+                std::vector<complex> in(dimension);
+                for (size_t group=begin; group<end; group++)
+                {
+                    complex* a=amplitudes+insert_zero_bits(group, sorted.data(), k);
+                    for (size_t j=0; j<dimension; j++)
+                    {
+                        in[j]=a[offsets[j]];
+                    }
+                    for (size_t i=0; i<dimension; i++)
+                    {
+                        a[offsets[i]]=unit_factors ? in[sources[i]] : mul(factors[i], in[sources[i]]);
+                    }
+                }
+            });
+    }
+
+    typedef void (*MatrixKernel)(complex*, size_t, const std::vector<size_t>&, const Matrix&);
+    typedef void (*ControlledKernel)(complex*, size_t, const std::vector<size_t>&, size_t, const Matrix&);
+
+    void skip_matrix(complex*, size_t, const std::vector<size_t>&, const Matrix&) {}
+    void skip_controlled(complex*, size_t, const std::vector<size_t>&, size_t, const Matrix&) {}
+
+    template <size_t K, GateClass C>
+    void run_matrix(complex* amplitudes, size_t num_qubits, const std::vector<size_t>& targets, const Matrix& matrix)
+    {
+        const GateData<K> gate=prepare<K>(targets, matrix);
+        parallel_for(0, (size_t(1)<<num_qubits)>>K, std::max<size_t>(1, parallel_grain>>K), [&](size_t begin, size_t end)
+            {
+                for (size_t group=begin; group<end; group++)
+                {
+                    apply_group<K, C>(amplitudes+insert_zero_bits<K>(group, gate.sorted), gate);
+                }
+            });
+    }
+
+    // P is the number of controls plus the target, or 0 if only known at
+    // run time.
+    template <size_t P, GateClass C>
+    void run_controlled(complex* amplitudes, size_t num_qubits, const std::vector<size_t>& controls, size_t target, const Matrix& matrix)
+    {
+        const GateData<1> gate=prepare<1>({ target }, matrix);
+        std::vector<size_t> positions(controls);
+        positions.push_back(target);
+        std::sort(positions.begin(), positions.end());
+        size_t control_mask=0;
+        for (size_t control : controls)
+        {
+            control_mask|=size_t(1)<<control;
+        }
+        const size_t* sorted=positions.data();
+        const size_t count=positions.size();
+        parallel_for(0, (size_t(1)<<num_qubits)>>count, parallel_grain/2, [&](size_t begin, size_t end)
+            {
+                for (size_t group=begin; group<end; group++)
+                {
+                    size_t base=(P==0 ? insert_zero_bits(group, sorted, count) : insert_zero_bits<P>(group, sorted))|control_mask;
+                    apply_group<1, C>(amplitudes+base, gate);
+                }
+            });
+    }
+
+    // Indexed by [targets-1][GateClass]. The Hadamard class only exists for
+    // one qubit; wider entries fall back to the general kernel.
+    const MatrixKernel matrix_kernels[max_specialised_qubits][gate_class_count]=
+    {
+        { skip_matrix, run_matrix<1, GateClass::phase>, run_matrix<1, GateClass::diagonal>,
+            run_matrix<1, GateClass::permutation>, run_matrix<1, GateClass::monomial>,
+            run_matrix<1, GateClass::hadamard>, run_matrix<1, GateClass::general> },
+        { skip_matrix, run_matrix<2, GateClass::phase>, run_matrix<2, GateClass::diagonal>,
+            run_matrix<2, GateClass::permutation>, run_matrix<2, GateClass::monomial>,
+            run_matrix<2, GateClass::general>, run_matrix<2, GateClass::general> },
+        { skip_matrix, run_matrix<3, GateClass::phase>, run_matrix<3, GateClass::diagonal>,
+            run_matrix<3, GateClass::permutation>, run_matrix<3, GateClass::monomial>,
+            run_matrix<3, GateClass::general>, run_matrix<3, GateClass::general> }
+    };
+
+    // Indexed by [controls][GateClass], the last row for any number of
+    // controls above two.
+    const ControlledKernel controlled_kernels[4][gate_class_count]=
+    {
+        { skip_controlled, run_controlled<1, GateClass::phase>, run_controlled<1, GateClass::diagonal>,
+            run_controlled<1, GateClass::permutation>, run_controlled<1, GateClass::monomial>,
+            run_controlled<1, GateClass::hadamard>, run_controlled<1, GateClass::general> },
+        { skip_controlled, run_controlled<2, GateClass::phase>, run_controlled<2, GateClass::diagonal>,
+            run_controlled<2, GateClass::permutation>, run_controlled<2, GateClass::monomial>,
+            run_controlled<2, GateClass::hadamard>, run_controlled<2, GateClass::general> },
+        { skip_controlled, run_controlled<3, GateClass::phase>, run_controlled<3, GateClass::diagonal>,
+            run_controlled<3, GateClass::permutation>, run_controlled<3, GateClass::monomial>,
+            run_controlled<3, GateClass::hadamard>, run_controlled<3, GateClass::general> },
+        { skip_controlled, run_controlled<0, GateClass::phase>, run_controlled<0, GateClass::diagonal>,
+            run_controlled<0, GateClass::permutation>, run_controlled<0, GateClass::monomial>,
+            run_controlled<0, GateClass::hadamard>, run_controlled<0, GateClass::general> }
+    };
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Non-member functions
+///////////////////////////////////////////////////////////////////////////////
+
+GateClass classify_gate(const Matrix& matrix)
+{
+    const size_t dimension=matrix.get_rows();
+    bool monomial=true;
+    bool diagonal=true;
+    bool unit_entries=true; // Every non-zero entry is exactly 1.
+    bool unit_leading_diagonal=true; // Diagonal entries before the last are 1.
+    std::vector<bool> column_used(dimension, false);
+    for (size_t i=0; i<dimension&&monomial; i++)
+    {
+        size_t non_zero=0;
+        for (size_t j=0; j<dimension; j++)
+        {
+            complex value=matrix(i, j);
+            if (is_zero(value))
+            {
+                continue;
+            }
+            non_zero++;
+            monomial=monomial&&!column_used[j];
+            column_used[j]=true;
+            diagonal=diagonal&&i==j;
+            unit_entries=unit_entries&&value==1.0;
+            if (i==j&&i+1<dimension)
+            {
+                unit_leading_diagonal=unit_leading_diagonal&&value==1.0;
+            }
+        }
+        monomial=monomial&&non_zero==1;
+    }
+    if (monomial&&diagonal)
+    {
+        if (unit_entries)
+        {
+            return GateClass::identity;
+        }
+        return unit_leading_diagonal ? GateClass::phase : GateClass::diagonal;
+    }
+    if (monomial)
+    {
+        return unit_entries ? GateClass::permutation : GateClass::monomial;
+    }
+    if (dimension==2)
+    {
+        complex a=matrix(0, 0);
+        if (a.imag()==0&&matrix(0, 1)==a&&matrix(1, 0)==a&&matrix(1, 1)==-a)
+        {
+            return GateClass::hadamard;
+        }
+    }
+    return GateClass::general;
+}
+
+bool apply_specialised_matrix(std::complex<double>* amplitudes, size_t num_qubits, const std::vector<size_t>& targets, const Matrix& matrix)
+{
+    if (targets.empty())
+    {
+        return false;
+    }
+    GateClass gate_class=classify_gate(matrix);
+    if (targets.size()>max_specialised_qubits)
+    {
+        switch (gate_class)
+        {
+        case GateClass::identity:
+            return true;
+        case GateClass::phase:
+        case GateClass::diagonal:
+        case GateClass::monomial:
+            run_wide_monomial(amplitudes, num_qubits, targets, matrix, false);
+            return true;
+        case GateClass::permutation:
+            run_wide_monomial(amplitudes, num_qubits, targets, matrix, true);
+            return true;
+        default:
+            return false;
+        }
+    }
+    matrix_kernels[targets.size()-1][size_t(gate_class)](amplitudes, num_qubits, targets, matrix);
+    return true;
+}
+
+void apply_specialised_controlled(std::complex<double>* amplitudes, size_t num_qubits, const std::vector<size_t>& controls, size_t target, const Matrix& matrix)
+{
+    controlled_kernels[std::min<size_t>(controls.size(), 3)][size_t(classify_gate(matrix))](amplitudes, num_qubits, controls, target, matrix);
+}
@@ -1,4 +1,7 @@
 #include "Matrix.h"
+#include "Profiler.h"
+#include <cmath>
+#include <utility>
 
 ///////////////////////////////////////////////////////////////////////////////
 // Helper functions
@@ -19,19 +22,38 @@ Matrix::Matrix() : Matrix(0, 0) {}
 
 Matrix::Matrix(size_t r, size_t c) : rows{ r }, cols{ c }
 {
-    data=std::vector<std::vector<std::complex<double>>>(rows, std::vector<std::complex<double>>(cols, std::complex<double>(0.0, 0.0)));
+    QC_PROFILE_ALLOCATION(rows*cols*sizeof(std::complex<double>));
+    data.assign(rows*cols, std::complex<double>(0.0, 0.0));
 }
 
-Matrix::Matrix(std::vector<std::vector<std::complex<double>>> data_in) : data{ data_in }
+Matrix::Matrix(std::vector<std::vector<std::complex<double>>> data_in)
 {
-    rows=data.size();
-    cols=data[0].size();
+    rows=data_in.size();
+    cols=data_in[0].size();
+    data.reserve(rows*cols);
+    for (const auto& row : data_in)
+    {
+        data.insert(data.end(), row.begin(), row.end());
+    }
+}
+
+Matrix::Matrix(const Matrix& m) : rows{ m.rows }, cols{ m.cols }, data{ m.data }
+{
+    QC_PROFILE_ALLOCATION(rows*cols*sizeof(std::complex<double>));
+}
+
+// Moves hand over the storage, so they are not counted as allocations.
+Matrix::Matrix(Matrix&& m) noexcept : rows{ m.rows }, cols{ m.cols }, data{ std::move(m.data) }
+{
+    m.rows=0;
+    m.cols=0;
 }
 
 Matrix& Matrix::operator=(const Matrix& m)
 {
     if (this!=&m)
     {
+        QC_PROFILE_ALLOCATION(m.rows*m.cols*sizeof(std::complex<double>));
         rows=m.rows;
         cols=m.cols;
         data=m.data;
@@ -39,7 +61,20 @@ Matrix& Matrix::operator=(const Matrix& m)
     return *this;
 }
 
-Matrix Matrix::operator+(const Matrix& m)
+Matrix& Matrix::operator=(Matrix&& m) noexcept
+{
+    if (this!=&m)
+    {
+        rows=m.rows;
+        cols=m.cols;
+        data=std::move(m.data);
+        m.rows=0;
+        m.cols=0;
+    }
+    return *this;
+}
+
+Matrix Matrix::operator+(const Matrix& m) const
 {
     if (rows!=m.rows||cols!=m.cols)
     {
@@ -50,13 +85,13 @@ Matrix Matrix::operator+(const Matrix& m)
     {
         for (int j=0; j<cols; j++)
         {
-            result(i, j)=data[i][j]+m(i, j);
+            result(i, j)=data[i*cols+j]+m(i, j);
         }
     }
     return result;
 }
 
-Matrix Matrix::operator-(const Matrix& m)
+Matrix Matrix::operator-(const Matrix& m) const
 {
     if (rows!=m.rows||cols!=m.cols)
     {
@@ -67,13 +102,13 @@ Matrix Matrix::operator-(const Matrix& m)
     {
         for (int j=0; j<cols; j++)
         {
-            result(i, j)=data[i][j]-m(i, j);
+            result(i, j)=data[i*cols+j]-m(i, j);
         }
     }
     return result;
 }
 
-Matrix Matrix::operator*(const Matrix& m)
+Matrix Matrix::operator*(const Matrix& m) const
 {
     if (cols!=m.rows)
     {
@@ -86,7 +121,7 @@ Matrix Matrix::operator*(const Matrix& m)
         {
             for (int k=0; k<cols; k++)
             {
-                result(i, j)+=data[i][k]*m(k, j);
+                result(i, j)+=data[i*cols+k]*m(k, j);
             }
         }
     }
@@ -99,7 +134,7 @@ const std::complex<double> Matrix::operator()(size_t r, size_t c) const
     {
         throw std::out_of_range("Index ("+std::to_string(r)+","+std::to_string(c)+") out of bounds");
     }
-    return data[r][c];
+    return data[r*cols+c];
 }
 
 std::complex<double>& Matrix::operator()(size_t r, size_t c)
@@ -108,7 +143,7 @@ std::complex<double>& Matrix::operator()(size_t r, size_t c)
     {
         throw std::out_of_range("Index ("+std::to_string(r)+","+std::to_string(c)+") out of bounds");
     }
-    return data[r][c];
+    return data[r*cols+c];
 }
 
 std::ostream& operator<<(std::ostream& os, const Matrix& matrix)
@@ -119,8 +154,8 @@ std::ostream& operator<<(std::ostream& os, const Matrix& matrix)
     {
         for (int j{}; j<matrix.cols; j++)
         {
-            double real=matrix.data[i][j].real();
-            double imag=matrix.data[i][j].imag();
+            double real=matrix.data[i*matrix.cols+j].real();
+            double imag=matrix.data[i*matrix.cols+j].imag();
             char sign=imag>=0 ? '+' : '-';
             imag=imag>=0 ? imag : -imag;
             real=real==0 ? 0 : real; // fix for -0 (which is a thing, like y)
@@ -172,7 +207,7 @@ std::istream& operator>>(std::istream& is, Matrix& matrix)
         {
             try
             {
-                is>>matrix.data[i][j];
+                is>>matrix.data[i*matrix.cols+j];
             }
             catch (std::invalid_argument& e)
             {
@@ -183,7 +218,8 @@ std::istream& operator>>(std::istream& is, Matrix& matrix)
     return is;
 }
 
-bool Matrix::operator==(const Matrix m) {
+bool Matrix::operator==(const Matrix& m) const
+{
     if (rows!=m.get_rows()||cols!=m.get_cols())
     {
         return false;
@@ -193,7 +229,7 @@ bool Matrix::operator==(const Matrix m) {
         for (int j{}; j<cols; j++)
         {
             double tol=1e-10;
-            if (abs(data[i][j].real()-m(i, j).real())>tol||abs(data[i][j].imag()-m(i, j).imag())>tol)
+            if (std::abs(data[i*cols+j].real()-m(i, j).real())>tol||std::abs(data[i*cols+j].imag()-m(i, j).imag())>tol)
             {
                 return false;
             }
@@ -202,7 +238,7 @@ bool Matrix::operator==(const Matrix m) {
     return true;
 }
 
-Matrix Matrix::tensor_product(const Matrix& m)
+Matrix Matrix::tensor_product(const Matrix& m) const
 {
     Matrix result(rows*m.rows, cols*m.cols);
     for (int i=0; i<rows; i++)
@@ -213,7 +249,7 @@ Matrix Matrix::tensor_product(const Matrix& m)
             {
                 for (int v=0; v<m.cols; v++)
                 {
-                    result(u*rows+i, v*cols+j)=data[i][j]*m(u, v);
+                    result(u*rows+i, v*cols+j)=data[i*cols+j]*m(u, v);
                 }
             }
         }
@@ -221,33 +257,33 @@ Matrix Matrix::tensor_product(const Matrix& m)
     return result;
 }
 
-Matrix Matrix::transpose()
+Matrix Matrix::transpose() const
 {
     Matrix result(cols, rows);
     for (int i=0; i<rows; i++)
     {
         for (int j=0; j<cols; j++)
         {
-            result(j, i)=data[i][j];
+            result(j, i)=data[i*cols+j];
         }
     }
     return result;
 }
 
-Matrix Matrix::conjugate()
+Matrix Matrix::conjugate() const
 {
     Matrix result(rows, cols);
     for (int i=0; i<rows; i++)
     {
         for (int j=0; j<cols; j++)
         {
-            result(i, j)=std::conj(data[i][j]);
+            result(i, j)=std::conj(data[i*cols+j]);
         }
     }
     return result;
 }
 
-Matrix Matrix::adjoint()
+Matrix Matrix::adjoint() const
 {
     return transpose().conjugate();
 }
@@ -267,7 +303,7 @@ Matrix identity_matrix(size_t n)
     return result;
 }
 
-Matrix perform_tensor_product(const std::vector<Matrix> matrices)
+Matrix perform_tensor_product(const std::vector<Matrix>& matrices)
 {
     Matrix result=matrices[0];
     for (size_t i=1; i<matrices.size(); i++)
@@ -0,0 +1,704 @@
+#include "MatrixProductState.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+typedef std::complex<double> complex;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    /**
+     * @brief Thin singular value decomposition a=u*diag(s)*vh of a row-major
+     * m x n matrix using one-sided (Hestenes) Jacobi rotations. u is m x k and
+     * vh is k x n, with k=min(m, n) and s sorted in descending order.
+     */
+    void svd(const std::vector<complex>& a, size_t m, size_t n,
+        std::vector<complex>& u, std::vector<double>& s, std::vector<complex>& vh)
+    {
+        if (m<n)
+        {
+            // Decompose the adjoint instead so there are fewer columns.
+            std::vector<complex> a_adjoint(n*m);
+            for (size_t i=0; i<m; i++)
+            {
+                for (size_t j=0; j<n; j++)
+                {
+                    a_adjoint[j*m+i]=std::conj(a[i*n+j]);
+                }
+            }
+            std::vector<complex> u_adjoint, vh_adjoint;
+            svd(a_adjoint, n, m, u_adjoint, s, vh_adjoint);
+            // a = (u' s vh')^dagger = vh'^dagger s u'^dagger
+            size_t k=m;
+            u=std::vector<complex>(m*k);
+            vh=std::vector<complex>(k*n);
+            for (size_t i=0; i<k; i++)
+            {
+                for (size_t j=0; j<m; j++)
+                {
+                    u[j*k+i]=std::conj(vh_adjoint[i*m+j]);
+                }
+                for (size_t j=0; j<n; j++)
+                {
+                    vh[i*n+j]=std::conj(u_adjoint[j*k+i]);
+                }
+            }
+            return;
+        }
+        // Columns of w (column-major) are rotated until mutually orthogonal,
+        // with the same rotations accumulated in v.
+        std::vector<complex> w(m*n), v(n*n, 0.0);
+        for (size_t i=0; i<m; i++)
+        {
+            for (size_t j=0; j<n; j++)
+            {
+                w[j*m+i]=a[i*n+j];
+            }
+        }
+        for (size_t j=0; j<n; j++)
+        {
+            v[j*n+j]=1;
+        }
+        const double epsilon=1e-15;
+        for (size_t sweep=0; sweep<60; sweep++)
+        {
+            bool rotated=false;
+            for (size_t p=0; p+1<n; p++)
+            {
+                for (size_t q=p+1; q<n; q++)
+                {
+                    complex* wp=&w[p*m];
+                    complex* wq=&w[q*m];
+                    double alpha=0, beta=0;
+                    complex gamma=0;
+                    for (size_t i=0; i<m; i++)
+                    {
+                        alpha+=std::norm(wp[i]);
+                        beta+=std::norm(wq[i]);
+                        gamma+=std::conj(wp[i])*wq[i];
+                    }
+                    double g=std::abs(gamma);
+                    if (g<=epsilon*std::sqrt(alpha*beta)||g<1e-300)
+                    {
+                        continue;
+                    }
+                    rotated=true;
+                    complex phase=std::conj(gamma)/g; // e^{-i phi}
+                    double zeta=(beta-alpha)/(2*g);
+                    double t=(zeta>=0 ? 1.0 : -1.0)/(std::abs(zeta)+std::sqrt(1+zeta*zeta));
+                    double c=1/std::sqrt(1+t*t);
+                    double sn=c*t;
+                    for (size_t i=0; i<m; i++)
+                    {
+                        complex bp=wp[i];
+                        complex bq=phase*wq[i];
+                        wp[i]=c*bp-sn*bq;
+                        wq[i]=sn*bp+c*bq;
+                    }
+                    complex* vp=&v[p*n];
+                    complex* vq=&v[q*n];
+                    for (size_t i=0; i<n; i++)
+                    {
+                        complex bp=vp[i];
+                        complex bq=phase*vq[i];
+                        vp[i]=c*bp-sn*bq;
+                        vq[i]=sn*bp+c*bq;
+                    }
+                }
+            }
+            if (!rotated)
+            {
+                break;
+            }
+        }
+        std::vector<double> norms(n);
+        for (size_t j=0; j<n; j++)
+        {
+            double norm=0;
+            for (size_t i=0; i<m; i++)
+            {
+                norm+=std::norm(w[j*m+i]);
+            }
+            norms[j]=std::sqrt(norm);
+        }
+        std::vector<size_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return norms[a]>norms[b]; });
+        u=std::vector<complex>(m*n, 0.0);
+        s=std::vector<double>(n);
+        vh=std::vector<complex>(n*n);
+        for (size_t k=0; k<n; k++)
+        {
+            size_t j=order[k];
+            s[k]=norms[j];
+            for (size_t i=0; i<m; i++)
+            {
+                u[i*n+k]=norms[j]>0 ? w[j*m+i]/norms[j] : 0.0;
+            }
+            for (size_t i=0; i<n; i++)
+            {
+                vh[k*n+i]=std::conj(v[j*n+i]);
+            }
+        }
+    }
+
+    std::vector<complex> to_flat(const Matrix& gate)
+    {
+        std::vector<complex> flat(gate.get_rows()*gate.get_cols());
+        for (size_t i=0; i<gate.get_rows(); i++)
+        {
+            for (size_t j=0; j<gate.get_cols(); j++)
+            {
+                flat[i*gate.get_cols()+j]=gate(i, j);
+            }
+        }
+        return flat;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MatrixProductState
+///////////////////////////////////////////////////////////////////////////////
+
+MatrixProductState::MatrixProductState(size_t n, size_t max_bond) :
+    num_qubits{ n }, max_bond_dimension{ max_bond }
+{
+    if (num_qubits==0||max_bond_dimension==0)
+    {
+        throw std::invalid_argument("MatrixProductState needs at least one qubit and a bond dimension of at least 1");
+    }
+    set_basis_state(std::vector<int>(num_qubits, 0));
+}
+
+size_t MatrixProductState::get_num_qubits() const
+{
+    return num_qubits;
+}
+
+size_t MatrixProductState::get_max_bond_dimension() const
+{
+    return max_bond_dimension;
+}
+
+std::vector<size_t> MatrixProductState::get_bond_dimensions() const
+{
+    // Internal bonds only: entry k is the bond between qubits k and k+1.
+    return std::vector<size_t>(bond_dimensions.begin()+1, bond_dimensions.end()-1);
+}
+
+double MatrixProductState::get_truncation_error() const
+{
+    return truncation_error;
+}
+
+double MatrixProductState::get_max_truncation_error() const
+{
+    return max_truncation_error;
+}
+
+double MatrixProductState::get_fidelity_estimate() const
+{
+    return fidelity_estimate;
+}
+
+double MatrixProductState::get_norm() const
+{
+    // Everything but the orthogonality center is an isometry.
+    double norm=0;
+    for (const complex& value : tensors[orthogonality_center])
+    {
+        norm+=std::norm(value);
+    }
+    return std::sqrt(norm);
+}
+
+std::complex<double> MatrixProductState::get_amplitude(const std::vector<int>& basis_state) const
+{
+    if (basis_state.size()!=num_qubits)
+    {
+        throw std::invalid_argument("Basis state size does not match MatrixProductState::get_amplitude()");
+    }
+    std::vector<complex> row(1, 1.0);
+    for (size_t k=0; k<num_qubits; k++)
+    {
+        size_t left=bond_dimensions[k], right=bond_dimensions[k+1];
+        std::vector<complex> next(right, 0.0);
+        const std::vector<complex>& tensor=tensors[k];
+        size_t s=basis_state[k] ? 1 : 0;
+        for (size_t l=0; l<left; l++)
+        {
+            for (size_t r=0; r<right; r++)
+            {
+                next[r]+=row[l]*tensor[(l*2+s)*right+r];
+            }
+        }
+        row.swap(next);
+    }
+    return row[0];
+}
+
+std::vector<std::string> MatrixProductState::sample(size_t shots, std::mt19937_64& rng) const
+{
+    // With the orthogonality center on qubit 0 every tensor to its right is
+    // right-canonical, so the marginal of each qubit given the ones already
+    // drawn is just the squared norm of the contracted row vector.
+    MatrixProductState canonical=*this;
+    canonical.move_center_to(0);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::vector<std::string> samples;
+    samples.reserve(shots);
+    for (size_t shot=0; shot<shots; shot++)
+    {
+        std::string outcome(num_qubits, '0');
+        std::vector<complex> row(1, 1.0);
+        for (size_t k=0; k<num_qubits; k++)
+        {
+            size_t left=canonical.bond_dimensions[k], right=canonical.bond_dimensions[k+1];
+            const std::vector<complex>& tensor=canonical.tensors[k];
+            std::vector<complex> branch[2]={ std::vector<complex>(right, 0.0), std::vector<complex>(right, 0.0) };
+            double weight[2]={ 0, 0 };
+            for (size_t s=0; s<2; s++)
+            {
+                for (size_t l=0; l<left; l++)
+                {
+                    for (size_t r=0; r<right; r++)
+                    {
+                        branch[s][r]+=row[l]*tensor[(l*2+s)*right+r];
+                    }
+                }
+                for (size_t r=0; r<right; r++)
+                {
+                    weight[s]+=std::norm(branch[s][r]);
+                }
+            }
+            size_t s=uniform(rng)*(weight[0]+weight[1])<weight[0] ? 0 : 1;
+            double norm=std::sqrt(weight[s]);
+            for (complex& value : branch[s])
+            {
+                value/=norm;
+            }
+            row.swap(branch[s]);
+            if (s==1)
+            {
+                outcome[num_qubits-1-k]='1';
+            }
+        }
+        samples.push_back(outcome);
+    }
+    return samples;
+}
+
+void MatrixProductState::set_truncation_threshold(double threshold)
+{
+    truncation_threshold=threshold;
+}
+
+void MatrixProductState::set_basis_state(const std::vector<int>& basis_state)
+{
+    if (basis_state.size()!=num_qubits)
+    {
+        throw std::invalid_argument("Basis state size does not match MatrixProductState::set_basis_state()");
+    }
+    tensors=std::vector<std::vector<complex>>(num_qubits, std::vector<complex>(2, 0.0));
+    bond_dimensions=std::vector<size_t>(num_qubits+1, 1);
+    for (size_t k=0; k<num_qubits; k++)
+    {
+        tensors[k][basis_state[k] ? 1 : 0]=1;
+    }
+    orthogonality_center=0;
+    truncation_error=0;
+    max_truncation_error=0;
+    fidelity_estimate=1;
+}
+
+void MatrixProductState::move_center_to(size_t qubit)
+{
+    while (orthogonality_center<qubit)
+    {
+        // Split A[(l,s)][r]=U S Vh, keep U and push S Vh into the next tensor.
+        size_t k=orthogonality_center;
+        size_t left=bond_dimensions[k], right=bond_dimensions[k+1];
+        std::vector<complex> u, vh;
+        std::vector<double> s;
+        svd(tensors[k], left*2, right, u, s, vh);
+        size_t rank=std::min(left*2, right);
+        size_t keep=0;
+        while (keep<rank&&s[keep]>1e-15*s[0])
+        {
+            keep++;
+        }
+        keep=std::max<size_t>(keep, 1);
+        std::vector<complex> tensor(left*2*keep);
+        for (size_t i=0; i<left*2; i++)
+        {
+            for (size_t j=0; j<keep; j++)
+            {
+                tensor[i*keep+j]=u[i*rank+j];
+            }
+        }
+        size_t next_right=bond_dimensions[k+2];
+        std::vector<complex> next(keep*2*next_right, 0.0);
+        for (size_t j=0; j<keep; j++)
+        {
+            for (size_t m=0; m<right; m++)
+            {
+                complex factor=s[j]*vh[j*right+m];
+                for (size_t x=0; x<2*next_right; x++)
+                {
+                    next[j*2*next_right+x]+=factor*tensors[k+1][m*2*next_right+x];
+                }
+            }
+        }
+        tensors[k].swap(tensor);
+        tensors[k+1].swap(next);
+        bond_dimensions[k+1]=keep;
+        orthogonality_center++;
+    }
+    while (orthogonality_center>qubit)
+    {
+        // Split A[l][(s,r)]=U S Vh, keep Vh and push U S into the previous tensor.
+        size_t k=orthogonality_center;
+        size_t left=bond_dimensions[k], right=bond_dimensions[k+1];
+        std::vector<complex> u, vh;
+        std::vector<double> s;
+        svd(tensors[k], left, 2*right, u, s, vh);
+        size_t rank=std::min(left, 2*right);
+        size_t keep=0;
+        while (keep<rank&&s[keep]>1e-15*s[0])
+        {
+            keep++;
+        }
+        keep=std::max<size_t>(keep, 1);
+        std::vector<complex> tensor(vh.begin(), vh.begin()+keep*2*right);
+        size_t previous_left=bond_dimensions[k-1];
+        std::vector<complex> previous(previous_left*2*keep, 0.0);
+        for (size_t x=0; x<previous_left*2; x++)
+        {
+            for (size_t m=0; m<left; m++)
+            {
+                complex value=tensors[k-1][x*left+m];
+                for (size_t j=0; j<keep; j++)
+                {
+                    previous[x*keep+j]+=value*u[m*rank+j]*s[j];
+                }
+            }
+        }
+        tensors[k].swap(tensor);
+        tensors[k-1].swap(previous);
+        bond_dimensions[k]=keep;
+        orthogonality_center--;
+    }
+}
+
+void MatrixProductState::apply_contiguous(size_t first, size_t gate_size, const std::vector<complex>& gate)
+{
+    // Contract the block of tensors into theta[l][p][r] (bit i of p is qubit
+    // first+i), apply the gate to p, then split it back qubit by qubit with
+    // truncated SVDs.
+    move_center_to(first);
+    size_t left=bond_dimensions[first];
+    std::vector<complex> theta=tensors[first];
+    size_t physical=2;
+    for (size_t i=1; i<gate_size; i++)
+    {
+        size_t k=first+i;
+        size_t middle=bond_dimensions[k], right=bond_dimensions[k+1];
+        std::vector<complex> next(left*physical*2*right, 0.0);
+        for (size_t l=0; l<left; l++)
+        {
+            for (size_t p=0; p<physical; p++)
+            {
+                for (size_t m=0; m<middle; m++)
+                {
+                    complex value=theta[(l*physical+p)*middle+m];
+                    if (value==0.0)
+                    {
+                        continue;
+                    }
+                    for (size_t s=0; s<2; s++)
+                    {
+                        complex* out=&next[(l*physical*2+p+s*physical)*right];
+                        const complex* in=&tensors[k][(m*2+s)*right];
+                        for (size_t r=0; r<right; r++)
+                        {
+                            out[r]+=value*in[r];
+                        }
+                    }
+                }
+            }
+        }
+        theta.swap(next);
+        physical*=2;
+    }
+    size_t right=bond_dimensions[first+gate_size];
+    std::vector<complex> applied(theta.size(), 0.0);
+    for (size_t l=0; l<left; l++)
+    {
+        for (size_t p=0; p<physical; p++)
+        {
+            for (size_t q=0; q<physical; q++)
+            {
+                complex g=gate[p*physical+q];
+                if (g==0.0)
+                {
+                    continue;
+                }
+                complex* out=&applied[(l*physical+p)*right];
+                const complex* in=&theta[(l*physical+q)*right];
+                for (size_t r=0; r<right; r++)
+                {
+                    out[r]+=g*in[r];
+                }
+            }
+        }
+    }
+    theta.swap(applied);
+    for (size_t i=0; i+1<gate_size; i++)
+    {
+        size_t k=first+i;
+        size_t rest=physical/2;
+        // Rows are (l, s) for the qubit being split off, columns (p_rest, r).
+        std::vector<complex> m(left*2*rest*right);
+        for (size_t l=0; l<left; l++)
+        {
+            for (size_t s=0; s<2; s++)
+            {
+                for (size_t p=0; p<rest; p++)
+                {
+                    for (size_t r=0; r<right; r++)
+                    {
+                        m[(l*2+s)*rest*right+p*right+r]=theta[(l*physical+s+2*p)*right+r];
+                    }
+                }
+            }
+        }
+        std::vector<complex> u, vh;
+        std::vector<double> s;
+        svd(m, left*2, rest*right, u, s, vh);
+        size_t rank=std::min(left*2, rest*right);
+        double total=0;
+        for (double value : s)
+        {
+            total+=value*value;
+        }
+        size_t keep=0;
+        while (keep<rank&&keep<max_bond_dimension&&s[keep]*s[keep]>truncation_threshold*total)
+        {
+            keep++;
+        }
+        keep=std::max<size_t>(keep, 1);
+        double discarded=0;
+        for (size_t j=keep; j<rank; j++)
+        {
+            discarded+=s[j]*s[j];
+        }
+        discarded=total>0 ? discarded/total : 0;
+        truncation_error+=discarded;
+        max_truncation_error=std::max(max_truncation_error, discarded);
+        fidelity_estimate*=1-discarded;
+        // Renormalise the kept singular values so the state stays normalised.
+        double scale=discarded<1 ? 1/std::sqrt(1-discarded) : 1;
+        std::vector<complex> tensor(left*2*keep);
+        for (size_t x=0; x<left*2; x++)
+        {
+            for (size_t j=0; j<keep; j++)
+            {
+                tensor[x*keep+j]=u[x*rank+j];
+            }
+        }
+        tensors[k].swap(tensor);
+        bond_dimensions[k+1]=keep;
+        std::vector<complex> remainder(keep*rest*right);
+        for (size_t j=0; j<keep; j++)
+        {
+            for (size_t x=0; x<rest*right; x++)
+            {
+                remainder[j*rest*right+x]=s[j]*scale*vh[j*rest*right+x];
+            }
+        }
+        theta.swap(remainder);
+        left=keep;
+        physical=rest;
+    }
+    tensors[first+gate_size-1].swap(theta);
+    orthogonality_center=first+gate_size-1;
+}
+
+void MatrixProductState::apply_adjacent_swap(size_t qubit)
+{
+    std::vector<complex> swap_gate(16, 0.0);
+    swap_gate[0*4+0]=1;
+    swap_gate[1*4+2]=1;
+    swap_gate[2*4+1]=1;
+    swap_gate[3*4+3]=1;
+    apply_contiguous(qubit, 2, swap_gate);
+}
+
+void MatrixProductState::apply_single(size_t qubit, const Matrix& gate)
+{
+    if (qubit>=num_qubits||gate.get_rows()!=2||gate.get_cols()!=2)
+    {
+        throw std::invalid_argument("Invalid gate for MatrixProductState::apply_single()");
+    }
+    // A unitary on the physical index keeps the tensor canonical.
+    complex g[4]={ gate(0, 0), gate(0, 1), gate(1, 0), gate(1, 1) };
+    std::vector<complex>& tensor=tensors[qubit];
+    size_t left=bond_dimensions[qubit], right=bond_dimensions[qubit+1];
+    for (size_t l=0; l<left; l++)
+    {
+        complex* zero=&tensor[(l*2)*right];
+        complex* one=&tensor[(l*2+1)*right];
+        for (size_t r=0; r<right; r++)
+        {
+            complex a=zero[r], b=one[r];
+            zero[r]=g[0]*a+g[1]*b;
+            one[r]=g[2]*a+g[3]*b;
+        }
+    }
+}
+
+void MatrixProductState::apply_two_qubit(size_t qubit_1, size_t qubit_2, const Matrix& gate)
+{
+    // Bit 0 of the gate's index is qubit_1 and bit 1 is qubit_2.
+    if (qubit_1==qubit_2||qubit_1>=num_qubits||qubit_2>=num_qubits||gate.get_rows()!=4||gate.get_cols()!=4)
+    {
+        throw std::invalid_argument("Invalid gate for MatrixProductState::apply_two_qubit()");
+    }
+    std::vector<complex> flat=to_flat(gate);
+    if (qubit_1>qubit_2)
+    {
+        // Swap the roles of the two index bits.
+        const size_t exchanged[4]={ 0, 2, 1, 3 };
+        std::vector<complex> permuted(16);
+        for (size_t i=0; i<4; i++)
+        {
+            for (size_t j=0; j<4; j++)
+            {
+                permuted[exchanged[i]*4+exchanged[j]]=flat[i*4+j];
+            }
+        }
+        flat.swap(permuted);
+        std::swap(qubit_1, qubit_2);
+    }
+    // Swap network: bring qubit_2 next to qubit_1, apply, and move it back.
+    for (size_t k=qubit_2-1; k>qubit_1; k--)
+    {
+        apply_adjacent_swap(k);
+    }
+    apply_contiguous(qubit_1, 2, flat);
+    for (size_t k=qubit_1+1; k<qubit_2; k++)
+    {
+        apply_adjacent_swap(k);
+    }
+}
+
+void MatrixProductState::apply_phase_oracle(const Operation& operation)
+{
+    // Swap network, as in apply_two_qubit(): gather the targets, in site
+    // order, next to the lowest one, apply the 2^k diagonal there and move
+    // them back. Oracle qubits may be in any order and far apart.
+    const size_t count=operation.targets.size();
+    std::vector<size_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&operation](size_t a, size_t b)
+        {
+            return operation.targets[a]<operation.targets[b];
+        });
+    const size_t first=operation.targets[order[0]];
+    for (size_t i=1; i<count; i++)
+    {
+        for (size_t k=operation.targets[order[i]]-1; k>=first+i; k--)
+        {
+            apply_adjacent_swap(k);
+        }
+    }
+    // Bit i of the gate's index is site first+i, which now holds the input
+    // bit order[i].
+    const size_t dimension=size_t(1)<<count;
+    std::vector<complex> diagonal(dimension*dimension, 0.0);
+    for (size_t j=0; j<dimension; j++)
+    {
+        size_t input=0;
+        for (size_t i=0; i<count; i++)
+        {
+            input|=((j>>i)&1)<<order[i];
+        }
+        diagonal[j*dimension+j]=operation.is_marked(input) ? -1.0 : 1.0;
+    }
+    apply_contiguous(first, count, diagonal);
+    for (size_t i=count; i-->1;)
+    {
+        for (size_t k=first+i; k<operation.targets[order[i]]; k++)
+        {
+            apply_adjacent_swap(k);
+        }
+    }
+}
+
+void MatrixProductState::apply_operation(const Operation& operation)
+{
+    if (operation.type==OperationType::phase_oracle)
+    {
+        apply_phase_oracle(operation);
+        return;
+    }
+    if (operation.type==OperationType::controlled)
+    {
+        if (operation.controls.size()!=1)
+        {
+            throw std::invalid_argument("MatrixProductState only supports singly controlled gates");
+        }
+        // Bit 0 is the target and bit 1 the control.
+        const Matrix& u=*operation.matrix;
+        Matrix gate=identity_matrix(4);
+        gate(2, 2)=u(0, 0);
+        gate(2, 3)=u(0, 1);
+        gate(3, 2)=u(1, 0);
+        gate(3, 3)=u(1, 1);
+        apply_two_qubit(operation.targets[0], operation.controls[0], gate);
+        return;
+    }
+    const std::vector<size_t>& targets=operation.targets;
+    if (targets.size()==1)
+    {
+        apply_single(targets[0], *operation.matrix);
+    }
+    else if (targets.size()==2)
+    {
+        apply_two_qubit(targets[0], targets[1], *operation.matrix);
+    }
+    else
+    {
+        // Larger gates are only produced for contiguous registers.
+        for (size_t i=1; i<targets.size(); i++)
+        {
+            if (targets[i]!=targets[0]+i)
+            {
+                throw std::invalid_argument("MatrixProductState needs multi-qubit gates on contiguous registers");
+            }
+        }
+        apply_contiguous(targets[0], targets.size(), to_flat(*operation.matrix));
+    }
+}
+
+void MatrixProductState::apply_circuit(const QuantumCircuit& circuit)
+{
+    // Starts from the circuit's input register. Subcircuits (swap, toffoli,
+    // gate_from_circuit) are inlined so only small gates reach the tensors.
+    if (circuit.get_register_size()!=num_qubits)
+    {
+        throw std::invalid_argument("Circuit size does not match MatrixProductState::apply_circuit()");
+    }
+    set_basis_state(circuit.get_input_register());
+    for (const Operation& operation : circuit.get_operations(true))
+    {
+        apply_operation(operation);
+    }
+}
@@ -0,0 +1,214 @@
+#include "MemoryPool.h"
+#include "Numa.h"
+#include <algorithm>
+#include <iostream>
+#include <new>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    const size_t block_alignment=64;
+
+    size_t round_up_to_power_of_two(size_t bytes)
+    {
+        size_t block_size=MemoryPool::min_pooled_bytes;
+        while (block_size<bytes)
+        {
+            block_size<<=1;
+        }
+        return block_size;
+    }
+
+    double to_mib(size_t bytes)
+    {
+        return double(bytes)/double(size_t(1)<<20);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MemoryPool
+///////////////////////////////////////////////////////////////////////////////
+
+MemoryPool::~MemoryPool()
+{
+    trim();
+}
+
+MemoryPool& MemoryPool::instance()
+{
+    static MemoryPool pool;
+    return pool;
+}
+
+void* MemoryPool::allocate_from_system(size_t block_size)
+{
+#ifdef __linux__
+    if (use_huge_pages&&block_size>=huge_page_bytes)
+    {
+        // Reserved huge pages first, then transparent huge pages.
+        void* block=mmap(nullptr, block_size, PROT_READ|PROT_WRITE,
+            MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+        if (block==MAP_FAILED)
+        {
+            block=mmap(nullptr, block_size, PROT_READ|PROT_WRITE,
+                MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+            if (block==MAP_FAILED)
+            {
+                throw std::bad_alloc();
+            }
+            madvise(block, block_size, MADV_HUGEPAGE);
+        }
+        huge_page_backed[block]=true;
+        stats.huge_page_blocks++;
+        place_pages(block, block_size);
+        return block;
+    }
+#endif
+    void* block=::operator new(block_size, std::align_val_t(block_alignment));
+    place_pages(block, block_size);
+    return block;
+}
+
+void MemoryPool::release_to_system(void* block, size_t block_size)
+{
+#ifdef __linux__
+    auto found=huge_page_backed.find(block);
+    if (found!=huge_page_backed.end())
+    {
+        huge_page_backed.erase(found);
+        munmap(block, block_size);
+        return;
+    }
+#endif
+    ::operator delete(block, std::align_val_t(block_alignment));
+}
+
+// Accessors
+///////////////////////////////////////////////////////////////////////////////
+
+MemoryPoolStats MemoryPool::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    return stats;
+}
+
+bool MemoryPool::get_huge_pages() const
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    return use_huge_pages;
+}
+
+// Mutators
+///////////////////////////////////////////////////////////////////////////////
+
+void* MemoryPool::allocate(size_t bytes)
+{
+    if (bytes<min_pooled_bytes)
+    {
+        return ::operator new(bytes);
+    }
+    size_t block_size=round_up_to_power_of_two(bytes);
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    stats.allocations++;
+    void* block=nullptr;
+    std::vector<void*>& blocks=free_blocks[block_size];
+    if (!blocks.empty())
+    {
+        block=blocks.back();
+        blocks.pop_back();
+        stats.reuses++;
+        stats.bytes_cached-=block_size;
+    }
+    else
+    {
+        block=allocate_from_system(block_size);
+        stats.system_allocations++;
+    }
+    stats.bytes_in_use+=block_size;
+    stats.high_water_in_use=std::max(stats.high_water_in_use, stats.bytes_in_use);
+    stats.high_water_reserved=std::max(stats.high_water_reserved, stats.bytes_in_use+stats.bytes_cached);
+    return block;
+}
+
+void MemoryPool::deallocate(void* block, size_t bytes)
+{
+    if (block==nullptr)
+    {
+        return;
+    }
+    if (bytes<min_pooled_bytes)
+    {
+        ::operator delete(block);
+        return;
+    }
+    size_t block_size=round_up_to_power_of_two(bytes);
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    stats.bytes_in_use-=block_size;
+    if (stats.bytes_cached+block_size>max_cached_bytes)
+    {
+        release_to_system(block, block_size);
+        return;
+    }
+    free_blocks[block_size].push_back(block);
+    stats.bytes_cached+=block_size;
+}
+
+void MemoryPool::set_huge_pages(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    use_huge_pages=enabled;
+}
+
+void MemoryPool::set_max_cached_bytes(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    max_cached_bytes=bytes;
+}
+
+void MemoryPool::trim()
+{
+    // Returns every cached block to the OS; blocks in use are unaffected.
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    for (auto& entry : free_blocks)
+    {
+        for (void* block : entry.second)
+        {
+            release_to_system(block, entry.first);
+        }
+        entry.second.clear();
+    }
+    stats.bytes_cached=0;
+}
+
+void MemoryPool::reset_high_water()
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    stats.high_water_in_use=stats.bytes_in_use;
+    stats.high_water_reserved=stats.bytes_in_use+stats.bytes_cached;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Non-member functions
+///////////////////////////////////////////////////////////////////////////////
+
+std::ostream& operator<<(std::ostream& os, const MemoryPoolStats& stats)
+{
+    os<<"in use "<<to_mib(stats.bytes_in_use)<<" MiB (peak "<<to_mib(stats.high_water_in_use)
+        <<" MiB), cached "<<to_mib(stats.bytes_cached)<<" MiB, reserved peak "
+        <<to_mib(stats.high_water_reserved)<<" MiB, "<<stats.allocations<<" allocations, "
+        <<stats.reuses<<" reuses, "<<stats.system_allocations<<" from the system";
+    if (stats.huge_page_blocks>0)
+    {
+        os<<", "<<stats.huge_page_blocks<<" huge page blocks";
+    }
+    return os;
+}
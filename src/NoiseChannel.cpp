@@ -0,0 +1,255 @@
+#include "NoiseChannel.h"
+#include <cmath>
+#include <stdexcept>
+
+typedef std::complex<double> complex;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    const double completeness_tolerance=1e-9;
+
+    void check_probability(double probability, const std::string& name)
+    {
+        if (!(probability>=0&&probability<=1))
+        {
+            throw std::invalid_argument(name+" probability must lie in [0, 1]");
+        }
+    }
+
+    Matrix scaled(Matrix matrix, double factor)
+    {
+        for (size_t i=0; i<matrix.get_rows(); i++)
+        {
+            for (size_t j=0; j<matrix.get_cols(); j++)
+            {
+                matrix(i, j)*=factor;
+            }
+        }
+        return matrix;
+    }
+
+    Matrix pauli(size_t which)
+    {
+        Matrix result(2, 2);
+        switch (which)
+        {
+        case 0: result(0, 0)=1; result(1, 1)=1; break;
+        case 1: result(0, 1)=1; result(1, 0)=1; break;
+        case 2: result(0, 1)=complex(0, -1); result(1, 0)=complex(0, 1); break;
+        default: result(0, 0)=1; result(1, 1)=-1; break;
+        }
+        return result;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// NoiseChannel
+///////////////////////////////////////////////////////////////////////////////
+
+NoiseChannel::NoiseChannel(std::vector<Matrix> kraus_in, std::string name_in)
+    : name{ std::move(name_in) }, kraus_operators{ std::move(kraus_in) }
+{
+    if (kraus_operators.empty())
+    {
+        throw std::invalid_argument("NoiseChannel needs at least one Kraus operator");
+    }
+    const size_t dimension=kraus_operators[0].get_rows();
+    num_qubits=0;
+    while ((size_t(1)<<num_qubits)<dimension)
+    {
+        num_qubits++;
+    }
+    if ((size_t(1)<<num_qubits)!=dimension)
+    {
+        throw std::invalid_argument("Kraus operators must be 2^k x 2^k");
+    }
+    Matrix completeness(dimension, dimension);
+    for (const Matrix& kraus : kraus_operators)
+    {
+        if (kraus.get_rows()!=dimension||kraus.get_cols()!=dimension)
+        {
+            throw std::invalid_argument("Kraus operators of a channel must all have the same size");
+        }
+        completeness=completeness+kraus.adjoint()*kraus;
+    }
+    for (size_t i=0; i<dimension; i++)
+    {
+        for (size_t j=0; j<dimension; j++)
+        {
+            if (std::abs(completeness(i, j)-complex(i==j ? 1.0 : 0.0))>completeness_tolerance)
+            {
+                throw std::invalid_argument("Kraus operators of channel '"+name+"' are not trace preserving");
+            }
+        }
+    }
+    // S[(r,c)][(r',c')]=sum_i K_i[r][r'] conj(K_i[c][c']), with the row bits
+    // low so it acts on the vectorised layout used by DensityMatrix.
+    superoperator=Matrix(dimension*dimension, dimension*dimension);
+    for (const Matrix& kraus : kraus_operators)
+    {
+        for (size_t c=0; c<dimension; c++)
+        {
+            for (size_t c_in=0; c_in<dimension; c_in++)
+            {
+                complex column_factor=std::conj(kraus(c, c_in));
+                if (column_factor==complex(0))
+                {
+                    continue;
+                }
+                for (size_t r=0; r<dimension; r++)
+                {
+                    for (size_t r_in=0; r_in<dimension; r_in++)
+                    {
+                        superoperator(r+c*dimension, r_in+c_in*dimension)+=kraus(r, r_in)*column_factor;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Accessors
+///////////////////////////////////////////////////////////////////////////////
+
+size_t NoiseChannel::get_num_qubits() const
+{
+    return num_qubits;
+}
+
+const std::string& NoiseChannel::get_name() const
+{
+    return name;
+}
+
+const std::vector<Matrix>& NoiseChannel::get_kraus_operators() const
+{
+    return kraus_operators;
+}
+
+const Matrix& NoiseChannel::get_superoperator() const
+{
+    return superoperator;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Standard channels
+///////////////////////////////////////////////////////////////////////////////
+
+NoiseChannel depolarizing(double probability, size_t num_qubits)
+{
+    // rho -> (1-p) rho + p/(4^k-1) sum of the non-identity Paulis P rho P.
+    check_probability(probability, "Depolarizing");
+    if (num_qubits==0||num_qubits>4)
+    {
+        throw std::invalid_argument("Depolarizing channel supports 1 to 4 qubits");
+    }
+    const size_t paulis=size_t(1)<<(2*num_qubits);
+    std::vector<Matrix> kraus;
+    for (size_t code=0; code<paulis; code++)
+    {
+        double weight=code==0 ? 1-probability : probability/(paulis-1);
+        if (weight==0)
+        {
+            continue;
+        }
+        Matrix product=pauli((code>>(2*(num_qubits-1)))&3);
+        for (size_t q=num_qubits-1; q-->0;)
+        {
+            product=product.tensor_product(pauli((code>>(2*q))&3));
+        }
+        kraus.push_back(scaled(std::move(product), std::sqrt(weight)));
+    }
+    return NoiseChannel(std::move(kraus), "depolarizing("+std::to_string(probability)+")");
+}
+
+NoiseChannel amplitude_damping(double gamma)
+{
+    check_probability(gamma, "Amplitude damping");
+    Matrix k0(2, 2), k1(2, 2);
+    k0(0, 0)=1;
+    k0(1, 1)=std::sqrt(1-gamma);
+    k1(0, 1)=std::sqrt(gamma);
+    return NoiseChannel({ k0, k1 }, "amplitude_damping("+std::to_string(gamma)+")");
+}
+
+NoiseChannel phase_damping(double lambda)
+{
+    check_probability(lambda, "Phase damping");
+    Matrix k0(2, 2), k1(2, 2);
+    k0(0, 0)=1;
+    k0(1, 1)=std::sqrt(1-lambda);
+    k1(1, 1)=std::sqrt(lambda);
+    return NoiseChannel({ k0, k1 }, "phase_damping("+std::to_string(lambda)+")");
+}
+
+NoiseChannel dephasing(double probability)
+{
+    // Z with the given probability.
+    check_probability(probability, "Dephasing");
+    return NoiseChannel({ scaled(pauli(0), std::sqrt(1-probability)),
+        scaled(pauli(3), std::sqrt(probability)) }, "dephasing("+std::to_string(probability)+")");
+}
+
+NoiseChannel bit_flip(double probability)
+{
+    check_probability(probability, "Bit flip");
+    return NoiseChannel({ scaled(pauli(0), std::sqrt(1-probability)),
+        scaled(pauli(1), std::sqrt(probability)) }, "bit_flip("+std::to_string(probability)+")");
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// NoiseModel
+///////////////////////////////////////////////////////////////////////////////
+
+bool NoiseModel::empty() const
+{
+    return gate_noise.empty()&&qubit_noise.empty();
+}
+
+std::vector<const NoiseChannel*> NoiseModel::get_gate_noise(const std::string& symbol) const
+{
+    std::vector<const NoiseChannel*> channels;
+    for (const std::string& key : { symbol, std::string("*") })
+    {
+        auto found=gate_noise.find(key);
+        if (found!=gate_noise.end())
+        {
+            for (const NoiseChannel& channel : found->second)
+            {
+                channels.push_back(&channel);
+            }
+        }
+        if (symbol=="*")
+        {
+            break;
+        }
+    }
+    return channels;
+}
+
+const std::map<size_t, std::vector<NoiseChannel>>& NoiseModel::get_qubit_noise() const
+{
+    return qubit_noise;
+}
+
+void NoiseModel::add_gate_noise(const std::string& symbol, NoiseChannel channel)
+{
+    gate_noise[symbol].push_back(std::move(channel));
+}
+
+void NoiseModel::add_qubit_noise(size_t qubit, NoiseChannel channel)
+{
+    if (channel.get_num_qubits()!=1)
+    {
+        throw std::invalid_argument("Qubit noise must be a single qubit channel");
+    }
+    qubit_noise[qubit].push_back(std::move(channel));
+}
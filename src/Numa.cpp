@@ -0,0 +1,314 @@
+#include "Numa.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    const int mpol_interleave=3; // From linux/mempolicy.h.
+
+    std::once_flag topology_flag;
+    std::vector<NumaNode> nodes;
+    std::vector<size_t> worker_cpus;
+    std::vector<size_t> node_of_cpu;
+
+    std::once_flag placement_flag;
+    std::atomic<int> placement{ int(NumaPlacement::first_touch) };
+
+    // Parses a sysfs CPU list such as "0-3,8-11".
+    std::vector<size_t> parse_cpu_list(const std::string& text)
+    {
+        std::vector<size_t> cpus;
+        std::stringstream stream(text);
+        std::string range;
+        while (std::getline(stream, range, ','))
+        {
+            if (range.empty()||range=="\n")
+            {
+                continue;
+            }
+            size_t dash=range.find('-');
+            size_t first=std::stoul(range.substr(0, dash));
+            size_t last=dash==std::string::npos ? first : std::stoul(range.substr(dash+1));
+            for (size_t cpu=first; cpu<=last; cpu++)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    std::vector<size_t> allowed_cpus()
+    {
+        std::vector<size_t> cpus;
+#ifdef __linux__
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        if (sched_getaffinity(0, sizeof(mask), &mask)==0)
+        {
+            for (size_t cpu=0; cpu<CPU_SETSIZE; cpu++)
+            {
+                if (CPU_ISSET(cpu, &mask))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+#endif
+        if (cpus.empty())
+        {
+            for (size_t cpu=0; cpu<std::max(1u, std::thread::hardware_concurrency()); cpu++)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    void detect_topology()
+    {
+        std::vector<size_t> allowed=allowed_cpus();
+#ifdef __linux__
+        if (DIR* directory=opendir("/sys/devices/system/node"))
+        {
+            while (dirent* entry=readdir(directory))
+            {
+                std::string name=entry->d_name;
+                if (name.compare(0, 4, "node")!=0||name.size()==4||name.find_first_not_of("0123456789", 4)!=std::string::npos)
+                {
+                    continue;
+                }
+                std::ifstream file("/sys/devices/system/node/"+name+"/cpulist");
+                std::string text;
+                std::getline(file, text);
+                NumaNode node;
+                node.id=std::stoul(name.substr(4));
+                for (size_t cpu : parse_cpu_list(text))
+                {
+                    if (std::find(allowed.begin(), allowed.end(), cpu)!=allowed.end())
+                    {
+                        node.cpus.push_back(cpu);
+                    }
+                }
+                nodes.push_back(node);
+            }
+            closedir(directory);
+        }
+#endif
+        std::sort(nodes.begin(), nodes.end(), [](const NumaNode& a, const NumaNode& b) { return a.id<b.id; });
+        if (nodes.empty())
+        {
+            NumaNode node;
+            node.cpus=allowed;
+            nodes.push_back(node);
+        }
+        for (const NumaNode& node : nodes)
+        {
+            for (size_t cpu : node.cpus)
+            {
+                worker_cpus.push_back(cpu);
+                if (node_of_cpu.size()<=cpu)
+                {
+                    node_of_cpu.resize(cpu+1, 0);
+                }
+                node_of_cpu[cpu]=node.id;
+            }
+        }
+        if (worker_cpus.empty())
+        {
+            worker_cpus=allowed;
+        }
+    }
+
+    void read_placement_setting()
+    {
+        const char* setting=std::getenv("QC_NUMA");
+        if (setting==nullptr)
+        {
+            return;
+        }
+        std::string value=setting;
+        if (value=="partition")
+        {
+            set_numa_placement(NumaPlacement::partition);
+        }
+        else if (value=="interleave")
+        {
+            set_numa_placement(NumaPlacement::interleave);
+        }
+        else if (value!="first_touch")
+        {
+            throw std::invalid_argument("Unknown QC_NUMA placement '"+value+"'");
+        }
+    }
+
+    size_t page_size()
+    {
+#ifdef __linux__
+        long size=sysconf(_SC_PAGESIZE);
+        return size>0 ? size_t(size) : 4096;
+#else
+        return 4096;
+#endif
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Topology
+///////////////////////////////////////////////////////////////////////////////
+
+const std::vector<NumaNode>& get_numa_nodes()
+{
+    std::call_once(topology_flag, detect_topology);
+    return nodes;
+}
+
+const std::vector<size_t>& get_worker_cpus()
+{
+    std::call_once(topology_flag, detect_topology);
+    return worker_cpus;
+}
+
+size_t get_node_of_cpu(size_t cpu)
+{
+    std::call_once(topology_flag, detect_topology);
+    return cpu<node_of_cpu.size() ? node_of_cpu[cpu] : 0;
+}
+
+bool pin_current_thread(size_t cpu)
+{
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    return sched_setaffinity(0, sizeof(mask), &mask)==0;
+#else
+    return false;
+#endif
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Placement
+///////////////////////////////////////////////////////////////////////////////
+
+NumaPlacement get_numa_placement()
+{
+    std::call_once(placement_flag, read_placement_setting);
+    return NumaPlacement(placement.load());
+}
+
+void set_numa_placement(NumaPlacement placement_in)
+{
+    placement=int(placement_in);
+    if (placement_in==NumaPlacement::partition)
+    {
+        set_thread_affinity(true);
+    }
+}
+
+void place_pages(void* block, size_t bytes)
+{
+    NumaPlacement policy=get_numa_placement();
+    if (policy==NumaPlacement::first_touch||get_numa_nodes().size()<2)
+    {
+        return;
+    }
+    const size_t page=page_size();
+    if (policy==NumaPlacement::interleave)
+    {
+#ifdef __linux__
+        // mbind() needs a page aligned start; a partial first page is left
+        // to first touch.
+        uintptr_t start=(reinterpret_cast<uintptr_t>(block)+page-1)&~(uintptr_t(page)-1);
+        uintptr_t end=reinterpret_cast<uintptr_t>(block)+bytes;
+        if (end<=start)
+        {
+            return;
+        }
+        std::vector<unsigned long> mask(nodes.back().id/(8*sizeof(unsigned long))+1, 0);
+        for (const NumaNode& node : nodes)
+        {
+            mask[node.id/(8*sizeof(unsigned long))]|=1ul<<(node.id%(8*sizeof(unsigned long)));
+        }
+        syscall(SYS_mbind, start, end-start, mpol_interleave, mask.data(),
+            mask.size()*8*sizeof(unsigned long), 0);
+#endif
+        return;
+    }
+    // Partition: one byte per page, written by the pinned worker that will
+    // later get the same share of every kernel's index range.
+    volatile char* bytes_out=static_cast<volatile char*>(block);
+    const size_t pages=(bytes+page-1)/page;
+    parallel_for(0, pages, 1, [&](size_t begin, size_t end)
+    {
+        for (size_t p=begin; p<end; p++)
+        {
+            bytes_out[p*page]=0;
+        }
+    });
+}
+
+std::vector<double> get_page_placement(const void* block, size_t bytes, size_t max_samples)
+{
+    std::vector<double> node_bytes(get_numa_nodes().back().id+1, 0.0);
+#ifdef __linux__
+    const size_t page=page_size();
+    const size_t pages=(bytes+page-1)/page;
+    const size_t samples=std::max<size_t>(1, std::min(pages, max_samples));
+    std::vector<void*> addresses(samples);
+    std::vector<int> status(samples, -1);
+    for (size_t i=0; i<samples; i++)
+    {
+        uintptr_t address=reinterpret_cast<uintptr_t>(block)+(i*pages/samples)*page;
+        addresses[i]=reinterpret_cast<void*>(address&~(uintptr_t(page)-1));
+    }
+    if (syscall(SYS_move_pages, 0, samples, addresses.data(), nullptr, status.data(), 0)!=0)
+    {
+        return node_bytes;
+    }
+    for (int node : status)
+    {
+        if (node>=0)
+        {
+            if (size_t(node)>=node_bytes.size())
+            {
+                node_bytes.resize(node+1, 0.0);
+            }
+            node_bytes[node]+=double(bytes)/samples;
+        }
+    }
+#endif
+    return node_bytes;
+}
+
+void record_placement(const std::string& name, const void* block, size_t bytes)
+{
+    ProfileEvent event;
+    event.name=name;
+    event.category="placement";
+    event.bytes=double(bytes);
+    event.node_bytes=get_page_placement(block, bytes);
+    event.start_us=Profiler::instance().get_time_us();
+    event.thread_id=Profiler::get_thread_id();
+    Profiler::instance().record(std::move(event));
+}
@@ -0,0 +1,121 @@
+#include "Parallel.h"
+#include "Numa.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    std::atomic<size_t> configured_threads{ 0 };
+    std::atomic<bool> affinity_enabled{ false };
+    thread_local bool inside_parallel_region=false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Non-member functions
+///////////////////////////////////////////////////////////////////////////////
+
+size_t get_thread_count()
+{
+    size_t threads=configured_threads;
+    if (threads==0)
+    {
+        // hardware_concurrency() reads sysfs on every call, which shows up
+        // when kernels run on many small tiles.
+        static const size_t hardware_threads=std::max<size_t>(1, std::thread::hardware_concurrency());
+        threads=hardware_threads;
+    }
+    return threads;
+}
+
+void set_thread_count(size_t thread_count)
+{
+    configured_threads=thread_count;
+}
+
+bool get_thread_affinity()
+{
+    return affinity_enabled;
+}
+
+void set_thread_affinity(bool enabled)
+{
+    affinity_enabled=enabled;
+}
+
+void parallel_for(size_t begin, size_t end, size_t min_chunk,
+    const std::function<void(size_t, size_t)>& body)
+{
+    if (end<=begin)
+    {
+        return;
+    }
+    size_t length=end-begin;
+    size_t chunks=std::min(get_thread_count(), length/std::max<size_t>(min_chunk, 1));
+    if (chunks<=1||inside_parallel_region)
+    {
+        body(begin, end);
+        return;
+    }
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    const bool pin=affinity_enabled;
+    const std::vector<size_t>* cpus=pin ? &get_worker_cpus() : nullptr;
+    auto run_chunk=[&](size_t chunk)
+    {
+        if (pin)
+        {
+            pin_current_thread((*cpus)[chunk*cpus->size()/chunks]);
+        }
+        size_t chunk_begin=begin+length*chunk/chunks;
+        size_t chunk_end=begin+length*(chunk+1)/chunks;
+        inside_parallel_region=true;
+        try
+        {
+            body(chunk_begin, chunk_end);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            error=std::current_exception();
+        }
+        inside_parallel_region=false;
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(chunks-1);
+    for (size_t chunk=1; chunk<chunks; chunk++)
+    {
+        threads.emplace_back(run_chunk, chunk);
+    }
+#ifdef __linux__
+    cpu_set_t caller_mask;
+    bool restore=pin&&sched_getaffinity(0, sizeof(caller_mask), &caller_mask)==0;
+    run_chunk(0);
+    if (restore)
+    {
+        sched_setaffinity(0, sizeof(caller_mask), &caller_mask);
+    }
+#else
+    run_chunk(0);
+#endif
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
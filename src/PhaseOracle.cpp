@@ -0,0 +1,123 @@
+#include "PhaseOracle.h"
+#include <algorithm>
+#include <stdexcept>
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PhaseOracle
+///////////////////////////////////////////////////////////////////////////////
+
+PhaseOracle::PhaseOracle(const std::vector<size_t>& qubits_in, const std::function<bool(size_t)>& predicate)
+{
+    set_qubits(qubits_in);
+    const size_t inputs=size_t(1)<<qubits.size();
+    for (size_t input=0; input<inputs; input++)
+    {
+        if (predicate(input))
+        {
+            marked[input>>6]|=uint64_t(1)<<(input&63);
+            marked_count++;
+        }
+    }
+}
+
+PhaseOracle::PhaseOracle(const std::vector<size_t>& qubits_in, const std::vector<bool>& truth_table)
+{
+    set_qubits(qubits_in);
+    if (truth_table.size()!=size_t(1)<<qubits.size())
+    {
+        throw std::invalid_argument("Truth table of a PhaseOracle needs one entry per input");
+    }
+    for (size_t input=0; input<truth_table.size(); input++)
+    {
+        if (truth_table[input])
+        {
+            marked[input>>6]|=uint64_t(1)<<(input&63);
+            marked_count++;
+        }
+    }
+}
+
+void PhaseOracle::set_qubits(const std::vector<size_t>& qubits_in)
+{
+    if (qubits_in.empty())
+    {
+        throw std::invalid_argument("PhaseOracle needs at least one qubit");
+    }
+    if (qubits_in.size()>max_inputs)
+    {
+        throw std::length_error("PhaseOracle supports at most "+std::to_string(max_inputs)+" qubits");
+    }
+    std::vector<size_t> sorted(qubits_in);
+    std::sort(sorted.begin(), sorted.end());
+    if (std::adjacent_find(sorted.begin(), sorted.end())!=sorted.end())
+    {
+        throw std::invalid_argument("PhaseOracle qubits must be distinct");
+    }
+    qubits=qubits_in;
+    qubit_index=sorted.front();
+    gate_size=sorted.back()-sorted.front()+1;
+    symbol="O";
+    matrix=Matrix();
+    marked.assign(((size_t(1)<<qubits.size())+63)/64, 0);
+}
+
+const std::vector<size_t>& PhaseOracle::get_qubits() const
+{
+    return qubits;
+}
+
+const std::vector<uint64_t>& PhaseOracle::get_marked() const
+{
+    return marked;
+}
+
+size_t PhaseOracle::get_marked_count() const
+{
+    return marked_count;
+}
+
+bool PhaseOracle::is_marked(size_t input) const
+{
+    if (input>=size_t(1)<<qubits.size())
+    {
+        throw std::out_of_range("Input out of range for PhaseOracle::is_marked()");
+    }
+    return (marked[input>>6]>>(input&63))&1;
+}
+
+const Matrix& PhaseOracle::get_matrix() const
+{
+    std::call_once(matrix_flag, [this]()
+        {
+            // Diagonal over every register the gate spans, including the
+            // ones between the selected qubits.
+            const size_t dimension=size_t(1)<<gate_size;
+            Matrix result(dimension, dimension);
+            for (size_t j=0; j<dimension; j++)
+            {
+                size_t input=0;
+                for (size_t r=0; r<qubits.size(); r++)
+                {
+                    input|=((j>>(qubits[r]-qubit_index))&1)<<r;
+                }
+                result(j, j)=((marked[input>>6]>>(input&63))&1) ? -1.0 : 1.0;
+            }
+            dense_matrix=std::move(result);
+        });
+    return dense_matrix;
+}
+
+void PhaseOracle::append_operations(std::vector<Operation>& operations, size_t qubit_offset, bool /*decompose_subcircuits*/) const
+{
+    // Already as small as it gets, so decomposing changes nothing.
+    Operation operation;
+    operation.type=OperationType::phase_oracle;
+    for (size_t qubit : qubits)
+    {
+        operation.targets.push_back(qubit+qubit_offset);
+    }
+    operation.marked=&marked;
+    operation.component=this;
+    operations.push_back(operation);
+}
@@ -0,0 +1,264 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    thread_local size_t thread_allocations=0;
+    thread_local size_t thread_allocated_bytes=0;
+    std::atomic<size_t> next_thread_id{ 0 };
+
+    std::string escape_json(const std::string& text)
+    {
+        std::string escaped;
+        escaped.reserve(text.size()+2);
+        for (char c : text)
+        {
+            if (c=='"'||c=='\\')
+            {
+                escaped+='\\';
+                escaped+=c;
+            }
+            else if (static_cast<unsigned char>(c)<0x20)
+            {
+                escaped+=' ';
+            }
+            else
+            {
+                escaped+=c;
+            }
+        }
+        return escaped;
+    }
+
+    void write_optional_index(std::ostream& os, const char* key, size_t value)
+    {
+        os<<"\""<<key<<"\":";
+        if (value==ProfileEvent::none)
+        {
+            os<<"null";
+        }
+        else
+        {
+            os<<value;
+        }
+    }
+
+    void write_event_fields(std::ostream& os, const ProfileEvent& event)
+    {
+        write_optional_index(os, "step", event.step_index);
+        os<<",";
+        write_optional_index(os, "qubit", event.qubit_index);
+        os<<",\"rows\":"<<event.rows
+            <<",\"cols\":"<<event.cols
+            <<",\"flops\":"<<event.flops
+            <<",\"bytes\":"<<event.bytes
+            <<",\"allocations\":"<<event.allocations
+            <<",\"allocated_bytes\":"<<event.allocated_bytes;
+        if (!event.node_bytes.empty())
+        {
+            os<<",\"node_bytes\":[";
+            for (size_t i=0; i<event.node_bytes.size(); i++)
+            {
+                os<<(i==0 ? "" : ",")<<event.node_bytes[i];
+            }
+            os<<"]";
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Profiler
+///////////////////////////////////////////////////////////////////////////////
+
+Profiler::Profiler() : epoch{ std::chrono::steady_clock::now() } {}
+
+Profiler& Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+bool Profiler::is_enabled()
+{
+#ifdef QC_ENABLE_PROFILING
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::vector<ProfileEvent> Profiler::get_events() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return events;
+}
+
+double Profiler::get_time_us() const
+{
+    return std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now()-epoch).count();
+}
+
+void Profiler::write_json(std::ostream& os) const
+{
+    std::vector<ProfileEvent> snapshot=get_events();
+    os<<"{\"enabled\":"<<(is_enabled() ? "true" : "false")<<",\"events\":[";
+    for (size_t i=0; i<snapshot.size(); i++)
+    {
+        const ProfileEvent& event=snapshot[i];
+        os<<(i==0 ? "" : ",")<<"\n{\"name\":\""<<escape_json(event.name)
+            <<"\",\"category\":\""<<escape_json(event.category)<<"\","
+            <<"\"start_us\":"<<event.start_us
+            <<",\"duration_us\":"<<event.duration_us
+            <<",\"thread\":"<<event.thread_id<<",";
+        write_event_fields(os, event);
+        os<<"}";
+    }
+    os<<"\n]}"<<std::endl;
+}
+
+void Profiler::write_chrome_trace(std::ostream& os) const
+{
+    // Complete ("X") events; nesting is recovered by the viewer from the
+    // timestamps of events on the same thread.
+    std::vector<ProfileEvent> snapshot=get_events();
+    os<<"{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (size_t i=0; i<snapshot.size(); i++)
+    {
+        const ProfileEvent& event=snapshot[i];
+        os<<(i==0 ? "" : ",")<<"\n{\"name\":\""<<escape_json(event.name)
+            <<"\",\"cat\":\""<<escape_json(event.category)
+            <<"\",\"ph\":\"X\",\"ts\":"<<event.start_us
+            <<",\"dur\":"<<event.duration_us
+            <<",\"pid\":1,\"tid\":"<<event.thread_id<<",\"args\":{";
+        write_event_fields(os, event);
+        os<<"}}";
+    }
+    os<<"\n]}"<<std::endl;
+}
+
+void Profiler::write_summary(std::ostream& os) const
+{
+    // Aggregate component events by symbol so the most expensive gates in a
+    // long circuit stand out.
+    struct Totals
+    {
+        size_t count=0;
+        double duration_us=0;
+        double flops=0;
+        double bytes=0;
+        size_t allocations=0;
+    };
+    std::map<std::string, Totals> totals;
+    for (const ProfileEvent& event : get_events())
+    {
+        Totals& entry=totals[event.category+":"+event.name];
+        entry.count++;
+        entry.duration_us+=event.duration_us;
+        entry.flops+=event.flops;
+        entry.bytes+=event.bytes;
+        entry.allocations+=event.allocations;
+    }
+    std::vector<std::pair<std::string, Totals>> sorted(totals.begin(), totals.end());
+    std::sort(sorted.begin(), sorted.end(),
+        [](const std::pair<std::string, Totals>& a, const std::pair<std::string, Totals>& b)
+        {
+            return a.second.duration_us>b.second.duration_us;
+        });
+    os<<"calls, total_us, mean_us, gflop/s, allocations, name"<<std::endl;
+    for (const auto& entry : sorted)
+    {
+        const Totals& t=entry.second;
+        double gflops=t.duration_us>0 ? t.flops/(t.duration_us*1e3) : 0;
+        os<<t.count<<", "<<t.duration_us<<", "<<t.duration_us/t.count<<", "
+            <<gflops<<", "<<t.allocations<<", "<<entry.first<<std::endl;
+    }
+    // Where the sampled pages of each buffer ended up, per NUMA node.
+    for (const ProfileEvent& event : get_events())
+    {
+        if (event.category!="placement")
+        {
+            continue;
+        }
+        os<<"placement "<<event.name<<" ("<<event.bytes/(1<<20)<<" MiB):";
+        for (size_t node=0; node<event.node_bytes.size(); node++)
+        {
+            os<<" node"<<node<<" "<<event.node_bytes[node]/(1<<20)<<" MiB";
+        }
+        os<<std::endl;
+    }
+}
+
+void Profiler::record(ProfileEvent event)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    events.push_back(std::move(event));
+}
+
+void Profiler::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    events.clear();
+}
+
+void Profiler::record_allocation(size_t bytes)
+{
+    thread_allocations++;
+    thread_allocated_bytes+=bytes;
+}
+
+size_t Profiler::get_thread_allocations()
+{
+    return thread_allocations;
+}
+
+size_t Profiler::get_thread_allocated_bytes()
+{
+    return thread_allocated_bytes;
+}
+
+size_t Profiler::get_thread_id()
+{
+    thread_local size_t id=next_thread_id++;
+    return id;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ProfileScope
+///////////////////////////////////////////////////////////////////////////////
+
+ProfileScope::ProfileScope(std::string name, std::string category,
+    size_t step_index, size_t qubit_index, size_t rows, size_t cols,
+    double flops, double bytes)
+{
+    event.name=std::move(name);
+    event.category=std::move(category);
+    event.step_index=step_index;
+    event.qubit_index=qubit_index;
+    event.rows=rows;
+    event.cols=cols;
+    event.flops=flops;
+    event.bytes=bytes;
+    event.thread_id=Profiler::get_thread_id();
+    start_allocations=Profiler::get_thread_allocations();
+    start_allocated_bytes=Profiler::get_thread_allocated_bytes();
+    event.start_us=Profiler::instance().get_time_us();
+}
+
+ProfileScope::~ProfileScope()
+{
+    Profiler& profiler=Profiler::instance();
+    event.duration_us=profiler.get_time_us()-event.start_us;
+    event.allocations=Profiler::get_thread_allocations()-start_allocations;
+    event.allocated_bytes=Profiler::get_thread_allocated_bytes()-start_allocated_bytes;
+    profiler.record(std::move(event));
+}
@@ -0,0 +1,122 @@
+#define _USE_MATH_DEFINES
+#include "QFTGate.h"
+#include "DerivedGates.h"
+#include "GateCache.h"
+#include <cmath>
+
+
+///////////////////////////////////////////////////////////////////////////////
+// QFTGate
+///////////////////////////////////////////////////////////////////////////////
+
+QFTGate::QFTGate(size_t n, size_t gate_size_in, bool inverse_in) : inverse{ inverse_in }
+{
+    if (gate_size_in==0)
+    {
+        throw std::invalid_argument("QFTGate needs at least one register");
+    }
+    qubit_index=n;
+    symbol=inverse ? "QFT*" : "QFT";
+    gate_size=gate_size_in;
+    matrix=Matrix();
+}
+
+bool QFTGate::is_inverse() const
+{
+    return inverse;
+}
+
+const Matrix& QFTGate::get_matrix() const
+{
+    std::call_once(matrix_flag, [this]()
+        {
+            // <y|QFT|x> = w^(rev(x)rev(y))/sqrt(N), where rev() reverses the
+            // bits of the local index because the first register is the most
+            // significant. Built once, on the first request.
+            size_t dimension=size_t(1)<<gate_size;
+            double sign=inverse ? -1.0 : 1.0;
+            std::vector<size_t> reversed(dimension, 0);
+            for (size_t i=0; i<dimension; i++)
+            {
+                for (size_t b=0; b<gate_size; b++)
+                {
+                    reversed[i]|=((i>>b)&1)<<(gate_size-1-b);
+                }
+            }
+            Matrix result(dimension, dimension);
+            for (size_t y=0; y<dimension; y++)
+            {
+                for (size_t x=0; x<dimension; x++)
+                {
+                    size_t exponent=(reversed[x]*reversed[y])%dimension;
+                    result(y, x)=std::polar(1/std::sqrt(double(dimension)), sign*2*M_PI*double(exponent)/double(dimension));
+                }
+            }
+            dense_matrix=std::move(result);
+        });
+    return dense_matrix;
+}
+
+const QuantumCircuit& QFTGate::get_circuit() const
+{
+    // Textbook decomposition, used by backends that need one and two qubit
+    // gates (eg: the matrix product state).
+    std::call_once(circuit_flag, [this]()
+        {
+            std::string key=std::string(inverse ? "inverse_qft(" : "qft(")+std::to_string(gate_size)+")";
+            circuit=GateCache::instance().get_circuit(key, [this]()
+                {
+                    size_t n=gate_size;
+                    QuantumCircuit qc(n);
+                    if (!inverse)
+                    {
+                        for (size_t j=0; j<n; j++)
+                        {
+                            for (size_t k=0; k<j; k++)
+                            {
+                                qc.add_component(controlled(p(k, M_PI/std::pow(2, j-k)), j));
+                            }
+                            qc.add_component(h(j));
+                        }
+                        for (size_t i=0; i<n/2; i++)
+                        {
+                            qc.add_component(swap(i, n-i-1));
+                        }
+                    }
+                    else
+                    {
+                        for (size_t i=0; i<n/2; i++)
+                        {
+                            qc.add_component(swap(i, n-i-1));
+                        }
+                        for (size_t j=n; j-->0;)
+                        {
+                            qc.add_component(h(j));
+                            for (size_t k=j; k-->0;)
+                            {
+                                qc.add_component(controlled(p(k, -M_PI/std::pow(2, j-k)), j));
+                            }
+                        }
+                    }
+                    return qc;
+                });
+        });
+    return *circuit;
+}
+
+void QFTGate::append_operations(std::vector<Operation>& operations, size_t qubit_offset, bool decompose_subcircuits) const
+{
+    if (decompose_subcircuits)
+    {
+        get_circuit().append_operations(operations, get_index()+qubit_offset, true);
+        return;
+    }
+    Operation operation;
+    operation.type=inverse ? OperationType::inverse_qft : OperationType::qft;
+    for (size_t i=0; i<gate_size; i++)
+    {
+        operation.targets.push_back(get_index()+qubit_offset+i);
+    }
+    operation.component=this;
+    operations.push_back(operation);
+}
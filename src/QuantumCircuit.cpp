@@ -1,4 +1,17 @@
 #include "QuantumCircuit.h"
+#include "BitSlicedSimulator.h"
+#include "BlockedScheduler.h"
+#include "DecisionDiagram.h"
+#include "DistributedStateVector.h"
+#include "MatrixProductState.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include "SparseStateVector.h"
+#include "StabilizerTableau.h"
+#include "StateOutput.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -11,21 +24,19 @@ std::string get_binary_representation(int num, int  size)
 }
 
 Matrix calculate_matrix_for_register(std::vector<int> input_register) {
-    Matrix qubit_zero(2, 1);
-    qubit_zero(0, 0)=std::complex<double>(1, 0);
-    Matrix qubit_one(2, 1);
-    qubit_one(1, 0)=std::complex<double>(1, 0);
-    // Store qubits in an array of matrices.
-    std::vector<Matrix> tensor_product_list(input_register.size(), qubit_zero);
+    // The tensor product of |0> and |1> columns is the basis column whose
+    // index has bit i set for qubit i, so set that entry directly.
+    size_t index=0;
     for (size_t i=0; i<input_register.size(); i++)
     {
         if (input_register[i]==1)
         {
-            tensor_product_list[i]=qubit_one;
+            index|=size_t(1)<<i;
         }
     }
-    // Tensor product them together to get the vector repersenting the state.
-    return perform_tensor_product(tensor_product_list);
+    Matrix state(size_t(1)<<input_register.size(), 1);
+    state(index, 0)=std::complex<double>(1, 0);
+    return state;
 }
 
 bool is_power_of_two(int n) {
@@ -33,13 +44,16 @@ bool is_power_of_two(int n) {
     return (n&(n-1))==0;
 }
 
-void draw_state(Matrix state)
+void draw_state(const Matrix& state)
 {
     if (!is_power_of_two(state.get_rows())&&state.get_cols()==1)
     {
         std::cout<<"Error: State vector has incorrect dimensions"<<std::endl;
         return;
     }
+    // Build the whole ket in one buffer instead of one stream call per term.
+    OutputBuffer out(std::cout);
+    const size_t num_qubits=std::log2(state.get_rows());
     int states_printed=0;
     for (size_t i=0; i<state.get_rows(); i++)
     {
@@ -49,13 +63,19 @@ void draw_state(Matrix state)
         {
             if (states_printed!=0)
             {
-                std::cout<<" + ";
+                out.append(" + ", 3);
             }
             if (std::abs(1.0-value.real())>tolerance||std::abs(value.imag())>tolerance)
             {
-                std::cout<<value;
+                out.append('(');
+                out.append_number(value.real(), "%g");
+                out.append(',');
+                out.append_number(value.imag(), "%g");
+                out.append(')');
             }
-            std::cout<<"|"<<get_binary_representation(i, std::log2(state.get_rows()))<<"> ";
+            out.append('|');
+            out.append_bits(i, num_qubits);
+            out.append("> ", 2);
             states_printed++;
         }
     }
@@ -90,12 +110,107 @@ Matrix QuantumCircuit::get_initial_state() const
 
 Matrix QuantumCircuit::get_final_state() const
 {
-    return get_matrix()*get_initial_state();
+    // The state vector and its column matrix copy are alive together.
+    ResourceEstimate estimate=estimate_resources(ExecutionMode::state_vector);
+    estimate.peak_bytes+=std::pow(2.0, double(register_size))*sizeof(std::complex<double>);
+    MemoryBudget::instance().admit(estimate, "get_final_state()");
+    return get_final_state_vector().to_matrix();
 }
 
 Matrix QuantumCircuit::get_state_after_step(size_t step_index) const
 {
-    return get_matrix_at_step(step_index)*get_initial_state();
+    const std::vector<Operation> operations=get_operations(false);
+    ResourceEstimate estimate=::estimate_resources(operations, register_size,
+        total_steps+1, ExecutionMode::state_vector);
+    estimate.peak_bytes+=std::pow(2.0, double(register_size))*sizeof(std::complex<double>);
+    MemoryBudget::instance().admit(estimate, "get_state_after_step()");
+    std::vector<Operation> applied;
+    for (const Operation& operation : operations)
+    {
+        if (operation.step_index<=step_index)
+        {
+            applied.push_back(operation);
+        }
+    }
+    StateVector state=get_initial_state_vector();
+    apply_operations(state, applied);
+    return state.to_matrix();
+}
+
+StateVector QuantumCircuit::get_initial_state_vector() const
+{
+    size_t index=0;
+    for (size_t i=0; i<register_size; i++)
+    {
+        if (input_register[i]==1)
+        {
+            index|=size_t(1)<<i;
+        }
+    }
+    StateVector state(register_size);
+    state.set_basis_state(index);
+    return state;
+}
+
+StateVector QuantumCircuit::get_final_state_vector() const
+{
+    // Gates are applied to the state one at a time, so the 2^n x 2^n circuit
+    // matrix is never formed.
+    MemoryBudget::instance().admit(estimate_resources(ExecutionMode::state_vector),
+        "get_final_state_vector()");
+    if (should_distribute(register_size))
+    {
+        DistributedStateVector distributed(register_size, get_process_count());
+        distributed.apply_circuit(*this);
+        return distributed.to_state_vector();
+    }
+    StateVector state=get_initial_state_vector();
+    apply_to_state(state);
+    return state;
+}
+
+SparseStateVector QuantumCircuit::get_final_sparse_state() const
+{
+    // Only the non-zero amplitudes are stored, so registers too large for
+    // get_final_state_vector() work while the superposition stays small.
+    size_t index=0;
+    for (size_t i=0; i<register_size; i++)
+    {
+        if (input_register[i]==1)
+        {
+            index|=size_t(1)<<i;
+        }
+    }
+    SparseStateVector state(register_size);
+    state.set_basis_state(index);
+    state.apply_circuit(*this);
+    return state;
+}
+
+DecisionDiagramState QuantumCircuit::get_final_decision_diagram() const
+{
+    size_t index=0;
+    for (size_t i=0; i<register_size; i++)
+    {
+        if (input_register[i]==1)
+        {
+            index|=size_t(1)<<i;
+        }
+    }
+    DecisionDiagramState state(register_size);
+    state.set_basis_state(index);
+    state.apply_circuit(*this);
+    return state;
+}
+
+void QuantumCircuit::apply_to_state(StateVector& state) const
+{
+    if (state.get_num_qubits()!=register_size)
+    {
+        throw std::invalid_argument("State size does not match circuit's register size!");
+    }
+    // Large states are run through the cache blocked scheduler.
+    apply_operations(state, get_operations(false));
 }
 
 size_t QuantumCircuit::get_register_size() const
@@ -108,13 +223,45 @@ size_t QuantumCircuit::get_total_steps() const
     return total_steps;
 }
 
+size_t QuantumCircuit::get_gate_count() const
+{
+    return placed_gates.size();
+}
+
+std::vector<int> QuantumCircuit::get_input_register() const
+{
+    return input_register;
+}
+
+std::shared_ptr<QuantumComponent> QuantumCircuit::get_component(size_t register_index, size_t step_index) const
+{
+    if (register_index>=register_size||step_index>=components[register_index].size())
+    {
+        throw std::out_of_range("Component index out of range for QuantumCircuit::get_component()");
+    }
+    return components[register_index][step_index];
+}
+
 Matrix QuantumCircuit::get_matrix_at_step(size_t step_index) const
 {
+    // Each dense N x N product costs 8N^3 flops and touches three N x N
+    // buffers.
+    MemoryBudget::instance().admit(::estimate_resources({}, register_size, 1,
+        ExecutionMode::unitary_by_products), "get_matrix_at_step()");
+    const size_t dimension=size_t(1)<<register_size;
+    QC_PROFILE_SCOPE("step "+std::to_string(step_index), "step", step_index,
+        ProfileEvent::none, dimension, dimension,
+        8.0*register_size*dimension*dimension*dimension,
+        3.0*register_size*dimension*dimension*sizeof(std::complex<double>));
     // Create an identity matrix that has the same size as n gates tensor producted
     //  together.
-    Matrix resultant_matrix=identity_matrix(1<<register_size);
+    Matrix resultant_matrix=identity_matrix(dimension);
     for (size_t i=0; i<register_size; i++)
     {
+        QC_PROFILE_SCOPE(components[i][step_index]->get_symbol(), "component",
+            step_index, i, dimension, dimension,
+            8.0*dimension*dimension*dimension,
+            3.0*dimension*dimension*sizeof(std::complex<double>));
         // Multiply by the gates matrix (which is changed to account for the circuits size).
         resultant_matrix=components[i][step_index]->get_matrix(register_size)*resultant_matrix;
     }
@@ -123,6 +270,47 @@ Matrix QuantumCircuit::get_matrix_at_step(size_t step_index) const
 
 Matrix QuantumCircuit::get_matrix() const
 {
+    // Column j of the unitary is the circuit applied to basis state |j>, so
+    // each column is propagated through the gates with the state vector
+    // kernels. That is O(steps*4^n) in total instead of the O(steps*n*8^n) of
+    // multiplying dense step matrices, and the columns run in parallel.
+    const size_t dimension=size_t(1)<<register_size;
+    const std::vector<Operation> operations=get_operations(false);
+    MemoryBudget::instance().admit(::estimate_resources(operations, register_size,
+        total_steps+1, ExecutionMode::unitary), "get_matrix()");
+    QC_PROFILE_SCOPE("get_matrix", "circuit", ProfileEvent::none,
+        ProfileEvent::none, dimension, dimension,
+        8.0*operations.size()*dimension*dimension,
+        2.0*operations.size()*dimension*dimension*sizeof(std::complex<double>));
+    Matrix circuit_matrix(dimension, dimension);
+    parallel_for(0, dimension, 1, [&](size_t begin, size_t end)
+    {
+        StateVector column(register_size);
+        for (size_t j=begin; j<end; j++)
+        {
+            column.set_basis_state(j);
+            for (const Operation& operation : operations)
+            {
+                column.apply_operation(operation);
+            }
+            const std::complex<double>* amplitudes=column.get_data();
+            for (size_t i=0; i<dimension; i++)
+            {
+                circuit_matrix(i, j)=amplitudes[i];
+            }
+        }
+    });
+    return circuit_matrix;
+}
+
+Matrix QuantumCircuit::get_matrix_by_products() const
+{
+    MemoryBudget::instance().admit(estimate_resources(ExecutionMode::unitary_by_products),
+        "get_matrix_by_products()");
+    QC_PROFILE_SCOPE("get_matrix_by_products", "circuit", ProfileEvent::none,
+        ProfileEvent::none, size_t(1)<<register_size, size_t(1)<<register_size,
+        8.0*(register_size+1)*(total_steps+1)*std::pow(2.0, 3.0*register_size),
+        3.0*(register_size+1)*(total_steps+1)*std::pow(2.0, 2.0*register_size)*sizeof(std::complex<double>));
     Matrix circuit_matrix=get_matrix_at_step(0);
     for (size_t i=1; i<total_steps+1; i++)
     {
@@ -169,6 +357,12 @@ bool QuantumCircuit::is_step_empty(size_t step_index) const
 
 bool QuantumCircuit::is_gate_in_circuit(std::shared_ptr<QuantumComponent> gate) const
 {
+    // Non-identity gates are indexed so large circuits don't rescan the grid
+    // on every add_component().
+    if (gate->get_symbol()!="I")
+    {
+        return placed_gates.count(gate.get())!=0;
+    }
     for (size_t i=0; i<register_size; i++)
     {
         for (size_t j=0; j<components[i].size(); j++)
@@ -182,6 +376,219 @@ bool QuantumCircuit::is_gate_in_circuit(std::shared_ptr<QuantumComponent> gate)
     return false;
 }
 
+std::vector<Operation> QuantumCircuit::get_operations(bool decompose_subcircuits) const
+{
+    std::vector<Operation> operations;
+    append_operations(operations, 0, decompose_subcircuits);
+    return operations;
+}
+
+void QuantumCircuit::append_operations(std::vector<Operation>& operations, size_t qubit_offset, bool decompose_subcircuits) const
+{
+    // Walk the circuit step by step, skipping identities. Gates within a step
+    // act on different registers so their order does not matter.
+    for (size_t step_index=0; step_index<total_steps+1; step_index++)
+    {
+        for (size_t i=0; i<register_size; i++)
+        {
+            const std::shared_ptr<QuantumComponent>& gate=components[i][step_index];
+            if (gate->get_symbol()=="I")
+            {
+                continue;
+            }
+            size_t first=operations.size();
+            gate->append_operations(operations, qubit_offset, decompose_subcircuits);
+            for (size_t j=first; j<operations.size(); j++)
+            {
+                operations[j].step_index=step_index;
+            }
+        }
+    }
+}
+
+bool QuantumCircuit::is_clifford() const
+{
+    for (const Operation& operation : get_operations(true))
+    {
+        if (!StabilizerTableau::is_clifford(operation))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+ResourceEstimate QuantumCircuit::estimate_resources(ExecutionMode mode, size_t max_bond_dimension) const
+{
+    // The stabilizer and matrix product state backends inline subcircuits.
+    bool decompose=mode==ExecutionMode::stabilizer||mode==ExecutionMode::matrix_product_state;
+    return ::estimate_resources(get_operations(decompose), register_size, total_steps+1,
+        mode, max_bond_dimension);
+}
+
+bool QuantumCircuit::is_permutation() const
+{
+    return BitSlicedSimulator::is_permutation(get_operations(false));
+}
+
+std::vector<size_t> QuantumCircuit::get_truth_table() const
+{
+    // Output basis index for every input basis index (bit k is qubit k), for
+    // circuits that only permute basis states.
+    const std::vector<Operation> operations=get_operations(false);
+    MemoryBudget::instance().admit(::estimate_resources(operations, register_size,
+        total_steps+1, ExecutionMode::bit_sliced), "get_truth_table()");
+    return BitSlicedSimulator(operations, register_size).get_truth_table();
+}
+
+std::map<std::string, size_t> QuantumCircuit::sample(size_t shots, unsigned seed) const
+{
+    // Measures every qubit of the final state shots times. Clifford-only
+    // circuits are run on a stabilizer tableau so they scale to thousands of
+    // qubits, anything else falls back to the full state.
+    std::mt19937_64 rng(seed);
+    std::map<std::string, size_t> counts;
+    std::vector<Operation> operations=get_operations(true);
+    bool clifford=true;
+    for (const Operation& operation : operations)
+    {
+        if (!StabilizerTableau::is_clifford(operation))
+        {
+            clifford=false;
+            break;
+        }
+    }
+    if (clifford)
+    {
+        StabilizerTableau tableau(register_size);
+        for (size_t i=0; i<register_size; i++)
+        {
+            if (input_register[i]==1)
+            {
+                tableau.apply_x(i);
+            }
+        }
+        for (const Operation& operation : operations)
+        {
+            tableau.apply_operation(operation);
+        }
+        for (const std::string& outcome : tableau.sample(shots, rng))
+        {
+            counts[outcome]++;
+        }
+        return counts;
+    }
+    // The state vector plus the cumulative distribution. When that is over
+    // the memory budget, try a sparse state, which is exact but gives up
+    // once its support outgrows the budget. If the policy allows it, then
+    // sample from a matrix product state with the largest bond dimension
+    // that fits instead.
+    MemoryBudget& budget=MemoryBudget::instance();
+    ResourceEstimate estimate=estimate_resources(ExecutionMode::state_vector);
+    estimate.peak_bytes+=std::pow(2.0, double(register_size))*sizeof(double);
+    if (!budget.fits(estimate)&&register_size<=63)
+    {
+        try
+        {
+            for (const std::string& outcome : get_final_sparse_state().sample(shots, rng))
+            {
+                counts[outcome]++;
+            }
+            return counts;
+        }
+        catch (const std::length_error&)
+        {
+            // The support outgrew the budget; rng has not been used yet.
+        }
+    }
+    if (!budget.fits(estimate)&&budget.get_policy()==BudgetPolicy::fallback)
+    {
+        size_t bond_dimension=0;
+        for (size_t chi=2; chi<=(size_t(1)<<std::min<size_t>(register_size/2, 20)); chi*=2)
+        {
+            if (budget.fits(::estimate_resources(operations, register_size, total_steps+1,
+                ExecutionMode::matrix_product_state, chi)))
+            {
+                bond_dimension=chi;
+            }
+        }
+        if (bond_dimension>0)
+        {
+            MatrixProductState mps(register_size, bond_dimension);
+            mps.apply_circuit(*this);
+            for (const std::string& outcome : mps.sample(shots, rng))
+            {
+                counts[outcome]++;
+            }
+            return counts;
+        }
+    }
+    budget.admit(estimate, "sample()");
+    StateVector final_state=get_final_state_vector();
+    std::vector<double> cumulative(final_state.get_size());
+    double total=0;
+    for (size_t i=0; i<final_state.get_size(); i++)
+    {
+        total+=std::norm(final_state.get_data()[i]);
+        cumulative[i]=total;
+    }
+    std::uniform_real_distribution<double> uniform(0, total);
+    for (size_t shot=0; shot<shots; shot++)
+    {
+        size_t outcome=std::lower_bound(cumulative.begin(), cumulative.end(), uniform(rng))-cumulative.begin();
+        outcome=std::min(outcome, cumulative.size()-1);
+        counts[get_binary_representation(outcome, register_size)]++;
+    }
+    return counts;
+}
+
+std::vector<double> QuantumCircuit::get_marginal_probabilities(const std::vector<size_t>& qubits) const
+{
+    // Entry j is the probability that qubit qubits[r] reads bit r of j, summed
+    // over the other qubits in one pass, so only 2^k values are returned.
+    return get_final_state_vector().get_marginal_probabilities(qubits);
+}
+
+TruthTableReport QuantumCircuit::verify_truth_table(const std::function<size_t(size_t)>& expected_output, size_t max_reported) const
+{
+    const std::vector<Operation> operations=get_operations(false);
+    if (!BitSlicedSimulator::is_permutation(operations))
+    {
+        // Every thread propagates its own state vector.
+        ResourceEstimate estimate=::estimate_resources(operations, register_size,
+            total_steps+1, ExecutionMode::state_vector);
+        estimate.peak_bytes*=get_thread_count();
+        MemoryBudget::instance().admit(estimate, "verify_truth_table()");
+    }
+    return ::verify_truth_table(operations, register_size, expected_output,
+        0, size_t(1)<<register_size, max_reported);
+}
+
+TruthTableReport QuantumCircuit::verify_truth_table(const std::vector<size_t>& expected_outputs, size_t max_reported) const
+{
+    if (expected_outputs.size()!=(size_t(1)<<register_size))
+    {
+        throw std::invalid_argument("Truth table needs one expected output per basis input!");
+    }
+    return verify_truth_table([&expected_outputs](size_t input) { return expected_outputs[input]; },
+        max_reported);
+}
+
+EquivalenceReport QuantumCircuit::check_equivalence(const QuantumCircuit& other, const EquivalenceOptions& options) const
+{
+    if (other.register_size!=register_size)
+    {
+        throw std::invalid_argument("Circuits of different register sizes cannot be equivalent!");
+    }
+    // Two state vectors, or two per thread when the basis states are run.
+    const std::vector<Operation> operations=get_operations(false);
+    ResourceEstimate estimate=::estimate_resources(operations, register_size,
+        total_steps+1, ExecutionMode::state_vector);
+    estimate.peak_bytes*=2*(options.check_basis_states ? get_thread_count()+1 : 1);
+    MemoryBudget::instance().admit(estimate, "check_equivalence()");
+    return ::check_equivalence(operations, other.get_operations(false), register_size, options);
+}
+
 // Drawing Functions
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -243,26 +650,36 @@ void QuantumCircuit::draw_probability_distribution() const
     // Calculate initial state in vector form and draw as ket.
     std::cout<<"Intial state:"<<std::endl;
     draw_state(get_initial_state());
-    // Draw basis states in ket form and calculate probabilities of each basis
-    //  state.
+    // Draw basis states in ket form with the probability of each as a
+    //  histogram bar. The rows are formatted into one buffer (StateOutput.h).
     std::cout<<std::endl
         <<"Probabilities of final states:"<<std::endl;
-    Matrix final_state=get_final_state();
-    for (int i=0; i<1<<register_size; i++)
-    {
-        Matrix basis_state=Matrix(1<<register_size, 1);
-        basis_state(i, 0)=1;
-        draw_state(basis_state);
-        // Draw probability distribution as a histogram.
-        double probability=(final_state(i, 0)*std::conj(final_state(i, 0))).real();
-        std::cout<<"||"<<std::to_string(probability).substr(0, 5)<<" ||";
-        int filled_blocks=probability*50;
-        for (int j=0; j<filled_blocks; j++)
-        {
-            std::cout<<"#";
-        }
-        std::cout<<std::endl;
-    }
+    write_probabilities(std::cout, get_final_state_vector());
+    std::cout.flush();
+}
+
+void QuantumCircuit::draw_probability_distribution(const std::vector<size_t>& qubits) const
+{
+    // Only the selected qubits are printed, qubits[0] as the rightmost bit.
+    std::cout<<"Probabilities of final states of the selected qubits:"<<std::endl;
+    write_probabilities(std::cout, get_marginal_probabilities(qubits));
+    std::cout.flush();
+}
+
+void QuantumCircuit::write_final_state(std::ostream& os, const OutputOptions& options) const
+{
+    write_state(os, get_final_state_vector(), options);
+}
+
+void QuantumCircuit::write_probability_distribution(std::ostream& os, const OutputOptions& options) const
+{
+    write_probabilities(os, get_final_state_vector(), options);
+}
+
+void QuantumCircuit::write_probability_distribution(std::ostream& os, const std::vector<size_t>& qubits,
+    const OutputOptions& options) const
+{
+    write_probabilities(os, get_marginal_probabilities(qubits), options);
 }
 
 // Mutators
@@ -337,8 +754,33 @@ void QuantumCircuit::replace_component(std::shared_ptr<QuantumComponent> gate, s
         return;
     }
     // release ownership of old gate from circuit and assign new gate.
+    placed_gates.erase(components[register_index][step_index].get());
     components[register_index][step_index].reset();
     components[register_index][step_index]=gate;
+    if (gate->get_symbol()!="I")
+    {
+        placed_gates.insert(gate.get());
+    }
+}
+
+void QuantumCircuit::remove_step(size_t step_index)
+{
+    if (step_index>total_steps)
+    {
+        throw std::out_of_range("Step index out of range for QuantumCircuit::remove_step()");
+    }
+    for (size_t i=0; i<register_size; i++)
+    {
+        placed_gates.erase(components[i][step_index].get());
+        components[i].erase(components[i].begin()+step_index);
+    }
+    total_steps--;
+    // Keep the invariant that the circuit always has a step to add gates to,
+    // and that a multigate is never in the last step.
+    if (total_steps==size_t(-1)||step_contains_multigate(total_steps))
+    {
+        evolve();
+    }
 }
 
 void QuantumCircuit::evolve()
@@ -416,20 +858,19 @@ void QuantumCircuit::ask_for_input()
     }
 }
 
-void QuantumCircuit::test_circuit() {
-    std::vector<int> initial_input = input_register;
+void QuantumCircuit::test_circuit() const {
+    // Each basis input gets its own state, so the circuit is left untouched.
+    const std::vector<Operation> operations=get_operations(false);
     std::cout<<"input states -> output states"<<std::endl;
-    for (int i = 0; i < (1 << register_size); i++) {
-        std::bitset<32> bits(i); // convert the number to a bitset
-        std::vector<int> input_register_; // initialize the vector of binary digits
-        for (int j = 0; j < register_size; j++) { // loop over the binary digits
-            input_register_.push_back(bits[j]); // add the j-th bit to the vector
-        }
-        input_register = input_register_;
-        draw_state(get_initial_state());
+    for (size_t i = 0; i < (size_t(1) << register_size); i++) {
+        StateVector state(register_size);
+        state.set_basis_state(i);
+        draw_state(state.to_matrix());
         std::cout<<"->";
-        draw_state(get_final_state());
+        for (const Operation& operation : operations) {
+            state.apply_operation(operation);
+        }
+        draw_state(state.to_matrix());
         std::cout<<std::endl;
     }
-    input_register = initial_input;
 }
\ No newline at end of file
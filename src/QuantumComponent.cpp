@@ -1,4 +1,5 @@
 #include "QuantumComponent.h"
+#include "GateKernels.h"
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -7,11 +8,7 @@
 QuantumComponent::QuantumComponent() : QuantumComponent(0, "I", identity_matrix(2)) {};
 
 QuantumComponent::QuantumComponent(size_t n, std::string symbol_in, Matrix matrix_in)
-{
-    qubit_index=n;
-    symbol=symbol_in;
-    matrix=matrix_in;
-};
+    : symbol{ std::move(symbol_in) }, qubit_index{ n }, matrix{ std::move(matrix_in) } {};
 
 std::string QuantumComponent::get_symbol() const
 {
@@ -98,8 +95,8 @@ int QuantumComponent::get_line_length() const
 // SingleGate
 ///////////////////////////////////////////////////////////////////////////////
 SingleGate::SingleGate() : SingleGate(0, "I", identity_matrix(2)) {};
-SingleGate::SingleGate(size_t n, std::string symbol_in, Matrix matrix_in) : QuantumComponent(n, symbol_in, matrix_in) {};
-Matrix SingleGate::get_matrix() const
+SingleGate::SingleGate(size_t n, std::string symbol_in, Matrix matrix_in) : QuantumComponent(n, std::move(symbol_in), std::move(matrix_in)) {};
+const Matrix& SingleGate::get_matrix() const
 {
     return matrix;
 }
@@ -143,14 +140,24 @@ std::string SingleGate::get_terminal_output(size_t terminal_line, size_t registe
     return get_line("edge");
 }
 
+void SingleGate::append_operations(std::vector<Operation>& operations, size_t qubit_offset, bool /*decompose_subcircuits*/) const
+{
+    Operation operation;
+    operation.type=OperationType::matrix;
+    operation.targets={ get_index()+qubit_offset };
+    operation.matrix=&matrix;
+    operation.component=this;
+    operations.push_back(operation);
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // MultiGate
 ///////////////////////////////////////////////////////////////////////////////
 MultiGate::MultiGate() : MultiGate(0, "I", identity_matrix(2), 1) {};
-MultiGate::MultiGate(size_t n, std::string symbol_in, Matrix matrix_in, size_t gate_size_in) : QuantumComponent(n, symbol_in, matrix_in)
+MultiGate::MultiGate(size_t n, std::string symbol_in, Matrix matrix_in, size_t gate_size_in) : QuantumComponent(n, std::move(symbol_in), std::move(matrix_in))
 {
-    if (1<<gate_size_in!=matrix_in.get_rows()||1<<gate_size_in!=matrix_in.get_cols())
+    if (1<<gate_size_in!=matrix.get_rows()||1<<gate_size_in!=matrix.get_cols())
     {
         throw std::invalid_argument("Matrix size does not match gate size for MultiGate constructor");
     }
@@ -161,7 +168,7 @@ size_t MultiGate::get_gate_size() const
     return gate_size;
 }
 
-Matrix MultiGate::get_matrix() const
+const Matrix& MultiGate::get_matrix() const
 {
     return matrix;
 }
@@ -174,7 +181,7 @@ Matrix MultiGate::get_matrix(size_t register_size) const
         throw std::invalid_argument("Gate cannot fit in register for MultiGate::get_matrix()");
     }
     std::vector<Matrix> matrices(register_size-gate_size+1, identity_matrix(2)); // right
-    matrices[get_index()]=matrix;
+    matrices[get_index()]=get_matrix();
     return perform_tensor_product(matrices);
 }
 
@@ -235,6 +242,19 @@ std::string MultiGate::get_terminal_output(size_t terminal_line, size_t register
     return get_line("middle");
 }
 
+void MultiGate::append_operations(std::vector<Operation>& operations, size_t qubit_offset, bool /*decompose_subcircuits*/) const
+{
+    Operation operation;
+    operation.type=OperationType::matrix;
+    for (size_t i=0; i<gate_size; i++)
+    {
+        operation.targets.push_back(get_index()+qubit_offset+i);
+    }
+    operation.matrix=&matrix;
+    operation.component=this;
+    operations.push_back(operation);
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // ControlledGate
@@ -253,10 +273,20 @@ ControlledGate::ControlledGate(std::shared_ptr<SingleGate> gate, size_t control_
     qubit_index=std::min(control_index, target_index);
     symbol=gate->get_symbol();
     gate_size=abs(control_index-target_index)+1;
-    matrix=get_controlled_matrix(gate->get_matrix());
+    target_matrix=gate->get_matrix();
+    target_gate=gate;
+    // The full 2^gate_size matrix is only built when get_matrix() is called,
+    // so long range controlled gates are cheap to add to large circuits.
+    matrix=Matrix();
+}
+
+const Matrix& ControlledGate::get_matrix() const
+{
+    std::call_once(controlled_flag, [this]() { controlled_matrix=get_controlled_matrix(target_matrix); });
+    return controlled_matrix;
 }
 
-Matrix ControlledGate::get_controlled_matrix(Matrix gate_matrix) const
+Matrix ControlledGate::get_controlled_matrix(const Matrix& gate_matrix) const
 {
     // Controlled gates have matrices of the form:
     // I x ... x|0><0| x ... x I x ... x I +
@@ -283,6 +313,34 @@ size_t ControlledGate::get_control_index() const
     return control_index;
 }
 
+size_t ControlledGate::get_target_index() const
+{
+    return target_index;
+}
+
+const Matrix& ControlledGate::get_target_matrix() const
+{
+    return target_matrix;
+}
+
+std::shared_ptr<SingleGate> ControlledGate::get_target_gate() const
+{
+    return target_gate;
+}
+
+void ControlledGate::append_operations(std::vector<Operation>& operations, size_t qubit_offset, bool /*decompose_subcircuits*/) const
+{
+    // Only the 2x2 target matrix is needed; the registers in between are left
+    // untouched.
+    Operation operation;
+    operation.type=OperationType::controlled;
+    operation.targets={ target_index+qubit_offset };
+    operation.controls={ control_index+qubit_offset };
+    operation.matrix=&target_matrix;
+    operation.component=this;
+    operations.push_back(operation);
+}
+
 std::string ControlledGate::get_terminal_output(size_t terminal_line, size_t register_index) const
 {
     // Return lines of strings so that something like this can be printed to 
@@ -367,11 +425,7 @@ HGate::HGate(size_t n)
 {
     qubit_index=n;
     symbol="H";
-    matrix=Matrix(2, 2);
-    matrix(0, 0)=std::complex<double>(1/sqrt(2), 0);
-    matrix(0, 1)=std::complex<double>(1/sqrt(2), 0);
-    matrix(1, 0)=std::complex<double>(1/sqrt(2), 0);
-    matrix(1, 1)=std::complex<double>(-1/sqrt(2), 0);
+    matrix=hadamard_gate.to_matrix();
 }
 
 // Pauli X Gate
@@ -380,9 +434,7 @@ XGate::XGate(size_t n)
 {
     qubit_index=n;
     symbol="X";
-    matrix=Matrix(2, 2);
-    matrix(0, 1)=std::complex<double>(1, 0);
-    matrix(1, 0)=std::complex<double>(1, 0);
+    matrix=pauli_x_gate.to_matrix();
 }
 
 // Pauli Y Gate
@@ -391,9 +443,7 @@ YGate::YGate(size_t n)
 {
     qubit_index=n;
     symbol="Y";
-    matrix=Matrix(2, 2);
-    matrix(0, 1)=std::complex<double>(0, -1);
-    matrix(1, 0)=std::complex<double>(0, 1);
+    matrix=pauli_y_gate.to_matrix();
 }
 
 // Pauli Z Gate
@@ -402,9 +452,7 @@ ZGate::ZGate(size_t n)
 {
     qubit_index=n;
     symbol="Z";
-    matrix=Matrix(2, 2);
-    matrix(0, 0)=std::complex<double>(1, 0);
-    matrix(1, 1)=std::complex<double>(-1, 0);
+    matrix=pauli_z_gate.to_matrix();
 }
 
 // S Gate
@@ -413,9 +461,7 @@ SGate::SGate(size_t n)
 {
     qubit_index=n;
     symbol="S";
-    matrix=Matrix(2, 2);
-    matrix(0, 0)=std::complex<double>(1, 0);
-    matrix(1, 1)=std::complex<double>(0, 1);
+    matrix=s_gate.to_matrix();
 }
 
 // T Gate
@@ -424,16 +470,19 @@ TGate::TGate(size_t n)
 {
     qubit_index=n;
     symbol="T";
-    matrix=Matrix(2, 2);
-    matrix(0, 0)=std::complex<double>(1, 0);
-    matrix(1, 1)=std::complex<double>(1/sqrt(2), 1/sqrt(2));
+    matrix=t_gate.to_matrix();
 }
 
 PhaseGate::PhaseGate() : PhaseGate(0, 0) {};
-PhaseGate::PhaseGate(size_t n, double phase) {
+PhaseGate::PhaseGate(size_t n, double phase_in) : phase(phase_in) {
     qubit_index=n;
     symbol="P(" + std::to_string(phase) + ")";
     matrix=Matrix(2,2);
     matrix(0,0) = std::complex<double>(1,0);
     matrix(1,1) = std::exp(phase*std::complex<double>(0,1));
 }
+
+double PhaseGate::get_phase() const
+{
+    return phase;
+}
@@ -0,0 +1,346 @@
+#include "ResourceEstimator.h"
+#include "BitSlicedSimulator.h"
+#include "Parallel.h"
+#include "StabilizerTableau.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <stdexcept>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    const double amplitude_bytes=sizeof(std::complex<double>);
+
+    double operation_matrix_bytes(const std::vector<Operation>& operations)
+    {
+        // Operations of repeated gates share a matrix, so count each once.
+        // Phase oracles hold a truth table instead.
+        std::set<const Matrix*> matrices;
+        std::set<const std::vector<uint64_t>*> truth_tables;
+        double bytes=0;
+        for (const Operation& operation : operations)
+        {
+            if (operation.matrix!=nullptr&&matrices.insert(operation.matrix).second)
+            {
+                bytes+=amplitude_bytes*operation.matrix->get_rows()*operation.matrix->get_cols();
+            }
+            if (operation.marked!=nullptr&&truth_tables.insert(operation.marked).second)
+            {
+                bytes+=sizeof(uint64_t)*operation.marked->size();
+            }
+        }
+        return bytes;
+    }
+
+    double state_vector_flops(const std::vector<Operation>& operations, size_t num_qubits)
+    {
+        // Same counts the profiler records for StateVector::apply_operation().
+        const double size=std::pow(2.0, double(num_qubits));
+        double flops=0;
+        for (const Operation& operation : operations)
+        {
+            switch (operation.type)
+            {
+            case OperationType::matrix:
+                flops+=8.0*size*std::pow(2.0, double(operation.targets.size()));
+                break;
+            case OperationType::controlled:
+                flops+=16.0*size;
+                break;
+            case OperationType::qft:
+            case OperationType::inverse_qft:
+                flops+=5.0*size*operation.targets.size();
+                break;
+            case OperationType::phase_oracle:
+                flops+=size;
+                break;
+            }
+        }
+        return flops;
+    }
+
+    size_t threads_for(double work_items)
+    {
+        return size_t(std::max(1.0, std::min(double(get_thread_count()), work_items)));
+    }
+
+    double physical_memory_bytes()
+    {
+#if defined(_SC_PHYS_PAGES)&&defined(_SC_PAGE_SIZE)
+        long pages=sysconf(_SC_PHYS_PAGES);
+        long page_size=sysconf(_SC_PAGE_SIZE);
+        if (pages<=0||page_size<=0)
+        {
+            return HUGE_VAL;
+        }
+        return double(pages)*double(page_size);
+#elif defined(_WIN32)
+        MEMORYSTATUSEX status;
+        status.dwLength=sizeof(status);
+        if (!GlobalMemoryStatusEx(&status))
+        {
+            return HUGE_VAL;
+        }
+        return double(status.ullTotalPhys);
+#else
+        return HUGE_VAL;
+#endif
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Estimation
+///////////////////////////////////////////////////////////////////////////////
+
+ResourceEstimate estimate_resources(const std::vector<Operation>& operations, size_t num_qubits, size_t num_steps, ExecutionMode mode, size_t max_bond_dimension)
+{
+    ResourceEstimate estimate;
+    estimate.mode=mode;
+    estimate.num_qubits=num_qubits;
+    estimate.num_operations=operations.size();
+    const double size=std::pow(2.0, double(num_qubits));
+    const double gate_bytes=operation_matrix_bytes(operations);
+    switch (mode)
+    {
+    case ExecutionMode::state_vector:
+        estimate.peak_bytes=amplitude_bytes*size+gate_bytes;
+        estimate.flops=state_vector_flops(operations, num_qubits);
+        break;
+    case ExecutionMode::unitary:
+        // The result plus one column being propagated per thread.
+        estimate.peak_bytes=amplitude_bytes*size*(size+threads_for(size))+gate_bytes;
+        estimate.flops=size*state_vector_flops(operations, num_qubits);
+        break;
+    case ExecutionMode::unitary_by_products:
+        // Running product, step matrix, expanded gate and product temporary.
+        estimate.peak_bytes=4*amplitude_bytes*size*size+gate_bytes;
+        estimate.flops=8.0*(num_qubits+1)*num_steps*size*size*size;
+        break;
+    case ExecutionMode::stabilizer:
+    {
+        const double rows=2.0*num_qubits+1;
+        const double words=std::ceil(num_qubits/64.0);
+        estimate.peak_bytes=rows*(2*8*words+1);
+        estimate.flops=4.0*rows*words*operations.size();
+        for (const Operation& operation : operations)
+        {
+            if (!StabilizerTableau::is_clifford(operation))
+            {
+                estimate.supported=false;
+                break;
+            }
+        }
+        break;
+    }
+    case ExecutionMode::matrix_product_state:
+    {
+        // A two-site update contracts and splits a (2 chi) x (2 chi) block;
+        // targets that are not neighbours add a swap there and back per gap.
+        const double chi=std::min(double(max_bond_dimension), std::pow(2.0, std::floor(num_qubits/2.0)));
+        const double block=2*chi;
+        estimate.peak_bytes=amplitude_bytes*(2*chi*chi*num_qubits+4*block*block)+gate_bytes;
+        for (const Operation& operation : operations)
+        {
+            std::vector<size_t> qubits=operation.targets;
+            qubits.insert(qubits.end(), operation.controls.begin(), operation.controls.end());
+            if (qubits.size()<=1)
+            {
+                estimate.flops+=8.0*4*chi*chi;
+                continue;
+            }
+            auto range=std::minmax_element(qubits.begin(), qubits.end());
+            double span=double(*range.second-*range.first);
+            estimate.flops+=(2*span-1)*8.0*(2*block*block*block+4*block*block);
+        }
+        break;
+    }
+    case ExecutionMode::density_matrix:
+        // Each gate is applied to the row and then the column qubits of a 2n
+        // qubit vector.
+        estimate.peak_bytes=amplitude_bytes*size*size+2*gate_bytes;
+        estimate.flops=2*state_vector_flops(operations, 2*num_qubits);
+        break;
+    case ExecutionMode::bit_sliced:
+    {
+        const double lanes=256;
+        estimate.peak_bytes=8*size+threads_for(size/lanes)*num_qubits*lanes/8;
+        estimate.flops=(size/64)*operations.size()*std::max<size_t>(1, num_qubits/8);
+        estimate.supported=num_qubits<64;
+        for (const Operation& operation : operations)
+        {
+            if (!BitSlicedSimulator::is_permutation(operation))
+            {
+                estimate.supported=false;
+                break;
+            }
+        }
+        break;
+    }
+    }
+    return estimate;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MemoryBudget
+///////////////////////////////////////////////////////////////////////////////
+
+MemoryBudget::MemoryBudget()
+{
+    const char* setting=std::getenv("QC_MEMORY_BUDGET");
+    limit_bytes=setting!=nullptr ? parse_byte_count(setting) : physical_memory_bytes();
+}
+
+MemoryBudget& MemoryBudget::instance()
+{
+    static MemoryBudget budget;
+    return budget;
+}
+
+// Accessors
+///////////////////////////////////////////////////////////////////////////////
+
+double MemoryBudget::get_limit() const
+{
+    std::lock_guard<std::mutex> lock(budget_mutex);
+    return limit_bytes;
+}
+
+BudgetPolicy MemoryBudget::get_policy() const
+{
+    std::lock_guard<std::mutex> lock(budget_mutex);
+    return policy;
+}
+
+bool MemoryBudget::fits(const ResourceEstimate& estimate) const
+{
+    return estimate.supported&&estimate.peak_bytes<=get_limit();
+}
+
+void MemoryBudget::admit(const ResourceEstimate& estimate, const std::string& caller) const
+{
+    if (!estimate.supported)
+    {
+        throw std::invalid_argument(caller+" cannot run this circuit in "+to_string(estimate.mode)+" mode");
+    }
+    double limit=get_limit();
+    if (estimate.peak_bytes>limit)
+    {
+        throw std::length_error(caller+" on "+std::to_string(estimate.num_qubits)+" qubits needs an estimated "
+            +format_byte_count(estimate.peak_bytes)+" ("+to_string(estimate.mode)+"), over the "
+            +format_byte_count(limit)+" memory budget");
+    }
+}
+
+// Mutators
+///////////////////////////////////////////////////////////////////////////////
+
+void MemoryBudget::set_limit(double bytes)
+{
+    if (!(bytes>0))
+    {
+        throw std::invalid_argument("Memory budget must be positive");
+    }
+    std::lock_guard<std::mutex> lock(budget_mutex);
+    limit_bytes=bytes;
+}
+
+void MemoryBudget::set_policy(BudgetPolicy policy_in)
+{
+    std::lock_guard<std::mutex> lock(budget_mutex);
+    policy=policy_in;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Non-member functions
+///////////////////////////////////////////////////////////////////////////////
+
+double parse_byte_count(const std::string& text)
+{
+    size_t end=0;
+    double value=0;
+    try
+    {
+        value=std::stod(text, &end);
+    }
+    catch (std::exception&)
+    {
+        throw std::invalid_argument("Invalid byte count '"+text+"'");
+    }
+    std::string suffix=text.substr(end);
+    const std::string units="KMGT";
+    if (!suffix.empty())
+    {
+        size_t power=units.find(std::toupper(suffix[0]));
+        bool rest_ok=suffix.size()==1||suffix.substr(1)=="B"||suffix.substr(1)=="iB";
+        if (power==std::string::npos||!rest_ok)
+        {
+            throw std::invalid_argument("Invalid byte count '"+text+"'");
+        }
+        value*=std::pow(1024.0, double(power+1));
+    }
+    if (!(value>0))
+    {
+        throw std::invalid_argument("Invalid byte count '"+text+"'");
+    }
+    return value;
+}
+
+std::string format_byte_count(double bytes)
+{
+    const char* units[]={ "B", "KiB", "MiB", "GiB", "TiB", "PiB", "EiB" };
+    size_t unit=0;
+    while (bytes>=1024&&unit<6)
+    {
+        bytes/=1024;
+        unit++;
+    }
+    char text[64];
+    std::snprintf(text, sizeof(text), unit==0 ? "%.0f %s" : "%.1f %s", bytes, units[unit]);
+    return text;
+}
+
+std::string to_string(ExecutionMode mode)
+{
+    switch (mode)
+    {
+    case ExecutionMode::state_vector: return "state_vector";
+    case ExecutionMode::unitary: return "unitary";
+    case ExecutionMode::unitary_by_products: return "unitary_by_products";
+    case ExecutionMode::stabilizer: return "stabilizer";
+    case ExecutionMode::matrix_product_state: return "matrix_product_state";
+    case ExecutionMode::bit_sliced: return "bit_sliced";
+    case ExecutionMode::density_matrix: return "density_matrix";
+    }
+    return "unknown";
+}
+
+std::ostream& operator<<(std::ostream& os, const ResourceEstimate& estimate)
+{
+    os<<to_string(estimate.mode)<<" on "<<estimate.num_qubits<<" qubits, "
+        <<estimate.num_operations<<" operations: ";
+    if (!estimate.supported)
+    {
+        return os<<"not supported";
+    }
+    char flops[32];
+    std::snprintf(flops, sizeof(flops), "%.2g", estimate.flops);
+    return os<<"peak "<<format_byte_count(estimate.peak_bytes)<<", "<<flops<<" flops";
+}
@@ -0,0 +1,623 @@
+#include "SparseStateVector.h"
+#include "GateKernels.h"
+#include "Profiler.h"
+#include "QuantumCircuit.h"
+#include "ResourceEstimator.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+typedef std::complex<double> complex;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // Amplitudes with a smaller squared magnitude are treated as cancelled.
+    const double prune_norm=1e-28;
+
+    // Dense above 2^n/16 non-zero amplitudes, back to sparse below 2^n/64,
+    // checked every check_interval operations while dense.
+    const size_t dense_divisor=16;
+    const size_t sparse_divisor=64;
+    const size_t check_interval=8;
+
+    // Basis indices are size_t and ~0 marks an empty slot.
+    const size_t max_sparse_qubits=63;
+
+    // Bytes per stored amplitude of the hash map at its worst load factor.
+    const double bytes_per_entry=4.0*(sizeof(size_t)+sizeof(complex));
+
+    inline complex mul(const complex& a, const complex& b)
+    {
+        return complex(a.real()*b.real()-a.imag()*b.imag(), a.real()*b.imag()+a.imag()*b.real());
+    }
+
+    inline bool is_zero(const complex& value)
+    {
+        return std::abs(value.real())<=gate_zero_tolerance&&std::abs(value.imag())<=gate_zero_tolerance;
+    }
+
+    std::string format_outcome(size_t index, size_t num_qubits)
+    {
+        // Highest qubit first, as get_binary_representation().
+        std::string outcome(num_qubits, '0');
+        for (size_t q=0; q<num_qubits; q++)
+        {
+            if ((index>>q)&1)
+            {
+                outcome[num_qubits-1-q]='1';
+            }
+        }
+        return outcome;
+    }
+
+    bool dense_fits(size_t num_qubits, double other_bytes)
+    {
+        if (num_qubits>40)
+        {
+            return false;
+        }
+        double dense_bytes=std::pow(2.0, double(num_qubits))*sizeof(complex);
+        return dense_bytes+other_bytes<=MemoryBudget::instance().get_limit();
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AmplitudeMap
+///////////////////////////////////////////////////////////////////////////////
+
+AmplitudeMap::AmplitudeMap(size_t expected_size)
+{
+    reserve(expected_size);
+}
+
+const std::complex<double>* AmplitudeMap::find(size_t key) const
+{
+    const size_t mask=keys.size()-1;
+    for (size_t slot=home_slot(key); keys[slot]!=empty_key; slot=(slot+1)&mask)
+    {
+        if (keys[slot]==key)
+        {
+            return &values[slot];
+        }
+    }
+    return nullptr;
+}
+
+std::complex<double>& AmplitudeMap::operator[](size_t key)
+{
+    if (2*(count+1)>keys.size())
+    {
+        grow();
+    }
+    const size_t mask=keys.size()-1;
+    size_t slot=home_slot(key);
+    while (keys[slot]!=empty_key)
+    {
+        if (keys[slot]==key)
+        {
+            return values[slot];
+        }
+        slot=(slot+1)&mask;
+    }
+    keys[slot]=key;
+    values[slot]=0;
+    count++;
+    return values[slot];
+}
+
+void AmplitudeMap::grow()
+{
+    reserve(keys.size());
+}
+
+void AmplitudeMap::reserve(size_t expected_size)
+{
+    size_t capacity=16;
+    size_t bits=4;
+    while (capacity<2*expected_size)
+    {
+        capacity*=2;
+        bits++;
+    }
+    if (capacity<=keys.size())
+    {
+        return;
+    }
+    std::vector<size_t> old_keys(capacity, empty_key);
+    std::vector<complex> old_values(capacity);
+    old_keys.swap(keys);
+    old_values.swap(values);
+    shift=64-bits;
+    count=0;
+    for (size_t slot=0; slot<old_keys.size(); slot++)
+    {
+        if (old_keys[slot]!=empty_key)
+        {
+            (*this)[old_keys[slot]]=old_values[slot];
+        }
+    }
+}
+
+void AmplitudeMap::clear()
+{
+    std::fill(keys.begin(), keys.end(), empty_key);
+    count=0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SparseStateVector
+///////////////////////////////////////////////////////////////////////////////
+
+SparseStateVector::SparseStateVector(size_t n) : num_qubits{ n }
+{
+    if (num_qubits==0||num_qubits>max_sparse_qubits)
+    {
+        throw std::out_of_range("SparseStateVector needs between 1 and "+std::to_string(max_sparse_qubits)+" qubits");
+    }
+    amplitudes[0]=1;
+}
+
+void SparseStateVector::apply_sparse(const Operation& operation)
+{
+    switch (operation.type)
+    {
+    case OperationType::matrix:
+        apply_matrix_sparse(operation.targets, 0, *operation.matrix);
+        break;
+    case OperationType::controlled:
+    {
+        size_t control_mask=0;
+        for (size_t control : operation.controls)
+        {
+            control_mask|=size_t(1)<<control;
+        }
+        apply_matrix_sparse(operation.targets, control_mask, *operation.matrix);
+        break;
+    }
+    case OperationType::qft:
+    case OperationType::inverse_qft:
+    {
+        // No sparse kernel: run the textbook circuit, which may well switch
+        // to the dense state part way through.
+        if (operation.component==nullptr)
+        {
+            throw std::invalid_argument("SparseStateVector cannot apply a QFT without its component");
+        }
+        std::vector<Operation> parts;
+        size_t offset=operation.targets[0]-operation.component->get_index();
+        operation.component->append_operations(parts, offset, true);
+        for (const Operation& part : parts)
+        {
+            apply_operation(part);
+        }
+        break;
+    }
+    case OperationType::phase_oracle:
+        // Diagonal, so only the stored amplitudes change sign.
+        for (size_t slot=0; slot<amplitudes.get_capacity(); slot++)
+        {
+            const size_t key=amplitudes.get_key(slot);
+            if (key==AmplitudeMap::empty_key)
+            {
+                continue;
+            }
+            size_t input=0;
+            for (size_t r=0; r<operation.targets.size(); r++)
+            {
+                input|=((key>>operation.targets[r])&1)<<r;
+            }
+            if (operation.is_marked(input))
+            {
+                amplitudes.get_value(slot)=-amplitudes.get_value(slot);
+            }
+        }
+        break;
+    }
+}
+
+void SparseStateVector::apply_matrix_sparse(const std::vector<size_t>& targets, size_t control_mask, const Matrix& matrix)
+{
+    const size_t k=targets.size();
+    const size_t dimension=size_t(1)<<k;
+    if (matrix.get_rows()!=dimension||matrix.get_cols()!=dimension)
+    {
+        throw std::invalid_argument("Matrix size does not match number of targets for SparseStateVector");
+    }
+    size_t target_mask=0;
+    std::vector<size_t> offsets(dimension, 0);
+    for (size_t local=0; local<dimension; local++)
+    {
+        for (size_t r=0; r<k; r++)
+        {
+            if ((local>>r)&1)
+            {
+                offsets[local]|=size_t(1)<<targets[r];
+            }
+        }
+    }
+    for (size_t target : targets)
+    {
+        target_mask|=size_t(1)<<target;
+    }
+    auto local_index=[&](size_t key)
+    {
+        size_t local=0;
+        for (size_t r=0; r<k; r++)
+        {
+            local|=((key>>targets[r])&1)<<r;
+        }
+        return local;
+    };
+    const GateClass gate_class=classify_gate(matrix);
+    switch (gate_class)
+    {
+    case GateClass::identity:
+        return;
+    case GateClass::phase:
+    case GateClass::diagonal:
+    {
+        // Support unchanged: rescale in place.
+        std::vector<complex> factors(dimension);
+        for (size_t local=0; local<dimension; local++)
+        {
+            factors[local]=matrix(local, local);
+        }
+        for (size_t slot=0; slot<amplitudes.get_capacity(); slot++)
+        {
+            size_t key=amplitudes.get_key(slot);
+            if (key==AmplitudeMap::empty_key||(key&control_mask)!=control_mask)
+            {
+                continue;
+            }
+            const complex& factor=factors[local_index(key)];
+            if (factor!=1.0)
+            {
+                amplitudes.get_value(slot)=mul(factor, amplitudes.get_value(slot));
+            }
+        }
+        return;
+    }
+    case GateClass::permutation:
+    case GateClass::monomial:
+    {
+        // Each amplitude moves to exactly one new index.
+        std::vector<size_t> destinations(dimension, 0);
+        std::vector<complex> factors(dimension, 0.0);
+        for (size_t i=0; i<dimension; i++)
+        {
+            for (size_t j=0; j<dimension; j++)
+            {
+                if (!is_zero(matrix(i, j)))
+                {
+                    destinations[j]=i;
+                    factors[j]=matrix(i, j);
+                }
+            }
+        }
+        AmplitudeMap result(amplitudes.size());
+        for (size_t slot=0; slot<amplitudes.get_capacity(); slot++)
+        {
+            size_t key=amplitudes.get_key(slot);
+            if (key==AmplitudeMap::empty_key)
+            {
+                continue;
+            }
+            if ((key&control_mask)!=control_mask)
+            {
+                result[key]=amplitudes.get_value(slot);
+                continue;
+            }
+            size_t local=local_index(key);
+            size_t destination=(key&~target_mask)|offsets[destinations[local]];
+            result[destination]=gate_class==GateClass::permutation ? amplitudes.get_value(slot)
+                : mul(factors[local], amplitudes.get_value(slot));
+        }
+        amplitudes=std::move(result);
+        return;
+    }
+    default:
+        break;
+    }
+    // General gate: every amplitude spreads over up to 2^k indices, and
+    // contributions that cancel are dropped afterwards.
+    std::vector<complex> columns(dimension*dimension);
+    for (size_t i=0; i<dimension; i++)
+    {
+        for (size_t j=0; j<dimension; j++)
+        {
+            columns[j*dimension+i]=matrix(i, j);
+        }
+    }
+    AmplitudeMap result(std::min(amplitudes.size()*dimension, size_t(1)<<num_qubits));
+    for (size_t slot=0; slot<amplitudes.get_capacity(); slot++)
+    {
+        size_t key=amplitudes.get_key(slot);
+        if (key==AmplitudeMap::empty_key)
+        {
+            continue;
+        }
+        const complex value=amplitudes.get_value(slot);
+        if ((key&control_mask)!=control_mask)
+        {
+            result[key]+=value;
+            continue;
+        }
+        size_t base=key&~target_mask;
+        const complex* column=&columns[local_index(key)*dimension];
+        for (size_t i=0; i<dimension; i++)
+        {
+            if (column[i]!=0.0)
+            {
+                result[base|offsets[i]]+=mul(column[i], value);
+            }
+        }
+    }
+    size_t cancelled=0;
+    for (size_t slot=0; slot<result.get_capacity(); slot++)
+    {
+        if (result.get_key(slot)!=AmplitudeMap::empty_key&&std::norm(result.get_value(slot))<prune_norm)
+        {
+            cancelled++;
+        }
+    }
+    if (cancelled==0)
+    {
+        amplitudes=std::move(result);
+        return;
+    }
+    amplitudes=AmplitudeMap(result.size()-cancelled);
+    for (size_t slot=0; slot<result.get_capacity(); slot++)
+    {
+        if (result.get_key(slot)!=AmplitudeMap::empty_key&&std::norm(result.get_value(slot))>=prune_norm)
+        {
+            amplitudes[result.get_key(slot)]=result.get_value(slot);
+        }
+    }
+}
+
+void SparseStateVector::update_representation()
+{
+    if (!dense_state)
+    {
+        double sparse_bytes=bytes_per_entry*amplitudes.size();
+        if (amplitudes.size()>(size_t(1)<<num_qubits)/dense_divisor&&dense_fits(num_qubits, sparse_bytes))
+        {
+            to_dense();
+        }
+        else if (sparse_bytes>MemoryBudget::instance().get_limit())
+        {
+            throw std::length_error("Sparse state of "+std::to_string(amplitudes.size())+" amplitudes on "+
+                std::to_string(num_qubits)+" qubits needs "+format_byte_count(sparse_bytes)+
+                ", over the memory budget of "+format_byte_count(MemoryBudget::instance().get_limit()));
+        }
+        return;
+    }
+    if (++operations_since_check<check_interval)
+    {
+        return;
+    }
+    operations_since_check=0;
+    if (get_support_size()<(size_t(1)<<num_qubits)/sparse_divisor)
+    {
+        to_sparse();
+    }
+}
+
+void SparseStateVector::to_dense()
+{
+    dense_state.reset(new StateVector(num_qubits));
+    dense_state->set_basis_state(0);
+    complex* data=dense_state->get_data();
+    data[0]=0;
+    for (size_t slot=0; slot<amplitudes.get_capacity(); slot++)
+    {
+        if (amplitudes.get_key(slot)!=AmplitudeMap::empty_key)
+        {
+            data[amplitudes.get_key(slot)]=amplitudes.get_value(slot);
+        }
+    }
+    amplitudes=AmplitudeMap();
+    operations_since_check=0;
+}
+
+void SparseStateVector::to_sparse()
+{
+    AmplitudeMap result(get_support_size());
+    const complex* data=dense_state->get_data();
+    for (size_t i=0; i<dense_state->get_size(); i++)
+    {
+        if (std::norm(data[i])>=prune_norm)
+        {
+            result[i]=data[i];
+        }
+    }
+    amplitudes=std::move(result);
+    dense_state.reset();
+}
+
+// Accessors
+///////////////////////////////////////////////////////////////////////////////
+
+size_t SparseStateVector::get_num_qubits() const
+{
+    return num_qubits;
+}
+
+bool SparseStateVector::is_dense() const
+{
+    return dense_state!=nullptr;
+}
+
+size_t SparseStateVector::get_support_size() const
+{
+    if (!dense_state)
+    {
+        return amplitudes.size();
+    }
+    size_t support=0;
+    const complex* data=dense_state->get_data();
+    for (size_t i=0; i<dense_state->get_size(); i++)
+    {
+        support+=std::norm(data[i])>=prune_norm ? 1 : 0;
+    }
+    return support;
+}
+
+std::complex<double> SparseStateVector::get_amplitude(size_t index) const
+{
+    if (num_qubits<64&&index>=(size_t(1)<<num_qubits))
+    {
+        throw std::out_of_range("Amplitude index out of range for SparseStateVector");
+    }
+    if (dense_state)
+    {
+        return dense_state->get_amplitude(index);
+    }
+    const complex* value=amplitudes.find(index);
+    return value!=nullptr ? *value : complex(0);
+}
+
+std::vector<std::pair<size_t, std::complex<double>>> SparseStateVector::get_entries() const
+{
+    // Non-zero amplitudes in increasing basis index.
+    std::vector<std::pair<size_t, complex>> entries;
+    if (dense_state)
+    {
+        const complex* data=dense_state->get_data();
+        for (size_t i=0; i<dense_state->get_size(); i++)
+        {
+            if (std::norm(data[i])>=prune_norm)
+            {
+                entries.emplace_back(i, data[i]);
+            }
+        }
+        return entries;
+    }
+    entries.reserve(amplitudes.size());
+    for (size_t slot=0; slot<amplitudes.get_capacity(); slot++)
+    {
+        if (amplitudes.get_key(slot)!=AmplitudeMap::empty_key)
+        {
+            entries.emplace_back(amplitudes.get_key(slot), amplitudes.get_value(slot));
+        }
+    }
+    std::sort(entries.begin(), entries.end(),
+        [](const std::pair<size_t, complex>& a, const std::pair<size_t, complex>& b) { return a.first<b.first; });
+    return entries;
+}
+
+double SparseStateVector::get_norm() const
+{
+    double total=0;
+    for (const std::pair<size_t, complex>& entry : get_entries())
+    {
+        total+=std::norm(entry.second);
+    }
+    return std::sqrt(total);
+}
+
+std::vector<std::string> SparseStateVector::sample(size_t shots, std::mt19937_64& rng) const
+{
+    const std::vector<std::pair<size_t, complex>> entries=get_entries();
+    std::vector<double> cumulative(entries.size());
+    double total=0;
+    for (size_t i=0; i<entries.size(); i++)
+    {
+        total+=std::norm(entries[i].second);
+        cumulative[i]=total;
+    }
+    std::uniform_real_distribution<double> uniform(0, total);
+    std::vector<std::string> samples;
+    samples.reserve(shots);
+    for (size_t shot=0; shot<shots; shot++)
+    {
+        size_t i=std::lower_bound(cumulative.begin(), cumulative.end(), uniform(rng))-cumulative.begin();
+        i=std::min(i, entries.size()-1);
+        samples.push_back(format_outcome(entries[i].first, num_qubits));
+    }
+    return samples;
+}
+
+StateVector SparseStateVector::to_state_vector() const
+{
+    if (dense_state)
+    {
+        return *dense_state;
+    }
+    if (!dense_fits(num_qubits, 0))
+    {
+        throw std::length_error("Dense state of "+std::to_string(num_qubits)+" qubits does not fit in the memory budget");
+    }
+    StateVector state(num_qubits);
+    state.set_basis_state(0);
+    state.get_data()[0]=0;
+    for (const std::pair<size_t, complex>& entry : get_entries())
+    {
+        state.get_data()[entry.first]=entry.second;
+    }
+    return state;
+}
+
+// Mutators
+///////////////////////////////////////////////////////////////////////////////
+
+void SparseStateVector::set_basis_state(size_t index)
+{
+    if (index>=(size_t(1)<<num_qubits))
+    {
+        throw std::out_of_range("Basis state index out of range for SparseStateVector");
+    }
+    dense_state.reset();
+    amplitudes=AmplitudeMap();
+    amplitudes[index]=1;
+}
+
+void SparseStateVector::apply_operation(const Operation& operation)
+{
+    for (size_t qubit : operation.targets)
+    {
+        if (qubit>=num_qubits)
+        {
+            throw std::out_of_range("Qubit "+std::to_string(qubit)+" out of range for SparseStateVector of "+std::to_string(num_qubits)+" qubits");
+        }
+    }
+    for (size_t qubit : operation.controls)
+    {
+        if (qubit>=num_qubits)
+        {
+            throw std::out_of_range("Qubit "+std::to_string(qubit)+" out of range for SparseStateVector of "+std::to_string(num_qubits)+" qubits");
+        }
+    }
+    QC_PROFILE_SCOPE(operation.component!=nullptr ? operation.component->get_symbol() : "operation",
+        dense_state ? "kernel" : "sparse", operation.step_index,
+        operation.targets.empty() ? ProfileEvent::none : operation.targets[0],
+        dense_state ? dense_state->get_size() : amplitudes.size(), 1, 0.0, 0.0);
+    if (dense_state)
+    {
+        dense_state->apply_operation(operation);
+    }
+    else
+    {
+        apply_sparse(operation);
+    }
+    update_representation();
+}
+
+void SparseStateVector::apply_circuit(const QuantumCircuit& circuit)
+{
+    if (circuit.get_register_size()!=num_qubits)
+    {
+        throw std::invalid_argument("Circuit size does not match SparseStateVector's number of qubits!");
+    }
+    for (const Operation& operation : circuit.get_operations(false))
+    {
+        apply_operation(operation);
+    }
+}
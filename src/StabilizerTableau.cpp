@@ -0,0 +1,558 @@
+#include "StabilizerTableau.h"
+#include <bitset>
+#include <stdexcept>
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    enum class CliffordGate { none, i, h, s, s_dagger, x, y, z, cnot, cz, swap };
+
+    int popcount(uint64_t word)
+    {
+        return static_cast<int>(std::bitset<64>(word).count());
+    }
+
+    bool matches(const Matrix& m, const std::complex<double> expected[4], bool up_to_phase)
+    {
+        // Compare a 2x2 matrix with an expected one, optionally ignoring a
+        // global phase (which cannot be observed for an uncontrolled gate).
+        const double tolerance=1e-10;
+        std::complex<double> phase(1, 0);
+        if (up_to_phase)
+        {
+            for (size_t i=0; i<4; i++)
+            {
+                if (std::abs(expected[i])>tolerance)
+                {
+                    if (std::abs(m(i/2, i%2))<tolerance)
+                    {
+                        return false;
+                    }
+                    phase=m(i/2, i%2)/expected[i];
+                    break;
+                }
+            }
+        }
+        for (size_t i=0; i<4; i++)
+        {
+            if (std::abs(m(i/2, i%2)-phase*expected[i])>tolerance)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    CliffordGate classify_single(const Matrix& m, bool up_to_phase)
+    {
+        if (m.get_rows()!=2||m.get_cols()!=2)
+        {
+            return CliffordGate::none;
+        }
+        const double r=1/sqrt(2);
+        const std::complex<double> i_gate[4]={ 1, 0, 0, 1 };
+        const std::complex<double> h_gate[4]={ r, r, r, -r };
+        const std::complex<double> s_gate[4]={ 1, 0, 0, std::complex<double>(0, 1) };
+        const std::complex<double> s_dagger_gate[4]={ 1, 0, 0, std::complex<double>(0, -1) };
+        const std::complex<double> x_gate[4]={ 0, 1, 1, 0 };
+        const std::complex<double> y_gate[4]={ 0, std::complex<double>(0, -1), std::complex<double>(0, 1), 0 };
+        const std::complex<double> z_gate[4]={ 1, 0, 0, -1 };
+        if (matches(m, i_gate, up_to_phase)) return CliffordGate::i;
+        if (matches(m, h_gate, up_to_phase)) return CliffordGate::h;
+        if (matches(m, s_gate, up_to_phase)) return CliffordGate::s;
+        if (matches(m, s_dagger_gate, up_to_phase)) return CliffordGate::s_dagger;
+        if (matches(m, x_gate, up_to_phase)) return CliffordGate::x;
+        if (matches(m, y_gate, up_to_phase)) return CliffordGate::y;
+        if (matches(m, z_gate, up_to_phase)) return CliffordGate::z;
+        return CliffordGate::none;
+    }
+
+    CliffordGate classify_two_qubit(const Matrix& m, size_t& control, size_t& target)
+    {
+        // Dense two qubit matrices (row/column bit 0 is the first target).
+        if (m.get_rows()!=4||m.get_cols()!=4)
+        {
+            return CliffordGate::none;
+        }
+        const double tolerance=1e-10;
+        // Collect the permutation/diagonal structure of the matrix.
+        size_t image[4];
+        std::complex<double> diagonal[4];
+        for (size_t col=0; col<4; col++)
+        {
+            image[col]=4;
+            for (size_t row=0; row<4; row++)
+            {
+                if (std::abs(m(row, col))>tolerance)
+                {
+                    if (image[col]!=4||std::abs(std::abs(m(row, col))-1)>tolerance)
+                    {
+                        return CliffordGate::none;
+                    }
+                    image[col]=row;
+                    diagonal[col]=m(row, col);
+                }
+            }
+            if (image[col]==4)
+            {
+                return CliffordGate::none;
+            }
+        }
+        std::complex<double> phase=diagonal[0];
+        for (size_t col=0; col<4; col++)
+        {
+            if (std::abs(diagonal[col]-phase)>tolerance&&!(col==3&&std::abs(diagonal[col]+phase)<tolerance))
+            {
+                return CliffordGate::none;
+            }
+        }
+        bool minus_three=std::abs(diagonal[3]+phase)<tolerance;
+        if (minus_three)
+        {
+            return (image[0]==0&&image[1]==1&&image[2]==2&&image[3]==3) ? CliffordGate::cz : CliffordGate::none;
+        }
+        if (image[0]!=0)
+        {
+            return CliffordGate::none;
+        }
+        if (image[1]==2&&image[2]==1&&image[3]==3)
+        {
+            return CliffordGate::swap;
+        }
+        if (image[1]==3&&image[2]==2&&image[3]==1)
+        {
+            control=0;
+            target=1;
+            return CliffordGate::cnot;
+        }
+        if (image[1]==1&&image[2]==3&&image[3]==2)
+        {
+            control=1;
+            target=0;
+            return CliffordGate::cnot;
+        }
+        return CliffordGate::none;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// StabilizerTableau
+///////////////////////////////////////////////////////////////////////////////
+
+StabilizerTableau::StabilizerTableau(size_t n) : num_qubits{ n }
+{
+    words=(num_qubits+63)/64;
+    size_t rows=2*num_qubits+1;
+    x_bits=std::vector<uint64_t>(rows*words, 0);
+    z_bits=std::vector<uint64_t>(rows*words, 0);
+    phases=std::vector<uint8_t>(rows, 0);
+    // |0...0> is stabilized by Z_i and destabilized by X_i.
+    for (size_t i=0; i<num_qubits; i++)
+    {
+        x_row(i)[i/64]|=uint64_t(1)<<(i%64);
+        z_row(i+num_qubits)[i/64]|=uint64_t(1)<<(i%64);
+    }
+}
+
+bool StabilizerTableau::get_x(size_t row, size_t qubit) const
+{
+    return (x_row(row)[qubit/64]>>(qubit%64))&1;
+}
+
+bool StabilizerTableau::get_z(size_t row, size_t qubit) const
+{
+    return (z_row(row)[qubit/64]>>(qubit%64))&1;
+}
+
+void StabilizerTableau::row_sum(size_t h, size_t i)
+{
+    // Left multiply row h by row i, tracking the phase as a sum mod 4 of the
+    // g() function from Aaronson-Gottesman, evaluated 64 qubits at a time.
+    int sum=2*phases[h]+2*phases[i];
+    uint64_t* x2=x_row(h);
+    uint64_t* z2=z_row(h);
+    const uint64_t* x1=x_row(i);
+    const uint64_t* z1=z_row(i);
+    for (size_t w=0; w<words; w++)
+    {
+        uint64_t y1=x1[w]&z1[w];
+        uint64_t x_only=x1[w]&~z1[w];
+        uint64_t z_only=~x1[w]&z1[w];
+        uint64_t plus=(y1&z2[w]&~x2[w])|(x_only&z2[w]&x2[w])|(z_only&x2[w]&~z2[w]);
+        uint64_t minus=(y1&x2[w]&~z2[w])|(x_only&z2[w]&~x2[w])|(z_only&x2[w]&z2[w]);
+        sum+=popcount(plus)-popcount(minus);
+        x2[w]^=x1[w];
+        z2[w]^=z1[w];
+    }
+    phases[h]=((sum%4)+4)%4==2 ? 1 : 0;
+}
+
+void StabilizerTableau::copy_row(size_t target, size_t source)
+{
+    for (size_t w=0; w<words; w++)
+    {
+        x_row(target)[w]=x_row(source)[w];
+        z_row(target)[w]=z_row(source)[w];
+    }
+    phases[target]=phases[source];
+}
+
+void StabilizerTableau::clear_row(size_t row)
+{
+    for (size_t w=0; w<words; w++)
+    {
+        x_row(row)[w]=0;
+        z_row(row)[w]=0;
+    }
+    phases[row]=0;
+}
+
+size_t StabilizerTableau::get_num_qubits() const
+{
+    return num_qubits;
+}
+
+std::vector<std::string> StabilizerTableau::get_stabilizers() const
+{
+    // Returns generators like "+XZI", written qubit 0 first.
+    std::vector<std::string> stabilizers;
+    for (size_t row=num_qubits; row<2*num_qubits; row++)
+    {
+        std::string pauli(1, phases[row] ? '-' : '+');
+        for (size_t q=0; q<num_qubits; q++)
+        {
+            const char symbols[4]={ 'I', 'X', 'Z', 'Y' };
+            pauli+=symbols[get_x(row, q)+2*get_z(row, q)];
+        }
+        stabilizers.push_back(pauli);
+    }
+    return stabilizers;
+}
+
+std::vector<std::string> StabilizerTableau::sample(size_t shots, std::mt19937_64& rng) const
+{
+    // Computational basis outcomes of a stabilizer state are uniform over an
+    // affine subspace: one reference outcome plus the span of the X parts of
+    // the stabilizers. Measure once, row reduce the X parts, and each further
+    // shot only costs O(k*n/64) for k random bits.
+    std::vector<std::string> samples;
+    if (shots==0)
+    {
+        return samples;
+    }
+    StabilizerTableau copy=*this;
+    std::string reference=copy.measure_all(rng);
+    std::vector<std::vector<uint64_t>> basis;
+    for (size_t row=num_qubits; row<2*num_qubits; row++)
+    {
+        std::vector<uint64_t> vector(x_row(row), x_row(row)+words);
+        for (const std::vector<uint64_t>& pivot_row : basis)
+        {
+            // Each basis row is reduced so its lowest set bit is its pivot.
+            size_t pivot=0;
+            while (((pivot_row[pivot/64]>>(pivot%64))&1)==0)
+            {
+                pivot++;
+            }
+            if ((vector[pivot/64]>>(pivot%64))&1)
+            {
+                for (size_t w=0; w<words; w++)
+                {
+                    vector[w]^=pivot_row[w];
+                }
+            }
+        }
+        bool nonzero=false;
+        for (size_t w=0; w<words; w++)
+        {
+            nonzero|=vector[w]!=0;
+        }
+        if (!nonzero)
+        {
+            continue;
+        }
+        // Keep the basis reduced against the new pivot as well.
+        size_t pivot=0;
+        while (((vector[pivot/64]>>(pivot%64))&1)==0)
+        {
+            pivot++;
+        }
+        for (std::vector<uint64_t>& pivot_row : basis)
+        {
+            if ((pivot_row[pivot/64]>>(pivot%64))&1)
+            {
+                for (size_t w=0; w<words; w++)
+                {
+                    pivot_row[w]^=vector[w];
+                }
+            }
+        }
+        basis.push_back(vector);
+    }
+    std::vector<uint64_t> reference_bits(words, 0);
+    for (size_t q=0; q<num_qubits; q++)
+    {
+        if (reference[num_qubits-1-q]=='1')
+        {
+            reference_bits[q/64]|=uint64_t(1)<<(q%64);
+        }
+    }
+    samples.reserve(shots);
+    samples.push_back(reference);
+    std::vector<uint64_t> outcome(words);
+    for (size_t shot=1; shot<shots; shot++)
+    {
+        outcome=reference_bits;
+        for (size_t b=0; b<basis.size(); b++)
+        {
+            if (rng()&1)
+            {
+                for (size_t w=0; w<words; w++)
+                {
+                    outcome[w]^=basis[b][w];
+                }
+            }
+        }
+        std::string result(num_qubits, '0');
+        for (size_t q=0; q<num_qubits; q++)
+        {
+            if ((outcome[q/64]>>(q%64))&1)
+            {
+                result[num_qubits-1-q]='1';
+            }
+        }
+        samples.push_back(result);
+    }
+    return samples;
+}
+
+bool StabilizerTableau::is_clifford(const Operation& operation)
+{
+    if (operation.type==OperationType::phase_oracle)
+    {
+        return false;
+    }
+    if (operation.type==OperationType::controlled)
+    {
+        if (operation.controls.size()!=1)
+        {
+            return false;
+        }
+        CliffordGate gate=classify_single(*operation.matrix, false);
+        return gate==CliffordGate::i||gate==CliffordGate::x||gate==CliffordGate::y||gate==CliffordGate::z;
+    }
+    if (operation.targets.size()==1)
+    {
+        return classify_single(*operation.matrix, true)!=CliffordGate::none;
+    }
+    size_t control, target;
+    return operation.targets.size()==2&&classify_two_qubit(*operation.matrix, control, target)!=CliffordGate::none;
+}
+
+void StabilizerTableau::apply_h(size_t a)
+{
+    size_t w=a/64;
+    uint64_t bit=uint64_t(1)<<(a%64);
+    for (size_t row=0; row<2*num_qubits; row++)
+    {
+        uint64_t& x=x_row(row)[w];
+        uint64_t& z=z_row(row)[w];
+        phases[row]^=((x&z)&bit)!=0;
+        uint64_t swapped=(x^z)&bit;
+        x^=swapped;
+        z^=swapped;
+    }
+}
+
+void StabilizerTableau::apply_s(size_t a)
+{
+    size_t w=a/64;
+    uint64_t bit=uint64_t(1)<<(a%64);
+    for (size_t row=0; row<2*num_qubits; row++)
+    {
+        uint64_t x=x_row(row)[w]&bit;
+        phases[row]^=(x&z_row(row)[w])!=0;
+        z_row(row)[w]^=x;
+    }
+}
+
+void StabilizerTableau::apply_s_dagger(size_t a)
+{
+    size_t w=a/64;
+    uint64_t bit=uint64_t(1)<<(a%64);
+    for (size_t row=0; row<2*num_qubits; row++)
+    {
+        uint64_t x=x_row(row)[w]&bit;
+        phases[row]^=(x&~z_row(row)[w])!=0;
+        z_row(row)[w]^=x;
+    }
+}
+
+void StabilizerTableau::apply_x(size_t a)
+{
+    for (size_t row=0; row<2*num_qubits; row++)
+    {
+        phases[row]^=get_z(row, a);
+    }
+}
+
+void StabilizerTableau::apply_y(size_t a)
+{
+    for (size_t row=0; row<2*num_qubits; row++)
+    {
+        phases[row]^=get_x(row, a)^get_z(row, a);
+    }
+}
+
+void StabilizerTableau::apply_z(size_t a)
+{
+    for (size_t row=0; row<2*num_qubits; row++)
+    {
+        phases[row]^=get_x(row, a);
+    }
+}
+
+void StabilizerTableau::apply_cnot(size_t c, size_t t)
+{
+    size_t wc=c/64, wt=t/64;
+    size_t bc=c%64, bt=t%64;
+    for (size_t row=0; row<2*num_qubits; row++)
+    {
+        uint64_t* x=x_row(row);
+        uint64_t* z=z_row(row);
+        uint64_t xc=(x[wc]>>bc)&1, zc=(z[wc]>>bc)&1;
+        uint64_t xt=(x[wt]>>bt)&1, zt=(z[wt]>>bt)&1;
+        phases[row]^=xc&zt&(xt^zc^1);
+        x[wt]^=xc<<bt;
+        z[wc]^=zt<<bc;
+    }
+}
+
+void StabilizerTableau::apply_cz(size_t c, size_t t)
+{
+    apply_h(t);
+    apply_cnot(c, t);
+    apply_h(t);
+}
+
+void StabilizerTableau::apply_cy(size_t c, size_t t)
+{
+    // CY = S CX S*
+    apply_s_dagger(t);
+    apply_cnot(c, t);
+    apply_s(t);
+}
+
+void StabilizerTableau::apply_swap(size_t a, size_t b)
+{
+    apply_cnot(a, b);
+    apply_cnot(b, a);
+    apply_cnot(a, b);
+}
+
+void StabilizerTableau::apply_operation(const Operation& operation)
+{
+    if (!is_clifford(operation))
+    {
+        throw std::invalid_argument("Operation is not a Clifford gate for StabilizerTableau::apply_operation()");
+    }
+    if (operation.type==OperationType::controlled)
+    {
+        size_t c=operation.controls[0], t=operation.targets[0];
+        switch (classify_single(*operation.matrix, false))
+        {
+        case CliffordGate::x: apply_cnot(c, t); break;
+        case CliffordGate::y: apply_cy(c, t); break;
+        case CliffordGate::z: apply_cz(c, t); break;
+        default: break;
+        }
+        return;
+    }
+    if (operation.targets.size()==1)
+    {
+        size_t a=operation.targets[0];
+        switch (classify_single(*operation.matrix, true))
+        {
+        case CliffordGate::h: apply_h(a); break;
+        case CliffordGate::s: apply_s(a); break;
+        case CliffordGate::s_dagger: apply_s_dagger(a); break;
+        case CliffordGate::x: apply_x(a); break;
+        case CliffordGate::y: apply_y(a); break;
+        case CliffordGate::z: apply_z(a); break;
+        default: break;
+        }
+        return;
+    }
+    size_t control=0, target=0;
+    switch (classify_two_qubit(*operation.matrix, control, target))
+    {
+    case CliffordGate::cnot: apply_cnot(operation.targets[control], operation.targets[target]); break;
+    case CliffordGate::cz: apply_cz(operation.targets[0], operation.targets[1]); break;
+    case CliffordGate::swap: apply_swap(operation.targets[0], operation.targets[1]); break;
+    default: break;
+    }
+}
+
+int StabilizerTableau::measure(size_t a, std::mt19937_64& rng)
+{
+    if (a>=num_qubits)
+    {
+        throw std::out_of_range("Qubit index out of range for StabilizerTableau::measure()");
+    }
+    size_t n=num_qubits;
+    // Look for a stabilizer that anticommutes with Z_a.
+    size_t p=2*n;
+    for (size_t row=n; row<2*n; row++)
+    {
+        if (get_x(row, a))
+        {
+            p=row;
+            break;
+        }
+    }
+    if (p!=2*n)
+    {
+        // Random outcome.
+        for (size_t row=0; row<2*n; row++)
+        {
+            if (row!=p&&get_x(row, a))
+            {
+                row_sum(row, p);
+            }
+        }
+        copy_row(p-n, p);
+        clear_row(p);
+        z_row(p)[a/64]|=uint64_t(1)<<(a%64);
+        phases[p]=rng()&1;
+        return phases[p];
+    }
+    // Deterministic outcome: accumulate the stabilizers into the scratch row.
+    clear_row(2*n);
+    for (size_t row=0; row<n; row++)
+    {
+        if (get_x(row, a))
+        {
+            row_sum(2*n, row+n);
+        }
+    }
+    return phases[2*n];
+}
+
+std::string StabilizerTableau::measure_all(std::mt19937_64& rng)
+{
+    // Written with the highest qubit first to match get_binary_representation().
+    std::string result(num_qubits, '0');
+    for (size_t q=0; q<num_qubits; q++)
+    {
+        if (measure(q, rng))
+        {
+            result[num_qubits-1-q]='1';
+        }
+    }
+    return result;
+}
@@ -0,0 +1,338 @@
+#include "StateOutput.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // Rows scanned per thread when selecting the most likely ones.
+    const size_t selection_grain=1<<16;
+
+    double probability_of(const std::complex<double>& amplitude)
+    {
+        return amplitude.real()*amplitude.real()+amplitude.imag()*amplitude.imag();
+    }
+
+    bool is_filtered(const OutputOptions& options)
+    {
+        return options.top_k!=0||options.threshold>0;
+    }
+
+    void append_text_row(OutputBuffer& out, size_t index, size_t num_qubits, double probability)
+    {
+        // Same layout as draw_probability_distribution(): ket, probability cut
+        // to 5 characters, then a 50 character histogram bar.
+        out.append('|');
+        out.append_bits(index, num_qubits);
+        out.append("> ||", 4);
+        std::string probability_text=std::to_string(probability).substr(0, 5);
+        out.append(probability_text);
+        out.append(" ||", 3);
+        out.append('#', size_t(probability*50));
+        out.append('\n');
+    }
+
+    // Rows kept by the threshold then top_k, most likely first for top_k
+    // (lower index first on ties) and in basis order otherwise.
+    template<typename Probability>
+    std::vector<size_t> select_rows(size_t size, const OutputOptions& options, const Probability& probability)
+    {
+        std::vector<size_t> indices;
+        if (options.top_k==0)
+        {
+            for (size_t i=0; i<size; i++)
+            {
+                if (options.threshold<=0||probability(i)>options.threshold)
+                {
+                    indices.push_back(i);
+                }
+            }
+            return indices;
+        }
+        // One pass keeping each thread's top_k in a heap whose front is the
+        // least likely row kept, so only O(top_k) indices are ever stored.
+        auto more_likely=[&probability](size_t a, size_t b)
+        {
+            double p_a=probability(a);
+            double p_b=probability(b);
+            return p_a>p_b||(p_a==p_b&&a<b);
+        };
+        const size_t k=std::min(options.top_k, size);
+        std::mutex indices_mutex;
+        parallel_for(0, size, selection_grain, [&](size_t begin, size_t end)
+            {
+                std::vector<size_t> heap;
+                heap.reserve(k);
+                for (size_t i=begin; i<end; i++)
+                {
+                    if (options.threshold>0&&probability(i)<=options.threshold)
+                    {
+                        continue;
+                    }
+                    if (heap.size()<k)
+                    {
+                        heap.push_back(i);
+                        std::push_heap(heap.begin(), heap.end(), more_likely);
+                    }
+                    else if (more_likely(i, heap.front()))
+                    {
+                        std::pop_heap(heap.begin(), heap.end(), more_likely);
+                        heap.back()=i;
+                        std::push_heap(heap.begin(), heap.end(), more_likely);
+                    }
+                }
+                std::lock_guard<std::mutex> lock(indices_mutex);
+                indices.insert(indices.end(), heap.begin(), heap.end());
+            });
+        std::sort(indices.begin(), indices.end(), more_likely);
+        if (indices.size()>k)
+        {
+            indices.resize(k);
+        }
+        return indices;
+    }
+
+    template<typename Probability>
+    void write_probability_rows(std::ostream& os, size_t num_bits, const OutputOptions& options,
+        const Probability& probability)
+    {
+        OutputBuffer out(os, options.buffer_size);
+        const size_t size=size_t(1)<<num_bits;
+        if (options.format==OutputFormat::binary&&!is_filtered(options))
+        {
+            for (size_t i=0; i<size; i++)
+            {
+                out.append_raw(probability(i));
+            }
+            return;
+        }
+        if (options.format==OutputFormat::csv)
+        {
+            out.append("state,probability\n");
+        }
+        for (size_t i : select_rows(size, options, probability))
+        {
+            const double value=probability(i);
+            switch (options.format)
+            {
+            case OutputFormat::text:
+                append_text_row(out, i, num_bits, value);
+                break;
+            case OutputFormat::csv:
+                out.append_bits(i, num_bits);
+                out.append(',');
+                out.append_number(value);
+                out.append('\n');
+                break;
+            case OutputFormat::json_lines:
+                out.append("{\"state\":\"", 10);
+                out.append_bits(i, num_bits);
+                out.append("\",\"probability\":", 16);
+                out.append_number(value);
+                out.append("}\n", 2);
+                break;
+            case OutputFormat::binary:
+                out.append_raw(double(i));
+                out.append_raw(value);
+                break;
+            }
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// OutputBuffer
+///////////////////////////////////////////////////////////////////////////////
+
+OutputBuffer::OutputBuffer(std::ostream& os_in, size_t capacity_in)
+    : os{ os_in }, capacity{ std::max<size_t>(capacity_in, 64) }
+{
+    buffer.reserve(capacity+64);
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    flush();
+}
+
+void OutputBuffer::append(const char* data, size_t size)
+{
+    buffer.append(data, size);
+    if (buffer.size()>=capacity)
+    {
+        flush();
+    }
+}
+
+void OutputBuffer::append(const std::string& text)
+{
+    append(text.data(), text.size());
+}
+
+void OutputBuffer::append(char character, size_t count)
+{
+    buffer.append(count, character);
+    if (buffer.size()>=capacity)
+    {
+        flush();
+    }
+}
+
+void OutputBuffer::append_number(double value, const char* format)
+{
+    char text[32];
+    int length=std::snprintf(text, sizeof(text), format, value);
+    append(text, size_t(length));
+}
+
+void OutputBuffer::append_bits(size_t index, size_t num_bits)
+{
+    // Most significant qubit first, as get_binary_representation().
+    size_t start=buffer.size();
+    buffer.resize(start+num_bits);
+    for (size_t i=0; i<num_bits; i++)
+    {
+        buffer[start+i]=((index>>(num_bits-1-i))&1) ? '1' : '0';
+    }
+    if (buffer.size()>=capacity)
+    {
+        flush();
+    }
+}
+
+void OutputBuffer::append_raw(double value)
+{
+    char bytes[sizeof(double)];
+    std::memcpy(bytes, &value, sizeof(double));
+    append(bytes, sizeof(double));
+}
+
+void OutputBuffer::flush()
+{
+    if (!buffer.empty())
+    {
+        os.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Non-member functions
+///////////////////////////////////////////////////////////////////////////////
+
+std::vector<size_t> select_basis_states(const std::complex<double>* amplitudes,
+    size_t num_qubits, const OutputOptions& options)
+{
+    return select_rows(size_t(1)<<num_qubits, options, [amplitudes](size_t i)
+        {
+            return probability_of(amplitudes[i]);
+        });
+}
+
+void write_state(std::ostream& os, const std::complex<double>* amplitudes,
+    size_t num_qubits, const OutputOptions& options)
+{
+    OutputBuffer out(os, options.buffer_size);
+    const bool filtered=is_filtered(options);
+    if (options.format==OutputFormat::binary&&!filtered)
+    {
+        for (size_t i=0; i<(size_t(1)<<num_qubits); i++)
+        {
+            out.append_raw(amplitudes[i].real());
+            out.append_raw(amplitudes[i].imag());
+        }
+        return;
+    }
+    if (options.format==OutputFormat::csv)
+    {
+        out.append("state,real,imag,probability\n");
+    }
+    for (size_t i : select_basis_states(amplitudes, num_qubits, options))
+    {
+        const std::complex<double>& value=amplitudes[i];
+        switch (options.format)
+        {
+        case OutputFormat::text:
+            out.append('|');
+            out.append_bits(i, num_qubits);
+            out.append("> (", 3);
+            out.append_number(value.real(), "%g");
+            out.append(',');
+            out.append_number(value.imag(), "%g");
+            out.append(")\n", 2);
+            break;
+        case OutputFormat::csv:
+            out.append_bits(i, num_qubits);
+            out.append(',');
+            out.append_number(value.real());
+            out.append(',');
+            out.append_number(value.imag());
+            out.append(',');
+            out.append_number(probability_of(value));
+            out.append('\n');
+            break;
+        case OutputFormat::json_lines:
+            out.append("{\"state\":\"", 10);
+            out.append_bits(i, num_qubits);
+            out.append("\",\"real\":", 9);
+            out.append_number(value.real());
+            out.append(",\"imag\":", 8);
+            out.append_number(value.imag());
+            out.append(",\"probability\":", 15);
+            out.append_number(probability_of(value));
+            out.append("}\n", 2);
+            break;
+        case OutputFormat::binary:
+            out.append_raw(double(i));
+            out.append_raw(value.real());
+            out.append_raw(value.imag());
+            break;
+        }
+    }
+}
+
+void write_state(std::ostream& os, const StateVector& state, const OutputOptions& options)
+{
+    write_state(os, state.get_data(), state.get_num_qubits(), options);
+}
+
+void write_probabilities(std::ostream& os, const std::complex<double>* amplitudes,
+    size_t num_qubits, const OutputOptions& options)
+{
+    write_probability_rows(os, num_qubits, options, [amplitudes](size_t i)
+        {
+            return probability_of(amplitudes[i]);
+        });
+}
+
+void write_probabilities(std::ostream& os, const StateVector& state, const OutputOptions& options)
+{
+    write_probabilities(os, state.get_data(), state.get_num_qubits(), options);
+}
+
+void write_probabilities(std::ostream& os, const std::vector<double>& probabilities, const OutputOptions& options)
+{
+    size_t num_bits=0;
+    while ((size_t(1)<<num_bits)<probabilities.size())
+    {
+        num_bits++;
+    }
+    if ((size_t(1)<<num_bits)!=probabilities.size())
+    {
+        throw std::invalid_argument("Probability distribution must have a power of two entries");
+    }
+    write_probability_rows(os, num_bits, options, [&probabilities](size_t i)
+        {
+            return probabilities[i];
+        });
+}
@@ -0,0 +1,529 @@
+#define _USE_MATH_DEFINES
+#include "StateVector.h"
+#include "GateKernels.h"
+#include "Numa.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include "QuantumComponent.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+
+typedef std::complex<double> complex;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // Amplitudes handled per thread before it is worth starting another one.
+    const size_t parallel_grain=1<<14;
+
+    // Plain complex product; std::complex's operator* also handles inf/nan
+    // corner cases through a library call, which dominates tight kernels.
+    inline complex mul(const complex& a, const complex& b)
+    {
+        return complex(a.real()*b.real()-a.imag()*b.imag(), a.real()*b.imag()+a.imag()*b.real());
+    }
+
+    size_t insert_zero_bits(size_t index, const std::vector<size_t>& sorted_positions)
+    {
+        for (size_t position : sorted_positions)
+        {
+            size_t low=index&((size_t(1)<<position)-1);
+            index=((index>>position)<<(position+1))|low;
+        }
+        return index;
+    }
+
+    size_t reverse_bits(size_t value, size_t bits)
+    {
+        size_t reversed=0;
+        for (size_t i=0; i<bits; i++)
+        {
+            reversed=(reversed<<1)|((value>>i)&1);
+        }
+        return reversed;
+    }
+
+    void check_qubit(size_t qubit, size_t num_qubits)
+    {
+        if (qubit>=num_qubits)
+        {
+            throw std::out_of_range("Qubit "+std::to_string(qubit)+" out of range for state of "+std::to_string(num_qubits)+" qubits");
+        }
+    }
+
+    /**
+     * @brief Gathers the bits of an amplitude index at the given qubits into
+     * a local index (bit r from qubits[r]) a byte at a time through lookup
+     * tables. Within an aligned block of 64 amplitudes only the qubits among
+     * the six lowest change, so callers gather the block's base index once
+     * and OR in low_part(j) for each of its amplitudes.
+     */
+    class QubitGather
+    {
+    private:
+        std::vector<std::array<size_t, 256>> spread;
+        bool low_qubits=false;
+
+    public:
+        QubitGather(const std::vector<size_t>& qubits, size_t num_qubits) : spread((num_qubits+7)/8)
+        {
+            for (size_t qubit : qubits)
+            {
+                check_qubit(qubit, num_qubits);
+            }
+            for (std::array<size_t, 256>& table : spread)
+            {
+                table.fill(0);
+            }
+            for (size_t r=0; r<qubits.size(); r++)
+            {
+                for (size_t value=0; value<256; value++)
+                {
+                    spread[qubits[r]/8][value]|=((value>>(qubits[r]%8))&1)<<r;
+                }
+                low_qubits=low_qubits||qubits[r]<6;
+            }
+        }
+
+        // Whether the local index changes within a block of 64.
+        bool has_low_qubits() const { return low_qubits; }
+        size_t low_part(size_t j) const { return spread[0][j]; }
+
+        size_t operator()(size_t index) const
+        {
+            size_t local=0;
+            for (size_t b=0; b<spread.size(); b++)
+            {
+                local|=spread[b][(index>>(8*b))&255];
+            }
+            return local;
+        }
+    };
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// StateVector
+///////////////////////////////////////////////////////////////////////////////
+
+StateVector::StateVector(size_t n) : num_qubits{ n }
+{
+    amplitudes.assign(size_t(1)<<num_qubits, 0.0);
+    amplitudes[0]=1;
+    QC_PROFILE_PLACEMENT("state vector", amplitudes.data(), amplitudes.size()*sizeof(complex));
+}
+
+StateVector::StateVector(const Matrix& column)
+{
+    if (column.get_cols()!=1||column.get_rows()==0||(column.get_rows()&(column.get_rows()-1))!=0)
+    {
+        throw std::invalid_argument("StateVector needs a 2^n x 1 column matrix");
+    }
+    num_qubits=0;
+    while ((size_t(1)<<num_qubits)<column.get_rows())
+    {
+        num_qubits++;
+    }
+    amplitudes.assign(column.get_rows(), 0.0);
+    for (size_t i=0; i<column.get_rows(); i++)
+    {
+        amplitudes[i]=column(i, 0);
+    }
+}
+
+size_t StateVector::get_num_qubits() const
+{
+    return num_qubits;
+}
+
+size_t StateVector::get_size() const
+{
+    return amplitudes.size();
+}
+
+std::complex<double> StateVector::get_amplitude(size_t index) const
+{
+    if (index>=amplitudes.size())
+    {
+        throw std::out_of_range("Index out of range for StateVector::get_amplitude()");
+    }
+    return amplitudes[index];
+}
+
+const std::complex<double>* StateVector::get_data() const
+{
+    return amplitudes.data();
+}
+
+std::vector<double> StateVector::get_marginal_probabilities(const std::vector<size_t>& qubits) const
+{
+    return marginal_probabilities(amplitudes.data(), num_qubits, qubits);
+}
+
+std::complex<double>* StateVector::get_data()
+{
+    return amplitudes.data();
+}
+
+Matrix StateVector::to_matrix() const
+{
+    Matrix column(amplitudes.size(), 1);
+    for (size_t i=0; i<amplitudes.size(); i++)
+    {
+        column(i, 0)=amplitudes[i];
+    }
+    return column;
+}
+
+void StateVector::set_basis_state(size_t index)
+{
+    if (index>=amplitudes.size())
+    {
+        throw std::out_of_range("Index out of range for StateVector::set_basis_state()");
+    }
+    // Cleared in parallel so each pinned worker writes its own pages.
+    complex* data=amplitudes.data();
+    parallel_for(0, amplitudes.size(), parallel_grain, [data](size_t begin, size_t end)
+        {
+            std::fill(data+begin, data+end, complex(0.0));
+        });
+    amplitudes[index]=1;
+}
+
+void StateVector::apply_operation(const Operation& operation)
+{
+    QC_PROFILE_SCOPE(operation.component ? operation.component->get_symbol() : "operation",
+        "kernel", operation.step_index, operation.targets.empty() ? ProfileEvent::none : operation.targets[0],
+        amplitudes.size(), 1,
+        8.0*amplitudes.size()*(operation.type==OperationType::matrix ? (size_t(1)<<operation.targets.size()) : 2),
+        2.0*amplitudes.size()*sizeof(complex));
+    ::apply_operation(amplitudes.data(), num_qubits, operation);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Kernels
+///////////////////////////////////////////////////////////////////////////////
+
+void apply_operation(std::complex<double>* amplitudes, size_t num_qubits, const Operation& operation)
+{
+    switch (operation.type)
+    {
+    case OperationType::matrix:
+        apply_matrix(amplitudes, num_qubits, operation.targets, *operation.matrix);
+        break;
+    case OperationType::controlled:
+        apply_controlled(amplitudes, num_qubits, operation.controls, operation.targets[0], *operation.matrix);
+        break;
+    case OperationType::qft:
+    case OperationType::inverse_qft:
+        apply_qft(amplitudes, num_qubits, operation.targets[0], operation.targets.size(),
+            operation.type==OperationType::inverse_qft);
+        break;
+    case OperationType::phase_oracle:
+        apply_phase_oracle(amplitudes, num_qubits, operation.targets, *operation.marked);
+        break;
+    }
+}
+
+void apply_matrix(std::complex<double>* amplitudes, size_t num_qubits, const std::vector<size_t>& targets, const Matrix& matrix)
+{
+    size_t k=targets.size();
+    size_t dimension=size_t(1)<<k;
+    if (matrix.get_rows()!=dimension||matrix.get_cols()!=dimension)
+    {
+        throw std::invalid_argument("Matrix size does not match number of targets for apply_matrix()");
+    }
+    for (size_t target : targets)
+    {
+        check_qubit(target, num_qubits);
+    }
+    // Gates on up to three qubits go to kernels specialised on their size
+    // and structure (see GateKernels.h).
+    if (apply_specialised_matrix(amplitudes, num_qubits, targets, matrix))
+    {
+        return;
+    }
+    size_t size=size_t(1)<<num_qubits;
+    // Wider gates: gather the 2^k amplitudes the gate mixes, multiply and
+    // scatter them back.
+    std::vector<size_t> sorted(targets);
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<size_t> offsets(dimension, 0);
+    for (size_t local=0; local<dimension; local++)
+    {
+        for (size_t r=0; r<k; r++)
+        {
+            if ((local>>r)&1)
+            {
+                offsets[local]|=size_t(1)<<targets[r];
+            }
+        }
+    }
+    std::vector<complex> flat(dimension*dimension);
+    for (size_t i=0; i<dimension; i++)
+    {
+        for (size_t j=0; j<dimension; j++)
+        {
+            flat[i*dimension+j]=matrix(i, j);
+        }
+    }
+    parallel_for(0, size>>k, std::max<size_t>(1, parallel_grain>>k), [&](size_t begin, size_t end)
+        {
+            std::vector<complex> in(dimension), out(dimension);
+            for (size_t group=begin; group<end; group++)
+            {
+                size_t base=insert_zero_bits(group, sorted);
+                for (size_t j=0; j<dimension; j++)
+                {
+                    in[j]=amplitudes[base|offsets[j]];
+                }
+                for (size_t i=0; i<dimension; i++)
+                {
+                    complex sum=0;
+                    const complex* row=&flat[i*dimension];
+                    for (size_t j=0; j<dimension; j++)
+                    {
+                        sum+=mul(row[j], in[j]);
+                    }
+                    out[i]=sum;
+                }
+                for (size_t i=0; i<dimension; i++)
+                {
+                    amplitudes[base|offsets[i]]=out[i];
+                }
+            }
+        });
+}
+
+void apply_controlled(std::complex<double>* amplitudes, size_t num_qubits, const std::vector<size_t>& controls, size_t target, const Matrix& matrix)
+{
+    if (matrix.get_rows()!=2||matrix.get_cols()!=2)
+    {
+        throw std::invalid_argument("Controlled gates need a 2x2 target matrix for apply_controlled()");
+    }
+    check_qubit(target, num_qubits);
+    for (size_t control : controls)
+    {
+        check_qubit(control, num_qubits);
+    }
+    // Only the groups whose controls are all 1 are visited.
+    apply_specialised_controlled(amplitudes, num_qubits, controls, target, matrix);
+}
+
+void apply_qft(std::complex<double>* amplitudes, size_t num_qubits, size_t first, size_t size, bool inverse)
+{
+    // The QFT in this project treats the first qubit of the range as the most
+    // significant (matching the textbook circuit of controlled phases, H gates
+    // and a final swap network). On the local index m of the range this is
+    // out[y]=sum_m w^(rev(m)rev(y)) in[m]/sqrt(M), which is a bit reversal
+    // followed by a decimation-in-frequency FFT (whose output is itself bit
+    // reversed). Each of the 2^first low-order columns is an independent
+    // transform, so the innermost loops run over contiguous memory.
+    if (size==0)
+    {
+        return;
+    }
+    check_qubit(first+size-1, num_qubits);
+    const size_t columns=size_t(1)<<first;    // stride between rows of the range
+    const size_t rows=size_t(1)<<size;        // transform length M
+    const size_t blocks=(size_t(1)<<num_qubits)>>(first+size);
+    const double sign=inverse ? -1.0 : 1.0;
+    const double norm=1/std::sqrt(double(rows));
+    std::vector<complex> twiddles(rows/2);
+    for (size_t j=0; j<rows/2; j++)
+    {
+        twiddles[j]=std::polar(1.0, sign*2*M_PI*double(j)/double(rows));
+    }
+    auto reverse_rows=[&](complex* block, size_t begin, size_t end)
+    {
+        for (size_t m=begin; m<end; m++)
+        {
+            size_t r=reverse_bits(m, size);
+            complex* a=&block[m*columns];
+            complex* b=&block[r*columns];
+            if (m<r)
+            {
+                for (size_t c=0; c<columns; c++)
+                {
+                    complex temp=a[c];
+                    a[c]=b[c]*norm;
+                    b[c]=temp*norm;
+                }
+            }
+            else if (m==r)
+            {
+                for (size_t c=0; c<columns; c++)
+                {
+                    a[c]*=norm;
+                }
+            }
+        }
+    };
+    auto butterflies=[&](complex* block, size_t length, size_t begin, size_t end)
+    {
+        // Butterflies q in [begin, end) of the stage with the given length.
+        size_t half=length/2;
+        size_t stride=rows/length;
+        for (size_t q=begin; q<end; q++)
+        {
+            size_t j=q%half;
+            size_t start=(q/half)*length;
+            complex w=twiddles[j*stride];
+            complex* a=&block[(start+j)*columns];
+            complex* b=&block[(start+j+half)*columns];
+            for (size_t c=0; c<columns; c++)
+            {
+                complex u=a[c], v=b[c];
+                a[c]=u+v;
+                b[c]=mul(u-v, w);
+            }
+        }
+    };
+    auto transform=[&](complex* block, bool parallel_stages)
+    {
+        size_t grain=std::max<size_t>(1, parallel_grain/columns);
+        if (!parallel_stages)
+        {
+            reverse_rows(block, 0, rows);
+            for (size_t length=rows; length>=2; length/=2)
+            {
+                butterflies(block, length, 0, rows/2);
+            }
+            return;
+        }
+        parallel_for(0, rows, grain, [&](size_t begin, size_t end) { reverse_rows(block, begin, end); });
+        for (size_t length=rows; length>=2; length/=2)
+        {
+            parallel_for(0, rows/2, grain, [&](size_t begin, size_t end) { butterflies(block, length, begin, end); });
+        }
+    };
+    size_t block_size=rows*columns;
+    if (blocks>=get_thread_count())
+    {
+        parallel_for(0, blocks, std::max<size_t>(1, parallel_grain/block_size), [&](size_t begin, size_t end)
+            {
+                for (size_t b=begin; b<end; b++)
+                {
+                    transform(amplitudes+b*block_size, false);
+                }
+            });
+    }
+    else
+    {
+        for (size_t b=0; b<blocks; b++)
+        {
+            transform(amplitudes+b*block_size, true);
+        }
+    }
+}
+
+void apply_phase_oracle(std::complex<double>* amplitudes, size_t num_qubits, const std::vector<size_t>& targets, const std::vector<uint64_t>& marked)
+{
+    // Blocks whose input does not depend on the low qubits are negated or
+    // skipped whole.
+    const QubitGather gather(targets, num_qubits);
+    auto is_marked=[&marked](size_t input)
+    {
+        return (marked[input>>6]>>(input&63))&1;
+    };
+    const size_t size=size_t(1)<<num_qubits;
+    if (size<64)
+    {
+        for (size_t i=0; i<size; i++)
+        {
+            if (is_marked(gather(i)))
+            {
+                amplitudes[i]=-amplitudes[i];
+            }
+        }
+        return;
+    }
+    parallel_for(0, size>>6, std::max<size_t>(1, parallel_grain>>6), [&](size_t begin, size_t end)
+        {
+            for (size_t block=begin; block<end; block++)
+            {
+                complex* chunk=amplitudes+(block<<6);
+                const size_t high_input=gather(block<<6);
+                if (!gather.has_low_qubits())
+                {
+                    if (is_marked(high_input))
+                    {
+                        for (size_t j=0; j<64; j++)
+                        {
+                            chunk[j]=-chunk[j];
+                        }
+                    }
+                    continue;
+                }
+                for (size_t j=0; j<64; j++)
+                {
+                    if (is_marked(high_input|gather.low_part(j)))
+                    {
+                        chunk[j]=-chunk[j];
+                    }
+                }
+            }
+        });
+}
+
+std::vector<double> marginal_probabilities(const std::complex<double>* amplitudes, size_t num_qubits, const std::vector<size_t>& qubits)
+{
+    // One pass over the state into a 2^k histogram per thread, which are
+    // then added up. Blocks of 64 amplitudes that all land in one outcome
+    // are summed first and added once.
+    std::vector<size_t> sorted(qubits);
+    std::sort(sorted.begin(), sorted.end());
+    if (std::adjacent_find(sorted.begin(), sorted.end())!=sorted.end())
+    {
+        throw std::invalid_argument("Qubits of a marginal distribution must be distinct");
+    }
+    const QubitGather gather(qubits, num_qubits);
+    const size_t size=size_t(1)<<num_qubits;
+    std::vector<double> probabilities(size_t(1)<<qubits.size(), 0.0);
+    if (size<64)
+    {
+        for (size_t i=0; i<size; i++)
+        {
+            probabilities[gather(i)]+=std::norm(amplitudes[i]);
+        }
+        return probabilities;
+    }
+    std::mutex total_mutex;
+    parallel_for(0, size>>6, std::max<size_t>(1, parallel_grain>>6), [&](size_t begin, size_t end)
+        {
+            std::vector<double> partial(probabilities.size(), 0.0);
+            for (size_t block=begin; block<end; block++)
+            {
+                const complex* chunk=amplitudes+(block<<6);
+                const size_t high_outcome=gather(block<<6);
+                if (!gather.has_low_qubits())
+                {
+                    double sum=0;
+                    for (size_t j=0; j<64; j++)
+                    {
+                        sum+=chunk[j].real()*chunk[j].real()+chunk[j].imag()*chunk[j].imag();
+                    }
+                    partial[high_outcome]+=sum;
+                    continue;
+                }
+                for (size_t j=0; j<64; j++)
+                {
+                    partial[high_outcome|gather.low_part(j)]+=chunk[j].real()*chunk[j].real()+chunk[j].imag()*chunk[j].imag();
+                }
+            }
+            std::lock_guard<std::mutex> lock(total_mutex);
+            for (size_t outcome=0; outcome<partial.size(); outcome++)
+            {
+                probabilities[outcome]+=partial[outcome];
+            }
+        });
+    return probabilities;
+}
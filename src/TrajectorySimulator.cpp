@@ -0,0 +1,426 @@
+#include "TrajectorySimulator.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+typedef std::complex<double> complex;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    const double tolerance=1e-10;
+
+    // Returns c if matrix=c*I (to tolerance), otherwise -1.
+    double identity_multiple(const Matrix& matrix)
+    {
+        complex scale=matrix(0, 0);
+        for (size_t i=0; i<matrix.get_rows(); i++)
+        {
+            for (size_t j=0; j<matrix.get_cols(); j++)
+            {
+                if (std::abs(matrix(i, j)-(i==j ? scale : complex(0)))>tolerance)
+                {
+                    return -1;
+                }
+            }
+        }
+        return std::abs(scale.imag())>tolerance ? -1 : scale.real();
+    }
+
+    Matrix scaled(Matrix matrix, double factor)
+    {
+        for (size_t i=0; i<matrix.get_rows(); i++)
+        {
+            for (size_t j=0; j<matrix.get_cols(); j++)
+            {
+                matrix(i, j)*=factor;
+            }
+        }
+        return matrix;
+    }
+
+    // <psi|G|psi> for G acting on the given qubits.
+    double local_expectation(const complex* amplitudes, size_t num_qubits, const std::vector<size_t>& qubits, const Matrix& gram)
+    {
+        const size_t k=qubits.size();
+        const size_t dimension=size_t(1)<<k;
+        std::vector<size_t> sorted(qubits);
+        std::sort(sorted.begin(), sorted.end());
+        std::vector<size_t> offsets(dimension, 0);
+        for (size_t local=0; local<dimension; local++)
+        {
+            for (size_t r=0; r<k; r++)
+            {
+                if ((local>>r)&1)
+                {
+                    offsets[local]|=size_t(1)<<qubits[r];
+                }
+            }
+        }
+        std::vector<complex> local_amplitudes(dimension);
+        double total=0;
+        for (size_t group=0; group<((size_t(1)<<num_qubits)>>k); group++)
+        {
+            size_t base=group;
+            for (size_t position : sorted)
+            {
+                base=((base>>position)<<(position+1))|(base&((size_t(1)<<position)-1));
+            }
+            for (size_t j=0; j<dimension; j++)
+            {
+                local_amplitudes[j]=amplitudes[base|offsets[j]];
+            }
+            for (size_t i=0; i<dimension; i++)
+            {
+                complex row=0;
+                for (size_t j=0; j<dimension; j++)
+                {
+                    row+=gram(i, j)*local_amplitudes[j];
+                }
+                total+=(std::conj(local_amplitudes[i])*row).real();
+            }
+        }
+        return total;
+    }
+
+    std::mt19937_64 trajectory_rng(uint64_t seed, uint64_t trajectory)
+    {
+        std::seed_seq sequence{ uint32_t(seed), uint32_t(seed>>32), uint32_t(trajectory), uint32_t(trajectory>>32) };
+        return std::mt19937_64(sequence);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Observables
+///////////////////////////////////////////////////////////////////////////////
+
+Observable z_expectation(size_t qubit)
+{
+    return [qubit](const StateVector& state)
+    {
+        if (qubit>=state.get_num_qubits())
+        {
+            throw std::out_of_range("Qubit "+std::to_string(qubit)+" out of range for z_expectation()");
+        }
+        const complex* amplitudes=state.get_data();
+        double total=0;
+        for (size_t i=0; i<state.get_size(); i++)
+        {
+            total+=((i>>qubit)&1) ? -std::norm(amplitudes[i]) : std::norm(amplitudes[i]);
+        }
+        return total;
+    };
+}
+
+Observable basis_probability(size_t index)
+{
+    return [index](const StateVector& state)
+    {
+        return std::norm(state.get_amplitude(index));
+    };
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// TrajectorySimulator
+///////////////////////////////////////////////////////////////////////////////
+
+TrajectorySimulator::TrajectorySimulator(const QuantumCircuit& circuit_in, const NoiseModel& noise)
+    : circuit{ circuit_in }, operations{ circuit.get_operations(false) }
+{
+    // Flattens the circuit and its noise into one instruction list, placing
+    // noise exactly as DensityMatrix::apply_circuit() does.
+    const size_t num_qubits=circuit.get_register_size();
+    std::map<const NoiseChannel*, size_t> prepared;
+    auto channel_index=[&](const NoiseChannel& channel)
+    {
+        auto found=prepared.find(&channel);
+        if (found!=prepared.end())
+        {
+            return found->second;
+        }
+        return prepared[&channel]=prepare_channel(channel);
+    };
+    auto add_idle_noise=[&]()
+    {
+        for (const auto& entry : noise.get_qubit_noise())
+        {
+            if (entry.first>=num_qubits)
+            {
+                throw std::out_of_range("Noise attached to qubit "+std::to_string(entry.first)+" outside the register");
+            }
+            for (const NoiseChannel& channel : entry.second)
+            {
+                program.push_back({ nullptr, channel_index(channel), { entry.first } });
+            }
+        }
+    };
+    const size_t num_steps=circuit.get_total_steps()+1;
+    size_t step=0;
+    for (const Operation& operation : operations)
+    {
+        for (; step<operation.step_index; step++)
+        {
+            add_idle_noise();
+        }
+        program.push_back({ &operation, 0, {} });
+        if (operation.component==nullptr)
+        {
+            continue;
+        }
+        std::vector<size_t> qubits=operation.targets;
+        qubits.insert(qubits.end(), operation.controls.begin(), operation.controls.end());
+        for (const NoiseChannel* channel : noise.get_gate_noise(operation.component->get_symbol()))
+        {
+            if (channel->get_num_qubits()==1)
+            {
+                for (size_t qubit : qubits)
+                {
+                    program.push_back({ nullptr, channel_index(*channel), { qubit } });
+                }
+            }
+            else if (channel->get_num_qubits()==qubits.size())
+            {
+                program.push_back({ nullptr, channel_index(*channel), qubits });
+            }
+            else
+            {
+                throw std::invalid_argument("Channel "+channel->get_name()+" does not match the width of gate "
+                    +operation.component->get_symbol());
+            }
+        }
+    }
+    for (; step<num_steps; step++)
+    {
+        add_idle_noise();
+    }
+}
+
+size_t TrajectorySimulator::prepare_channel(const NoiseChannel& channel)
+{
+    PreparedChannel result;
+    for (const Matrix& kraus : channel.get_kraus_operators())
+    {
+        Branch branch;
+        branch.gram=kraus.adjoint()*kraus;
+        double weight=identity_multiple(branch.gram);
+        if (weight>=0&&weight<tolerance)
+        {
+            continue; // K_i=0 never happens.
+        }
+        if (weight<0)
+        {
+            result.unitary_mixture=false;
+            branch.kraus=kraus;
+        }
+        else
+        {
+            branch.weight=weight;
+            branch.kraus=scaled(kraus, 1/std::sqrt(weight));
+            branch.identity=identity_multiple(branch.kraus)>0;
+        }
+        result.branches.push_back(std::move(branch));
+    }
+    if (!result.unitary_mixture)
+    {
+        for (Branch& branch : result.branches)
+        {
+            // Mixed channels sample from ||K_i psi||^2 and apply K_i itself.
+            if (branch.weight>0)
+            {
+                branch.kraus=scaled(branch.kraus, std::sqrt(branch.weight));
+                branch.weight=0;
+                branch.identity=false;
+            }
+        }
+    }
+    channels.push_back(std::move(result));
+    return channels.size()-1;
+}
+
+void TrajectorySimulator::run_trajectory(StateVector& state, std::mt19937_64& rng) const
+{
+    const size_t num_qubits=circuit.get_register_size();
+    size_t index=0;
+    std::vector<int> input_register=circuit.get_input_register();
+    for (size_t i=0; i<num_qubits; i++)
+    {
+        if (input_register[i]==1)
+        {
+            index|=size_t(1)<<i;
+        }
+    }
+    state.set_basis_state(index);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::vector<double> probabilities;
+    for (const Instruction& instruction : program)
+    {
+        if (instruction.operation!=nullptr)
+        {
+            state.apply_operation(*instruction.operation);
+            continue;
+        }
+        const PreparedChannel& channel=channels[instruction.channel];
+        probabilities.clear();
+        double total=0;
+        for (const Branch& branch : channel.branches)
+        {
+            double probability=channel.unitary_mixture ? branch.weight
+                : local_expectation(state.get_data(), num_qubits, instruction.qubits, branch.gram);
+            probabilities.push_back(std::max(probability, 0.0));
+            total+=probabilities.back();
+        }
+        double draw=uniform(rng)*total;
+        size_t chosen=0;
+        while (chosen+1<probabilities.size()&&(draw>=probabilities[chosen]||probabilities[chosen]==0))
+        {
+            draw-=probabilities[chosen];
+            chosen++;
+        }
+        const Branch& branch=channel.branches[chosen];
+        if (channel.unitary_mixture)
+        {
+            if (!branch.identity)
+            {
+                apply_matrix(state.get_data(), num_qubits, instruction.qubits, branch.kraus);
+            }
+            continue;
+        }
+        apply_matrix(state.get_data(), num_qubits, instruction.qubits,
+            scaled(branch.kraus, 1/std::sqrt(probabilities[chosen])));
+    }
+}
+
+// Accessors
+///////////////////////////////////////////////////////////////////////////////
+
+size_t TrajectorySimulator::get_noise_locations() const
+{
+    return program.size()-operations.size();
+}
+
+StateVector TrajectorySimulator::run_single(uint64_t seed) const
+{
+    StateVector state(circuit.get_register_size());
+    std::mt19937_64 rng(seed);
+    run_trajectory(state, rng);
+    return state;
+}
+
+TrajectoryResult TrajectorySimulator::run(const TrajectoryOptions& options, const std::vector<Observable>& observables) const
+{
+    if (options.batch_size==0)
+    {
+        throw std::invalid_argument("Trajectory batch size must be positive");
+    }
+    const size_t num_qubits=circuit.get_register_size();
+    ResourceEstimate estimate=::estimate_resources(operations, num_qubits,
+        circuit.get_total_steps()+1, ExecutionMode::state_vector);
+    estimate.peak_bytes*=std::min(get_thread_count(), options.batch_size);
+    MemoryBudget::instance().admit(estimate, "TrajectorySimulator::run()");
+
+    TrajectoryResult result;
+    result.means.assign(observables.size(), 0);
+    result.standard_errors.assign(observables.size(), std::numeric_limits<double>::infinity());
+    std::vector<double> squared_deviations(observables.size(), 0);
+    size_t done=0;
+    while (done<options.max_trajectories)
+    {
+        // Values are collected per trajectory and merged in order, so the
+        // result is the same whatever the thread count.
+        const size_t batch=std::min(options.batch_size, options.max_trajectories-done);
+        std::vector<std::vector<double>> values(batch);
+        std::vector<std::vector<size_t>> outcomes(batch);
+        parallel_for(0, batch, 1, [&](size_t begin, size_t end)
+        {
+            StateVector state(num_qubits);
+            std::vector<double> cumulative(state.get_size());
+            for (size_t t=begin; t<end; t++)
+            {
+                QC_PROFILE_SCOPE("trajectory", "trajectory", ProfileEvent::none, ProfileEvent::none,
+                    state.get_size(), 1, estimate.flops, 0.0);
+                std::mt19937_64 rng=trajectory_rng(options.seed, done+t);
+                run_trajectory(state, rng);
+                for (const Observable& observable : observables)
+                {
+                    values[t].push_back(observable(state));
+                }
+                if (options.shots_per_trajectory==0)
+                {
+                    continue;
+                }
+                double total=0;
+                for (size_t i=0; i<state.get_size(); i++)
+                {
+                    total+=std::norm(state.get_data()[i]);
+                    cumulative[i]=total;
+                }
+                std::uniform_real_distribution<double> uniform(0, total);
+                for (size_t shot=0; shot<options.shots_per_trajectory; shot++)
+                {
+                    size_t outcome=std::lower_bound(cumulative.begin(), cumulative.end(), uniform(rng))-cumulative.begin();
+                    outcomes[t].push_back(std::min(outcome, cumulative.size()-1));
+                }
+            }
+        });
+        for (size_t t=0; t<batch; t++)
+        {
+            // Welford's running mean and variance.
+            size_t count=done+t+1;
+            for (size_t i=0; i<observables.size(); i++)
+            {
+                double delta=values[t][i]-result.means[i];
+                result.means[i]+=delta/count;
+                squared_deviations[i]+=delta*(values[t][i]-result.means[i]);
+            }
+            for (size_t outcome : outcomes[t])
+            {
+                result.counts[get_binary_representation(outcome, num_qubits)]++;
+            }
+        }
+        done+=batch;
+        result.trajectories=done;
+        bool converged=!observables.empty()&&options.target_standard_error>0&&done>=options.min_trajectories;
+        for (size_t i=0; i<observables.size(); i++)
+        {
+            if (done>1)
+            {
+                result.standard_errors[i]=std::sqrt(squared_deviations[i]/(done-1)/done);
+            }
+            converged=converged&&result.standard_errors[i]<=options.target_standard_error;
+        }
+        result.converged=converged;
+        if (options.progress)
+        {
+            options.progress(result);
+        }
+        if (converged)
+        {
+            break;
+        }
+    }
+    return result;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Non-member functions
+///////////////////////////////////////////////////////////////////////////////
+
+std::ostream& operator<<(std::ostream& os, const TrajectoryResult& result)
+{
+    os<<result.trajectories<<" trajectories"<<(result.converged ? " (converged)" : "");
+    for (size_t i=0; i<result.means.size(); i++)
+    {
+        os<<(i==0 ? ": " : ", ")<<result.means[i]<<" +- "<<result.standard_errors[i];
+    }
+    return os;
+}
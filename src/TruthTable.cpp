@@ -0,0 +1,125 @@
+#include "TruthTable.h"
+#include "BitSlicedSimulator.h"
+#include "Parallel.h"
+#include "StateVector.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Helper functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    const double tolerance=1e-9;
+    // Inputs per thread before it is worth starting another one.
+    const size_t input_grain=256;
+
+    // Outputs computed per call to the bit-sliced simulator.
+    const size_t classical_batch=4096;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Non-member functions
+///////////////////////////////////////////////////////////////////////////////
+
+TruthTableReport verify_truth_table(const std::vector<Operation>& operations,
+    size_t num_qubits, const std::function<size_t(size_t)>& expected_output,
+    size_t first_input, size_t end_input, size_t max_reported)
+{
+    if (end_input>(size_t(1)<<num_qubits)||first_input>end_input)
+    {
+        throw std::out_of_range("Input range is outside the "+std::to_string(num_qubits)+" qubit basis");
+    }
+    TruthTableReport report;
+    report.classical=BitSlicedSimulator::is_permutation(operations)&&num_qubits<64;
+    std::unique_ptr<BitSlicedSimulator> classical;
+    if (report.classical)
+    {
+        classical=std::make_unique<BitSlicedSimulator>(operations, num_qubits);
+    }
+    std::mutex report_mutex;
+    parallel_for(first_input, end_input, input_grain, [&](size_t begin, size_t end)
+    {
+        std::vector<TruthTableMismatch> mismatches;
+        size_t mismatch_count=0;
+        StateVector state(report.classical ? 0 : num_qubits);
+        std::vector<size_t> outputs(report.classical ? classical_batch : 0);
+        size_t batch_begin=begin, batch_end=begin;
+        for (size_t input=begin; input<end; input++)
+        {
+            size_t expected=expected_output(input);
+            TruthTableMismatch mismatch{ input, expected, expected, 1.0 };
+            if (report.classical)
+            {
+                // Permutation circuits: outputs come from the bit-sliced
+                // simulator a batch at a time.
+                if (input==batch_end)
+                {
+                    batch_begin=input;
+                    batch_end=std::min(input+classical_batch, end);
+                    classical->evaluate(batch_begin, batch_end-batch_begin, outputs.data());
+                }
+                mismatch.actual=outputs[input-batch_begin];
+                mismatch.expected_probability=mismatch.actual==expected ? 1.0 : 0.0;
+            }
+            else
+            {
+                state.set_basis_state(input);
+                for (const Operation& operation : operations)
+                {
+                    state.apply_operation(operation);
+                }
+                const std::complex<double>* amplitudes=state.get_data();
+                mismatch.expected_probability=expected<state.get_size() ? std::norm(amplitudes[expected]) : 0.0;
+                double best=-1;
+                for (size_t i=0; i<state.get_size(); i++)
+                {
+                    if (std::norm(amplitudes[i])>best)
+                    {
+                        best=std::norm(amplitudes[i]);
+                        mismatch.actual=i;
+                    }
+                }
+            }
+            if (mismatch.expected_probability<1-tolerance)
+            {
+                mismatch_count++;
+                if (mismatches.size()<max_reported)
+                {
+                    mismatches.push_back(mismatch);
+                }
+            }
+        }
+        std::lock_guard<std::mutex> lock(report_mutex);
+        report.inputs_checked+=end-begin;
+        report.mismatch_count+=mismatch_count;
+        report.mismatches.insert(report.mismatches.end(), mismatches.begin(), mismatches.end());
+    });
+    std::sort(report.mismatches.begin(), report.mismatches.end(),
+        [](const TruthTableMismatch& a, const TruthTableMismatch& b) { return a.input<b.input; });
+    if (report.mismatches.size()>max_reported)
+    {
+        report.mismatches.resize(max_reported);
+    }
+    return report;
+}
+
+std::ostream& operator<<(std::ostream& os, const TruthTableReport& report)
+{
+    if (report.passed())
+    {
+        return os<<"passed "<<report.inputs_checked<<"/"<<report.inputs_checked<<" inputs";
+    }
+    os<<"failed "<<report.mismatch_count<<"/"<<report.inputs_checked<<" inputs";
+    for (const TruthTableMismatch& mismatch : report.mismatches)
+    {
+        os<<std::endl<<"  "<<mismatch.input<<" -> "<<mismatch.actual<<" (expected "
+            <<mismatch.expected<<", p="<<mismatch.expected_probability<<")";
+    }
+    return os;
+}
@@ -2,10 +2,24 @@
 #include "Matrix.h"
 #include "QuantumCircuit.h"
 #include "DerivedGates.h"
+#include "AdjointGradient.h"
+#include "BitSlicedSimulator.h"
+#include "CircuitOptimiser.h"
+#include "DecisionDiagram.h"
+#include "DensityMatrix.h"
+#include "DistributedStateVector.h"
+#include "GateCache.h"
+#include "MatrixProductState.h"
+#include "SparseStateVector.h"
+#include "TrajectorySimulator.h"
+#include <cstdio>
 #include <iostream>
 #include <memory>
 #include <cmath>
 
+// Example circuits, defined at the end of the file.
+QuantumCircuit qft_circuit(size_t n);
+
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -82,6 +96,333 @@ void check_toffoli(std::vector<int> input_register) {
     print_test_result("Toffoli", expected==result);
 }
 
+void check_stabilizer_sampling() {
+    // A Clifford circuit is sampled from the tableau; only the two states
+    // the dense simulation gives probability 1/2 may come up.
+    QuantumCircuit qc(4);
+    qc.add_component(h(0));
+    qc.add_component(controlled(x(1), 0));
+    qc.add_component(controlled(x(3), 1));
+    qc.add_component(x(2));
+    qc.add_component(s(3));
+    StateVector expected=qc.get_final_state_vector();
+    std::map<std::string, size_t> counts=qc.sample(1000, 7);
+    bool matches=qc.is_clifford()&&counts.size()==2;
+    for (const auto& outcome : counts) {
+        size_t index=std::stoul(outcome.first, nullptr, 2);
+        matches=matches&&std::abs(std::norm(expected.get_data()[index])-0.5)<1e-12&&outcome.second>400;
+    }
+    print_test_result("Stabilizer sampling", matches);
+}
+
+void check_mps_amplitudes() {
+    // Two-qubit gates on qubits that are not neighbours go through the swap
+    // network.
+    QuantumCircuit qc(5);
+    for (size_t q=0; q<5; q++) {
+        qc.add_component(h(q));
+    }
+    qc.add_component(controlled(x(4), 0));
+    qc.add_component(controlled(p(1, 0.3), 3));
+    qc.add_component(t(2));
+    qc.add_component(controlled(x(0), 2));
+    StateVector expected=qc.get_final_state_vector();
+    MatrixProductState mps(5, 32);
+    mps.apply_circuit(qc);
+    bool matches=true;
+    for (size_t i=0; i<expected.get_size(); i++) {
+        std::vector<int> basis_state(5);
+        for (size_t q=0; q<5; q++) {
+            basis_state[q]=(i>>q)&1;
+        }
+        matches=matches&&std::abs(mps.get_amplitude(basis_state)-expected.get_data()[i])<1e-12;
+    }
+    print_test_result("MPS amplitudes", matches);
+}
+
+void check_qft_gate() {
+    // The native gate against the gate by gate construction in qft_circuit().
+    QuantumCircuit native(4);
+    native.add_component(qft(0, 4));
+    QuantumCircuit inverse(4);
+    inverse.add_component(inverse_qft(0, 4));
+    Matrix expected=qft_circuit(4).get_matrix();
+    print_test_result("QFT gate", native.get_matrix()==expected&&inverse.get_matrix()==expected.adjoint());
+}
+
+void check_optimiser() {
+    // Inverse pairs, some separated by gates on other qubits, must cancel
+    // without changing the unitary.
+    QuantumCircuit qc(3);
+    qc.add_component(h(0));
+    qc.add_component(t(1));
+    qc.add_component(h(0));
+    qc.add_component(controlled(x(2), 1));
+    qc.add_component(x(0));
+    qc.add_component(controlled(x(2), 1));
+    qc.add_component(adjoint(t(1)));
+    qc.add_component(s(2));
+    Matrix expected=qc.get_matrix();
+    OptimisationReport report=optimise_circuit(qc);
+    print_test_result("Optimiser", report.cancelled_pairs==3&&report.gates_after==2&&qc.get_matrix()==expected);
+}
+
+void check_truth_table() {
+    // Expected outputs are read off the dense simulation of each input.
+    QuantumCircuit qc(4);
+    qc.add_component(toffoli(3, 0, 1));
+    qc.add_component(controlled(x(1), 0));
+    qc.add_component(toffoli(3, 1, 2));
+    qc.add_component(controlled(x(2), 1));
+    std::vector<size_t> expected(16);
+    for (size_t input=0; input<16; input++) {
+        std::vector<int> input_register(4);
+        for (size_t q=0; q<4; q++) {
+            input_register[q]=(input>>q)&1;
+        }
+        qc.set_input_register(input_register);
+        StateVector state=qc.get_final_state_vector();
+        while (std::norm(state.get_data()[expected[input]])<0.5) {
+            expected[input]++;
+        }
+    }
+    TruthTableReport passing=qc.verify_truth_table(expected);
+    expected[5]^=8;
+    TruthTableReport failing=qc.verify_truth_table(expected);
+    print_test_result("Truth table", passing.passed()&&passing.classical&&failing.mismatch_count==1
+        &&failing.mismatches[0].input==5);
+}
+
+void check_bit_sliced() {
+    // Every input of a reversible circuit through the bit-sliced lanes.
+    QuantumCircuit qc(4);
+    qc.add_component(x(0));
+    qc.add_component(toffoli(3, 0, 1));
+    qc.add_component(swap(1, 2));
+    qc.add_component(controlled(x(2), 3));
+    BitSlicedSimulator simulator(qc.get_operations(false), 4);
+    std::vector<size_t> outputs=simulator.get_truth_table();
+    bool matches=qc.is_permutation()&&outputs==qc.get_truth_table();
+    for (size_t input=0; input<16; input++) {
+        std::vector<int> input_register(4);
+        for (size_t q=0; q<4; q++) {
+            input_register[q]=(input>>q)&1;
+        }
+        qc.set_input_register(input_register);
+        matches=matches&&std::norm(qc.get_final_state_vector().get_data()[outputs[input]])>0.5;
+    }
+    print_test_result("Bit-sliced simulator", matches);
+}
+
+void check_gate_cache() {
+    // Toffolis with the same layout share one compiled matrix, which
+    // survives a save and a load.
+    GateCache& cache=GateCache::instance();
+    cache.clear();
+    QuantumCircuit qc(4);
+    qc.add_component(toffoli(2, 0, 1));
+    qc.add_component(toffoli(3, 1, 2));
+    Matrix first=qc.get_matrix();
+    bool hit=cache.get_hits()>0&&cache.get_size()==1;
+    cache.save("check_gate_cache.bin");
+    cache.clear();
+    size_t loaded=cache.load("check_gate_cache.bin");
+    std::remove("check_gate_cache.bin");
+    Matrix second=qc.get_matrix();
+    print_test_result("Gate cache", hit&&loaded==1&&cache.get_misses()==0&&first==second);
+}
+
+void check_density_matrix() {
+    // Bit flip with probability 0.1 after X leaves P(1)=0.9, and without
+    // noise the density matrix is the pure dense state.
+    QuantumCircuit qc(2);
+    qc.add_component(x(0));
+    qc.add_component(h(1));
+    NoiseModel noise;
+    noise.add_gate_noise("X", bit_flip(0.1));
+    DensityMatrix noisy(2);
+    noisy.apply_circuit(qc, noise);
+    DensityMatrix pure(2);
+    pure.apply_circuit(qc);
+    std::vector<double> probabilities=noisy.get_probabilities();
+    print_test_result("Density matrix", std::abs(probabilities[1]+probabilities[3]-0.9)<1e-12
+        &&std::abs(noisy.get_trace()-1)<1e-12&&std::abs(pure.get_fidelity(qc.get_final_state_vector())-1)<1e-12);
+}
+
+void check_trajectories() {
+    // <Z> after a noisy X is 0.1-0.9=-0.8; the average over trajectories
+    // must be within a few standard errors of it.
+    QuantumCircuit qc(2);
+    qc.add_component(x(0));
+    qc.add_component(h(1));
+    NoiseModel noise;
+    noise.add_gate_noise("X", bit_flip(0.1));
+    TrajectorySimulator trajectories(qc, noise);
+    TrajectoryOptions options;
+    options.max_trajectories=2000;
+    TrajectoryResult result=trajectories.run(options, { z_expectation(0) });
+    print_test_result("Trajectories", result.trajectories==2000
+        &&std::abs(result.means[0]+0.8)<4*result.standard_errors[0]);
+}
+
+void check_distributed() {
+    // Gates on qubits 4 and 5, global for 4 processes, force exchanges.
+    QuantumCircuit qc(6);
+    for (size_t q=0; q<6; q++) {
+        qc.add_component(h(q));
+    }
+    qc.add_component(controlled(x(5), 0));
+    qc.add_component(t(4));
+    qc.add_component(controlled(p(1, 0.7), 4));
+    qc.add_component(qft(2, 4));
+    DistributedStateVector distributed(6, 4);
+    distributed.apply_circuit(qc);
+    print_test_result("Distributed state", distributed.to_state_vector().to_matrix()==qc.get_final_state_vector().to_matrix());
+}
+
+void check_sparse_state() {
+    // Two superposed qubits out of twelve keep the state sparse.
+    QuantumCircuit qc(12);
+    qc.add_component(h(3));
+    qc.add_component(controlled(x(10), 3));
+    qc.add_component(h(7));
+    qc.add_component(t(7));
+    qc.add_component(x(0));
+    SparseStateVector sparse=qc.get_final_sparse_state();
+    print_test_result("Sparse state", !sparse.is_dense()&&sparse.get_support_size()==4
+        &&sparse.to_state_vector().to_matrix()==qc.get_final_state_vector().to_matrix());
+}
+
+void check_decision_diagram() {
+    QuantumCircuit qc(3);
+    qc.add_component(h(0));
+    qc.add_component(controlled(x(2), 0));
+    qc.add_component(t(1));
+    qc.add_component(h(1));
+    qc.add_component(toffoli(1, 0, 2));
+    DecisionDiagramState state=qc.get_final_decision_diagram();
+    DecisionDiagramUnitary unitary(qc);
+    Matrix expected=qc.get_matrix();
+    bool matches=state.to_state_vector().to_matrix()==qc.get_final_state_vector().to_matrix()
+        &&unitary.is_equivalent(DecisionDiagramUnitary(qc));
+    for (size_t i=0; i<8; i++) {
+        for (size_t j=0; j<8; j++) {
+            matches=matches&&std::abs(unitary.get_entry(i, j)-expected(i, j))<1e-12;
+        }
+    }
+    print_test_result("Decision diagram", matches);
+}
+
+void check_equivalence_checker() {
+    // A swap is three CNOTs; one extra T gate breaks it.
+    QuantumCircuit swapped(3);
+    swapped.add_component(h(0));
+    swapped.add_component(swap(0, 2));
+    QuantumCircuit cnots(3);
+    cnots.add_component(h(0));
+    cnots.add_component(controlled(x(2), 0));
+    cnots.add_component(controlled(x(0), 2));
+    cnots.add_component(controlled(x(2), 0));
+    QuantumCircuit different=cnots;
+    different.add_component(t(1));
+    print_test_result("Equivalence checker", swapped.get_matrix()==cnots.get_matrix()
+        &&swapped.check_equivalence(cnots).passed()&&!swapped.check_equivalence(different).passed());
+}
+
+QuantumCircuit phase_circuit(double theta_1, double theta_2) {
+    QuantumCircuit qc(2);
+    qc.add_component(h(0));
+    qc.add_component(h(1));
+    qc.add_component(p(0, theta_1));
+    qc.add_component(controlled(p(1, theta_2), 0));
+    qc.add_component(h(0));
+    return qc;
+}
+
+void check_adjoint_gradient() {
+    // Central differences of <H> against the adjoint gradients.
+    Hamiltonian hamiltonian={ { 1.0, "ZI" }, { 0.5, "XY" } };
+    GradientResult result=adjoint_gradient(phase_circuit(0.4, 1.1), hamiltonian);
+    double step=1e-5;
+    double d_theta_1=(expectation_value(phase_circuit(0.4+step, 1.1).get_final_state_vector(), hamiltonian)
+        -expectation_value(phase_circuit(0.4-step, 1.1).get_final_state_vector(), hamiltonian))/(2*step);
+    double d_theta_2=(expectation_value(phase_circuit(0.4, 1.1+step).get_final_state_vector(), hamiltonian)
+        -expectation_value(phase_circuit(0.4, 1.1-step).get_final_state_vector(), hamiltonian))/(2*step);
+    print_test_result("Adjoint gradient", result.gradients.size()==2&&std::abs(result.gradients[0]-d_theta_1)<1e-8
+        &&std::abs(result.gradients[1]-d_theta_2)<1e-8);
+}
+
+void check_phase_oracle_mps() {
+    // Oracle on qubits that are neither adjacent nor in ascending order.
+    QuantumCircuit qc(5);
+    for (size_t q=0; q<5; q++) {
+        qc.add_component(h(q));
+    }
+    qc.add_component(t(1));
+    qc.add_component(controlled(x(3), 2));
+    qc.add_component(phase_oracle({ 4, 0, 2 }, [](size_t input) { return input==1||input==6; }));
+    for (size_t q=0; q<5; q++) {
+        qc.add_component(h(q));
+    }
+    StateVector expected=qc.get_final_state_vector();
+    MatrixProductState mps(5, 32);
+    mps.apply_circuit(qc);
+    bool matches=true;
+    for (size_t i=0; i<expected.get_size(); i++) {
+        std::vector<int> basis_state(5);
+        for (size_t q=0; q<5; q++) {
+            basis_state[q]=(i>>q)&1;
+        }
+        matches=matches&&std::abs(mps.get_amplitude(basis_state)-expected.get_data()[i])<1e-12;
+    }
+    print_test_result("Phase oracle on MPS", matches);
+}
+
+void check_phase_oracle_distributed() {
+    // Gates on qubits 4 and 5 (global for 4 processes) exchange them first,
+    // so the oracle is read through a permuted qubit map.
+    QuantumCircuit qc(6);
+    for (size_t q=0; q<6; q++) {
+        qc.add_component(h(q));
+    }
+    qc.add_component(t(5));
+    qc.add_component(controlled(x(4), 0));
+    qc.add_component(phase_oracle({ 5, 1, 3 }, [](size_t input) { return input==2||input==7; }));
+    for (size_t q=0; q<6; q++) {
+        qc.add_component(h(q));
+    }
+    StateVector expected=qc.get_final_state_vector();
+    DistributedStateVector distributed(6, 4);
+    distributed.apply_circuit(qc);
+    bool matches=true;
+    for (size_t i=0; i<expected.get_size(); i++) {
+        matches=matches&&std::abs(distributed.get_amplitude(i)-expected.get_data()[i])<1e-12;
+    }
+    print_test_result("Phase oracle on distributed state", matches);
+}
+
+void check_marginal_probabilities() {
+    // Summing the full distribution over qubit 1 gives the marginal of
+    // qubits { 2, 0 }, with qubit 2 as bit 0.
+    QuantumCircuit qc(3);
+    qc.add_component(h(0));
+    qc.add_component(t(0));
+    qc.add_component(h(0));
+    qc.add_component(controlled(x(2), 0));
+    qc.add_component(h(1));
+    StateVector state=qc.get_final_state_vector();
+    std::vector<double> marginal=qc.get_marginal_probabilities({ 2, 0 });
+    std::vector<double> expected(4, 0.0);
+    for (size_t i=0; i<8; i++) {
+        expected[((i>>2)&1)|((i&1)<<1)]+=std::norm(state.get_data()[i]);
+    }
+    bool matches=marginal.size()==4;
+    for (size_t j=0; j<4&&matches; j++) {
+        matches=std::abs(marginal[j]-expected[j])<1e-12;
+    }
+    print_test_result("Marginal probabilities", matches);
+}
+
 // Example circuits
 QuantumCircuit full_adder_circuit()
 {